@@ -0,0 +1,176 @@
+#include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+
+#include "allocator.h"
+
+// Size explicit huge pages come in on x86-64 and most ARM64 systems
+#define HUGE_PAGE_SIZE (2u * 1024 * 1024)
+
+static size_t round_up(size_t size, size_t multiple)
+{
+    return (size + multiple - 1) / multiple * multiple;
+}
+
+/* Map 'size' bytes of zeroed memory. With ALLOCATOR_HUGE_PAGES explicit huge
+ * pages are tried first, they need pages reserved by the administrator.
+ * Failing that, Linux is asked to back the memory with transparent huge pages.
+ * Other systems get normal pages.
+ */
+static void* map_memory(size_t* size, unsigned int flags, bool* huge_pages)
+{
+    *huge_pages = false;
+#ifdef MAP_HUGETLB
+    if (flags & ALLOCATOR_HUGE_PAGES) {
+        size_t huge_size = round_up(*size, HUGE_PAGE_SIZE);
+        void* memory = mmap(NULL, huge_size, PROT_READ | PROT_WRITE,
+            MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+        if (memory != MAP_FAILED) {
+            *size = huge_size;
+            *huge_pages = true;
+            return memory;
+        }
+    }
+#endif
+    void* memory = mmap(NULL, *size, PROT_READ | PROT_WRITE,
+        MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (memory == MAP_FAILED) {
+        fprintf(stderr, "allocator: could not map %zu bytes\n", *size);
+        return NULL;
+    }
+#ifdef MADV_HUGEPAGE
+    if (flags & ALLOCATOR_HUGE_PAGES) {
+        *huge_pages = madvise(memory, *size, MADV_HUGEPAGE) == 0;
+    }
+#endif
+    return memory;
+}
+
+bool arena_init(struct arena* a, size_t capacity, unsigned int flags)
+{
+    memset(a, 0, sizeof(*a));
+    a->base = map_memory(&capacity, flags, &a->huge_pages);
+    if (a->base == NULL) {
+        return false;
+    }
+    a->capacity = capacity;
+    return true;
+}
+
+void arena_free(struct arena* a)
+{
+    if (a->base != NULL) {
+        munmap(a->base, a->capacity);
+    }
+    memset(a, 0, sizeof(*a));
+}
+
+void* arena_alloc(struct arena* a, size_t size, size_t alignment)
+{
+    size_t start = round_up(a->used, alignment);
+    if (start + size > a->capacity) {
+        fprintf(stderr, "arena: %zu bytes do not fit, %zu of %zu used\n",
+            size, a->used, a->capacity);
+        return NULL;
+    }
+    a->used = start + size;
+    if (a->used > a->peak) {
+        a->peak = a->used;
+    }
+    return a->base + start;
+}
+
+void* arena_calloc(struct arena* a, size_t count, size_t size)
+{
+    void* memory = arena_alloc(a, count * size, ALLOCATOR_ALIGNMENT);
+    if (memory != NULL) {
+        memset(memory, 0, count * size);
+    }
+    return memory;
+}
+
+void arena_reset(struct arena* a)
+{
+    a->used = 0;
+}
+
+bool frame_arena_init(struct frame_arena* fa, size_t capacity,
+    unsigned int flags)
+{
+    memset(fa, 0, sizeof(*fa));
+    if (!arena_init(&fa->arenas[0], capacity, flags)
+        || !arena_init(&fa->arenas[1], capacity, flags)) {
+        frame_arena_free(fa);
+        return false;
+    }
+    return true;
+}
+
+void frame_arena_free(struct frame_arena* fa)
+{
+    arena_free(&fa->arenas[0]);
+    arena_free(&fa->arenas[1]);
+}
+
+struct arena* frame_arena_begin(struct frame_arena* fa)
+{
+    fa->frame++;
+    struct arena* a = &fa->arenas[fa->frame % 2];
+    arena_reset(a);
+    return a;
+}
+
+struct arena* frame_arena_current(struct frame_arena* fa)
+{
+    return &fa->arenas[fa->frame % 2];
+}
+
+bool object_pool_init(struct object_pool* p, size_t object_size,
+    uint32_t capacity, unsigned int flags)
+{
+    memset(p, 0, sizeof(*p));
+    // Released objects hold the free list link
+    p->object_size = round_up(object_size < sizeof(void*)
+            ? sizeof(void*)
+            : object_size,
+        ALLOCATOR_ALIGNMENT);
+    size_t size = p->object_size * capacity;
+    p->memory = map_memory(&size, flags, &p->huge_pages);
+    if (p->memory == NULL) {
+        return false;
+    }
+    p->mapped_size = size;
+    p->capacity = capacity;
+    return true;
+}
+
+void object_pool_free(struct object_pool* p)
+{
+    if (p->memory != NULL) {
+        munmap(p->memory, p->mapped_size);
+    }
+    memset(p, 0, sizeof(*p));
+}
+
+void* object_pool_alloc(struct object_pool* p)
+{
+    void* object = p->free_list;
+    if (object != NULL) {
+        memcpy(&p->free_list, object, sizeof(void*));
+    } else if (p->untouched < p->capacity) {
+        object = p->memory + (size_t)p->untouched++ * p->object_size;
+    } else {
+        fprintf(stderr, "object_pool: all %u objects are in use\n",
+            p->capacity);
+        return NULL;
+    }
+    p->used++;
+    return object;
+}
+
+void object_pool_release(struct object_pool* p, void* object)
+{
+    memcpy(object, &p->free_list, sizeof(void*));
+    p->free_list = object;
+    p->used--;
+}
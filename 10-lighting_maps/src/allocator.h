@@ -0,0 +1,79 @@
+#ifndef ALLOCATOR_H
+#define ALLOCATOR_H
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// Back the memory with huge pages where the system has them
+#define ALLOCATOR_HUGE_PAGES (1u << 0)
+
+// Alignment of arena_calloc and of pooled objects, enough for any type
+#define ALLOCATOR_ALIGNMENT 16
+
+/* A bump allocator over one block of memory mapped up front. Allocating moves
+ * a pointer, resetting frees everything at once. Nothing is allocated from the
+ * heap after arena_init.
+ */
+struct arena {
+    unsigned char* base;
+    size_t capacity;
+    size_t used;
+    // Most that was ever used, to size the arena
+    size_t peak;
+    // Mapped with MAP_HUGETLB, or advised to use transparent huge pages
+    bool huge_pages;
+};
+
+/* Two arenas used on alternate frames. What a frame allocates stays valid
+ * through the next one, so data one thread builds in a frame can be read by
+ * another while the next frame is being built.
+ */
+struct frame_arena {
+    struct arena arenas[2];
+    uint32_t frame;
+};
+
+/* Fixed size objects out of one block mapped up front, with a free list
+ * threaded through the released ones
+ */
+struct object_pool {
+    unsigned char* memory;
+    // Length of the mapping, rounded up to whole huge pages with MAP_HUGETLB
+    size_t mapped_size;
+    size_t object_size;
+    uint32_t capacity;
+    uint32_t used;
+    // Objects never handed out yet start here
+    uint32_t untouched;
+    void* free_list;
+    bool huge_pages;
+};
+
+bool arena_init(struct arena* a, size_t capacity, unsigned int flags);
+void arena_free(struct arena* a);
+
+// NULL when the arena is full, 'alignment' must be a power of two
+void* arena_alloc(struct arena* a, size_t size, size_t alignment);
+
+// Zeroed memory for 'count' objects of 'size'
+void* arena_calloc(struct arena* a, size_t count, size_t size);
+
+void arena_reset(struct arena* a);
+
+bool frame_arena_init(struct frame_arena* fa, size_t capacity,
+    unsigned int flags);
+void frame_arena_free(struct frame_arena* fa);
+
+// Start a frame, emptying the arena of the frame before last
+struct arena* frame_arena_begin(struct frame_arena* fa);
+
+struct arena* frame_arena_current(struct frame_arena* fa);
+
+bool object_pool_init(struct object_pool* p, size_t object_size,
+    uint32_t capacity, unsigned int flags);
+void object_pool_free(struct object_pool* p);
+
+// NULL when all objects are in use. The memory is not cleared
+void* object_pool_alloc(struct object_pool* p);
+void object_pool_release(struct object_pool* p, void* object);
+#endif
@@ -0,0 +1,1102 @@
+#include <glad/glad.h>
+// Glad needs to be before GLFW
+#include <GLFW/glfw3.h>
+
+#include <cglm/cglm.h>
+#include <math.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "bench.h"
+#include "command_buffer.h"
+#include "cpu_features.h"
+#include "cull.h"
+#include "masked_occlusion.h"
+#include "math_batch.h"
+#include "render_target.h"
+#include "shader.h"
+#include "thread_pool.h"
+
+// Elements per call, small enough that the working set stays in L2
+#define BENCH_COUNT 4096
+// Each case runs for at least this long
+#define BENCH_MIN_SECONDS 0.2
+
+// Keeps the compiler from throwing the benchmarked work away
+static volatile float bench_sink;
+
+// Set when a kernel's results are wrong, bench_run then fails
+static bool bench_failed;
+
+static double now_seconds(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static float random_float(float min, float max)
+{
+    return min + (max - min) * ((float)rand() / (float)RAND_MAX);
+}
+
+static float* random_floats(size_t count, float min, float max)
+{
+    float* values = malloc(count * sizeof(float));
+    for (size_t i = 0; i < count; i++) {
+        values[i] = random_float(min, max);
+    }
+    return values;
+}
+
+/* Call 'fn' until BENCH_MIN_SECONDS have passed and print the time per
+ * element. 'fn' processes 'elements_per_call' elements per call.
+ */
+static void measure(char const* label, void (*fn)(void),
+    size_t elements_per_call)
+{
+    // Warm up caches and let the clock settle
+    fn();
+
+    unsigned long calls = 0;
+    double start = now_seconds();
+    double elapsed;
+    do {
+        for (int i = 0; i < 16; i++) {
+            fn();
+        }
+        calls += 16;
+        elapsed = now_seconds() - start;
+    } while (elapsed < BENCH_MIN_SECONDS);
+
+    double elements = (double)calls * elements_per_call;
+    printf("  %-28s %8.2f ns/elem %10.1f M elem/s\n", label,
+        elapsed * 1e9 / elements, elements / elapsed * 1e-6);
+}
+
+/* Math batch benchmark. The cglm cases call cglm once per element on AoS
+ * data, the batch cases run the SoA kernels at every level the CPU has.
+ */
+static struct {
+    mat4* a;
+    mat4* b;
+    mat4* dest;
+    vec3* points;
+    vec3* points_out;
+    vec3 (*boxes)[2];
+    vec3 (*boxes_out)[2];
+    versor* quats;
+    mat4 transform;
+
+    struct mat4_soa a_soa;
+    struct mat4_soa b_soa;
+    struct mat4_soa dest_soa;
+    struct vec3_soa points_soa;
+    struct vec3_soa points_out_soa;
+    struct aabb_soa boxes_soa;
+    struct aabb_soa boxes_out_soa;
+    struct quat_soa quats_soa;
+} math_data;
+
+static void cglm_mat4_mul(void)
+{
+    for (size_t i = 0; i < BENCH_COUNT; i++) {
+        glm_mat4_mul(math_data.a[i], math_data.b[i], math_data.dest[i]);
+    }
+    bench_sink = math_data.dest[BENCH_COUNT - 1][3][3];
+}
+
+static void cglm_transform_points(void)
+{
+    for (size_t i = 0; i < BENCH_COUNT; i++) {
+        glm_mat4_mulv3(math_data.transform, math_data.points[i], 1.0f,
+            math_data.points_out[i]);
+    }
+    bench_sink = math_data.points_out[BENCH_COUNT - 1][0];
+}
+
+static void cglm_transform_aabbs(void)
+{
+    for (size_t i = 0; i < BENCH_COUNT; i++) {
+        glm_aabb_transform(math_data.boxes[i], math_data.transform,
+            math_data.boxes_out[i]);
+    }
+    bench_sink = math_data.boxes_out[BENCH_COUNT - 1][0][0];
+}
+
+static void cglm_normalize(void)
+{
+    for (size_t i = 0; i < BENCH_COUNT; i++) {
+        glm_vec3_normalize_to(math_data.points[i], math_data.points_out[i]);
+    }
+    bench_sink = math_data.points_out[BENCH_COUNT - 1][0];
+}
+
+static void cglm_quat_mat4(void)
+{
+    for (size_t i = 0; i < BENCH_COUNT; i++) {
+        glm_quat_mat4(math_data.quats[i], math_data.dest[i]);
+    }
+    bench_sink = math_data.dest[BENCH_COUNT - 1][0][0];
+}
+
+static void batch_mat4_mul_case(void)
+{
+    batch_mat4_mul(math_data.a_soa, math_data.b_soa, math_data.dest_soa,
+        BENCH_COUNT);
+    bench_sink = math_data.dest_soa.m[15][BENCH_COUNT - 1];
+}
+
+static void batch_transform_points_case(void)
+{
+    batch_transform_points(math_data.transform, math_data.points_soa,
+        math_data.points_out_soa, BENCH_COUNT);
+    bench_sink = math_data.points_out_soa.x[BENCH_COUNT - 1];
+}
+
+static void batch_transform_aabbs_case(void)
+{
+    batch_transform_aabbs(math_data.transform, math_data.boxes_soa,
+        math_data.boxes_out_soa, BENCH_COUNT);
+    bench_sink = math_data.boxes_out_soa.center_x[BENCH_COUNT - 1];
+}
+
+static void batch_normalize_case(void)
+{
+    batch_normalize(math_data.points_soa, math_data.points_out_soa,
+        BENCH_COUNT);
+    bench_sink = math_data.points_out_soa.x[BENCH_COUNT - 1];
+}
+
+static void batch_quat_mat4_case(void)
+{
+    batch_quat_mat4(math_data.quats_soa, math_data.dest_soa, BENCH_COUNT);
+    bench_sink = math_data.dest_soa.m[0][BENCH_COUNT - 1];
+}
+
+/* Batch results may differ from cglm's by rounding, FMA contraction and the
+ * order of the sums, relative to the value for large ones
+ */
+#define MATH_TOLERANCE 1e-4f
+
+static bool nearly_equal(float value, float expected)
+{
+    return fabsf(value - expected)
+        <= MATH_TOLERANCE * fmaxf(1.0f, fabsf(expected));
+}
+
+// Batch matrices against the ones cglm computed, for mat4_mul and quat_mat4
+static bool mat4_matches(void)
+{
+    for (size_t i = 0; i < BENCH_COUNT; i++) {
+        for (int k = 0; k < 16; k++) {
+            if (!nearly_equal(math_data.dest_soa.m[k][i],
+                    math_data.dest[i][k / 4][k % 4])) {
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+// For transform_points and normalize
+static bool points_match(void)
+{
+    struct vec3_soa const* out = &math_data.points_out_soa;
+    for (size_t i = 0; i < BENCH_COUNT; i++) {
+        float const* expected = math_data.points_out[i];
+        if (!nearly_equal(out->x[i], expected[0])
+            || !nearly_equal(out->y[i], expected[1])
+            || !nearly_equal(out->z[i], expected[2])) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// cglm gives corners, the batch kernel center and half size
+static bool aabbs_match(void)
+{
+    struct aabb_soa const* out = &math_data.boxes_out_soa;
+    for (size_t i = 0; i < BENCH_COUNT; i++) {
+        float const* center[3] = { out->center_x, out->center_y,
+            out->center_z };
+        float const* extent[3] = { out->extent_x, out->extent_y,
+            out->extent_z };
+        for (int k = 0; k < 3; k++) {
+            float min = math_data.boxes_out[i][0][k];
+            float max = math_data.boxes_out[i][1][k];
+            if (!nearly_equal(center[k][i], (min + max) * 0.5f)
+                || !nearly_equal(extent[k][i], (max - min) * 0.5f)) {
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+static void math_setup(void)
+{
+    size_t n = BENCH_COUNT;
+    math_data.a = malloc(n * sizeof(mat4));
+    math_data.b = malloc(n * sizeof(mat4));
+    math_data.dest = malloc(n * sizeof(mat4));
+    math_data.points = malloc(n * sizeof(vec3));
+    math_data.points_out = malloc(n * sizeof(vec3));
+    math_data.boxes = malloc(n * sizeof(*math_data.boxes));
+    math_data.boxes_out = malloc(n * sizeof(*math_data.boxes_out));
+    math_data.quats = malloc(n * sizeof(versor));
+
+    for (int k = 0; k < 16; k++) {
+        math_data.a_soa.m[k] = random_floats(n, -1.0f, 1.0f);
+        math_data.b_soa.m[k] = random_floats(n, -1.0f, 1.0f);
+        math_data.dest_soa.m[k] = malloc(n * sizeof(float));
+    }
+    batch_mat4_from_soa(math_data.a_soa, math_data.a, n);
+    batch_mat4_from_soa(math_data.b_soa, math_data.b, n);
+
+    math_data.points_soa = (struct vec3_soa) {
+        random_floats(n, -10.0f, 10.0f),
+        random_floats(n, -10.0f, 10.0f),
+        random_floats(n, -10.0f, 10.0f)
+    };
+    math_data.points_out_soa = (struct vec3_soa) {
+        malloc(n * sizeof(float)),
+        malloc(n * sizeof(float)),
+        malloc(n * sizeof(float))
+    };
+    math_data.boxes_soa = (struct aabb_soa) {
+        random_floats(n, -10.0f, 10.0f),
+        random_floats(n, -10.0f, 10.0f),
+        random_floats(n, -10.0f, 10.0f),
+        random_floats(n, 0.1f, 2.0f),
+        random_floats(n, 0.1f, 2.0f),
+        random_floats(n, 0.1f, 2.0f)
+    };
+    math_data.boxes_out_soa = (struct aabb_soa) {
+        malloc(n * sizeof(float)),
+        malloc(n * sizeof(float)),
+        malloc(n * sizeof(float)),
+        malloc(n * sizeof(float)),
+        malloc(n * sizeof(float)),
+        malloc(n * sizeof(float))
+    };
+    math_data.quats_soa = (struct quat_soa) {
+        random_floats(n, -1.0f, 1.0f),
+        random_floats(n, -1.0f, 1.0f),
+        random_floats(n, -1.0f, 1.0f),
+        random_floats(n, -1.0f, 1.0f)
+    };
+
+    for (size_t i = 0; i < n; i++) {
+        math_data.points[i][0] = math_data.points_soa.x[i];
+        math_data.points[i][1] = math_data.points_soa.y[i];
+        math_data.points[i][2] = math_data.points_soa.z[i];
+
+        struct aabb_soa const* box = &math_data.boxes_soa;
+        vec3 center = { box->center_x[i], box->center_y[i], box->center_z[i] };
+        vec3 extent = { box->extent_x[i], box->extent_y[i], box->extent_z[i] };
+        glm_vec3_sub(center, extent, math_data.boxes[i][0]);
+        glm_vec3_add(center, extent, math_data.boxes[i][1]);
+
+        // glm_quat_mat4 only gives a rotation for unit quaternions, the
+        // batch kernel for any, so they are normalized to compare the two
+        struct quat_soa const* q = &math_data.quats_soa;
+        glm_quat_init(math_data.quats[i], q->x[i], q->y[i], q->z[i], q->w[i]);
+        glm_quat_normalize(math_data.quats[i]);
+        q->x[i] = math_data.quats[i][0];
+        q->y[i] = math_data.quats[i][1];
+        q->z[i] = math_data.quats[i][2];
+        q->w[i] = math_data.quats[i][3];
+    }
+
+    glm_mat4_identity(math_data.transform);
+    vec3 axis = { 0.3f, 1.0f, 0.2f };
+    glm_rotate(math_data.transform, 0.7f, axis);
+    vec3 offset = { 1.0f, -2.0f, 3.0f };
+    glm_translate(math_data.transform, offset);
+}
+
+static void math_teardown(void)
+{
+    free(math_data.a);
+    free(math_data.b);
+    free(math_data.dest);
+    free(math_data.points);
+    free(math_data.points_out);
+    free(math_data.boxes);
+    free(math_data.boxes_out);
+    free(math_data.quats);
+    for (int k = 0; k < 16; k++) {
+        free(math_data.a_soa.m[k]);
+        free(math_data.b_soa.m[k]);
+        free(math_data.dest_soa.m[k]);
+    }
+    free(math_data.points_soa.x);
+    free(math_data.points_soa.y);
+    free(math_data.points_soa.z);
+    free(math_data.points_out_soa.x);
+    free(math_data.points_out_soa.y);
+    free(math_data.points_out_soa.z);
+    free(math_data.boxes_soa.center_x);
+    free(math_data.boxes_soa.center_y);
+    free(math_data.boxes_soa.center_z);
+    free(math_data.boxes_soa.extent_x);
+    free(math_data.boxes_soa.extent_y);
+    free(math_data.boxes_soa.extent_z);
+    free(math_data.boxes_out_soa.center_x);
+    free(math_data.boxes_out_soa.center_y);
+    free(math_data.boxes_out_soa.center_z);
+    free(math_data.boxes_out_soa.extent_x);
+    free(math_data.boxes_out_soa.extent_y);
+    free(math_data.boxes_out_soa.extent_z);
+    free(math_data.quats_soa.x);
+    free(math_data.quats_soa.y);
+    free(math_data.quats_soa.z);
+    free(math_data.quats_soa.w);
+}
+
+static void bench_math(void)
+{
+    static struct {
+        char const* name;
+        void (*cglm)(void);
+        void (*batch)(void);
+        // Compares the batch output with what 'cglm' left behind
+        bool (*matches)(void);
+    } const cases[] = {
+        { "mat4 * mat4", cglm_mat4_mul, batch_mat4_mul_case, mat4_matches },
+        { "transform points", cglm_transform_points,
+            batch_transform_points_case, points_match },
+        { "transform aabbs", cglm_transform_aabbs, batch_transform_aabbs_case,
+            aabbs_match },
+        { "normalize", cglm_normalize, batch_normalize_case, points_match },
+        { "quat to mat4", cglm_quat_mat4, batch_quat_mat4_case,
+            mat4_matches },
+    };
+    static enum simd_level const levels[] = {
+        SIMD_SCALAR, SIMD_SSE2, SIMD_AVX2, SIMD_AVX512
+    };
+
+    math_setup();
+    printf("math batch, %d elements per call, cpu level %s\n", BENCH_COUNT,
+        simd_level_name(cpu_simd_level()));
+
+    for (size_t c = 0; c < sizeof(cases) / sizeof(cases[0]); c++) {
+        printf("%s\n", cases[c].name);
+        measure("cglm per element", cases[c].cglm, BENCH_COUNT);
+        for (size_t l = 0; l < sizeof(levels) / sizeof(levels[0]); l++) {
+            if (levels[l] > cpu_simd_level()) {
+                break;
+            }
+            char label[64];
+            snprintf(label, sizeof(label), "batch %s",
+                simd_level_name(levels[l]));
+            math_batch_use_level(levels[l]);
+            // A fast kernel is only worth timing when it is right
+            cases[c].batch();
+            if (!cases[c].matches()) {
+                fprintf(stderr, "  %s does not match cglm\n", label);
+                bench_failed = true;
+                continue;
+            }
+            measure(label, cases[c].batch, BENCH_COUNT);
+        }
+    }
+    math_batch_init();
+    math_teardown();
+}
+
+/* Culling benchmark. Boxes are scattered around a camera looking down -z so
+ * roughly a quarter of them end up visible, which keeps the compaction busy.
+ */
+#define CULL_BOX_COUNT (64 * 1024)
+
+static struct {
+    struct aabb_soa boxes;
+    vec3 (*boxes_aos)[2];
+    vec4 planes[6];
+    uint32_t* visible;
+    uint8_t* straddle_masks;
+    size_t visible_count;
+} cull_data;
+
+static void cglm_cull(void)
+{
+    size_t n = 0;
+    for (size_t i = 0; i < CULL_BOX_COUNT; i++) {
+        if (glm_aabb_frustum(cull_data.boxes_aos[i], cull_data.planes)) {
+            cull_data.visible[n++] = (uint32_t)i;
+        }
+    }
+    cull_data.visible_count = n;
+}
+
+static void kernel_cull(void)
+{
+    cull_data.visible_count = cull_aabbs(cull_data.boxes, CULL_BOX_COUNT,
+        cull_data.planes, CULL_ALL_PLANES, cull_data.visible, NULL);
+}
+
+static void kernel_cull_masks(void)
+{
+    cull_data.visible_count = cull_aabbs(cull_data.boxes, CULL_BOX_COUNT,
+        cull_data.planes, CULL_ALL_PLANES, cull_data.visible,
+        cull_data.straddle_masks);
+}
+
+static void bench_cull(void)
+{
+    size_t n = CULL_BOX_COUNT;
+    cull_data.boxes = (struct aabb_soa) {
+        random_floats(n, -50.0f, 50.0f),
+        random_floats(n, -50.0f, 50.0f),
+        random_floats(n, -50.0f, 50.0f),
+        random_floats(n, 0.1f, 1.0f),
+        random_floats(n, 0.1f, 1.0f),
+        random_floats(n, 0.1f, 1.0f)
+    };
+    cull_data.boxes_aos = malloc(n * sizeof(*cull_data.boxes_aos));
+    for (size_t i = 0; i < n; i++) {
+        struct aabb_soa const* box = &cull_data.boxes;
+        vec3 center = { box->center_x[i], box->center_y[i], box->center_z[i] };
+        vec3 extent = { box->extent_x[i], box->extent_y[i], box->extent_z[i] };
+        glm_vec3_sub(center, extent, cull_data.boxes_aos[i][0]);
+        glm_vec3_add(center, extent, cull_data.boxes_aos[i][1]);
+    }
+    cull_data.visible = malloc((n + CULL_OUTPUT_PADDING) * sizeof(uint32_t));
+    cull_data.straddle_masks = malloc(n + CULL_OUTPUT_PADDING);
+
+    mat4 projection;
+    mat4 view;
+    mat4 view_projection;
+    glm_perspective(glm_rad(60.0f), 16.0f / 9.0f, 0.1f, 100.0f, projection);
+    vec3 eye = { 0.0f, 0.0f, 10.0f };
+    vec3 center = { 0.0f, 0.0f, 0.0f };
+    vec3 up = { 0.0f, 1.0f, 0.0f };
+    glm_lookat(eye, center, up, view);
+    glm_mat4_mul(projection, view, view_projection);
+    glm_frustum_planes(view_projection, cull_data.planes);
+
+    static enum simd_level const levels[] = {
+        SIMD_SCALAR, SIMD_AVX2, SIMD_AVX512
+    };
+
+    printf("frustum cull, %d boxes per call, cpu level %s\n", CULL_BOX_COUNT,
+        simd_level_name(cpu_simd_level()));
+    measure("cglm glm_aabb_frustum", cglm_cull, n);
+    printf("  %zu visible\n", cull_data.visible_count);
+    for (size_t l = 0; l < sizeof(levels) / sizeof(levels[0]); l++) {
+        if (levels[l] > cpu_simd_level()) {
+            break;
+        }
+        cull_use_level(levels[l]);
+
+        char label[64];
+        snprintf(label, sizeof(label), "cull %s", simd_level_name(levels[l]));
+        measure(label, kernel_cull, n);
+        snprintf(label, sizeof(label), "cull %s + plane masks",
+            simd_level_name(levels[l]));
+        measure(label, kernel_cull_masks, n);
+        printf("  %zu visible\n", cull_data.visible_count);
+    }
+    cull_init();
+
+    free(cull_data.boxes.center_x);
+    free(cull_data.boxes.center_y);
+    free(cull_data.boxes.center_z);
+    free(cull_data.boxes.extent_x);
+    free(cull_data.boxes.extent_y);
+    free(cull_data.boxes.extent_z);
+    free(cull_data.boxes_aos);
+    free(cull_data.visible);
+    free(cull_data.straddle_masks);
+}
+
+/* Software occlusion benchmark. A camera looks down a field of cubes with
+ * walls standing in it. The walls and the cubes nearest to the camera are
+ * the occluders, every cube in the view is tested against them.
+ */
+#define OCCLUSION_FIELD_SIZE 96
+#define OCCLUSION_CUBE_COUNT (OCCLUSION_FIELD_SIZE * OCCLUSION_FIELD_SIZE)
+#define OCCLUSION_WALL_COUNT 6
+// Cubes this close to the camera are occluders as well
+#define OCCLUSION_OCCLUDER_CUBES 256
+
+static struct {
+    struct masked_occlusion mo;
+    struct thread_pool* pool;
+    mat4 view_projection;
+    struct aabb_soa boxes;
+    uint32_t* in_view;
+    size_t in_view_count;
+    uint32_t* visible;
+    size_t visible_count;
+    // Corners of every wall and occluder cube, 8 vertices per box
+    vec3* occluder_vertices;
+    uint32_t occluder_count;
+    size_t occluder_triangles;
+} occlusion_data;
+
+static void occlusion_raster(void)
+{
+    static uint32_t const box_indices[] = {
+        0, 2, 1, 1, 2, 3, 4, 5, 6, 5, 7, 6,
+        0, 1, 4, 1, 5, 4, 2, 6, 3, 3, 6, 7,
+        0, 4, 2, 2, 4, 6, 1, 3, 5, 3, 7, 5
+    };
+    mat4 identity = GLM_MAT4_IDENTITY_INIT;
+    masked_occlusion_clear(&occlusion_data.mo, occlusion_data.view_projection);
+    for (uint32_t i = 0; i < occlusion_data.occluder_count; i++) {
+        masked_occlusion_add(&occlusion_data.mo,
+            occlusion_data.occluder_vertices[i * 8], sizeof(vec3), box_indices,
+            36, identity);
+    }
+    masked_occlusion_flush(&occlusion_data.mo, occlusion_data.pool);
+}
+
+static void occlusion_test(void)
+{
+    occlusion_data.visible_count = masked_occlusion_cull(&occlusion_data.mo,
+        occlusion_data.boxes, occlusion_data.in_view,
+        occlusion_data.in_view_count, occlusion_data.visible);
+}
+
+static void occlusion_frame(void)
+{
+    occlusion_raster();
+    occlusion_test();
+}
+
+static void box_corners(vec3 center, vec3 extent, vec3 corners[8])
+{
+    for (int k = 0; k < 8; k++) {
+        for (int a = 0; a < 3; a++) {
+            corners[k][a] = center[a]
+                + (k & (1 << a) ? extent[a] : -extent[a]);
+        }
+    }
+}
+
+static void bench_occlusion(void)
+{
+    size_t n = OCCLUSION_CUBE_COUNT;
+    occlusion_data.boxes = (struct aabb_soa) {
+        malloc(n * sizeof(float)), malloc(n * sizeof(float)),
+        malloc(n * sizeof(float)), malloc(n * sizeof(float)),
+        malloc(n * sizeof(float)), malloc(n * sizeof(float))
+    };
+    struct aabb_soa* b = &occlusion_data.boxes;
+    for (size_t i = 0; i < n; i++) {
+        b->center_x[i] = ((float)(i % OCCLUSION_FIELD_SIZE)
+                             - OCCLUSION_FIELD_SIZE / 2)
+                * 2.0f
+            + random_float(-0.4f, 0.4f);
+        b->center_z[i] = -2.0f - (float)(i / OCCLUSION_FIELD_SIZE) * 2.0f
+            + random_float(-0.4f, 0.4f);
+        b->extent_x[i] = b->extent_z[i] = random_float(0.3f, 0.5f);
+        b->extent_y[i] = random_float(0.3f, 1.5f);
+        b->center_y[i] = b->extent_y[i];
+    }
+    occlusion_data.in_view = malloc((n + CULL_OUTPUT_PADDING)
+        * sizeof(uint32_t));
+    occlusion_data.visible = malloc(n * sizeof(uint32_t));
+
+    // Walls in front, then the cubes closest to the camera, which come first
+    occlusion_data.occluder_count = OCCLUSION_WALL_COUNT
+        + OCCLUSION_OCCLUDER_CUBES;
+    occlusion_data.occluder_vertices = malloc(
+        occlusion_data.occluder_count * 8 * sizeof(vec3));
+    for (int w = 0; w < OCCLUSION_WALL_COUNT; w++) {
+        vec3 center = { (w - OCCLUSION_WALL_COUNT / 2 + 0.5f) * 14.0f, 3.0f,
+            -12.0f - (w % 3) * 10.0f };
+        vec3 extent = { 6.0f, 3.0f, 0.25f };
+        box_corners(center, extent, occlusion_data.occluder_vertices + w * 8);
+    }
+    for (int i = 0; i < OCCLUSION_OCCLUDER_CUBES; i++) {
+        // The middle 16 columns of the rows nearest to the camera
+        size_t c = (size_t)(i / 16) * OCCLUSION_FIELD_SIZE
+            + OCCLUSION_FIELD_SIZE / 2 - 8 + i % 16;
+        vec3 center = { b->center_x[c], b->center_y[c], b->center_z[c] };
+        vec3 extent = { b->extent_x[c], b->extent_y[c], b->extent_z[c] };
+        box_corners(center, extent,
+            occlusion_data.occluder_vertices + (OCCLUSION_WALL_COUNT + i) * 8);
+    }
+    occlusion_data.occluder_triangles = occlusion_data.occluder_count * 12;
+
+    mat4 projection;
+    mat4 view;
+    glm_perspective(glm_rad(60.0f), 16.0f / 9.0f, 0.1f, 500.0f, projection);
+    vec3 eye = { 0.0f, 1.7f, 0.0f };
+    vec3 center = { 0.0f, 1.0f, -20.0f };
+    vec3 up = { 0.0f, 1.0f, 0.0f };
+    glm_lookat(eye, center, up, view);
+    glm_mat4_mul(projection, view, occlusion_data.view_projection);
+    vec4 planes[6];
+    glm_frustum_planes(occlusion_data.view_projection, planes);
+    occlusion_data.in_view_count = cull_aabbs(occlusion_data.boxes, n, planes,
+        CULL_ALL_PLANES, occlusion_data.in_view, NULL);
+
+    masked_occlusion_init(&occlusion_data.mo, 512, 288);
+    struct thread_pool pool;
+    thread_pool_init(&pool, 0);
+
+    static enum simd_level const levels[] = { SIMD_SCALAR, SIMD_AVX2 };
+
+    printf("masked occlusion, %ux%u buffer, %zu occluder triangles, %zu "
+           "cubes, cpu level %s\n",
+        occlusion_data.mo.width, occlusion_data.mo.height,
+        occlusion_data.occluder_triangles, n,
+        simd_level_name(cpu_simd_level()));
+    for (size_t l = 0; l < sizeof(levels) / sizeof(levels[0]); l++) {
+        if (levels[l] > cpu_simd_level()) {
+            break;
+        }
+        masked_occlusion_use_level(&occlusion_data.mo, levels[l]);
+        // On one thread, then on every core if there is more than one
+        unsigned int threads = thread_pool_concurrency(&pool);
+        for (int threaded = 0; threaded < 1 + (threads > 1); threaded++) {
+            occlusion_data.pool = threaded ? &pool : NULL;
+            char label[64];
+            snprintf(label, sizeof(label), "raster %s, %u thread%s",
+                simd_level_name(levels[l]), threaded ? threads : 1,
+                threaded ? "s" : "");
+            measure(label, occlusion_raster, occlusion_data.occluder_triangles);
+        }
+        occlusion_data.pool = &pool;
+        char label[64];
+        snprintf(label, sizeof(label), "test %s",
+            simd_level_name(levels[l]));
+        measure(label, occlusion_test, occlusion_data.in_view_count);
+        snprintf(label, sizeof(label), "frame %s", simd_level_name(levels[l]));
+        measure(label, occlusion_frame, 1);
+    }
+    size_t hidden = occlusion_data.in_view_count - occlusion_data.visible_count;
+    printf("  %zu in view, %zu hidden (%.1f%%), %zu drawn\n",
+        occlusion_data.in_view_count, hidden,
+        100.0 * hidden / (occlusion_data.in_view_count
+                             ? occlusion_data.in_view_count
+                             : 1),
+        occlusion_data.visible_count);
+
+    thread_pool_destroy(&pool);
+    masked_occlusion_free(&occlusion_data.mo);
+    free(b->center_x);
+    free(b->center_y);
+    free(b->center_z);
+    free(b->extent_x);
+    free(b->extent_y);
+    free(b->extent_z);
+    free(occlusion_data.in_view);
+    free(occlusion_data.visible);
+    free(occlusion_data.occluder_vertices);
+}
+
+/* Command recording benchmark. 100k boxes are frustum culled and the ones in
+ * view recorded as a matrix, a texture and a draw each, in ranges that run
+ * on one thread and then on every core. Replaying needs a GL context, the
+ * demo does that with --mesh-grid.
+ */
+#define COMMAND_OBJECTS 100000
+
+static struct {
+    struct aabb_soa boxes;
+    vec4 planes[6];
+    uint32_t* visible;
+    struct command_buffer* buffers;
+    unsigned int task_count;
+    struct thread_pool* pool;
+} command_data;
+
+static void command_record_task(void* data, unsigned int task)
+{
+    (void)data;
+    size_t begin = (size_t)COMMAND_OBJECTS * task / command_data.task_count;
+    size_t end = (size_t)COMMAND_OBJECTS * (task + 1)
+        / command_data.task_count;
+    struct aabb_soa const* b = &command_data.boxes;
+    struct aabb_soa range = {
+        b->center_x + begin, b->center_y + begin, b->center_z + begin,
+        b->extent_x + begin, b->extent_y + begin, b->extent_z + begin
+    };
+    // Each range has its own part of the list, padding included
+    uint32_t* visible = command_data.visible + begin
+        + task * CULL_OUTPUT_PADDING;
+    size_t count = cull_aabbs(range, end - begin, command_data.planes,
+        CULL_ALL_PLANES, visible, NULL);
+
+    struct command_buffer* cb = &command_data.buffers[task];
+    command_buffer_reset(cb);
+    for (size_t v = 0; v < count; v++) {
+        size_t i = begin + visible[v];
+        vec3 center = { b->center_x[i], b->center_y[i], b->center_z[i] };
+        vec3 size = { b->extent_x[i] * 2.0f, b->extent_y[i] * 2.0f,
+            b->extent_z[i] * 2.0f };
+        mat4 model;
+        glm_translate_make(model, center);
+        glm_scale(model, size);
+        command_uniform_mat4(cb, 0, model);
+        command_bind_texture(cb, 0, 1 + i % 4);
+        command_draw_elements(cb, GL_TRIANGLES, 36, 0);
+    }
+}
+
+static void command_record(void)
+{
+    if (command_data.pool != NULL) {
+        thread_pool_for(command_data.pool, command_data.task_count,
+            command_record_task, NULL);
+        return;
+    }
+    for (unsigned int t = 0; t < command_data.task_count; t++) {
+        command_record_task(NULL, t);
+    }
+}
+
+static void bench_commands(void)
+{
+    size_t n = COMMAND_OBJECTS;
+    struct aabb_soa* b = &command_data.boxes;
+    *b = (struct aabb_soa) {
+        random_floats(n, -200.0f, 200.0f), random_floats(n, -5.0f, 5.0f),
+        random_floats(n, -400.0f, 0.0f), random_floats(n, 0.2f, 1.0f),
+        random_floats(n, 0.2f, 1.0f), random_floats(n, 0.2f, 1.0f)
+    };
+    mat4 projection;
+    mat4 view;
+    mat4 view_projection;
+    glm_perspective(glm_rad(60.0f), 16.0f / 9.0f, 0.1f, 500.0f, projection);
+    vec3 eye = { 0.0f, 2.0f, 10.0f };
+    vec3 center = { 0.0f, 0.0f, -100.0f };
+    vec3 up = { 0.0f, 1.0f, 0.0f };
+    glm_lookat(eye, center, up, view);
+    glm_mat4_mul(projection, view, view_projection);
+    glm_frustum_planes(view_projection, command_data.planes);
+
+    struct thread_pool pool;
+    thread_pool_init(&pool, 0);
+    unsigned int threads = thread_pool_concurrency(&pool);
+    command_data.task_count = threads * 4;
+    command_data.visible = malloc((n + command_data.task_count
+                                      * CULL_OUTPUT_PADDING)
+        * sizeof(uint32_t));
+    command_data.buffers = calloc(command_data.task_count,
+        sizeof(struct command_buffer));
+
+    printf("command recording, %zu objects in %u ranges\n", n,
+        command_data.task_count);
+    command_data.pool = NULL;
+    measure("cull and record, 1 thread", command_record, n);
+    if (threads > 1) {
+        command_data.pool = &pool;
+        char label[64];
+        snprintf(label, sizeof(label), "cull and record, %u threads",
+            threads);
+        measure(label, command_record, n);
+    }
+    uint32_t commands = 0;
+    size_t words = 0;
+    for (unsigned int t = 0; t < command_data.task_count; t++) {
+        commands += command_data.buffers[t].commands;
+        words += command_data.buffers[t].count;
+    }
+    printf("  %u draws in view, %u commands, %.1f KB\n", commands / 3,
+        commands, words * sizeof(uint32_t) / 1024.0);
+
+    for (unsigned int t = 0; t < command_data.task_count; t++) {
+        command_buffer_free(&command_data.buffers[t]);
+    }
+    free(command_data.buffers);
+    free(command_data.visible);
+    thread_pool_destroy(&pool);
+    free(b->center_x);
+    free(b->center_y);
+    free(b->center_z);
+    free(b->extent_x);
+    free(b->extent_y);
+    free(b->extent_z);
+}
+
+/* Anti-aliasing benchmark. Draws a field of boxes, every triangle its own
+ * color, into offscreen targets at 1080p and 4K: without anti-aliasing, with
+ * the FXAA pass of post.h and with 2x, 4x and 8x MSAA resolved by a blit. GPU
+ * times come from timer queries. It runs on whatever GL the window system
+ * gives, LIBGL_ALWAYS_SOFTWARE=1 makes Mesa use its software renderer.
+ */
+#define AA_FRAMES 20
+#define AA_GRID 24
+
+static struct {
+    struct shader boxes;
+    struct shader fxaa;
+    unsigned int box_VAO;
+    unsigned int empty_VAO;
+    mat4 view_projection;
+} aa;
+
+static void aa_draw_boxes(void)
+{
+    glEnable(GL_DEPTH_TEST);
+    glClearColor(0.1f, 0.1f, 0.1f, 1.0f);
+    glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+    glUseProgram(aa.boxes.ID);
+    shader_set_mat4(&aa.boxes, "view_projection", aa.view_projection);
+    glBindVertexArray(aa.box_VAO);
+    for (int z = 0; z < AA_GRID; z++) {
+        for (int x = 0; x < AA_GRID; x++) {
+            vec3 center = { (x - AA_GRID / 2) * 1.5f,
+                0.6f * sinf(x * 0.7f + z * 1.3f), -z * 1.5f };
+            vec3 size = { 1.0f, 0.4f + 0.3f * ((x * 7 + z * 3) % 5), 1.0f };
+            shader_set_vec3(&aa.boxes, "box_center", center);
+            shader_set_vec3(&aa.boxes, "box_size", size);
+            glDrawElements(GL_TRIANGLES, 36, GL_UNSIGNED_INT, 0);
+        }
+    }
+}
+
+static void aa_fxaa(unsigned int source, struct render_target const* target)
+{
+    glDisable(GL_DEPTH_TEST);
+    glBindFramebuffer(GL_FRAMEBUFFER, target->framebuffer);
+    glUseProgram(aa.fxaa.ID);
+    glActiveTexture(GL_TEXTURE0);
+    glBindTexture(GL_TEXTURE_2D, source);
+    glBindVertexArray(aa.empty_VAO);
+    glDrawArrays(GL_TRIANGLES, 0, 3);
+}
+
+// Framebuffer with 'samples' per pixel, 0 when the GL can not make one
+static unsigned int aa_multisampled(int width, int height, int samples,
+    unsigned int renderbuffers[2])
+{
+    unsigned int framebuffer;
+    glGenFramebuffers(1, &framebuffer);
+    glGenRenderbuffers(2, renderbuffers);
+    glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+    glBindRenderbuffer(GL_RENDERBUFFER, renderbuffers[0]);
+    glRenderbufferStorageMultisample(GL_RENDERBUFFER, samples, GL_RGBA8,
+        width, height);
+    glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0,
+        GL_RENDERBUFFER, renderbuffers[0]);
+    glBindRenderbuffer(GL_RENDERBUFFER, renderbuffers[1]);
+    glRenderbufferStorageMultisample(GL_RENDERBUFFER, samples,
+        GL_DEPTH24_STENCIL8, width, height);
+    glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_STENCIL_ATTACHMENT,
+        GL_RENDERBUFFER, renderbuffers[1]);
+    if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE
+        || glGetError() != GL_NO_ERROR) {
+        glDeleteFramebuffers(1, &framebuffer);
+        glDeleteRenderbuffers(2, renderbuffers);
+        return 0;
+    }
+    return framebuffer;
+}
+
+// GPU time of 'frame' in milliseconds, after a few frames of warm up
+static double aa_time(void (*frame)(void* data), void* data)
+{
+    unsigned int queries[AA_FRAMES];
+    glGenQueries(AA_FRAMES, queries);
+    for (int i = 0; i < 3; i++) {
+        frame(data);
+    }
+    for (int i = 0; i < AA_FRAMES; i++) {
+        glBeginQuery(GL_TIME_ELAPSED, queries[i]);
+        frame(data);
+        glEndQuery(GL_TIME_ELAPSED);
+    }
+    GLuint64 total = 0;
+    for (int i = 0; i < AA_FRAMES; i++) {
+        GLuint64 ns;
+        glGetQueryObjectui64v(queries[i], GL_QUERY_RESULT, &ns);
+        total += ns;
+    }
+    glDeleteQueries(AA_FRAMES, queries);
+    return total * 1e-6 / AA_FRAMES;
+}
+
+struct aa_frame {
+    struct render_target* scene;
+    struct render_target* resolved;
+    unsigned int multisampled;
+    int width;
+    int height;
+};
+
+static void aa_frame_plain(void* data)
+{
+    struct aa_frame const* f = data;
+    glBindFramebuffer(GL_FRAMEBUFFER, f->scene->framebuffer);
+    aa_draw_boxes();
+}
+
+static void aa_frame_fxaa(void* data)
+{
+    struct aa_frame const* f = data;
+    aa_frame_plain(data);
+    aa_fxaa(f->scene->color, f->resolved);
+}
+
+// FXAA again over the scene the last frame left
+static void aa_frame_fxaa_only(void* data)
+{
+    struct aa_frame const* f = data;
+    aa_fxaa(f->scene->color, f->resolved);
+}
+
+static void aa_frame_msaa(void* data)
+{
+    struct aa_frame const* f = data;
+    glBindFramebuffer(GL_FRAMEBUFFER, f->multisampled);
+    aa_draw_boxes();
+    glBindFramebuffer(GL_READ_FRAMEBUFFER, f->multisampled);
+    glBindFramebuffer(GL_DRAW_FRAMEBUFFER, f->resolved->framebuffer);
+    glBlitFramebuffer(0, 0, f->width, f->height, 0, 0, f->width, f->height,
+        GL_COLOR_BUFFER_BIT, GL_NEAREST);
+}
+
+static void bench_antialias(void)
+{
+    glfwInit();
+    glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
+    glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
+    glfwWindowHint(GLFW_OPENGL_FORWARD_COMPAT, GL_TRUE);
+    glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
+    glfwWindowHint(GLFW_VISIBLE, GLFW_FALSE);
+    GLFWwindow* window = glfwCreateWindow(64, 64, "bench", NULL, NULL);
+    if (window == NULL) {
+        fprintf(stderr, "bench: no window for the GL context\n");
+        glfwTerminate();
+        return;
+    }
+    glfwMakeContextCurrent(window);
+    if (!gladLoadGLLoader((GLADloadproc)glfwGetProcAddress)) {
+        fprintf(stderr, "bench: failed to load GL\n");
+        glfwTerminate();
+        return;
+    }
+    printf("antialias: %s, %s\n", (char const*)glGetString(GL_RENDERER),
+        (char const*)glGetString(GL_VERSION));
+
+    shader_init(&aa.boxes, "../src/occlusion_box.vs", "../src/bench_colors.fs");
+    shader_init(&aa.fxaa, "../src/post_fullscreen.vs", "../src/post_fxaa.fs");
+    glGenVertexArrays(1, &aa.empty_VAO);
+
+    float const corners[] = {
+        -0.5f, -0.5f, -0.5f, 0.5f, -0.5f, -0.5f, 0.5f, 0.5f, -0.5f,
+        -0.5f, 0.5f, -0.5f, -0.5f, -0.5f, 0.5f, 0.5f, -0.5f, 0.5f,
+        0.5f, 0.5f, 0.5f, -0.5f, 0.5f, 0.5f
+    };
+    unsigned int const indices[] = {
+        0, 2, 1, 0, 3, 2, 4, 5, 6, 4, 6, 7, 0, 1, 5, 0, 5, 4,
+        3, 6, 2, 3, 7, 6, 0, 4, 7, 0, 7, 3, 1, 2, 6, 1, 6, 5
+    };
+    unsigned int buffers[2];
+    glGenVertexArrays(1, &aa.box_VAO);
+    glGenBuffers(2, buffers);
+    glBindVertexArray(aa.box_VAO);
+    glBindBuffer(GL_ARRAY_BUFFER, buffers[0]);
+    glBufferData(GL_ARRAY_BUFFER, sizeof(corners), corners, GL_STATIC_DRAW);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, buffers[1]);
+    glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(indices), indices,
+        GL_STATIC_DRAW);
+    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 3 * sizeof(float),
+        (void*)0);
+    glEnableVertexAttribArray(0);
+
+    GLint max_samples = 0;
+    glGetIntegerv(GL_MAX_SAMPLES, &max_samples);
+    struct render_target_pool pool;
+    render_target_pool_init(&pool);
+
+    int const sizes[][2] = { { 1920, 1080 }, { 3840, 2160 } };
+    for (size_t r = 0; r < sizeof(sizes) / sizeof(sizes[0]); r++) {
+        struct aa_frame f = { .width = sizes[r][0], .height = sizes[r][1] };
+        printf("%dx%d\n", f.width, f.height);
+
+        mat4 projection;
+        mat4 view;
+        vec3 eye = { 0.0f, 6.0f, 8.0f };
+        vec3 target = { 0.0f, 0.0f, -12.0f };
+        vec3 up = { 0.0f, 1.0f, 0.0f };
+        glm_perspective(glm_rad(45.0f), (float)f.width / f.height, 0.1f,
+            100.0f, projection);
+        glm_lookat(eye, target, up, view);
+        glm_mat4_mul(projection, view, aa.view_projection);
+        glViewport(0, 0, f.width, f.height);
+
+        f.scene = render_target_acquire(&pool, f.width, f.height, GL_RGBA8,
+            true);
+        f.resolved = render_target_acquire(&pool, f.width, f.height,
+            GL_RGBA8, false);
+        if (f.scene == NULL || f.resolved == NULL) {
+            break;
+        }
+
+        printf("  %-10s %8.3f ms\n", "none", aa_time(aa_frame_plain, &f));
+        double fxaa = aa_time(aa_frame_fxaa, &f);
+        printf("  %-10s %8.3f ms, the pass alone %.3f ms\n", "fxaa", fxaa,
+            aa_time(aa_frame_fxaa_only, &f));
+        for (int samples = 2; samples <= 8; samples *= 2) {
+            char label[16];
+            snprintf(label, sizeof(label), "msaa %dx", samples);
+            unsigned int renderbuffers[2];
+            f.multisampled = samples <= max_samples
+                ? aa_multisampled(f.width, f.height, samples, renderbuffers)
+                : 0;
+            if (f.multisampled == 0) {
+                printf("  %-10s not supported\n", label);
+                continue;
+            }
+            printf("  %-10s %8.3f ms\n", label,
+                aa_time(aa_frame_msaa, &f));
+            glDeleteFramebuffers(1, &f.multisampled);
+            glDeleteRenderbuffers(2, renderbuffers);
+        }
+        render_target_release(&pool, f.scene);
+        render_target_release(&pool, f.resolved);
+    }
+
+    render_target_pool_free(&pool);
+    glDeleteBuffers(2, buffers);
+    glDeleteVertexArrays(1, &aa.box_VAO);
+    glDeleteVertexArrays(1, &aa.empty_VAO);
+    glDeleteProgram(aa.boxes.ID);
+    glDeleteProgram(aa.fxaa.ID);
+    glfwDestroyWindow(window);
+    glfwTerminate();
+}
+
+static struct {
+    char const* name;
+    void (*run)(void);
+} const benches[] = {
+    { "math", bench_math },
+    { "cull", bench_cull },
+    { "occlusion", bench_occlusion },
+    { "commands", bench_commands },
+    { "antialias", bench_antialias },
+};
+
+int bench_run(char const* name)
+{
+    bool found = false;
+    for (size_t i = 0; i < sizeof(benches) / sizeof(benches[0]); i++) {
+        if (strcmp(name, "all") == 0 || strcmp(name, benches[i].name) == 0) {
+            benches[i].run();
+            found = true;
+        }
+    }
+    if (!found) {
+        fprintf(stderr, "Unknown benchmark '%s', available:", name);
+        for (size_t i = 0; i < sizeof(benches) / sizeof(benches[0]); i++) {
+            fprintf(stderr, " %s", benches[i].name);
+        }
+        fprintf(stderr, " all\n");
+        return 1;
+    }
+    return bench_failed ? 1 : 0;
+}
@@ -0,0 +1,9 @@
+#ifndef BENCH_H
+#define BENCH_H
+
+/* Microbenchmarks, run with './main --bench <name>' before any window is
+ * opened. 'all' runs every benchmark. Returns the exit code for main, which
+ * is not 0 when a kernel's results do not match the cglm reference.
+ */
+int bench_run(char const* name);
+#endif
@@ -0,0 +1,10 @@
+#version 330 core
+out vec4 frag_color;
+
+// Every triangle gets its own color, so every edge is one FXAA has to find
+void main()
+{
+    uint h = uint(gl_PrimitiveID) * 2654435761u;
+    vec3 color = vec3(h & 255u, (h >> 8) & 255u, (h >> 16) & 255u) / 255.0;
+    frag_color = vec4(color, dot(color, vec3(0.299, 0.587, 0.114)));
+}
@@ -1,7 +1,9 @@
 #include <cglm/cglm.h>
 #include <math.h>
+#include <string.h>
 
 #include "camera.h"
+#include "math_dispatch.h"
 
 void camera_init(struct camera* cam)
 {
@@ -13,7 +15,11 @@ void camera_init(struct camera* cam)
         .mouse_sensitivity = 0.05f,
         .camera_position = { 0.0f, 0.0f, 3.0f },
         .camera_front = { 0.0f, 0.0f, -1.0f },
-        .camera_up = { 0.0f, 1.0f, 0.0f }
+        .camera_up = { 0.0f, 1.0f, 0.0f },
+        .aspect = 800.0f / 600.0f,
+        .near_plane = 0.1f,
+        .far_plane = 100.0f,
+        .dirty = CAMERA_DIRTY_ALL
     };
 }
 
@@ -26,12 +32,13 @@ void camera_process_mouse_movement(struct camera* const cam, float xoffset,
     cam->yaw += xoffset;
     cam->pitch -= yoffset;
 
-    if (cam->pitch > 89.0f) {
-        cam->pitch = 89.0f;
+    if (cam->pitch > CAMERA_MAX_PITCH) {
+        cam->pitch = CAMERA_MAX_PITCH;
     }
-    if (cam->pitch < -89.0f) {
-        cam->pitch = -89.0f;
+    if (cam->pitch < -CAMERA_MAX_PITCH) {
+        cam->pitch = -CAMERA_MAX_PITCH;
     }
+    cam->dirty |= CAMERA_DIRTY_FRONT | CAMERA_DIRTY_VIEW | CAMERA_DIRTY_DERIVED;
 }
 void camera_process_scroll(struct camera* const cam, float yoffset)
 {
@@ -43,11 +50,14 @@ void camera_process_scroll(struct camera* const cam, float yoffset)
     } else if (cam->fov >= 45.0f) {
         cam->fov = 44.9f;
     }
+    cam->dirty |= CAMERA_DIRTY_PROJECTION | CAMERA_DIRTY_DERIVED;
 }
 void camera_process_keyboard(struct camera* const cam,
     enum camera_movement direction, float delta_time)
 {
     float velocity = cam->movement_speed * delta_time;
+    // Move along where the camera is looking now, not where it looked last frame
+    camera_get_front(cam);
     switch (direction) {
     case FORWARD: {
         vec3 calculated_camera_front;
@@ -92,17 +102,127 @@ void camera_process_keyboard(struct camera* const cam,
         break;
     }
     }
+    cam->dirty |= CAMERA_DIRTY_VIEW | CAMERA_DIRTY_DERIVED;
 }
-void camera_get_view_matrix(struct camera const* const cam, mat4 out)
+void camera_set_pose(struct camera* const cam, vec3 position, float yaw,
+    float pitch, float fov)
 {
-    vec3 dir;
-    dir[0] = cos(glm_rad(cam->yaw)) * cos(glm_rad(cam->pitch));
-    dir[1] = sin(glm_rad(cam->pitch));
-    dir[2] = sin(glm_rad(cam->yaw)) * cos(glm_rad(cam->pitch));
-    glm_normalize(dir);
+    glm_vec3_copy(position, cam->camera_position);
+    cam->yaw = yaw;
+    cam->pitch = pitch;
+    cam->fov = fov;
+    cam->dirty |= CAMERA_DIRTY_ALL;
+}
+
+void camera_set_aspect(struct camera* const cam, float aspect)
+{
+    if (aspect == cam->aspect) {
+        return;
+    }
+    cam->aspect = aspect;
+    cam->dirty |= CAMERA_DIRTY_PROJECTION | CAMERA_DIRTY_DERIVED;
+}
+
+void camera_get_pose(struct camera const* cam, struct camera_pose* pose)
+{
+    memcpy(pose->position, cam->camera_position, sizeof(vec3));
+    pose->yaw = cam->yaw;
+    pose->pitch = cam->pitch;
+    pose->fov = cam->fov;
+    pose->aspect = cam->aspect;
+}
+
+void camera_apply_pose(struct camera* const cam,
+    struct camera_pose const* pose)
+{
+    if (pose->yaw != cam->yaw || pose->pitch != cam->pitch) {
+        cam->yaw = pose->yaw;
+        cam->pitch = pose->pitch;
+        cam->dirty |= CAMERA_DIRTY_FRONT | CAMERA_DIRTY_VIEW
+            | CAMERA_DIRTY_DERIVED;
+    }
+    if (memcmp(pose->position, cam->camera_position, sizeof(vec3)) != 0) {
+        memcpy(cam->camera_position, pose->position, sizeof(vec3));
+        cam->dirty |= CAMERA_DIRTY_VIEW | CAMERA_DIRTY_DERIVED;
+    }
+    if (pose->fov != cam->fov || pose->aspect != cam->aspect) {
+        cam->fov = pose->fov;
+        cam->aspect = pose->aspect;
+        cam->dirty |= CAMERA_DIRTY_PROJECTION | CAMERA_DIRTY_DERIVED;
+    }
+}
+
+float* camera_get_front(struct camera* const cam)
+{
+    if (cam->dirty & CAMERA_DIRTY_FRONT) {
+        float yaw = glm_rad(cam->yaw);
+        float pitch = glm_rad(cam->pitch);
+        float cos_pitch = cosf(pitch);
+
+        vec3 dir;
+        dir[0] = cosf(yaw) * cos_pitch;
+        dir[1] = sinf(pitch);
+        dir[2] = sinf(yaw) * cos_pitch;
+        glm_normalize_to(dir, cam->camera_front);
+
+        cam->dirty &= ~CAMERA_DIRTY_FRONT;
+    }
+    return cam->camera_front;
+}
+
+vec4* camera_get_view_matrix(struct camera* const cam)
+{
+    if (cam->dirty & CAMERA_DIRTY_VIEW) {
+        // lookat wants a point to look at, not a direction
+        vec3 center;
+        glm_vec3_add(cam->camera_position, camera_get_front(cam), center);
+        glm_lookat(cam->camera_position, center, cam->camera_up, cam->view);
+
+        cam->dirty &= ~CAMERA_DIRTY_VIEW;
+    }
+    return cam->view;
+}
 
-    glm_vec3_copy(dir, (float*)cam->camera_front);
-    glm_vec3_add((float*)cam->camera_position, (float*)cam->camera_front, dir);
+vec4* camera_get_projection_matrix(struct camera* const cam)
+{
+    if (cam->dirty & CAMERA_DIRTY_PROJECTION) {
+        glm_perspective(glm_rad(cam->fov), cam->aspect, cam->near_plane,
+            cam->far_plane, cam->projection);
 
-    glm_lookat((float*)cam->camera_position, dir, (float*)cam->camera_up, out);
+        cam->dirty &= ~CAMERA_DIRTY_PROJECTION;
+    }
+    return cam->projection;
+}
+
+vec4* camera_get_view_projection_matrix(struct camera* const cam)
+{
+    if (cam->dirty & CAMERA_DIRTY_VIEW_PROJECTION) {
+        math_mat4_mul(camera_get_projection_matrix(cam),
+            camera_get_view_matrix(cam), cam->view_projection);
+
+        cam->dirty &= ~CAMERA_DIRTY_VIEW_PROJECTION;
+    }
+    return cam->view_projection;
+}
+
+vec4* camera_get_inverse_view_projection_matrix(struct camera* const cam)
+{
+    if (cam->dirty & CAMERA_DIRTY_INVERSE) {
+        math_mat4_inv(camera_get_view_projection_matrix(cam),
+            cam->inverse_view_projection);
+
+        cam->dirty &= ~CAMERA_DIRTY_INVERSE;
+    }
+    return cam->inverse_view_projection;
+}
+
+vec4* camera_get_frustum_planes(struct camera* const cam)
+{
+    if (cam->dirty & CAMERA_DIRTY_FRUSTUM) {
+        glm_frustum_planes(camera_get_view_projection_matrix(cam),
+            cam->frustum_planes);
+
+        cam->dirty &= ~CAMERA_DIRTY_FRUSTUM;
+    }
+    return cam->frustum_planes;
 }
@@ -1,6 +1,24 @@
 #ifndef CAMERA_H
 #define CAMERA_H
 #include <cglm/cglm.h>
+
+// Furthest the camera looks up or down, in degrees. Any further flips it
+#define CAMERA_MAX_PITCH 89.0f
+
+// Bits in camera.dirty telling which cached values are out of date
+#define CAMERA_DIRTY_FRONT (1u << 0)
+#define CAMERA_DIRTY_VIEW (1u << 1)
+#define CAMERA_DIRTY_PROJECTION (1u << 2)
+#define CAMERA_DIRTY_VIEW_PROJECTION (1u << 3)
+#define CAMERA_DIRTY_INVERSE (1u << 4)
+#define CAMERA_DIRTY_FRUSTUM (1u << 5)
+
+// Everything derived from the combined view projection matrix
+#define CAMERA_DIRTY_DERIVED (CAMERA_DIRTY_VIEW_PROJECTION \
+    | CAMERA_DIRTY_INVERSE | CAMERA_DIRTY_FRUSTUM)
+#define CAMERA_DIRTY_ALL (CAMERA_DIRTY_FRONT | CAMERA_DIRTY_VIEW \
+    | CAMERA_DIRTY_PROJECTION | CAMERA_DIRTY_DERIVED)
+
 struct camera {
     vec3 camera_position;
     vec3 camera_front;
@@ -10,6 +28,28 @@ struct camera {
     float pitch;
     float fov;
     float mouse_sensitivity;
+    float aspect;
+    float near_plane;
+    float far_plane;
+
+    /* Cached matrices and planes. Only read these through the camera_get_*
+     * functions, they are recomputed lazily when 'dirty' says so.
+     */
+    unsigned int dirty;
+    mat4 view;
+    mat4 projection;
+    mat4 view_projection;
+    mat4 inverse_view_projection;
+    vec4 frustum_planes[6];
+};
+
+// What moves a camera, without anything derived from it
+struct camera_pose {
+    vec3 position;
+    float yaw;
+    float pitch;
+    float fov;
+    float aspect;
 };
 
 // Camera moves
@@ -24,7 +64,34 @@ void camera_init(struct camera* cam);
 void camera_process_mouse_movement(struct camera* const cam, float xoffset,
     float yoffset);
 void camera_process_scroll(struct camera* const cam, float yoffset);
-void camera_get_view_matrix(struct camera const* const cam, mat4 out);
 void camera_process_keyboard(struct camera* const cam,
     enum camera_movement direction, float delta_time);
+
+// Place the camera directly, used when replaying a recorded path
+void camera_set_pose(struct camera* const cam, vec3 position, float yaw,
+    float pitch, float fov);
+
+// Width divided by height of the viewport the camera renders to
+void camera_set_aspect(struct camera* const cam, float aspect);
+
+void camera_get_pose(struct camera const* cam, struct camera_pose* pose);
+
+/* Move the camera to 'pose', another camera's. Only what differs is marked
+ * dirty, so a camera following one that stands still keeps its caches.
+ */
+void camera_apply_pose(struct camera* const cam,
+    struct camera_pose const* pose);
+
+/* Getters for the cached data. Each one only recomputes what has changed
+ * since the last call. The returned pointers point into 'cam' and stay valid
+ * until the camera is changed again.
+ */
+float* camera_get_front(struct camera* const cam);
+vec4* camera_get_view_matrix(struct camera* const cam);
+vec4* camera_get_projection_matrix(struct camera* const cam);
+vec4* camera_get_view_projection_matrix(struct camera* const cam);
+vec4* camera_get_inverse_view_projection_matrix(struct camera* const cam);
+
+// World space planes in cglm order: left, right, bottom, top, near, far
+vec4* camera_get_frustum_planes(struct camera* const cam);
 #endif
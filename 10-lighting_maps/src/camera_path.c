@@ -0,0 +1,239 @@
+#include <cglm/cglm.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "camera_path.h"
+
+/* File layout: the header below followed by 'count' keys of 7 floats each
+ * (time, position xyz, yaw, pitch, fov) in host byte order.
+ */
+#define CAMERA_PATH_MAGIC "CPTH"
+#define CAMERA_PATH_VERSION 1
+#define CAMERA_PATH_KEY_FLOATS 7
+
+// The spline code walks a key as a plain array of floats
+_Static_assert(sizeof(struct camera_path_key)
+        == CAMERA_PATH_KEY_FLOATS * sizeof(float),
+    "camera_path_key must be tightly packed floats");
+
+struct camera_path_header {
+    char magic[4];
+    uint32_t version;
+    uint32_t count;
+};
+
+void camera_path_init(struct camera_path* path)
+{
+    *path = (struct camera_path) { 0 };
+}
+
+void camera_path_free(struct camera_path* path)
+{
+    free(path->keys);
+    camera_path_init(path);
+}
+
+static bool reserve(struct camera_path* const path, unsigned int capacity)
+{
+    if (capacity <= path->capacity) {
+        return true;
+    }
+    struct camera_path_key* keys = realloc(path->keys,
+        capacity * sizeof(*keys));
+    if (keys == NULL) {
+        fprintf(stderr, "camera_path.c: out of memory\n");
+        return false;
+    }
+    path->keys = keys;
+    path->capacity = capacity;
+    return true;
+}
+
+void camera_path_record(struct camera_path* const path,
+    struct camera const* const cam, float time)
+{
+    if (path->count > 0 && time <= path->keys[path->count - 1].time) {
+        return;
+    }
+    if (path->count == path->capacity) {
+        unsigned int capacity = path->capacity ? path->capacity * 2 : 256;
+        if (!reserve(path, capacity)) {
+            return;
+        }
+    }
+    struct camera_path_key* key = &path->keys[path->count++];
+    key->time = time;
+    glm_vec3_copy((float*)cam->camera_position, key->position);
+    key->yaw = cam->yaw;
+    key->pitch = cam->pitch;
+    key->fov = cam->fov;
+}
+
+bool camera_path_save(struct camera_path const* const path,
+    char const* file_path)
+{
+    FILE* file = fopen(file_path, "wb");
+    if (file == NULL) {
+        fprintf(stderr, "camera_path.c, %s:", file_path);
+        perror(NULL);
+        return false;
+    }
+
+    struct camera_path_header header = {
+        .version = CAMERA_PATH_VERSION,
+        .count = path->count
+    };
+    memcpy(header.magic, CAMERA_PATH_MAGIC, sizeof(header.magic));
+    bool ok = fwrite(&header, sizeof(header), 1, file) == 1;
+
+    for (unsigned int i = 0; ok && i < path->count; i++) {
+        struct camera_path_key const* key = &path->keys[i];
+        float packed[CAMERA_PATH_KEY_FLOATS] = {
+            key->time,
+            key->position[0], key->position[1], key->position[2],
+            key->yaw, key->pitch, key->fov
+        };
+        ok = fwrite(packed, sizeof(packed), 1, file) == 1;
+    }
+
+    if (fclose(file) != 0) {
+        ok = false;
+    }
+    if (!ok) {
+        fprintf(stderr, "camera_path.c, %s: failed to write path\n", file_path);
+    }
+    return ok;
+}
+
+bool camera_path_load(struct camera_path* const path, char const* file_path)
+{
+    FILE* file = fopen(file_path, "rb");
+    if (file == NULL) {
+        fprintf(stderr, "camera_path.c, %s:", file_path);
+        perror(NULL);
+        return false;
+    }
+
+    struct camera_path_header header;
+    if (fread(&header, sizeof(header), 1, file) != 1
+        || memcmp(header.magic, CAMERA_PATH_MAGIC, sizeof(header.magic)) != 0
+        || header.version != CAMERA_PATH_VERSION) {
+        fprintf(stderr, "camera_path.c, %s: not a camera path file\n",
+            file_path);
+        fclose(file);
+        return false;
+    }
+
+    path->count = 0;
+    if (!reserve(path, header.count)) {
+        fclose(file);
+        return false;
+    }
+
+    for (uint32_t i = 0; i < header.count; i++) {
+        float packed[CAMERA_PATH_KEY_FLOATS];
+        if (fread(packed, sizeof(packed), 1, file) != 1) {
+            fprintf(stderr, "camera_path.c, %s: truncated file\n", file_path);
+            path->count = 0;
+            fclose(file);
+            return false;
+        }
+        struct camera_path_key* key = &path->keys[i];
+        key->time = packed[0];
+        key->position[0] = packed[1];
+        key->position[1] = packed[2];
+        key->position[2] = packed[3];
+        key->yaw = packed[4];
+        key->pitch = packed[5];
+        key->fov = packed[6];
+    }
+    path->count = header.count;
+    fclose(file);
+    return true;
+}
+
+float camera_path_duration(struct camera_path const* const path)
+{
+    if (path->count == 0) {
+        return 0.0f;
+    }
+    return path->keys[path->count - 1].time;
+}
+
+// Index of the key starting the segment that contains 'time'
+static unsigned int find_segment(struct camera_path const* const path,
+    float time)
+{
+    unsigned int low = 0;
+    unsigned int high = path->count - 1;
+    while (high - low > 1) {
+        unsigned int mid = low + (high - low) / 2;
+        if (path->keys[mid].time <= time) {
+            low = mid;
+        } else {
+            high = mid;
+        }
+    }
+    return low;
+}
+
+/* Catmull-Rom tangent at key 'i' for the channel at 'offset' floats into the
+ * key, scaled to a segment of length 'segment_time'. Keys are not evenly spaced
+ * in time so the neighbours' slope is taken per second first.
+ */
+static float tangent(struct camera_path const* const path, unsigned int i,
+    size_t offset, float segment_time)
+{
+    unsigned int prev = i > 0 ? i - 1 : i;
+    unsigned int next = i + 1 < path->count ? i + 1 : i;
+    float dt = path->keys[next].time - path->keys[prev].time;
+    if (dt <= 0.0f) {
+        return 0.0f;
+    }
+    float const* a = (float const*)&path->keys[prev] + offset;
+    float const* b = (float const*)&path->keys[next] + offset;
+    return (*b - *a) / dt * segment_time;
+}
+
+void camera_path_sample(struct camera_path const* const path, float time,
+    struct camera* const cam)
+{
+    if (path->count == 0) {
+        return;
+    }
+
+    struct camera_path_key const* first = &path->keys[0];
+    struct camera_path_key const* last = &path->keys[path->count - 1];
+    if (path->count == 1 || time <= first->time) {
+        camera_set_pose(cam, (float*)first->position, first->yaw, first->pitch,
+            first->fov);
+        return;
+    }
+    if (time >= last->time) {
+        camera_set_pose(cam, (float*)last->position, last->yaw, last->pitch,
+            last->fov);
+        return;
+    }
+
+    unsigned int i = find_segment(path, time);
+    struct camera_path_key const* k0 = &path->keys[i];
+    struct camera_path_key const* k1 = &path->keys[i + 1];
+    float segment_time = k1->time - k0->time;
+    float s = (time - k0->time) / segment_time;
+
+    // Every channel after 'time' is interpolated the same way
+    float channels[CAMERA_PATH_KEY_FLOATS - 1];
+    for (size_t c = 0; c < CAMERA_PATH_KEY_FLOATS - 1; c++) {
+        size_t offset = c + 1;
+        float p0 = *((float const*)k0 + offset);
+        float p1 = *((float const*)k1 + offset);
+        float t0 = tangent(path, i, offset, segment_time);
+        float t1 = tangent(path, i + 1, offset, segment_time);
+        channels[c] = glm_hermite(s, p0, t0, t1, p1);
+    }
+    // The spline overshoots keys close to the limit, the camera would flip
+    float pitch = glm_clamp(channels[4], -CAMERA_MAX_PITCH, CAMERA_MAX_PITCH);
+    camera_set_pose(cam, channels, channels[3], pitch, channels[5]);
+}
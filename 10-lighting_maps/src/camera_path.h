@@ -0,0 +1,49 @@
+#ifndef CAMERA_PATH_H
+#define CAMERA_PATH_H
+#include <stdbool.h>
+
+#include "camera.h"
+
+// One recorded camera state, 'time' is in seconds from the start of the path
+struct camera_path_key {
+    float time;
+    vec3 position;
+    float yaw;
+    float pitch;
+    float fov;
+};
+
+struct camera_path {
+    struct camera_path_key* keys;
+    unsigned int count;
+    unsigned int capacity;
+};
+
+void camera_path_init(struct camera_path* path);
+void camera_path_free(struct camera_path* path);
+
+/* Append the current state of 'cam' at 'time'. Keys must come in increasing
+ * time order, keys that do not move time forward are dropped.
+ */
+void camera_path_record(struct camera_path* const path,
+    struct camera const* const cam, float time);
+
+/* Write the path to 'file_path' as a compact binary file.
+ * Returns false on error.
+ */
+bool camera_path_save(struct camera_path const* const path,
+    char const* file_path);
+
+// Replace the contents of 'path' with the keys in 'file_path'. Returns false on error
+bool camera_path_load(struct camera_path* const path, char const* file_path);
+
+// Time of the last key, 0 for an empty path
+float camera_path_duration(struct camera_path const* const path);
+
+/* Move 'cam' to where the path is at 'time'. The keys are joined by a
+ * Catmull-Rom spline so playback is smooth at any frame rate, and sampling the
+ * same time always gives the same camera.
+ */
+void camera_path_sample(struct camera_path const* const path, float time,
+    struct camera* const cam);
+#endif
@@ -0,0 +1,244 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "command_buffer.h"
+
+void command_buffer_init(struct command_buffer* cb)
+{
+    memset(cb, 0, sizeof(*cb));
+}
+
+void command_buffer_free(struct command_buffer* cb)
+{
+    free(cb->words);
+    memset(cb, 0, sizeof(*cb));
+}
+
+void command_buffer_reset(struct command_buffer* cb)
+{
+    cb->count = 0;
+    cb->commands = 0;
+}
+
+// Room for a command of 'type' with 'arguments' words, returned past the type
+static uint32_t* push(struct command_buffer* cb, enum command_type type,
+    size_t arguments)
+{
+    if (cb->count + 1 + arguments > cb->capacity) {
+        while (cb->count + 1 + arguments > cb->capacity) {
+            cb->capacity = cb->capacity ? cb->capacity * 2 : 1024;
+        }
+        cb->words = realloc(cb->words, cb->capacity * sizeof(uint32_t));
+    }
+    uint32_t* w = cb->words + cb->count;
+    w[0] = type;
+    cb->count += 1 + arguments;
+    cb->commands++;
+    return w + 1;
+}
+
+static uint32_t float_bits(float f)
+{
+    uint32_t u;
+    memcpy(&u, &f, sizeof(u));
+    return u;
+}
+
+void command_use_program(struct command_buffer* cb, unsigned int program)
+{
+    push(cb, COMMAND_USE_PROGRAM, 1)[0] = program;
+}
+
+void command_bind_vertex_array(struct command_buffer* cb, unsigned int VAO)
+{
+    push(cb, COMMAND_BIND_VERTEX_ARRAY, 1)[0] = VAO;
+}
+
+void command_bind_texture(struct command_buffer* cb, uint32_t unit,
+    unsigned int texture)
+{
+    uint32_t* w = push(cb, COMMAND_BIND_TEXTURE, 2);
+    w[0] = unit;
+    w[1] = texture;
+}
+
+void command_uniform_int(struct command_buffer* cb, GLint location,
+    int value)
+{
+    uint32_t* w = push(cb, COMMAND_UNIFORM_INT, 2);
+    w[0] = (uint32_t)location;
+    w[1] = (uint32_t)value;
+}
+
+void command_uniform_float(struct command_buffer* cb, GLint location,
+    float value)
+{
+    uint32_t* w = push(cb, COMMAND_UNIFORM_FLOAT, 2);
+    w[0] = (uint32_t)location;
+    w[1] = float_bits(value);
+}
+
+void command_uniform_vec3(struct command_buffer* cb, GLint location,
+    vec3 value)
+{
+    uint32_t* w = push(cb, COMMAND_UNIFORM_VEC3, 4);
+    w[0] = (uint32_t)location;
+    memcpy(w + 1, value, sizeof(vec3));
+}
+
+void command_uniform_mat4(struct command_buffer* cb, GLint location,
+    mat4 value)
+{
+    uint32_t* w = push(cb, COMMAND_UNIFORM_MAT4, 17);
+    w[0] = (uint32_t)location;
+    memcpy(w + 1, value, sizeof(mat4));
+}
+
+void command_draw_arrays(struct command_buffer* cb, GLenum mode,
+    GLint first, GLsizei count)
+{
+    uint32_t* w = push(cb, COMMAND_DRAW_ARRAYS, 3);
+    w[0] = mode;
+    w[1] = (uint32_t)first;
+    w[2] = (uint32_t)count;
+}
+
+void command_draw_elements(struct command_buffer* cb, GLenum mode,
+    GLsizei count, size_t offset)
+{
+    uint32_t* w = push(cb, COMMAND_DRAW_ELEMENTS, 3);
+    w[0] = mode;
+    w[1] = (uint32_t)count;
+    w[2] = (uint32_t)offset;
+}
+
+// GL state replay has seen, to skip binds that change nothing
+struct replay_state {
+    GLint program;
+    GLint VAO;
+    GLint active_unit;
+    GLint textures[COMMAND_TEXTURE_UNITS];
+};
+
+static void query_state(struct replay_state* st)
+{
+    glGetIntegerv(GL_CURRENT_PROGRAM, &st->program);
+    glGetIntegerv(GL_VERTEX_ARRAY_BINDING, &st->VAO);
+    glGetIntegerv(GL_ACTIVE_TEXTURE, &st->active_unit);
+    // Unknown until bound here, querying every unit costs more than it saves
+    for (uint32_t u = 0; u < COMMAND_TEXTURE_UNITS; u++) {
+        st->textures[u] = -1;
+    }
+    st->active_unit -= GL_TEXTURE0;
+}
+
+static void replay(struct command_buffer const* cb, struct replay_state* st,
+    struct command_stats* stats)
+{
+    uint32_t const* w = cb->words;
+    uint32_t const* end = cb->words + cb->count;
+    while (w < end) {
+        enum command_type type = w[0];
+        uint32_t const* a = w + 1;
+        switch (type) {
+        case COMMAND_USE_PROGRAM:
+            if ((GLint)a[0] != st->program) {
+                st->program = a[0];
+                glUseProgram(a[0]);
+            } else {
+                stats->redundant++;
+            }
+            w = a + 1;
+            break;
+        case COMMAND_BIND_VERTEX_ARRAY:
+            if ((GLint)a[0] != st->VAO) {
+                st->VAO = a[0];
+                glBindVertexArray(a[0]);
+            } else {
+                stats->redundant++;
+            }
+            w = a + 1;
+            break;
+        case COMMAND_BIND_TEXTURE:
+            if (a[0] >= COMMAND_TEXTURE_UNITS
+                || st->textures[a[0]] != (GLint)a[1]) {
+                if ((GLint)a[0] != st->active_unit) {
+                    st->active_unit = a[0];
+                    glActiveTexture(GL_TEXTURE0 + a[0]);
+                }
+                glBindTexture(GL_TEXTURE_2D, a[1]);
+                if (a[0] < COMMAND_TEXTURE_UNITS) {
+                    st->textures[a[0]] = a[1];
+                }
+            } else {
+                stats->redundant++;
+            }
+            w = a + 2;
+            break;
+        case COMMAND_UNIFORM_INT:
+            glUniform1i((GLint)a[0], (GLint)a[1]);
+            w = a + 2;
+            break;
+        case COMMAND_UNIFORM_FLOAT: {
+            float f;
+            memcpy(&f, a + 1, sizeof(f));
+            glUniform1f((GLint)a[0], f);
+            w = a + 2;
+            break;
+        }
+        case COMMAND_UNIFORM_VEC3:
+            glUniform3fv((GLint)a[0], 1, (float const*)(a + 1));
+            w = a + 4;
+            break;
+        case COMMAND_UNIFORM_MAT4:
+            glUniformMatrix4fv((GLint)a[0], 1, GL_FALSE,
+                (float const*)(a + 1));
+            w = a + 17;
+            break;
+        case COMMAND_DRAW_ARRAYS:
+            glDrawArrays(a[0], (GLint)a[1], (GLsizei)a[2]);
+            stats->draws++;
+            w = a + 3;
+            break;
+        case COMMAND_DRAW_ELEMENTS:
+            glDrawElements(a[0], (GLsizei)a[1], GL_UNSIGNED_INT,
+                (void*)(uintptr_t)a[2]);
+            stats->draws++;
+            w = a + 3;
+            break;
+        default:
+            fprintf(stderr, "command_buffer: unknown command %u\n", type);
+            return;
+        }
+        stats->commands++;
+    }
+}
+
+struct command_stats command_buffer_execute(
+    struct command_buffer const* buffers, size_t count)
+{
+    struct command_stats stats = { 0 };
+    struct replay_state st;
+    query_state(&st);
+    for (size_t i = 0; i < count; i++) {
+        replay(&buffers[i], &st, &stats);
+    }
+    return stats;
+}
+
+void uniform_table_init(struct uniform_table* t, unsigned int program,
+    char const* const* names, uint32_t count)
+{
+    t->locations = calloc(count + 1, sizeof(GLint));
+    t->count = count;
+    for (uint32_t i = 0; i < count; i++) {
+        t->locations[i] = glGetUniformLocation(program, names[i]);
+    }
+}
+
+void uniform_table_free(struct uniform_table* t)
+{
+    free(t->locations);
+    memset(t, 0, sizeof(*t));
+}
@@ -0,0 +1,87 @@
+#ifndef COMMAND_BUFFER_H
+#define COMMAND_BUFFER_H
+#include <cglm/cglm.h>
+#include <glad/glad.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// Texture units whose bindings replay keeps track of
+#define COMMAND_TEXTURE_UNITS 16
+
+enum command_type {
+    COMMAND_USE_PROGRAM,
+    COMMAND_BIND_VERTEX_ARRAY,
+    COMMAND_BIND_TEXTURE,
+    COMMAND_UNIFORM_INT,
+    COMMAND_UNIFORM_FLOAT,
+    COMMAND_UNIFORM_VEC3,
+    COMMAND_UNIFORM_MAT4,
+    COMMAND_DRAW_ARRAYS,
+    COMMAND_DRAW_ELEMENTS
+};
+
+/* GL calls recorded into memory, so threads without the context can prepare
+ * draws that the GL thread replays later. Each command is a word holding
+ * its type, followed by its arguments as 32 bit words. Recording never
+ * touches the GL, and one buffer must only be recorded by one thread at a
+ * time; give each worker its own and replay them in order.
+ */
+struct command_buffer {
+    uint32_t* words;
+    size_t count;
+    size_t capacity;
+    uint32_t commands;
+};
+
+/* Uniform locations looked up on the GL thread, for workers to record
+ * uniforms with. 'locations' follows the order of the names.
+ */
+struct uniform_table {
+    GLint* locations;
+    uint32_t count;
+};
+
+// What the last command_buffer_execute did
+struct command_stats {
+    uint32_t commands;
+    uint32_t draws;
+    // Binds dropped because the object was bound already
+    uint32_t redundant;
+};
+
+void command_buffer_init(struct command_buffer* cb);
+void command_buffer_free(struct command_buffer* cb);
+
+// Forget the commands, keeping the memory for the next recording
+void command_buffer_reset(struct command_buffer* cb);
+
+void command_use_program(struct command_buffer* cb, unsigned int program);
+void command_bind_vertex_array(struct command_buffer* cb, unsigned int VAO);
+// Bind a GL_TEXTURE_2D on 'unit'
+void command_bind_texture(struct command_buffer* cb, uint32_t unit,
+    unsigned int texture);
+void command_uniform_int(struct command_buffer* cb, GLint location,
+    int value);
+void command_uniform_float(struct command_buffer* cb, GLint location,
+    float value);
+void command_uniform_vec3(struct command_buffer* cb, GLint location,
+    vec3 value);
+void command_uniform_mat4(struct command_buffer* cb, GLint location,
+    mat4 value);
+void command_draw_arrays(struct command_buffer* cb, GLenum mode,
+    GLint first, GLsizei count);
+// Draw GL_UNSIGNED_INT indices starting 'offset' bytes into the index buffer
+void command_draw_elements(struct command_buffer* cb, GLenum mode,
+    GLsizei count, size_t offset);
+
+/* Replay 'count' buffers in order on the GL thread. Binds of the program,
+ * vertex array and textures that are bound already are skipped, starting
+ * with what was bound before the call.
+ */
+struct command_stats command_buffer_execute(
+    struct command_buffer const* buffers, size_t count);
+
+void uniform_table_init(struct uniform_table* t, unsigned int program,
+    char const* const* names, uint32_t count);
+void uniform_table_free(struct uniform_table* t);
+#endif
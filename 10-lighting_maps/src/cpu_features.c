@@ -0,0 +1,105 @@
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "cpu_features.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <cpuid.h>
+#define CPU_FEATURES_X86
+#endif
+
+static char const* const level_names[] = {
+    [SIMD_SCALAR] = "scalar",
+    [SIMD_SSE2] = "sse2",
+    [SIMD_AVX] = "avx",
+    [SIMD_AVX2] = "avx2",
+    [SIMD_AVX512] = "avx512"
+};
+
+#ifdef CPU_FEATURES_X86
+// Which register states the OS saves on context switches
+static unsigned long long read_xcr0(void)
+{
+    unsigned int eax;
+    unsigned int edx;
+    __asm__ volatile("xgetbv"
+                     : "=a"(eax), "=d"(edx)
+                     : "c"(0));
+    return ((unsigned long long)edx << 32) | eax;
+}
+
+static enum simd_level detect(void)
+{
+    unsigned int eax, ebx, ecx, edx;
+    if (!__get_cpuid(1, &eax, &ebx, &ecx, &edx)) {
+        return SIMD_SCALAR;
+    }
+    if (!(edx & bit_SSE2)) {
+        return SIMD_SCALAR;
+    }
+
+    // The CPU having AVX is not enough, the OS must also save the YMM registers
+    bool has_fma = ecx & bit_FMA;
+    if (!(ecx & bit_AVX) || !(ecx & bit_OSXSAVE)) {
+        return SIMD_SSE2;
+    }
+    unsigned long long xcr0 = read_xcr0();
+    if ((xcr0 & 0x6) != 0x6) {
+        return SIMD_SSE2;
+    }
+
+    if (!__get_cpuid_count(7, 0, &eax, &ebx, &ecx, &edx)) {
+        return SIMD_AVX;
+    }
+    if (!(ebx & bit_AVX2) || !has_fma) {
+        return SIMD_AVX;
+    }
+
+    // Opmask and the upper ZMM registers
+    if ((ebx & bit_AVX512F) && (xcr0 & 0xe0) == 0xe0) {
+        return SIMD_AVX512;
+    }
+    return SIMD_AVX2;
+}
+#else
+static enum simd_level detect(void)
+{
+    return SIMD_SCALAR;
+}
+#endif
+
+// Lowest of the detected level and the one asked for in SIMD_LEVEL
+static enum simd_level apply_override(enum simd_level detected)
+{
+    char const* requested = getenv("SIMD_LEVEL");
+    if (requested == NULL) {
+        return detected;
+    }
+    for (int level = SIMD_SCALAR; level <= SIMD_AVX512; level++) {
+        if (strcmp(requested, level_names[level]) == 0) {
+            return (enum simd_level)level < detected
+                ? (enum simd_level)level
+                : detected;
+        }
+    }
+    fprintf(stderr, "cpu_features.c: unknown SIMD_LEVEL '%s'\n", requested);
+    return detected;
+}
+
+enum simd_level cpu_simd_level(void)
+{
+    static bool detected = false;
+    static enum simd_level level;
+    if (!detected) {
+        level = apply_override(detect());
+        detected = true;
+    }
+    return level;
+}
+
+char const* simd_level_name(enum simd_level level)
+{
+    return level_names[level];
+}
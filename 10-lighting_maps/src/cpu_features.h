@@ -0,0 +1,24 @@
+#ifndef CPU_FEATURES_H
+#define CPU_FEATURES_H
+
+/* Widest SIMD instruction set the current machine and OS can run, in
+ * increasing order so levels can be compared with < and >=.
+ * SIMD_AVX2 also requires FMA, every CPU we care about has both.
+ */
+enum simd_level {
+    SIMD_SCALAR,
+    SIMD_SSE2,
+    SIMD_AVX,
+    SIMD_AVX2,
+    SIMD_AVX512
+};
+
+/* Detect the SIMD level with cpuid on the first call and cache it. Setting the
+ * environment variable SIMD_LEVEL to one of "scalar", "sse2", "avx", "avx2" or
+ * "avx512" caps the result, which is handy for comparing the code paths on one
+ * machine.
+ */
+enum simd_level cpu_simd_level(void);
+
+char const* simd_level_name(enum simd_level level);
+#endif
@@ -0,0 +1,251 @@
+#include <cglm/cglm.h>
+#include <math.h>
+
+#include "cull.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define CULL_X86
+#endif
+
+/* A box is outside a plane when its center is further behind it than the box
+ * reaches towards it: dot(n, c) + d < -dot(|n|, e). It crosses the plane when
+ * the center is also closer than that reach on the front side.
+ */
+struct cull_plane {
+    float nx, ny, nz, d;
+    float ax, ay, az;
+    unsigned int bit;
+};
+
+typedef size_t (*cull_kernel)(struct aabb_soa boxes, size_t begin, size_t end,
+    struct cull_plane const* planes, int plane_count, uint32_t* visible,
+    uint8_t* straddle_masks);
+
+static size_t cull_scalar(struct aabb_soa boxes, size_t begin, size_t end,
+    struct cull_plane const* planes, int plane_count, uint32_t* visible,
+    uint8_t* straddle_masks)
+{
+    size_t n = 0;
+    for (size_t i = begin; i < end; i++) {
+        // Locals, the byte stores below could alias anything as far as the
+        // compiler knows
+        float cx = boxes.center_x[i];
+        float cy = boxes.center_y[i];
+        float cz = boxes.center_z[i];
+        float ex = boxes.extent_x[i];
+        float ey = boxes.extent_y[i];
+        float ez = boxes.extent_z[i];
+
+        unsigned int outside = 0;
+        unsigned int straddle = 0;
+        for (int p = 0; p < plane_count; p++) {
+            struct cull_plane const* pl = &planes[p];
+            float dist = pl->nx * cx + pl->ny * cy + pl->nz * cz + pl->d;
+            float reach = pl->ax * ex + pl->ay * ey + pl->az * ez;
+            outside |= dist < -reach;
+            straddle |= (dist < reach) * pl->bit;
+        }
+        // Always write, only advance for visible boxes
+        visible[n] = (uint32_t)i;
+        if (straddle_masks != NULL) {
+            straddle_masks[n] = straddle;
+        }
+        n += !outside;
+    }
+    return n;
+}
+
+#ifdef CULL_X86
+/* For every 8 bit mask, the lanes that are set packed to the front, 4 bits
+ * per lane index. Used to compact 8 results with one permute.
+ */
+static uint32_t compress_lut[256];
+
+static void init_compress_lut(void)
+{
+    for (unsigned int mask = 0; mask < 256; mask++) {
+        uint32_t packed = 0;
+        int out = 0;
+        for (unsigned int lane = 0; lane < 8; lane++) {
+            if (mask & (1u << lane)) {
+                packed |= lane << (out * 4);
+                out++;
+            }
+        }
+        compress_lut[mask] = packed;
+    }
+}
+
+__attribute__((target("avx2,fma,popcnt"))) static size_t cull_avx2(
+    struct aabb_soa boxes, size_t begin, size_t end,
+    struct cull_plane const* planes, int plane_count, uint32_t* visible,
+    uint8_t* straddle_masks)
+{
+    __m256i const lane_index = _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7);
+    __m256i const lut_shift = _mm256_setr_epi32(0, 4, 8, 12, 16, 20, 24, 28);
+    __m256 const zero = _mm256_setzero_ps();
+
+    size_t n = 0;
+    size_t i = begin;
+    for (; i + 8 <= end; i += 8) {
+        __m256 cx = _mm256_loadu_ps(boxes.center_x + i);
+        __m256 cy = _mm256_loadu_ps(boxes.center_y + i);
+        __m256 cz = _mm256_loadu_ps(boxes.center_z + i);
+        __m256 ex = _mm256_loadu_ps(boxes.extent_x + i);
+        __m256 ey = _mm256_loadu_ps(boxes.extent_y + i);
+        __m256 ez = _mm256_loadu_ps(boxes.extent_z + i);
+
+        __m256 outside = zero;
+        __m256i straddle = _mm256_setzero_si256();
+        for (int p = 0; p < plane_count; p++) {
+            struct cull_plane const* pl = &planes[p];
+            __m256 dist = _mm256_fmadd_ps(_mm256_set1_ps(pl->nx), cx,
+                _mm256_fmadd_ps(_mm256_set1_ps(pl->ny), cy,
+                    _mm256_fmadd_ps(_mm256_set1_ps(pl->nz), cz,
+                        _mm256_set1_ps(pl->d))));
+            __m256 reach = _mm256_fmadd_ps(_mm256_set1_ps(pl->ax), ex,
+                _mm256_fmadd_ps(_mm256_set1_ps(pl->ay), ey,
+                    _mm256_mul_ps(_mm256_set1_ps(pl->az), ez)));
+            // dist + reach < 0 is the same test as dist < -reach
+            outside = _mm256_or_ps(outside,
+                _mm256_cmp_ps(_mm256_add_ps(dist, reach), zero, _CMP_LT_OQ));
+            __m256 crosses = _mm256_cmp_ps(dist, reach, _CMP_LT_OQ);
+            straddle = _mm256_or_si256(straddle,
+                _mm256_and_si256(_mm256_castps_si256(crosses),
+                    _mm256_set1_epi32(pl->bit)));
+        }
+
+        unsigned int keep = ~_mm256_movemask_ps(outside) & 0xff;
+        __m256i permute = _mm256_srlv_epi32(
+            _mm256_set1_epi32(compress_lut[keep]), lut_shift);
+        permute = _mm256_and_si256(permute, _mm256_set1_epi32(0xf));
+
+        __m256i indices = _mm256_add_epi32(lane_index,
+            _mm256_set1_epi32((int)i));
+        _mm256_storeu_si256((__m256i*)(visible + n),
+            _mm256_permutevar8x32_epi32(indices, permute));
+        if (straddle_masks != NULL) {
+            // Narrow the 8 packed masks to bytes, all are below 64
+            __m256i packed = _mm256_permutevar8x32_epi32(straddle, permute);
+            __m128i words = _mm_packus_epi32(_mm256_castsi256_si128(packed),
+                _mm256_extracti128_si256(packed, 1));
+            _mm_storel_epi64((__m128i*)(straddle_masks + n),
+                _mm_packus_epi16(words, words));
+        }
+        n += _mm_popcnt_u32(keep);
+    }
+    return n + cull_scalar(boxes, i, end, planes, plane_count, visible + n,
+               straddle_masks ? straddle_masks + n : NULL);
+}
+
+__attribute__((target("avx512f,popcnt"))) static size_t cull_avx512(
+    struct aabb_soa boxes, size_t begin, size_t end,
+    struct cull_plane const* planes, int plane_count, uint32_t* visible,
+    uint8_t* straddle_masks)
+{
+    __m512i const lane_index = _mm512_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7, 8,
+        9, 10, 11, 12, 13, 14, 15);
+
+    size_t n = 0;
+    size_t i = begin;
+    for (; i + 16 <= end; i += 16) {
+        __m512 cx = _mm512_loadu_ps(boxes.center_x + i);
+        __m512 cy = _mm512_loadu_ps(boxes.center_y + i);
+        __m512 cz = _mm512_loadu_ps(boxes.center_z + i);
+        __m512 ex = _mm512_loadu_ps(boxes.extent_x + i);
+        __m512 ey = _mm512_loadu_ps(boxes.extent_y + i);
+        __m512 ez = _mm512_loadu_ps(boxes.extent_z + i);
+
+        __mmask16 outside = 0;
+        __m512i straddle = _mm512_setzero_si512();
+        for (int p = 0; p < plane_count; p++) {
+            struct cull_plane const* pl = &planes[p];
+            __m512 dist = _mm512_fmadd_ps(_mm512_set1_ps(pl->nx), cx,
+                _mm512_fmadd_ps(_mm512_set1_ps(pl->ny), cy,
+                    _mm512_fmadd_ps(_mm512_set1_ps(pl->nz), cz,
+                        _mm512_set1_ps(pl->d))));
+            __m512 reach = _mm512_fmadd_ps(_mm512_set1_ps(pl->ax), ex,
+                _mm512_fmadd_ps(_mm512_set1_ps(pl->ay), ey,
+                    _mm512_mul_ps(_mm512_set1_ps(pl->az), ez)));
+            outside |= _mm512_cmp_ps_mask(_mm512_add_ps(dist, reach),
+                _mm512_setzero_ps(), _CMP_LT_OQ);
+            __mmask16 crosses = _mm512_cmp_ps_mask(dist, reach, _CMP_LT_OQ);
+            straddle = _mm512_mask_or_epi32(straddle, crosses, straddle,
+                _mm512_set1_epi32(pl->bit));
+        }
+
+        __mmask16 keep = ~outside;
+        __m512i indices = _mm512_add_epi32(lane_index,
+            _mm512_set1_epi32((int)i));
+        _mm512_mask_compressstoreu_epi32(visible + n, keep, indices);
+        if (straddle_masks != NULL) {
+            __m512i packed = _mm512_maskz_compress_epi32(keep, straddle);
+            _mm_storeu_si128((__m128i*)(straddle_masks + n),
+                _mm512_cvtepi32_epi8(packed));
+        }
+        n += _mm_popcnt_u32(keep);
+    }
+    return n + cull_scalar(boxes, i, end, planes, plane_count, visible + n,
+               straddle_masks ? straddle_masks + n : NULL);
+}
+#endif
+
+static cull_kernel kernel = cull_scalar;
+static enum simd_level kernel_level = SIMD_SCALAR;
+
+void cull_init(void)
+{
+    cull_use_level(cpu_simd_level());
+}
+
+void cull_use_level(enum simd_level level)
+{
+    if (level > cpu_simd_level()) {
+        level = cpu_simd_level();
+    }
+
+    kernel = cull_scalar;
+    kernel_level = SIMD_SCALAR;
+#ifdef CULL_X86
+    if (level >= SIMD_AVX2) {
+        init_compress_lut();
+        kernel = cull_avx2;
+        kernel_level = SIMD_AVX2;
+    }
+    if (level >= SIMD_AVX512) {
+        kernel = cull_avx512;
+        kernel_level = SIMD_AVX512;
+    }
+#endif
+}
+
+enum simd_level cull_level(void)
+{
+    return kernel_level;
+}
+
+size_t cull_aabbs(struct aabb_soa boxes, size_t count, vec4 planes[6],
+    unsigned int plane_mask, uint32_t* visible, uint8_t* straddle_masks)
+{
+    // Only the planes in the mask, with |n| precomputed for the reach
+    struct cull_plane active[6];
+    int plane_count = 0;
+    for (int p = 0; p < 6; p++) {
+        if (!(plane_mask & (1u << p))) {
+            continue;
+        }
+        active[plane_count++] = (struct cull_plane) {
+            .nx = planes[p][0],
+            .ny = planes[p][1],
+            .nz = planes[p][2],
+            .d = planes[p][3],
+            .ax = fabsf(planes[p][0]),
+            .ay = fabsf(planes[p][1]),
+            .az = fabsf(planes[p][2]),
+            .bit = 1u << p
+        };
+    }
+    return kernel(boxes, 0, count, active, plane_count, visible,
+        straddle_masks);
+}
@@ -0,0 +1,38 @@
+#ifndef CULL_H
+#define CULL_H
+#include <cglm/cglm.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "cpu_features.h"
+#include "math_batch.h"
+
+// Test against all six planes of glm_frustum_planes
+#define CULL_ALL_PLANES 0x3fu
+
+/* The SIMD kernels always write whole vectors of results, the output arrays
+ * need room for this many entries past 'count'.
+ */
+#define CULL_OUTPUT_PADDING 16
+
+// Pick the culling kernel for the running CPU
+void cull_init(void);
+
+// Use the kernel for 'level' instead, capped to what the CPU supports
+void cull_use_level(enum simd_level level);
+
+// Level of the kernel in use, scalar, AVX2 (8 boxes) or AVX-512 (16 boxes)
+enum simd_level cull_level(void);
+
+/* Test 'count' boxes against 'planes' and write the indices of the boxes that
+ * are not completely outside into 'visible'. Returns how many were written.
+ *
+ * Only the planes whose bit is set in 'plane_mask' are tested. If
+ * 'straddle_masks' is not NULL, it gets the planes each visible box crosses,
+ * in the same order as 'visible'. For a hierarchy, pass a parent's entry as
+ * the plane mask of its children, since planes a parent is fully inside can
+ * not cull anything below it.
+ */
+size_t cull_aabbs(struct aabb_soa boxes, size_t count, vec4 planes[6],
+    unsigned int plane_mask, uint32_t* visible, uint8_t* straddle_masks);
+#endif
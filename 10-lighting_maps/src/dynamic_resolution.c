@@ -0,0 +1,130 @@
+#include <math.h>
+#include <string.h>
+
+#include "dynamic_resolution.h"
+
+// Weight of a new GPU time in the smoothed one
+#define SMOOTHING 0.2f
+
+// Under this fraction of the budget there is room to grow
+#define GROW_BELOW 0.8f
+
+void dynamic_resolution_init(struct dynamic_resolution* dr, float budget_ms,
+    float min_scale)
+{
+    memset(dr, 0, sizeof(*dr));
+    dr->scale = 1.0f;
+    dr->min_scale = min_scale;
+    dr->max_scale = 1.0f;
+    dr->budget_ms = budget_ms;
+    dr->sharpness = 0.5f;
+    glGenQueries(DYNAMIC_RESOLUTION_QUERIES, dr->queries);
+    shader_init(&dr->upscale, "../src/post_fullscreen.vs",
+        "../src/upscale.fs");
+    glGenVertexArrays(1, &dr->empty_VAO);
+}
+
+void dynamic_resolution_free(struct dynamic_resolution* dr)
+{
+    glDeleteQueries(DYNAMIC_RESOLUTION_QUERIES, dr->queries);
+    glDeleteProgram(dr->upscale.ID);
+    glDeleteVertexArrays(1, &dr->empty_VAO);
+    memset(dr, 0, sizeof(*dr));
+}
+
+static float clamp_scale(struct dynamic_resolution const* dr, float scale)
+{
+    scale = roundf(scale / DYNAMIC_RESOLUTION_STEP) * DYNAMIC_RESOLUTION_STEP;
+    return fminf(fmaxf(scale, dr->min_scale), dr->max_scale);
+}
+
+static void update_scale(struct dynamic_resolution* dr, float ms)
+{
+    dr->gpu_ms = dr->gpu_ms > 0.0f
+        ? dr->gpu_ms + SMOOTHING * (ms - dr->gpu_ms)
+        : ms;
+    if (dr->settle > 0) {
+        dr->settle--;
+        return;
+    }
+
+    float next = dr->scale;
+    if (dr->gpu_ms > dr->budget_ms) {
+        // Time goes with the pixel count, aim a little under the budget
+        next = dr->scale * sqrtf(dr->budget_ms / dr->gpu_ms) * 0.95f;
+        next = fminf(clamp_scale(dr, next),
+            dr->scale - DYNAMIC_RESOLUTION_STEP);
+    } else if (dr->gpu_ms < GROW_BELOW * dr->budget_ms) {
+        next = dr->scale + DYNAMIC_RESOLUTION_STEP;
+    }
+    next = clamp_scale(dr, next);
+    if (next == dr->scale) {
+        return;
+    }
+    // Guess the time at the new size until frames drawn at it come in
+    dr->gpu_ms *= (next * next) / (dr->scale * dr->scale);
+    dr->scale = next;
+    dr->settle = dr->issued - dr->read;
+}
+
+void dynamic_resolution_begin(struct dynamic_resolution* dr)
+{
+    while (dr->read < dr->issued) {
+        unsigned int query = dr->queries[dr->read % DYNAMIC_RESOLUTION_QUERIES];
+        GLint available = 0;
+        glGetQueryObjectiv(query, GL_QUERY_RESULT_AVAILABLE, &available);
+        if (!available) {
+            break;
+        }
+        GLuint64 ns;
+        glGetQueryObjectui64v(query, GL_QUERY_RESULT, &ns);
+        dr->read++;
+        update_scale(dr, ns * 1e-6f);
+    }
+
+    // With every query still in flight this frame goes untimed
+    dr->timing = dr->issued - dr->read < DYNAMIC_RESOLUTION_QUERIES;
+    if (dr->timing) {
+        glBeginQuery(GL_TIME_ELAPSED,
+            dr->queries[dr->issued % DYNAMIC_RESOLUTION_QUERIES]);
+    }
+}
+
+void dynamic_resolution_end(struct dynamic_resolution* dr)
+{
+    if (dr->timing) {
+        glEndQuery(GL_TIME_ELAPSED);
+        dr->issued++;
+        dr->timing = false;
+    }
+}
+
+void dynamic_resolution_size(struct dynamic_resolution const* dr, int width,
+    int height, int* scaled_width, int* scaled_height)
+{
+    int w = (int)lroundf(width * dr->scale);
+    int h = (int)lroundf(height * dr->scale);
+    *scaled_width = w > 0 ? w : 1;
+    *scaled_height = h > 0 ? h : 1;
+}
+
+static void run_upscale(struct render_graph const* g, void* data)
+{
+    struct dynamic_resolution* dr = data;
+    glDisable(GL_DEPTH_TEST);
+    glBindVertexArray(dr->empty_VAO);
+    glUseProgram(dr->upscale.ID);
+    shader_set_float(&dr->upscale, "sharpness", dr->sharpness);
+    glActiveTexture(GL_TEXTURE0);
+    glBindTexture(GL_TEXTURE_2D, render_graph_texture(g, dr->source));
+    glDrawArrays(GL_TRIANGLES, 0, 3);
+}
+
+void dynamic_resolution_add_upscale(struct dynamic_resolution* dr,
+    struct render_graph* g, uint32_t scene, uint32_t output)
+{
+    dr->source = scene;
+    uint32_t pass = render_graph_add_pass(g, "upscale", run_upscale, dr);
+    render_graph_read(g, pass, scene);
+    render_graph_write(g, pass, output, false);
+}
@@ -0,0 +1,66 @@
+#ifndef DYNAMIC_RESOLUTION_H
+#define DYNAMIC_RESOLUTION_H
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "render_graph.h"
+#include "shader.h"
+
+// Timer queries in flight, results are read this many frames late at most
+#define DYNAMIC_RESOLUTION_QUERIES 4
+
+// Scales are multiples of this, so small changes in GPU time keep the targets
+#define DYNAMIC_RESOLUTION_STEP 0.05f
+
+/* Renders the scene at a fraction of the window size, picked every frame so
+ * the GPU time of a frame stays within a budget.
+ *
+ * The time of each frame is measured with a GL_TIME_ELAPSED query, read once
+ * the GPU has it so the CPU never waits. When the smoothed time is over the
+ * budget the scale drops right away by as much as the pixel count suggests,
+ * when it is well under the scale grows one step at a time. After a change
+ * the frames still in flight at the old size are ignored.
+ */
+struct dynamic_resolution {
+    float scale;
+    float min_scale;
+    float max_scale;
+    float budget_ms;
+    // How much the upscale sharpens, 0 is plain bilinear
+    float sharpness;
+
+    // Smoothed GPU time of a frame, 0 before the first result
+    float gpu_ms;
+    unsigned int queries[DYNAMIC_RESOLUTION_QUERIES];
+    // Queries begun and queries whose results were read
+    uint32_t issued;
+    uint32_t read;
+    bool timing;
+    // Results left to ignore after the last change
+    uint32_t settle;
+
+    struct shader upscale;
+    unsigned int empty_VAO;
+    // Resource the upscale pass of this frame reads
+    uint32_t source;
+};
+
+// Aim for 'budget_ms' of GPU time, never going below 'min_scale'
+void dynamic_resolution_init(struct dynamic_resolution* dr, float budget_ms,
+    float min_scale);
+void dynamic_resolution_free(struct dynamic_resolution* dr);
+
+/* Time what the GPU does from here to dynamic_resolution_end, and update the
+ * scale with the results that came in
+ */
+void dynamic_resolution_begin(struct dynamic_resolution* dr);
+void dynamic_resolution_end(struct dynamic_resolution* dr);
+
+// Size to render a 'width' by 'height' output at, never smaller than a pixel
+void dynamic_resolution_size(struct dynamic_resolution const* dr, int width,
+    int height, int* scaled_width, int* scaled_height);
+
+// Declare a pass that stretches 'scene', a transient, over 'output'
+void dynamic_resolution_add_upscale(struct dynamic_resolution* dr,
+    struct render_graph* g, uint32_t scene, uint32_t output);
+#endif
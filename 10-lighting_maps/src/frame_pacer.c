@@ -0,0 +1,116 @@
+#include <GLFW/glfw3.h>
+
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+#include "frame_pacer.h"
+
+// Spin margin to start with, and the most it may grow to
+#define INITIAL_SPIN_MARGIN 0.001
+#define MAX_SPIN_MARGIN 0.004
+
+static double now_seconds(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static void sleep_seconds(double seconds)
+{
+    struct timespec ts = {
+        .tv_sec = (time_t)seconds,
+        .tv_nsec = (long)((seconds - (time_t)seconds) * 1e9)
+    };
+    nanosleep(&ts, NULL);
+}
+
+bool frame_pacer_set_swap(enum swap_mode mode)
+{
+    switch (mode) {
+    case SWAP_VSYNC:
+        glfwSwapInterval(1);
+        return true;
+    case SWAP_ADAPTIVE:
+        // A negative interval needs the tear extension of the window system
+        if (glfwExtensionSupported("WGL_EXT_swap_control_tear")
+            || glfwExtensionSupported("GLX_EXT_swap_control_tear")) {
+            glfwSwapInterval(-1);
+            return true;
+        }
+        fprintf(stderr, "frame_pacer: no adaptive vsync, using vsync\n");
+        glfwSwapInterval(1);
+        return false;
+    case SWAP_OFF:
+        glfwSwapInterval(0);
+        return true;
+    }
+    return false;
+}
+
+void frame_pacer_init(struct frame_pacer* p, double fps)
+{
+    memset(p, 0, sizeof(*p));
+    p->frame_time = fps > 0.0 ? 1.0 / fps : 0.0;
+    p->spin_margin = INITIAL_SPIN_MARGIN;
+    p->last_frame = now_seconds();
+    p->deadline = p->last_frame + p->frame_time;
+}
+
+void frame_pacer_wait(struct frame_pacer* p)
+{
+    double now = now_seconds();
+    if (p->frame_time > 0.0) {
+        double sleep_until = p->deadline - p->spin_margin;
+        if (now < sleep_until) {
+            sleep_seconds(sleep_until - now);
+            double overslept = now_seconds() - sleep_until;
+            // Grow quickly when a sleep ran long, shrink slowly after
+            p->spin_margin = overslept > p->spin_margin
+                ? fmin(overslept * 1.25, MAX_SPIN_MARGIN)
+                : p->spin_margin * 0.99 + overslept * 0.01;
+        }
+        while ((now = now_seconds()) < p->deadline) {
+        }
+        p->deadline += p->frame_time;
+        if (p->deadline < now) {
+            p->deadline = now + p->frame_time;
+        }
+    }
+
+    double interval = now - p->last_frame;
+    p->last_frame = now;
+    if (p->frames == 0 || interval < p->min) {
+        p->min = interval;
+    }
+    if (p->frames == 0 || interval > p->max) {
+        p->max = interval;
+    }
+    p->sum += interval;
+    p->sum_squares += interval * interval;
+    p->frames++;
+    if (p->frame_time > 0.0 && interval > 1.5 * p->frame_time) {
+        p->late++;
+    }
+}
+
+struct frame_pacing_stats frame_pacer_report(struct frame_pacer* p)
+{
+    struct frame_pacing_stats s = { .frames = p->frames };
+    if (p->frames > 0) {
+        double mean = p->sum / p->frames;
+        double variance = p->sum_squares / p->frames - mean * mean;
+        s.mean_ms = mean * 1e3;
+        s.jitter_ms = sqrt(variance > 0.0 ? variance : 0.0) * 1e3;
+        s.min_ms = p->min * 1e3;
+        s.max_ms = p->max * 1e3;
+        s.late = p->late;
+    }
+    p->frames = 0;
+    p->sum = 0.0;
+    p->sum_squares = 0.0;
+    p->late = 0;
+    return s;
+}
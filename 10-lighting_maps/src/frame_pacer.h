@@ -0,0 +1,62 @@
+#ifndef FRAME_PACER_H
+#define FRAME_PACER_H
+#include <stdbool.h>
+#include <stdint.h>
+
+enum swap_mode {
+    // Wait for the vertical blank on every swap
+    SWAP_VSYNC,
+    // Like SWAP_VSYNC, but a late frame is shown right away and tears
+    SWAP_ADAPTIVE,
+    // Swap immediately, the frame limiter is all that paces the loop
+    SWAP_OFF
+};
+
+// Frame intervals between two calls to frame_pacer_report
+struct frame_pacing_stats {
+    uint32_t frames;
+    double mean_ms;
+    // Standard deviation of the intervals
+    double jitter_ms;
+    double min_ms;
+    double max_ms;
+    // Intervals more than half a target frame too long
+    uint32_t late;
+};
+
+/* Keeps the loop at a target frame time without spinning a core. It sleeps
+ * until shortly before the deadline and spins only for the rest, and how
+ * short that is follows how much the sleeps have overslept so far. Deadlines
+ * advance by the frame time rather than from when the wait ended, so the
+ * rate does not drift; after a frame that took too long the next deadline
+ * starts over from now instead of rushing to catch up.
+ */
+struct frame_pacer {
+    // 0 without a limit, the pacer then only measures
+    double frame_time;
+    double deadline;
+    // How long before the deadline sleeping stops
+    double spin_margin;
+
+    double last_frame;
+    // Sums over the frames since the last report
+    uint32_t frames;
+    double sum;
+    double sum_squares;
+    double min;
+    double max;
+    uint32_t late;
+};
+
+// Set the swap interval of the current context, false if 'mode' is missing
+bool frame_pacer_set_swap(enum swap_mode mode);
+
+// Aim for 'fps' frames a second, 0 for no limit
+void frame_pacer_init(struct frame_pacer* p, double fps);
+
+// Wait for the end of this frame. Call once a frame, after swapping
+void frame_pacer_wait(struct frame_pacer* p);
+
+// What the frames since the last report looked like, and start over
+struct frame_pacing_stats frame_pacer_report(struct frame_pacer* p);
+#endif
@@ -0,0 +1,1203 @@
+#include <glad/glad.h>
+
+#include <fcntl.h>
+#include <math.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "gltf_loader.h"
+#include "gpu_memory.h"
+#include "json.h"
+#include "texture.h"
+
+#define GLB_MAGIC 0x46546c67
+#define GLB_CHUNK_JSON 0x4e4f534a
+#define GLB_CHUNK_BIN 0x004e4942
+
+// Largest byte offset or length taken from JSON, doubles are exact up to here
+#define GLTF_MAX_BYTES 9007199254740992.0
+
+// Largest byteStride the spec allows
+#define GLTF_MAX_STRIDE 252.0
+
+// Vertex attribute locations of shader.vs
+#define POSITION_LOCATION 0
+#define NORMAL_LOCATION 1
+#define UV_LOCATION 2
+
+// Shininess range roughness is mapped to, 1 is as rough as the shader gets
+#define MIN_SHININESS 1.0f
+#define MAX_SHININESS 512.0f
+
+/* File contents, either mapped or decoded from a data URI. glTF buffers
+ * that live inside a .glb point into the mapping of the whole file and own
+ * nothing.
+ */
+struct blob {
+    unsigned char* data;
+    size_t size;
+    enum {
+        BLOB_BORROWED,
+        BLOB_MAPPED,
+        BLOB_ALLOCATED
+    } owner;
+};
+
+struct accessor {
+    // Buffer view, -1 when the accessor is all zeros
+    int32_t view;
+    size_t offset;
+    uint32_t count;
+    unsigned int component_type;
+    int components;
+    bool normalized;
+    // JSON object of the sparse substitutions, 0 if there are none
+    uint32_t sparse;
+};
+
+struct buffer_view {
+    int32_t buffer;
+    size_t offset;
+    size_t length;
+    size_t stride;
+};
+
+// Loading state, everything in here is gone once gltf_load returns
+struct gltf_loader {
+    char const* path;
+    struct blob file;
+    struct json_document doc;
+    // Contents of the GLB binary chunk, empty for .gltf files
+    struct blob glb_bin;
+
+    struct blob* buffers;
+    uint32_t buffer_count;
+    struct buffer_view* views;
+    uint32_t view_count;
+
+    // JSON value of every element of the top level arrays
+    uint32_t* accessors;
+    uint32_t accessor_count;
+    uint32_t* images;
+    uint32_t image_count;
+    uint32_t* textures;
+    uint32_t texture_count;
+    uint32_t* materials;
+    uint32_t* meshes;
+    uint32_t* nodes;
+
+    // Images already tried, textures are created on first use
+    bool* image_loaded;
+};
+
+static bool map_file(struct blob* blob, char const* path)
+{
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        fprintf(stderr, "Failed to open %s\n", path);
+        return false;
+    }
+    struct stat st;
+    if (fstat(fd, &st) != 0 || st.st_size == 0) {
+        fprintf(stderr, "Failed to read %s\n", path);
+        close(fd);
+        return false;
+    }
+    void* data = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (data == MAP_FAILED) {
+        fprintf(stderr, "Failed to map %s\n", path);
+        return false;
+    }
+    // Start reading everything in while the JSON is being parsed
+    madvise(data, st.st_size, MADV_WILLNEED);
+
+    blob->data = data;
+    blob->size = st.st_size;
+    blob->owner = BLOB_MAPPED;
+    return true;
+}
+
+static void blob_free(struct blob* blob)
+{
+    if (blob->owner == BLOB_MAPPED) {
+        munmap(blob->data, blob->size);
+    } else if (blob->owner == BLOB_ALLOCATED) {
+        free(blob->data);
+    }
+    *blob = (struct blob) { 0 };
+}
+
+static int base64_value(char c)
+{
+    if (c >= 'A' && c <= 'Z') {
+        return c - 'A';
+    }
+    if (c >= 'a' && c <= 'z') {
+        return c - 'a' + 26;
+    }
+    if (c >= '0' && c <= '9') {
+        return c - '0' + 52;
+    }
+    if (c == '+') {
+        return 62;
+    }
+    if (c == '/') {
+        return 63;
+    }
+    return -1;
+}
+
+// Decode the payload of a "data:...;base64," URI
+static bool decode_data_uri(struct blob* blob, char const* uri, size_t length)
+{
+    char const* comma = memchr(uri, ',', length);
+    if (comma == NULL || comma - uri < 7
+        || memcmp(comma - 7, ";base64", 7) != 0) {
+        fprintf(stderr, "glTF: only base64 data URIs are supported\n");
+        return false;
+    }
+    char const* p = comma + 1;
+    char const* end = uri + length;
+
+    blob->data = malloc((end - p) / 4 * 3 + 3);
+    blob->size = 0;
+    blob->owner = BLOB_ALLOCATED;
+    if (blob->data == NULL) {
+        fprintf(stderr, "glTF: out of memory decoding a data URI\n");
+        return false;
+    }
+    uint32_t bits = 0;
+    int bit_count = 0;
+    for (; p < end && *p != '='; p++) {
+        int value = base64_value(*p);
+        if (value < 0) {
+            fprintf(stderr, "glTF: bad base64 data\n");
+            blob_free(blob);
+            return false;
+        }
+        bits = bits << 6 | (uint32_t)value;
+        bit_count += 6;
+        if (bit_count >= 8) {
+            bit_count -= 8;
+            blob->data[blob->size++] = (unsigned char)(bits >> bit_count);
+        }
+    }
+    return true;
+}
+
+/* Path of 'uri' relative to the glTF file. URIs may escape characters like
+ * spaces as %20, those are decoded.
+ */
+static void resolve_uri(char* out, size_t out_size, char const* gltf_path,
+    char const* uri, size_t uri_length)
+{
+    char const* slash = strrchr(gltf_path, '/');
+    size_t dir_length = slash ? (size_t)(slash - gltf_path) + 1 : 0;
+    if (dir_length >= out_size) {
+        dir_length = 0;
+    }
+    memcpy(out, gltf_path, dir_length);
+
+    size_t n = dir_length;
+    for (size_t i = 0; i < uri_length && n + 1 < out_size; i++) {
+        char hex[3] = { 0 };
+        if (uri[i] == '%' && i + 2 < uri_length) {
+            hex[0] = uri[i + 1];
+            hex[1] = uri[i + 2];
+            char* hex_end;
+            long value = strtol(hex, &hex_end, 16);
+            if (hex_end == hex + 2) {
+                out[n++] = (char)value;
+                i += 2;
+                continue;
+            }
+        }
+        out[n++] = uri[i];
+    }
+    out[n] = '\0';
+}
+
+// Load a buffer or an image from its "uri" member
+static bool load_uri(struct gltf_loader* l, struct blob* blob, uint32_t uri)
+{
+    struct json_value const* value = &l->doc.values[uri];
+    if (value->string_length >= 5 && memcmp(value->string, "data:", 5) == 0) {
+        return decode_data_uri(blob, value->string, value->string_length);
+    }
+    char path[1024];
+    resolve_uri(path, sizeof(path), l->path, value->string,
+        value->string_length);
+    return map_file(blob, path);
+}
+
+/* 'key' of 'object' as a whole number from 0 to 'max', 0 when it is missing.
+ * False when it is negative, has a fraction or is larger.
+ */
+static bool get_unsigned(struct json_document const* doc, uint32_t object,
+    char const* key, double max, double* value)
+{
+    *value = json_get_number(doc, object, key, 0.0);
+    return *value >= 0.0 && *value <= max && *value == floor(*value);
+}
+
+// JSON value of every element of a top level array like "accessors"
+static uint32_t* index_array(struct json_document const* doc, char const* key,
+    uint32_t* count)
+{
+    uint32_t array = json_object_get(doc, JSON_ROOT, key);
+    *count = 0;
+    if (array == 0 || doc->values[array].type != JSON_ARRAY) {
+        return NULL;
+    }
+    *count = doc->values[array].child_count;
+    uint32_t* table = malloc((*count + 1) * sizeof(uint32_t));
+    // Walking the siblings once beats json_array_get per element on files
+    // with many thousands of accessors
+    uint32_t value = array + 1;
+    for (uint32_t i = 0; i < *count; i++) {
+        table[i] = value;
+        value = doc->values[value].end;
+    }
+    return table;
+}
+
+static bool split_glb(struct gltf_loader* l, char const** json,
+    size_t* json_length)
+{
+    unsigned char const* data = l->file.data;
+    uint32_t header[3];
+    if (l->file.size < 20) {
+        return false;
+    }
+    memcpy(header, data, sizeof(header));
+    if (header[1] != 2 || header[2] > l->file.size) {
+        fprintf(stderr, "glTF: unsupported GLB version %u\n", header[1]);
+        return false;
+    }
+
+    // A JSON chunk and an optional binary chunk, each 4 byte aligned
+    size_t offset = 12;
+    size_t end = header[2];
+    while (offset + 8 <= end) {
+        uint32_t chunk[2];
+        memcpy(chunk, data + offset, sizeof(chunk));
+        offset += 8;
+        if (chunk[0] > end - offset) {
+            break;
+        }
+        if (chunk[1] == GLB_CHUNK_JSON && *json == NULL) {
+            *json = (char const*)data + offset;
+            *json_length = chunk[0];
+        } else if (chunk[1] == GLB_CHUNK_BIN && l->glb_bin.data == NULL) {
+            l->glb_bin.data = (unsigned char*)data + offset;
+            l->glb_bin.size = chunk[0];
+            l->glb_bin.owner = BLOB_BORROWED;
+        }
+        offset += (chunk[0] + 3) & ~3u;
+    }
+    if (*json == NULL) {
+        fprintf(stderr, "glTF: GLB without JSON chunk\n");
+        return false;
+    }
+    return true;
+}
+
+static bool load_buffers(struct gltf_loader* l)
+{
+    struct json_document const* doc = &l->doc;
+    uint32_t* buffers = index_array(doc, "buffers", &l->buffer_count);
+    l->buffers = calloc(l->buffer_count + 1, sizeof(struct blob));
+
+    bool ok = true;
+    for (uint32_t i = 0; i < l->buffer_count && ok; i++) {
+        uint32_t uri = json_object_get(doc, buffers[i], "uri");
+        double length;
+        if (!get_unsigned(doc, buffers[i], "byteLength", GLTF_MAX_BYTES,
+                &length)) {
+            fprintf(stderr, "glTF: buffer %u has a bad byteLength\n", i);
+            ok = false;
+        } else if (uri != 0 && doc->values[uri].type == JSON_STRING) {
+            ok = load_uri(l, &l->buffers[i], uri);
+        } else if (i == 0 && l->glb_bin.data != NULL) {
+            l->buffers[i] = l->glb_bin;
+        } else {
+            fprintf(stderr, "glTF: buffer %u has no data\n", i);
+            ok = false;
+        }
+        if (ok && l->buffers[i].size < (size_t)length) {
+            fprintf(stderr, "glTF: buffer %u is truncated\n", i);
+            ok = false;
+        }
+    }
+    free(buffers);
+    if (!ok) {
+        return false;
+    }
+
+    uint32_t* views = index_array(doc, "bufferViews", &l->view_count);
+    l->views = calloc(l->view_count + 1, sizeof(struct buffer_view));
+    for (uint32_t i = 0; i < l->view_count && ok; i++) {
+        struct buffer_view* view = &l->views[i];
+        view->buffer = json_get_int(doc, views[i], "buffer", -1);
+        double offset;
+        double length;
+        double stride;
+        if (!get_unsigned(doc, views[i], "byteOffset", GLTF_MAX_BYTES, &offset)
+            || !get_unsigned(doc, views[i], "byteLength", GLTF_MAX_BYTES,
+                &length)
+            || !get_unsigned(doc, views[i], "byteStride", GLTF_MAX_STRIDE,
+                &stride)) {
+            fprintf(stderr, "glTF: buffer view %u has a bad size\n", i);
+            ok = false;
+            break;
+        }
+        view->offset = (size_t)offset;
+        view->length = (size_t)length;
+        view->stride = (size_t)stride;
+        if (view->buffer < 0 || (uint32_t)view->buffer >= l->buffer_count
+            || view->offset + view->length > l->buffers[view->buffer].size) {
+            fprintf(stderr, "glTF: buffer view %u is out of range\n", i);
+            ok = false;
+        }
+    }
+    free(views);
+    return ok;
+}
+
+static int component_size(unsigned int component_type)
+{
+    switch (component_type) {
+    case GL_BYTE:
+    case GL_UNSIGNED_BYTE:
+        return 1;
+    case GL_SHORT:
+    case GL_UNSIGNED_SHORT:
+        return 2;
+    case GL_UNSIGNED_INT:
+    case GL_FLOAT:
+        return 4;
+    default:
+        return 0;
+    }
+}
+
+static size_t element_size(struct accessor const* a)
+{
+    return (size_t)a->components * component_size(a->component_type);
+}
+
+static size_t accessor_stride(struct gltf_loader const* l,
+    struct accessor const* a)
+{
+    size_t stride = a->view >= 0 ? l->views[a->view].stride : 0;
+    return stride ? stride : element_size(a);
+}
+
+static bool read_accessor(struct gltf_loader const* l, int32_t index,
+    struct accessor* a)
+{
+    struct json_document const* doc = &l->doc;
+    if (index < 0 || (uint32_t)index >= l->accessor_count) {
+        fprintf(stderr, "glTF: accessor %d does not exist\n", index);
+        return false;
+    }
+    uint32_t value = l->accessors[index];
+    a->view = json_get_int(doc, value, "bufferView", -1);
+    double offset;
+    double count;
+    // Counts end up in draw calls, which take at most INT32_MAX elements
+    if (!get_unsigned(doc, value, "byteOffset", GLTF_MAX_BYTES, &offset)
+        || !get_unsigned(doc, value, "count", INT32_MAX, &count)) {
+        fprintf(stderr, "glTF: accessor %d has a bad offset or count\n",
+            index);
+        return false;
+    }
+    a->offset = (size_t)offset;
+    a->count = (uint32_t)count;
+    a->component_type = json_get_int(doc, value, "componentType", 0);
+    a->sparse = json_object_get(doc, value, "sparse");
+    uint32_t normalized = json_object_get(doc, value, "normalized");
+    a->normalized = normalized != 0
+        && doc->values[normalized].type == JSON_TRUE;
+
+    uint32_t type = json_object_get(doc, value, "type");
+    a->components = json_string_equals(doc, type, "SCALAR") ? 1
+        : json_string_equals(doc, type, "VEC2")             ? 2
+        : json_string_equals(doc, type, "VEC3")             ? 3
+        : json_string_equals(doc, type, "VEC4")             ? 4
+                                                            : 0;
+    if (a->components == 0 || component_size(a->component_type) == 0) {
+        fprintf(stderr, "glTF: accessor %d has an unsupported type\n", index);
+        return false;
+    }
+    if (a->view >= 0) {
+        if ((uint32_t)a->view >= l->view_count) {
+            fprintf(stderr, "glTF: accessor %d has no buffer view\n", index);
+            return false;
+        }
+        // Can not overflow, offsets are below 2^53 and strides below 256
+        struct buffer_view const* view = &l->views[a->view];
+        uint64_t last = a->count
+            ? a->offset + (uint64_t)(a->count - 1) * accessor_stride(l, a)
+                + element_size(a)
+            : 0;
+        if (last > view->length) {
+            fprintf(stderr, "glTF: accessor %d is out of range\n", index);
+            return false;
+        }
+    }
+    return true;
+}
+
+static unsigned char const* view_data(struct gltf_loader const* l,
+    int32_t view, size_t offset, size_t length)
+{
+    if (view < 0 || (uint32_t)view >= l->view_count
+        || offset > l->views[view].length
+        || length > l->views[view].length - offset) {
+        return NULL;
+    }
+    return l->buffers[l->views[view].buffer].data + l->views[view].offset
+        + offset;
+}
+
+// Index and sparse index types, the unsigned integers
+static bool is_index_type(unsigned int component_type)
+{
+    return component_type == GL_UNSIGNED_BYTE
+        || component_type == GL_UNSIGNED_SHORT
+        || component_type == GL_UNSIGNED_INT;
+}
+
+// Unsigned integer of 'size' bytes at 'data', which may be unaligned
+static uint32_t read_index(unsigned char const* data, int size)
+{
+    if (size == 1) {
+        return data[0];
+    }
+    if (size == 2) {
+        uint16_t index16;
+        memcpy(&index16, data, 2);
+        return index16;
+    }
+    uint32_t index;
+    memcpy(&index, data, 4);
+    return index;
+}
+
+// Sparse substitutions of an accessor, 'count' is 0 when it has none
+struct sparse {
+    uint32_t count;
+    int index_size;
+    unsigned char const* indices;
+    unsigned char const* values;
+};
+
+static bool read_sparse(struct gltf_loader const* l, struct accessor const* a,
+    struct sparse* s)
+{
+    *s = (struct sparse) { 0 };
+    if (a->sparse == 0) {
+        return true;
+    }
+    struct json_document const* doc = &l->doc;
+    uint32_t indices = json_object_get(doc, a->sparse, "indices");
+    uint32_t values = json_object_get(doc, a->sparse, "values");
+    unsigned int index_type = json_get_int(doc, indices, "componentType", 0);
+    double count;
+    double index_offset;
+    double value_offset;
+    if (!is_index_type(index_type)
+        || !get_unsigned(doc, a->sparse, "count", a->count, &count)
+        || !get_unsigned(doc, indices, "byteOffset", GLTF_MAX_BYTES,
+            &index_offset)
+        || !get_unsigned(doc, values, "byteOffset", GLTF_MAX_BYTES,
+            &value_offset)) {
+        fprintf(stderr, "glTF: sparse accessor has a bad type or size\n");
+        return false;
+    }
+    s->count = (uint32_t)count;
+    s->index_size = component_size(index_type);
+    s->indices = view_data(l, json_get_int(doc, indices, "bufferView", -1),
+        (size_t)index_offset, (size_t)s->count * s->index_size);
+    s->values = view_data(l, json_get_int(doc, values, "bufferView", -1),
+        (size_t)value_offset, (size_t)s->count * element_size(a));
+    if (s->count > 0 && (s->indices == NULL || s->values == NULL)) {
+        fprintf(stderr, "glTF: sparse accessor is out of range\n");
+        return false;
+    }
+    return true;
+}
+
+/* Copy an accessor into a tightly packed array and apply its sparse
+ * substitutions. Only needed for accessors the GPU can not read in place.
+ * NULL when it is broken or does not fit in memory.
+ */
+static unsigned char* unpack_accessor(struct gltf_loader const* l,
+    struct accessor const* a, size_t* bytes)
+{
+    struct sparse sparse;
+    if (!read_sparse(l, a, &sparse)) {
+        return NULL;
+    }
+    size_t size = element_size(a);
+    if (a->count > SIZE_MAX / size - 1) {
+        fprintf(stderr, "glTF: accessor with %u elements is too large\n",
+            a->count);
+        return NULL;
+    }
+    unsigned char* data = calloc((size_t)a->count + 1, size);
+    if (data == NULL) {
+        fprintf(stderr, "glTF: out of memory unpacking an accessor\n");
+        return NULL;
+    }
+    *bytes = (size_t)a->count * size;
+    if (a->view >= 0) {
+        size_t stride = accessor_stride(l, a);
+        unsigned char const* src = view_data(l, a->view, a->offset, 0);
+        for (uint32_t i = 0; i < a->count; i++) {
+            memcpy(data + i * size, src + i * stride, size);
+        }
+    }
+    for (uint32_t i = 0; i < sparse.count; i++) {
+        uint32_t index = read_index(sparse.indices + i * sparse.index_size,
+            sparse.index_size);
+        if (index >= a->count) {
+            fprintf(stderr, "glTF: sparse index %u is out of range\n", index);
+            free(data);
+            return NULL;
+        }
+        memcpy(data + index * size, sparse.values + i * size, size);
+    }
+    return data;
+}
+
+static unsigned int upload_unpacked(struct gltf_scene* scene,
+    unsigned char const* data, size_t bytes,
+    enum gpu_memory_category category)
+{
+    unsigned int buffer = gpu_buffer_create(category, "glTF accessor");
+    glBindBuffer(GL_COPY_WRITE_BUFFER, buffer);
+    gpu_buffer_data(buffer, GL_COPY_WRITE_BUFFER, bytes, data,
+        GL_STATIC_DRAW);
+
+    scene->unpacked_buffers = realloc(scene->unpacked_buffers,
+        (scene->unpacked_buffer_count + 1) * sizeof(unsigned int));
+    scene->unpacked_buffers[scene->unpacked_buffer_count++] = buffer;
+    return buffer;
+}
+
+/* GL buffer holding an accessor and the offset of its first element in it,
+ * 0 when it had to be unpacked and that failed
+ */
+static unsigned int accessor_buffer(struct gltf_loader const* l,
+    struct gltf_scene* scene, struct accessor const* a,
+    enum gpu_memory_category category, size_t* offset)
+{
+    *offset = 0;
+    if (a->view < 0 || a->sparse != 0) {
+        size_t bytes;
+        unsigned char* data = unpack_accessor(l, a, &bytes);
+        if (data == NULL) {
+            return 0;
+        }
+        unsigned int buffer = upload_unpacked(scene, data, bytes, category);
+        free(data);
+        return buffer;
+    }
+    *offset = a->offset;
+    return scene->buffers[a->view];
+}
+
+/* Upload the buffer views the meshes draw from, straight out of the mapped
+ * file. Views only images or sparse data use stay on the CPU.
+ */
+static void upload_views(struct gltf_loader const* l, struct gltf_scene* scene,
+    uint32_t mesh_count)
+{
+    struct json_document const* doc = &l->doc;
+    scene->buffer_count = l->view_count;
+    scene->buffers = calloc(l->view_count + 1, sizeof(unsigned int));
+
+    // GPU_MEMORY_CATEGORY_COUNT for views no mesh draws from
+    enum gpu_memory_category* used = calloc(l->view_count + 1,
+        sizeof(enum gpu_memory_category));
+    for (uint32_t i = 0; i < l->view_count; i++) {
+        used[i] = GPU_MEMORY_CATEGORY_COUNT;
+    }
+    for (uint32_t m = 0; m < mesh_count; m++) {
+        uint32_t primitives = json_object_get(doc, l->meshes[m], "primitives");
+        for (uint32_t p = 0; p < doc->values[primitives].child_count; p++) {
+            uint32_t primitive = json_array_get(doc, primitives, p);
+            uint32_t attributes = json_object_get(doc, primitive, "attributes");
+            int32_t accessors[] = {
+                json_get_int(doc, attributes, "POSITION", -1),
+                json_get_int(doc, attributes, "NORMAL", -1),
+                json_get_int(doc, attributes, "TEXCOORD_0", -1),
+                json_get_int(doc, primitive, "indices", -1)
+            };
+            for (int i = 0; i < 4; i++) {
+                struct accessor a;
+                if (accessors[i] >= 0
+                    && (uint32_t)accessors[i] < l->accessor_count
+                    && read_accessor(l, accessors[i], &a) && a.view >= 0
+                    && a.sparse == 0 && used[a.view] != GPU_MEMORY_VERTEX) {
+                    // Views that hold both count as vertex data
+                    used[a.view] = i == 3 ? GPU_MEMORY_INDEX
+                                          : GPU_MEMORY_VERTEX;
+                }
+            }
+        }
+    }
+
+    for (uint32_t i = 0; i < l->view_count; i++) {
+        if (used[i] == GPU_MEMORY_CATEGORY_COUNT) {
+            continue;
+        }
+        struct buffer_view const* view = &l->views[i];
+        scene->buffers[i] = gpu_buffer_create(used[i], "glTF buffer view");
+        // Neither array nor element buffer, the same view may be both
+        glBindBuffer(GL_COPY_WRITE_BUFFER, scene->buffers[i]);
+        gpu_buffer_data(scene->buffers[i], GL_COPY_WRITE_BUFFER, view->length,
+            l->buffers[view->buffer].data + view->offset, GL_STATIC_DRAW);
+    }
+    free(used);
+}
+
+static unsigned int load_image(struct gltf_loader* l, struct gltf_scene* scene,
+    int32_t image)
+{
+    if (image < 0 || (uint32_t)image >= l->image_count) {
+        return 0;
+    }
+    if (l->image_loaded[image]) {
+        return scene->textures[image];
+    }
+    l->image_loaded[image] = true;
+
+    // glTF texture coordinates start at the top row, so images are not
+    // flipped like the other textures
+    struct json_document const* doc = &l->doc;
+    uint32_t uri = json_object_get(doc, l->images[image], "uri");
+    int32_t view = json_get_int(doc, l->images[image], "bufferView", -1);
+    unsigned int texture = 0;
+    if (uri != 0 && doc->values[uri].type == JSON_STRING) {
+        struct json_value const* value = &doc->values[uri];
+        if (value->string_length >= 5
+            && memcmp(value->string, "data:", 5) == 0) {
+            struct blob blob = { 0 };
+            if (decode_data_uri(&blob, value->string, value->string_length)) {
+                texture = texture_load_memory(blob.data, blob.size, false);
+            }
+            blob_free(&blob);
+        } else {
+            char path[1024];
+            resolve_uri(path, sizeof(path), l->path, value->string,
+                value->string_length);
+            texture = texture_load(path, false);
+        }
+    } else if (view >= 0 && (uint32_t)view < l->view_count) {
+        texture = texture_load_memory(view_data(l, view, 0, 0),
+            l->views[view].length, false);
+    }
+    scene->textures[image] = texture;
+    return texture;
+}
+
+// Texture of a textureInfo member like "baseColorTexture", 0 if there is none
+static unsigned int material_texture(struct gltf_loader* l,
+    struct gltf_scene* scene, uint32_t object, char const* key)
+{
+    struct json_document const* doc = &l->doc;
+    uint32_t info = json_object_get(doc, object, key);
+    int32_t texture = json_get_int(doc, info, "index", -1);
+    if (texture < 0 || (uint32_t)texture >= l->texture_count) {
+        return 0;
+    }
+    return load_image(l, scene,
+        json_get_int(doc, l->textures[texture], "source", -1));
+}
+
+/* Phong exponent that gives about the same highlight as a microfacet
+ * roughness, from n = 2 / alpha^2 - 2 with alpha = roughness^2
+ */
+static float roughness_to_shininess(float roughness)
+{
+    float alpha = roughness * roughness;
+    float shininess = alpha > 0.0f ? 2.0f / (alpha * alpha) - 2.0f
+                                   : MAX_SHININESS;
+    return glm_clamp(shininess, MIN_SHININESS, MAX_SHININESS);
+}
+
+static void load_materials(struct gltf_loader* l, struct gltf_scene* scene)
+{
+    struct json_document const* doc = &l->doc;
+    scene->materials = calloc(scene->material_count + 1,
+        sizeof(struct gltf_material));
+    for (uint32_t i = 0; i < scene->material_count; i++) {
+        struct gltf_material* mat = &scene->materials[i];
+        uint32_t pbr = json_object_get(doc, l->materials[i],
+            "pbrMetallicRoughness");
+        uint32_t extensions = json_object_get(doc, l->materials[i],
+            "extensions");
+        uint32_t spec_gloss = json_object_get(doc, extensions,
+            "KHR_materials_pbrSpecularGlossiness");
+        uint32_t specular = json_object_get(doc, extensions,
+            "KHR_materials_specular");
+
+        float roughness;
+        if (spec_gloss != 0) {
+            // The older workflow has maps that match the shader directly
+            mat->diffuse_map = material_texture(l, scene, spec_gloss,
+                "diffuseTexture");
+            mat->specular_map = material_texture(l, scene, spec_gloss,
+                "specularGlossinessTexture");
+            roughness = 1.0f
+                - json_get_number(doc, spec_gloss, "glossinessFactor", 1.0);
+        } else {
+            mat->diffuse_map = material_texture(l, scene, pbr,
+                "baseColorTexture");
+            mat->specular_map = material_texture(l, scene, specular,
+                "specularColorTexture");
+            roughness = json_get_number(doc, pbr, "roughnessFactor", 1.0);
+        }
+        mat->shininess = roughness_to_shininess(roughness);
+    }
+}
+
+/* Point 'location' at an accessor. False when it is broken or has fewer
+ * than 'vertex_count' elements, the draw would read past it.
+ */
+static bool bind_attribute(struct gltf_loader const* l,
+    struct gltf_scene* scene, int32_t index, unsigned int location,
+    uint32_t vertex_count)
+{
+    struct accessor a;
+    if (!read_accessor(l, index, &a)) {
+        return false;
+    }
+    if (a.count < vertex_count) {
+        fprintf(stderr, "glTF: accessor %d has %u of %u vertices\n", index,
+            a.count, vertex_count);
+        return false;
+    }
+    size_t offset;
+    unsigned int buffer = accessor_buffer(l, scene, &a, GPU_MEMORY_VERTEX,
+        &offset);
+    if (buffer == 0) {
+        return false;
+    }
+    // Unpacked accessors are tightly packed, where stride 0 is right
+    size_t stride = a.view >= 0 && a.sparse == 0 ? l->views[a.view].stride : 0;
+
+    glBindBuffer(GL_ARRAY_BUFFER, buffer);
+    // GL takes every glTF component type as it is, integer ones are
+    // converted to float by the vertex fetch
+    glVertexAttribPointer(location, a.components, a.component_type,
+        a.normalized, stride, (void*)offset);
+    glEnableVertexAttribArray(location);
+    return true;
+}
+
+// False when any of 'count' indices 'stride' bytes apart is not a vertex
+static bool indices_in_range(unsigned char const* data, size_t stride,
+    uint32_t count, int size, uint32_t vertex_count)
+{
+    for (uint32_t i = 0; i < count; i++) {
+        if (read_index(data + i * stride, size) >= vertex_count) {
+            return false;
+        }
+    }
+    return true;
+}
+
+/* Bind the index accessor to the VAO. It is read once on the CPU, the GPU
+ * does not check indices and would fetch past the vertex buffers.
+ */
+static bool bind_indices(struct gltf_loader const* l, struct gltf_scene* scene,
+    int32_t index, uint32_t vertex_count, struct gltf_primitive* primitive)
+{
+    struct accessor a;
+    if (!read_accessor(l, index, &a)) {
+        return false;
+    }
+    if (a.components != 1 || !is_index_type(a.component_type)) {
+        fprintf(stderr, "glTF: accessor %d can not hold indices\n", index);
+        return false;
+    }
+    int size = component_size(a.component_type);
+    unsigned int buffer;
+    bool in_range;
+    if (a.view >= 0 && a.sparse == 0) {
+        in_range = indices_in_range(view_data(l, a.view, a.offset, 0),
+            accessor_stride(l, &a), a.count, size, vertex_count);
+        buffer = scene->buffers[a.view];
+        primitive->index_offset = a.offset;
+    } else {
+        size_t bytes;
+        unsigned char* data = unpack_accessor(l, &a, &bytes);
+        if (data == NULL) {
+            return false;
+        }
+        in_range = indices_in_range(data, size, a.count, size, vertex_count);
+        buffer = in_range
+            ? upload_unpacked(scene, data, bytes, GPU_MEMORY_INDEX)
+            : 0;
+        primitive->index_offset = 0;
+        free(data);
+    }
+    if (!in_range) {
+        fprintf(stderr, "glTF: accessor %d indexes past %u vertices\n", index,
+            vertex_count);
+        return false;
+    }
+    // The element buffer binding is part of the VAO state
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, buffer);
+    primitive->index_type = a.component_type;
+    primitive->count = a.count;
+    return true;
+}
+
+// 'count' numbers of a JSON array like "min", false if it has fewer
+static bool read_numbers(struct json_document const* doc, uint32_t array,
+    float* out, int count)
+{
+    if (array == 0 || doc->values[array].type != JSON_ARRAY) {
+        return false;
+    }
+    for (int i = 0; i < count; i++) {
+        uint32_t value = json_array_get(doc, array, i);
+        if (value == 0 || doc->values[value].type != JSON_NUMBER) {
+            return false;
+        }
+        out[i] = doc->values[value].number;
+    }
+    return true;
+}
+
+static bool load_primitive(struct gltf_loader const* l,
+    struct gltf_scene* scene, uint32_t value, struct gltf_primitive* primitive)
+{
+    struct json_document const* doc = &l->doc;
+    uint32_t attributes = json_object_get(doc, value, "attributes");
+    int32_t position = json_get_int(doc, attributes, "POSITION", -1);
+    int32_t normal = json_get_int(doc, attributes, "NORMAL", -1);
+    int32_t uv = json_get_int(doc, attributes, "TEXCOORD_0", -1);
+    int32_t indices = json_get_int(doc, value, "indices", -1);
+    int32_t mode = json_get_int(doc, value, "mode", GL_TRIANGLES);
+
+    struct accessor a;
+    if (!read_accessor(l, position, &a)) {
+        return false;
+    }
+    // glTF modes are the GL primitive types from points to triangle fans
+    if (mode < GL_POINTS || mode > GL_TRIANGLE_FAN) {
+        fprintf(stderr, "glTF: unsupported primitive mode %d\n", mode);
+        return false;
+    }
+    // POSITION has to have min and max, which saves a pass over the data
+    uint32_t min = json_object_get(doc, l->accessors[position], "min");
+    uint32_t max = json_object_get(doc, l->accessors[position], "max");
+    if (!read_numbers(doc, min, primitive->bounds_min, 3)
+        || !read_numbers(doc, max, primitive->bounds_max, 3)) {
+        fprintf(stderr, "glTF: accessor %d has no min and max\n", position);
+        return false;
+    }
+    primitive->mode = mode;
+    primitive->material = json_get_int(doc, value, "material", -1);
+    if (primitive->material >= (int32_t)scene->material_count) {
+        primitive->material = -1;
+    }
+    uint32_t vertex_count = a.count;
+    primitive->count = vertex_count;
+    primitive->has_normals = normal >= 0;
+
+    glGenVertexArrays(1, &primitive->VAO);
+    glBindVertexArray(primitive->VAO);
+    bool ok = bind_attribute(l, scene, position, POSITION_LOCATION,
+        vertex_count);
+    if (ok && normal >= 0) {
+        ok = bind_attribute(l, scene, normal, NORMAL_LOCATION, vertex_count);
+    }
+    if (ok && uv >= 0) {
+        ok = bind_attribute(l, scene, uv, UV_LOCATION, vertex_count);
+    }
+    if (ok && indices >= 0) {
+        ok = bind_indices(l, scene, indices, vertex_count, primitive);
+    }
+    glBindVertexArray(0);
+    return ok;
+}
+
+static bool load_meshes(struct gltf_loader* l, struct gltf_scene* scene)
+{
+    struct json_document const* doc = &l->doc;
+    scene->meshes = calloc(scene->mesh_count + 1, sizeof(struct gltf_mesh));
+
+    uint32_t total = 0;
+    for (uint32_t m = 0; m < scene->mesh_count; m++) {
+        uint32_t primitives = json_object_get(doc, l->meshes[m], "primitives");
+        total += doc->values[primitives].child_count;
+    }
+    scene->primitives = calloc(total + 1, sizeof(struct gltf_primitive));
+
+    for (uint32_t m = 0; m < scene->mesh_count; m++) {
+        uint32_t primitives = json_object_get(doc, l->meshes[m], "primitives");
+        struct gltf_mesh* mesh = &scene->meshes[m];
+        mesh->first_primitive = scene->primitive_count;
+        for (uint32_t p = 0; p < doc->values[primitives].child_count; p++) {
+            struct gltf_primitive* primitive
+                = &scene->primitives[scene->primitive_count++];
+            if (!load_primitive(l, scene, json_array_get(doc, primitives, p),
+                    primitive)) {
+                fprintf(stderr, "glTF: failed to load mesh %u\n", m);
+                return false;
+            }
+            mesh->primitive_count++;
+        }
+    }
+    return true;
+}
+
+static void node_local_matrix(struct json_document const* doc, uint32_t node,
+    mat4 local)
+{
+    uint32_t matrix = json_object_get(doc, node, "matrix");
+    if (matrix != 0 && doc->values[matrix].child_count == 16) {
+        // Column major like cglm
+        uint32_t value = matrix + 1;
+        for (int i = 0; i < 16; i++) {
+            local[i / 4][i % 4] = doc->values[value].number;
+            value = doc->values[value].end;
+        }
+        return;
+    }
+
+    vec3 translation = { 0.0f, 0.0f, 0.0f };
+    versor rotation = { 0.0f, 0.0f, 0.0f, 1.0f };
+    vec3 scale = { 1.0f, 1.0f, 1.0f };
+    uint32_t t = json_object_get(doc, node, "translation");
+    uint32_t r = json_object_get(doc, node, "rotation");
+    uint32_t s = json_object_get(doc, node, "scale");
+    for (int i = 0; i < 4; i++) {
+        if (i < 3 && json_array_get(doc, t, i) != 0) {
+            translation[i] = doc->values[json_array_get(doc, t, i)].number;
+        }
+        // glTF and cglm both store quaternions as x, y, z, w
+        if (json_array_get(doc, r, i) != 0) {
+            rotation[i] = doc->values[json_array_get(doc, r, i)].number;
+        }
+        if (i < 3 && json_array_get(doc, s, i) != 0) {
+            scale[i] = doc->values[json_array_get(doc, s, i)].number;
+        }
+    }
+    // T * R * S
+    glm_quat_mat4(rotation, local);
+    glm_scale(local, scale);
+    glm_vec3_copy(translation, local[3]);
+}
+
+/* Place the nodes of the default scene. Walks down from its roots so every
+ * parent's world matrix is known before its children need it.
+ */
+static void load_nodes(struct gltf_loader* l, struct gltf_scene* scene)
+{
+    struct json_document const* doc = &l->doc;
+    uint32_t count = scene->node_count;
+    scene->nodes = calloc(count + 1, sizeof(struct gltf_node));
+    scene->scene_nodes = malloc((count + 1) * sizeof(uint32_t));
+    for (uint32_t i = 0; i < count; i++) {
+        struct gltf_node* node = &scene->nodes[i];
+        node_local_matrix(doc, l->nodes[i], node->local);
+        node->mesh = json_get_int(doc, l->nodes[i], "mesh", -1);
+        if (node->mesh >= (int32_t)scene->mesh_count) {
+            node->mesh = -1;
+        }
+        node->parent = -1;
+    }
+
+    uint32_t scenes = json_object_get(doc, JSON_ROOT, "scenes");
+    uint32_t roots = json_object_get(doc,
+        json_array_get(doc, scenes, json_get_int(doc, JSON_ROOT, "scene", 0)),
+        "nodes");
+
+    // Breadth first, the output doubles as the queue of nodes to visit
+    uint32_t* queue = scene->scene_nodes;
+    uint32_t done = 0;
+    uint32_t top = 0;
+    bool* visited = calloc(count + 1, sizeof(bool));
+    uint32_t root_count = doc->values[roots].child_count;
+    for (uint32_t r = 0; r < root_count; r++) {
+        int32_t root = doc->values[json_array_get(doc, roots, r)].number;
+        if (root < 0 || (uint32_t)root >= count || visited[root]) {
+            continue;
+        }
+        visited[root] = true;
+        glm_mat4_copy(scene->nodes[root].local, scene->nodes[root].world);
+        queue[top++] = root;
+
+        while (done < top) {
+            uint32_t parent = queue[done++];
+            uint32_t children = json_object_get(doc, l->nodes[parent],
+                "children");
+            for (uint32_t c = 0; c < doc->values[children].child_count; c++) {
+                int32_t child
+                    = doc->values[json_array_get(doc, children, c)].number;
+                // A node can only have one parent, anything else is a
+                // broken file
+                if (child < 0 || (uint32_t)child >= count || visited[child]) {
+                    continue;
+                }
+                visited[child] = true;
+                struct gltf_node* node = &scene->nodes[child];
+                node->parent = parent;
+                glm_mat4_mul(scene->nodes[parent].world, node->local,
+                    node->world);
+                queue[top++] = child;
+            }
+        }
+    }
+    scene->scene_node_count = top;
+    free(visited);
+}
+
+static void loader_free(struct gltf_loader* l)
+{
+    for (uint32_t i = 0; i < l->buffer_count; i++) {
+        blob_free(&l->buffers[i]);
+    }
+    free(l->buffers);
+    free(l->views);
+    free(l->accessors);
+    free(l->images);
+    free(l->textures);
+    free(l->materials);
+    free(l->meshes);
+    free(l->nodes);
+    free(l->image_loaded);
+    json_free(&l->doc);
+    blob_free(&l->file);
+}
+
+bool gltf_load(struct gltf_scene* scene, char const* path)
+{
+    *scene = (struct gltf_scene) { 0 };
+    struct gltf_loader l = { .path = path };
+    if (!map_file(&l.file, path)) {
+        return false;
+    }
+
+    char const* json = (char const*)l.file.data;
+    size_t json_length = l.file.size;
+    uint32_t magic = 0;
+    memcpy(&magic, l.file.data, l.file.size < 4 ? l.file.size : 4);
+    if (magic == GLB_MAGIC) {
+        json = NULL;
+        if (!split_glb(&l, &json, &json_length)) {
+            loader_free(&l);
+            return false;
+        }
+    }
+    if (!json_parse(&l.doc, json, json_length)) {
+        fprintf(stderr, "glTF: failed to parse %s\n", path);
+        loader_free(&l);
+        return false;
+    }
+
+    l.accessors = index_array(&l.doc, "accessors", &l.accessor_count);
+    l.images = index_array(&l.doc, "images", &l.image_count);
+    l.textures = index_array(&l.doc, "textures", &l.texture_count);
+    l.materials = index_array(&l.doc, "materials", &scene->material_count);
+    l.meshes = index_array(&l.doc, "meshes", &scene->mesh_count);
+    l.nodes = index_array(&l.doc, "nodes", &scene->node_count);
+
+    if (!load_buffers(&l)) {
+        fprintf(stderr, "glTF: failed to load buffers of %s\n", path);
+        loader_free(&l);
+        gltf_free(scene);
+        return false;
+    }
+    upload_views(&l, scene, scene->mesh_count);
+
+    scene->texture_count = l.image_count;
+    scene->textures = calloc(l.image_count + 1, sizeof(unsigned int));
+    l.image_loaded = calloc(l.image_count + 1, sizeof(bool));
+    load_materials(&l, scene);
+
+    bool ok = load_meshes(&l, scene);
+    if (ok) {
+        load_nodes(&l, scene);
+    }
+    loader_free(&l);
+    if (!ok) {
+        gltf_free(scene);
+    }
+    return ok;
+}
+
+void gltf_free(struct gltf_scene* scene)
+{
+    for (uint32_t i = 0; i < scene->primitive_count; i++) {
+        glDeleteVertexArrays(1, &scene->primitives[i].VAO);
+    }
+    if (scene->buffer_count > 0) {
+        gpu_buffers_delete(scene->buffer_count, scene->buffers);
+    }
+    if (scene->unpacked_buffer_count > 0) {
+        gpu_buffers_delete(scene->unpacked_buffer_count,
+            scene->unpacked_buffers);
+    }
+    if (scene->texture_count > 0) {
+        gpu_textures_delete(scene->texture_count, scene->textures);
+    }
+    free(scene->buffers);
+    free(scene->unpacked_buffers);
+    free(scene->primitives);
+    free(scene->meshes);
+    free(scene->materials);
+    free(scene->textures);
+    free(scene->nodes);
+    free(scene->scene_nodes);
+    *scene = (struct gltf_scene) { 0 };
+}
+
+void gltf_draw(struct gltf_scene const* scene, struct shader* s,
+    mat4 transform, void (*bind_material)(void* data, int32_t material),
+    void* data)
+{
+    for (uint32_t n = 0; n < scene->scene_node_count; n++) {
+        struct gltf_node const* node = &scene->nodes[scene->scene_nodes[n]];
+        if (node->mesh < 0) {
+            continue;
+        }
+        mat4 model;
+        glm_mat4_mul(transform, (vec4*)node->world, model);
+        shader_set_mat4(s, "model", model);
+
+        struct gltf_mesh const* mesh = &scene->meshes[node->mesh];
+        for (uint32_t p = 0; p < mesh->primitive_count; p++) {
+            struct gltf_primitive const* primitive
+                = &scene->primitives[mesh->first_primitive + p];
+            if (bind_material != NULL) {
+                bind_material(data, primitive->material);
+            }
+            if (!primitive->has_normals) {
+                // Constant attribute instead of the missing array
+                glVertexAttrib3f(NORMAL_LOCATION, 0.0f, 1.0f, 0.0f);
+            }
+            glBindVertexArray(primitive->VAO);
+            if (primitive->index_type != 0) {
+                glDrawElements(primitive->mode, primitive->count,
+                    primitive->index_type, (void*)primitive->index_offset);
+            } else {
+                glDrawArrays(primitive->mode, 0, primitive->count);
+            }
+        }
+    }
+}
@@ -0,0 +1,86 @@
+#ifndef GLTF_LOADER_H
+#define GLTF_LOADER_H
+#include <cglm/cglm.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "shader.h"
+
+/* glTF materials mapped onto the Material struct of shader.fs. Maps are 0
+ * when the material has none.
+ */
+struct gltf_material {
+    unsigned int diffuse_map;
+    unsigned int specular_map;
+    float shininess;
+};
+
+// One draw call, its VAO points straight into the buffer view buffers
+struct gltf_primitive {
+    unsigned int VAO;
+    // GL primitive type, glTF uses the same values
+    unsigned int mode;
+    // Indices, or vertices when 'index_type' is 0
+    int32_t count;
+    unsigned int index_type;
+    size_t index_offset;
+    int32_t material;
+    bool has_normals;
+    vec3 bounds_min;
+    vec3 bounds_max;
+};
+
+struct gltf_mesh {
+    uint32_t first_primitive;
+    uint32_t primitive_count;
+};
+
+struct gltf_node {
+    mat4 local;
+    // Transform to the scene root, parents are applied
+    mat4 world;
+    int32_t parent;
+    int32_t mesh;
+};
+
+struct gltf_scene {
+    // One GL buffer per buffer view, 0 for views no geometry uses
+    unsigned int* buffers;
+    uint32_t buffer_count;
+    // Accessors that had to be unpacked, sparse ones or ones without a view
+    unsigned int* unpacked_buffers;
+    uint32_t unpacked_buffer_count;
+
+    struct gltf_primitive* primitives;
+    uint32_t primitive_count;
+    struct gltf_mesh* meshes;
+    uint32_t mesh_count;
+    struct gltf_material* materials;
+    uint32_t material_count;
+    // One texture per glTF image, shared by the materials
+    unsigned int* textures;
+    uint32_t texture_count;
+
+    struct gltf_node* nodes;
+    uint32_t node_count;
+    // Nodes of the default scene, parents before their children
+    uint32_t* scene_nodes;
+    uint32_t scene_node_count;
+};
+
+/* Load a .gltf file with its buffers and images, or a .glb file. Buffers are
+ * mapped and their views uploaded from the mapping as they are, so a large
+ * scene costs little more than reading it. Needs a current GL context.
+ */
+bool gltf_load(struct gltf_scene* scene, char const* path);
+void gltf_free(struct gltf_scene* scene);
+
+/* Draw every node of the scene placed with 'transform', setting the "model"
+ * uniform of 's' per node. 'bind_material' is called before every primitive
+ * if it is not NULL, with -1 for primitives that have no material.
+ */
+void gltf_draw(struct gltf_scene const* scene, struct shader* s,
+    mat4 transform, void (*bind_material)(void* data, int32_t material),
+    void* data);
+#endif
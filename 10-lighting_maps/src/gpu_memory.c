@@ -0,0 +1,316 @@
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "gpu_memory.h"
+
+// Leak reports cut longer labels off
+#define LABEL_LENGTH 48
+
+enum object_kind {
+    KIND_BUFFER,
+    KIND_TEXTURE,
+    KIND_RENDERBUFFER,
+    KIND_COUNT
+};
+
+static char const* const kind_names[KIND_COUNT] = {
+    "buffer",
+    "texture",
+    "renderbuffer"
+};
+
+static char const* const category_names[GPU_MEMORY_CATEGORY_COUNT] = {
+    "vertex",
+    "index",
+    "uniform",
+    "texture",
+    "render target"
+};
+
+struct tracked_object {
+    bool alive;
+    enum gpu_memory_category category;
+    size_t bytes;
+    // Of the first level of a texture, what the mipmaps are made from
+    size_t base_bytes;
+    char label[LABEL_LENGTH];
+};
+
+// Indexed by GL name, which drivers hand out small and mostly in order
+struct object_table {
+    struct tracked_object* objects;
+    unsigned int capacity;
+};
+
+static struct {
+    pthread_mutex_t lock;
+    struct object_table tables[KIND_COUNT];
+    struct gpu_memory_stats stats;
+} tracker = { .lock = PTHREAD_MUTEX_INITIALIZER };
+
+static void track(enum object_kind kind, unsigned int name,
+    enum gpu_memory_category category, char const* label)
+{
+    if (name == 0) {
+        return;
+    }
+    pthread_mutex_lock(&tracker.lock);
+    struct object_table* t = &tracker.tables[kind];
+    if (name >= t->capacity) {
+        unsigned int capacity = t->capacity ? t->capacity : 64;
+        while (capacity <= name) {
+            capacity *= 2;
+        }
+        t->objects = realloc(t->objects,
+            capacity * sizeof(struct tracked_object));
+        memset(t->objects + t->capacity, 0,
+            (capacity - t->capacity) * sizeof(struct tracked_object));
+        t->capacity = capacity;
+    }
+    struct tracked_object* o = &t->objects[name];
+    *o = (struct tracked_object) {
+        .alive = true,
+        .category = category
+    };
+    snprintf(o->label, sizeof(o->label), "%s", label);
+    tracker.stats.categories[category].objects++;
+    tracker.stats.total.objects++;
+    pthread_mutex_unlock(&tracker.lock);
+}
+
+// Call with the lock held. NULL for objects created without a wrapper
+static struct tracked_object* find(enum object_kind kind, unsigned int name)
+{
+    struct object_table* t = &tracker.tables[kind];
+    if (name == 0 || name >= t->capacity || !t->objects[name].alive) {
+        return NULL;
+    }
+    return &t->objects[name];
+}
+
+static void resize_usage(struct gpu_memory_usage* u, size_t old_bytes,
+    size_t bytes)
+{
+    u->bytes = u->bytes - old_bytes + bytes;
+    if (u->bytes > u->peak_bytes) {
+        u->peak_bytes = u->bytes;
+    }
+}
+
+// Call with the lock held
+static void set_bytes(struct tracked_object* o, size_t bytes)
+{
+    resize_usage(&tracker.stats.categories[o->category], o->bytes, bytes);
+    resize_usage(&tracker.stats.total, o->bytes, bytes);
+    o->bytes = bytes;
+}
+
+static void add_bytes(enum object_kind kind, unsigned int name, size_t bytes,
+    bool base_level)
+{
+    pthread_mutex_lock(&tracker.lock);
+    struct tracked_object* o = find(kind, name);
+    if (o != NULL) {
+        set_bytes(o, o->bytes + bytes);
+        if (base_level) {
+            o->base_bytes += bytes;
+        }
+    }
+    pthread_mutex_unlock(&tracker.lock);
+}
+
+static void untrack(enum object_kind kind, GLsizei count,
+    unsigned int const* names)
+{
+    pthread_mutex_lock(&tracker.lock);
+    for (GLsizei i = 0; i < count; i++) {
+        struct tracked_object* o = find(kind, names[i]);
+        if (o == NULL) {
+            continue;
+        }
+        set_bytes(o, 0);
+        tracker.stats.categories[o->category].objects--;
+        tracker.stats.total.objects--;
+        o->alive = false;
+    }
+    pthread_mutex_unlock(&tracker.lock);
+}
+
+unsigned int gpu_buffer_create(enum gpu_memory_category category,
+    char const* label)
+{
+    unsigned int buffer;
+    glGenBuffers(1, &buffer);
+    track(KIND_BUFFER, buffer, category, label);
+    return buffer;
+}
+
+void gpu_buffer_data(unsigned int buffer, GLenum target, size_t size,
+    void const* data, GLenum usage)
+{
+    glBufferData(target, size, data, usage);
+    // New storage replaces the old
+    pthread_mutex_lock(&tracker.lock);
+    struct tracked_object* o = find(KIND_BUFFER, buffer);
+    if (o != NULL) {
+        set_bytes(o, size);
+    }
+    pthread_mutex_unlock(&tracker.lock);
+}
+
+void gpu_buffers_delete(GLsizei count, unsigned int const* buffers)
+{
+    untrack(KIND_BUFFER, count, buffers);
+    glDeleteBuffers(count, buffers);
+}
+
+unsigned int gpu_texture_create(enum gpu_memory_category category,
+    char const* label)
+{
+    unsigned int texture;
+    glGenTextures(1, &texture);
+    track(KIND_TEXTURE, texture, category, label);
+    return texture;
+}
+
+void gpu_texture_image_2d(unsigned int texture, GLenum target, GLint level,
+    GLenum internal_format, GLsizei width, GLsizei height, GLenum format,
+    GLenum type, void const* data)
+{
+    glTexImage2D(target, level, internal_format, width, height, 0, format,
+        type, data);
+    add_bytes(KIND_TEXTURE, texture,
+        (size_t)width * height * gpu_memory_format_bytes(internal_format),
+        level == 0);
+}
+
+void gpu_texture_image_3d(unsigned int texture, GLenum target, GLint level,
+    GLenum internal_format, GLsizei width, GLsizei height, GLsizei depth,
+    GLenum format, GLenum type, void const* data)
+{
+    glTexImage3D(target, level, internal_format, width, height, depth, 0,
+        format, type, data);
+    add_bytes(KIND_TEXTURE, texture,
+        (size_t)width * height * depth
+            * gpu_memory_format_bytes(internal_format),
+        level == 0);
+}
+
+void gpu_texture_mipmaps(unsigned int texture, GLenum target)
+{
+    glGenerateMipmap(target);
+    pthread_mutex_lock(&tracker.lock);
+    struct tracked_object* o = find(KIND_TEXTURE, texture);
+    if (o != NULL) {
+        set_bytes(o, o->bytes + o->base_bytes / 3);
+    }
+    pthread_mutex_unlock(&tracker.lock);
+}
+
+void gpu_textures_delete(GLsizei count, unsigned int const* textures)
+{
+    untrack(KIND_TEXTURE, count, textures);
+    glDeleteTextures(count, textures);
+}
+
+unsigned int gpu_renderbuffer_create(enum gpu_memory_category category,
+    char const* label)
+{
+    unsigned int renderbuffer;
+    glGenRenderbuffers(1, &renderbuffer);
+    track(KIND_RENDERBUFFER, renderbuffer, category, label);
+    return renderbuffer;
+}
+
+void gpu_renderbuffer_storage(unsigned int renderbuffer,
+    GLenum internal_format, GLsizei width, GLsizei height)
+{
+    glRenderbufferStorage(GL_RENDERBUFFER, internal_format, width, height);
+    pthread_mutex_lock(&tracker.lock);
+    struct tracked_object* o = find(KIND_RENDERBUFFER, renderbuffer);
+    if (o != NULL) {
+        set_bytes(o,
+            (size_t)width * height * gpu_memory_format_bytes(internal_format));
+    }
+    pthread_mutex_unlock(&tracker.lock);
+}
+
+void gpu_renderbuffers_delete(GLsizei count,
+    unsigned int const* renderbuffers)
+{
+    untrack(KIND_RENDERBUFFER, count, renderbuffers);
+    glDeleteRenderbuffers(count, renderbuffers);
+}
+
+size_t gpu_memory_format_bytes(GLenum internal_format)
+{
+    switch (internal_format) {
+    case GL_RGBA32F:
+        return 16;
+    case GL_RGB32F:
+        return 12;
+    case GL_RGBA16F:
+    case GL_RGB16F:
+    case GL_RG32F:
+        return 8;
+    case GL_R16F:
+    case GL_RG8:
+    case GL_RG:
+    case GL_DEPTH_COMPONENT16:
+        return 2;
+    case GL_R8:
+    case GL_RED:
+        return 1;
+    default:
+        // GL_RGBA8, GL_R11F_G11F_B10F, GL_RGB10_A2, GL_R32F, depth and
+        // stencil, and GL_RGB, which drivers pad to four bytes
+        return 4;
+    }
+}
+
+char const* gpu_memory_category_name(enum gpu_memory_category category)
+{
+    return category_names[category];
+}
+
+struct gpu_memory_stats gpu_memory_report(void)
+{
+    pthread_mutex_lock(&tracker.lock);
+    struct gpu_memory_stats stats = tracker.stats;
+    pthread_mutex_unlock(&tracker.lock);
+    return stats;
+}
+
+uint32_t gpu_memory_shutdown(void)
+{
+    pthread_mutex_lock(&tracker.lock);
+    uint32_t leaks = 0;
+    size_t leaked_bytes = 0;
+    for (int k = 0; k < KIND_COUNT; k++) {
+        struct object_table* t = &tracker.tables[k];
+        for (unsigned int name = 0; name < t->capacity; name++) {
+            struct tracked_object const* o = &t->objects[name];
+            if (!o->alive) {
+                continue;
+            }
+            fprintf(stderr, "gpu_memory: %s %u \"%s\" (%s, %zu bytes) was"
+                            " never deleted\n",
+                kind_names[k], name, o->label, category_names[o->category],
+                o->bytes);
+            leaks++;
+            leaked_bytes += o->bytes;
+        }
+        free(t->objects);
+    }
+    if (leaks > 0) {
+        fprintf(stderr, "gpu_memory: %u objects, %zu bytes leaked\n", leaks,
+            leaked_bytes);
+    }
+    memset(tracker.tables, 0, sizeof(tracker.tables));
+    memset(&tracker.stats, 0, sizeof(tracker.stats));
+    pthread_mutex_unlock(&tracker.lock);
+    return leaks;
+}
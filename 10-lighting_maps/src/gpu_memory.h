@@ -0,0 +1,85 @@
+#ifndef GPU_MEMORY_H
+#define GPU_MEMORY_H
+#include <glad/glad.h>
+#include <stddef.h>
+#include <stdint.h>
+
+enum gpu_memory_category {
+    GPU_MEMORY_VERTEX,
+    GPU_MEMORY_INDEX,
+    GPU_MEMORY_UNIFORM,
+    // Images loaded from files
+    GPU_MEMORY_TEXTURE,
+    // Textures and renderbuffers drawn into, shadow maps included
+    GPU_MEMORY_RENDER_TARGET,
+    GPU_MEMORY_CATEGORY_COUNT
+};
+
+struct gpu_memory_usage {
+    size_t bytes;
+    size_t peak_bytes;
+    uint32_t objects;
+};
+
+struct gpu_memory_stats {
+    struct gpu_memory_usage categories[GPU_MEMORY_CATEGORY_COUNT];
+    struct gpu_memory_usage total;
+};
+
+/* Buffers, textures and renderbuffers created through these are counted with
+ * the bytes their storage takes, an estimate where the driver pads or
+ * compresses. Objects can be created and deleted on any thread, like the
+ * upload thread, as long as its context shares with the others.
+ *
+ * Each texture image is specified once, re-specifying an image counts it
+ * again. Deleting through glDelete* directly leaves the object counted and
+ * shows up in gpu_memory_shutdown.
+ */
+unsigned int gpu_buffer_create(enum gpu_memory_category category,
+    char const* label);
+
+// glBufferData for 'buffer', which has to be bound to 'target'
+void gpu_buffer_data(unsigned int buffer, GLenum target, size_t size,
+    void const* data, GLenum usage);
+
+void gpu_buffers_delete(GLsizei count, unsigned int const* buffers);
+
+unsigned int gpu_texture_create(enum gpu_memory_category category,
+    char const* label);
+
+// glTexImage2D for 'texture', which has to be bound
+void gpu_texture_image_2d(unsigned int texture, GLenum target, GLint level,
+    GLenum internal_format, GLsizei width, GLsizei height, GLenum format,
+    GLenum type, void const* data);
+
+void gpu_texture_image_3d(unsigned int texture, GLenum target, GLint level,
+    GLenum internal_format, GLsizei width, GLsizei height, GLsizei depth,
+    GLenum format, GLenum type, void const* data);
+
+// glGenerateMipmap, the chain adds a third of the first level
+void gpu_texture_mipmaps(unsigned int texture, GLenum target);
+
+void gpu_textures_delete(GLsizei count, unsigned int const* textures);
+
+unsigned int gpu_renderbuffer_create(enum gpu_memory_category category,
+    char const* label);
+
+// glRenderbufferStorage for 'renderbuffer', which has to be bound
+void gpu_renderbuffer_storage(unsigned int renderbuffer,
+    GLenum internal_format, GLsizei width, GLsizei height);
+
+void gpu_renderbuffers_delete(GLsizei count,
+    unsigned int const* renderbuffers);
+
+// Bytes a pixel of 'internal_format' takes, 4 for formats not listed
+size_t gpu_memory_format_bytes(GLenum internal_format);
+
+char const* gpu_memory_category_name(enum gpu_memory_category category);
+
+struct gpu_memory_stats gpu_memory_report(void);
+
+/* Print every object that was never deleted to stderr and forget them all.
+ * Returns how many there were. Call at exit, after everything was freed.
+ */
+uint32_t gpu_memory_shutdown(void);
+#endif
@@ -0,0 +1,307 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "json.h"
+
+// Deeper documents are rejected instead of overflowing the stack
+#define MAX_DEPTH 64
+
+struct json_parser {
+    struct json_document* doc;
+    char const* begin;
+    char const* p;
+    char const* end;
+    bool failed;
+};
+
+static void fail(struct json_parser* parser, char const* what)
+{
+    if (!parser->failed) {
+        fprintf(stderr, "JSON: %s at offset %ld\n", what,
+            (long)(parser->p - parser->begin));
+    }
+    parser->failed = true;
+}
+
+static void skip_whitespace(struct json_parser* parser)
+{
+    while (parser->p < parser->end
+        && (*parser->p == ' ' || *parser->p == '\t' || *parser->p == '\n'
+            || *parser->p == '\r')) {
+        parser->p++;
+    }
+}
+
+// Append a value and return its index, values move when the array grows
+static uint32_t add_value(struct json_parser* parser, enum json_type type)
+{
+    struct json_document* doc = parser->doc;
+    if (doc->count == doc->capacity) {
+        uint32_t capacity = doc->capacity ? doc->capacity * 2 : 256;
+        struct json_value* values = realloc(doc->values,
+            capacity * sizeof(struct json_value));
+        if (values == NULL) {
+            fail(parser, "out of memory");
+            return 0;
+        }
+        doc->values = values;
+        doc->capacity = capacity;
+    }
+    uint32_t index = doc->count++;
+    doc->values[index] = (struct json_value) { .type = type };
+    return index;
+}
+
+static void add_leaf(struct json_parser* parser, enum json_type type)
+{
+    uint32_t index = add_value(parser, type);
+    if (!parser->failed) {
+        parser->doc->values[index].end = index + 1;
+    }
+}
+
+static void parse_string(struct json_parser* parser)
+{
+    // Skip the opening quote
+    char const* start = ++parser->p;
+    while (parser->p < parser->end && *parser->p != '"') {
+        if (*parser->p == '\\') {
+            parser->p++;
+        }
+        parser->p++;
+    }
+    if (parser->p >= parser->end) {
+        fail(parser, "unterminated string");
+        return;
+    }
+    uint32_t index = add_value(parser, JSON_STRING);
+    if (parser->failed) {
+        return;
+    }
+    parser->doc->values[index].string = start;
+    parser->doc->values[index].string_length = (uint32_t)(parser->p - start);
+    parser->doc->values[index].end = index + 1;
+    parser->p++;
+}
+
+static bool match_literal(struct json_parser* parser, char const* literal)
+{
+    size_t length = strlen(literal);
+    if ((size_t)(parser->end - parser->p) < length
+        || memcmp(parser->p, literal, length) != 0) {
+        fail(parser, "unexpected character");
+        return false;
+    }
+    parser->p += length;
+    return true;
+}
+
+static void parse_number(struct json_parser* parser)
+{
+    // strtod needs a terminated string and the text is not, numbers are short
+    // so copy it out first
+    char buffer[64];
+    size_t length = 0;
+    while (parser->p + length < parser->end && length < sizeof(buffer) - 1
+        && strchr("+-.eE0123456789", parser->p[length]) != NULL) {
+        length++;
+    }
+    memcpy(buffer, parser->p, length);
+    buffer[length] = '\0';
+
+    char* number_end;
+    double number = strtod(buffer, &number_end);
+    if (length == 0 || number_end != buffer + length) {
+        fail(parser, "bad number");
+        return;
+    }
+    parser->p += length;
+
+    uint32_t index = add_value(parser, JSON_NUMBER);
+    if (!parser->failed) {
+        parser->doc->values[index].number = number;
+        parser->doc->values[index].end = index + 1;
+    }
+}
+
+static void parse_value(struct json_parser* parser, int depth);
+
+// Arrays and objects, objects parse a key string before every element
+static void parse_container(struct json_parser* parser, int depth,
+    enum json_type type)
+{
+    char close = type == JSON_OBJECT ? '}' : ']';
+    uint32_t index = add_value(parser, type);
+    uint32_t child_count = 0;
+    parser->p++;
+
+    skip_whitespace(parser);
+    if (parser->p < parser->end && *parser->p == close) {
+        parser->p++;
+    } else {
+        while (!parser->failed) {
+            skip_whitespace(parser);
+            if (type == JSON_OBJECT) {
+                if (parser->p >= parser->end || *parser->p != '"') {
+                    fail(parser, "expected a key");
+                    break;
+                }
+                parse_string(parser);
+                skip_whitespace(parser);
+                if (parser->p >= parser->end || *parser->p != ':') {
+                    fail(parser, "expected ':'");
+                    break;
+                }
+                parser->p++;
+            }
+            parse_value(parser, depth + 1);
+            child_count++;
+
+            skip_whitespace(parser);
+            if (parser->p < parser->end && *parser->p == ',') {
+                parser->p++;
+            } else if (parser->p < parser->end && *parser->p == close) {
+                parser->p++;
+                break;
+            } else {
+                fail(parser, "expected ',' or end of container");
+            }
+        }
+    }
+    if (!parser->failed) {
+        parser->doc->values[index].child_count = child_count;
+        parser->doc->values[index].end = parser->doc->count;
+    }
+}
+
+static void parse_value(struct json_parser* parser, int depth)
+{
+    if (depth > MAX_DEPTH) {
+        fail(parser, "nested too deeply");
+        return;
+    }
+    skip_whitespace(parser);
+    if (parser->p >= parser->end) {
+        fail(parser, "unexpected end");
+        return;
+    }
+
+    switch (*parser->p) {
+    case '{':
+        parse_container(parser, depth, JSON_OBJECT);
+        break;
+    case '[':
+        parse_container(parser, depth, JSON_ARRAY);
+        break;
+    case '"':
+        parse_string(parser);
+        break;
+    case 't':
+        if (match_literal(parser, "true")) {
+            add_leaf(parser, JSON_TRUE);
+        }
+        break;
+    case 'f':
+        if (match_literal(parser, "false")) {
+            add_leaf(parser, JSON_FALSE);
+        }
+        break;
+    case 'n':
+        if (match_literal(parser, "null")) {
+            add_leaf(parser, JSON_NULL);
+        }
+        break;
+    default:
+        parse_number(parser);
+        break;
+    }
+}
+
+bool json_parse(struct json_document* doc, char const* text, size_t length)
+{
+    *doc = (struct json_document) { 0 };
+    struct json_parser parser = {
+        .doc = doc,
+        .begin = text,
+        .p = text,
+        .end = text + length
+    };
+    add_leaf(&parser, JSON_NULL);
+    parse_value(&parser, 0);
+    skip_whitespace(&parser);
+    // GLB pads the JSON chunk with spaces, anything else is an error
+    if (!parser.failed && parser.p != parser.end && *parser.p != '\0') {
+        fail(&parser, "trailing characters");
+    }
+    if (parser.failed) {
+        json_free(doc);
+        return false;
+    }
+    return true;
+}
+
+void json_free(struct json_document* doc)
+{
+    free(doc->values);
+    *doc = (struct json_document) { 0 };
+}
+
+uint32_t json_object_get(struct json_document const* doc, uint32_t object,
+    char const* key)
+{
+    if (object >= doc->count || doc->values[object].type != JSON_OBJECT) {
+        return 0;
+    }
+    // Members are key, value pairs, hop over each value's subtree
+    uint32_t i = object + 1;
+    while (i < doc->values[object].end) {
+        uint32_t value = i + 1;
+        if (json_string_equals(doc, i, key)) {
+            return value;
+        }
+        i = doc->values[value].end;
+    }
+    return 0;
+}
+
+uint32_t json_array_get(struct json_document const* doc, uint32_t array,
+    uint32_t n)
+{
+    if (array >= doc->count || doc->values[array].type != JSON_ARRAY
+        || n >= doc->values[array].child_count) {
+        return 0;
+    }
+    uint32_t i = array + 1;
+    while (n-- > 0) {
+        i = doc->values[i].end;
+    }
+    return i;
+}
+
+double json_get_number(struct json_document const* doc, uint32_t object,
+    char const* key, double fallback)
+{
+    uint32_t value = json_object_get(doc, object, key);
+    if (value == 0 || doc->values[value].type != JSON_NUMBER) {
+        return fallback;
+    }
+    return doc->values[value].number;
+}
+
+int32_t json_get_int(struct json_document const* doc, uint32_t object,
+    char const* key, int32_t fallback)
+{
+    return (int32_t)json_get_number(doc, object, key, fallback);
+}
+
+bool json_string_equals(struct json_document const* doc, uint32_t value,
+    char const* string)
+{
+    if (value >= doc->count || doc->values[value].type != JSON_STRING) {
+        return false;
+    }
+    size_t length = strlen(string);
+    return doc->values[value].string_length == length
+        && memcmp(doc->values[value].string, string, length) == 0;
+}
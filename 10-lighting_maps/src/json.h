@@ -0,0 +1,69 @@
+#ifndef JSON_H
+#define JSON_H
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+enum json_type {
+    JSON_NULL,
+    JSON_FALSE,
+    JSON_TRUE,
+    JSON_NUMBER,
+    JSON_STRING,
+    JSON_ARRAY,
+    JSON_OBJECT
+};
+
+// Index of the top level value, index 0 is a null that stands for "missing"
+#define JSON_ROOT 1
+
+/* One value in a parsed document. Values are stored in document order, the
+ * children of an array or object follow it directly and 'end' is the index
+ * just past its last descendant. Objects store each key as a string value
+ * right before its value.
+ */
+struct json_value {
+    enum json_type type;
+    // Number of elements, or of key/value pairs for objects
+    uint32_t child_count;
+    uint32_t end;
+    // Strings point into the source text, escapes are not decoded
+    char const* string;
+    uint32_t string_length;
+    double number;
+};
+
+struct json_document {
+    struct json_value* values;
+    uint32_t count;
+    uint32_t capacity;
+};
+
+/* Parse 'length' bytes of JSON text. The text must stay alive while the
+ * document is used. Returns false and prints where on a syntax error.
+ */
+bool json_parse(struct json_document* doc, char const* text, size_t length);
+void json_free(struct json_document* doc);
+
+/* Lookups return 0 when something is missing and accept 0 as input, so they
+ * can be chained without checking every step.
+ */
+
+// Index of the value of 'key' in the object at 'object', 0 if there is none
+uint32_t json_object_get(struct json_document const* doc, uint32_t object,
+    char const* key);
+
+// Index of element 'n' of the array at 'array', 0 if out of range
+uint32_t json_array_get(struct json_document const* doc, uint32_t array,
+    uint32_t n);
+
+/* Convenience getters for object members, returning 'fallback' when the key
+ * is missing or has another type
+ */
+double json_get_number(struct json_document const* doc, uint32_t object,
+    char const* key, double fallback);
+int32_t json_get_int(struct json_document const* doc, uint32_t object,
+    char const* key, int32_t fallback);
+bool json_string_equals(struct json_document const* doc, uint32_t value,
+    char const* string);
+#endif
@@ -2,76 +2,1106 @@
 // Glad needs to be before GLFW
 #include <GLFW/glfw3.h>
 
-#define STB_IMAGE_IMPLEMENTATION
-#include "stb_image.h"
-
 #include "cglm/cglm.h"
 
+#include "allocator.h"
+#include "bench.h"
 #include "camera.h"
+#include "camera_path.h"
+#include "command_buffer.h"
+#include "cull.h"
+#include "dynamic_resolution.h"
+#include "frame_pacer.h"
+#include "gltf_loader.h"
+#include "gpu_memory.h"
+#include "math_batch.h"
+#include "masked_occlusion.h"
+#include "material_table.h"
+#include "math_dispatch.h"
+#include "mesh.h"
+#include "mesh_lod.h"
+#include "obj_loader.h"
+#include "occlusion.h"
+#include "post.h"
+#include "render_graph.h"
+#include "render_target.h"
 #include "shader.h"
+#include "shadow.h"
+#include "texture.h"
+#include "texture_atlas.h"
+#include "thread_pool.h"
+#include "triple_buffer.h"
+#include "upload.h"
+#include "vertex_format.h"
 
 #include <math.h>
 #include <stdbool.h>
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
 
 #define WINDOW_WIDTH 800
 #define WINDOW_HEIGHT 600
 #define NUM_CUBES 1
 
+// Screen space error a mesh level of detail may have, in pixels
+#define MESH_LOD_PIXEL_ERROR 1.0f
+
+// Nearest copies of the mesh that occlude the others in CPU occlusion culling
+#define MESH_OCCLUDER_COUNT 16
+
+// Fewer visible copies of the mesh than this are drawn without recording
+#define MESH_RECORD_MIN_INSTANCES 256
+
+// Texture units of the shadow maps, 0 and 1 are the material's
+#define POINT_SHADOW_UNIT 2
+#define SUN_SHADOW_UNIT 3
+// Texture units of the material atlas and table, with --texture-atlas
+#define ATLAS_UNIT 4
+#define MATERIAL_TABLE_UNIT 5
+
+// Playback renders every frame as if it took exactly this long
+#define PLAYBACK_TIME_STEP (1.0f / 60.0f)
+
+// Ticks a second of the main thread, each hands the render thread a snapshot
+#define SIMULATION_RATE 500.0
+
+// Keys a second a recorded camera path gets, the spline fills in between
+#define CAMERA_RECORD_RATE 30.0f
+
+// Scratch memory of each of the two frames the render thread alternates
+#define FRAME_ARENA_SIZE (8u * 1024 * 1024)
+
+enum camera_mode {
+    CAMERA_LIVE,
+    CAMERA_RECORD,
+    CAMERA_PLAYBACK
+};
+
+// Uniforms of the scene shader that draws are recorded with
+enum scene_uniform {
+    SCENE_UNIFORM_MODEL,
+    SCENE_UNIFORM_COUNT
+};
+
+static char const* const scene_uniform_names[SCENE_UNIFORM_COUNT] = {
+    "model"
+};
+
+enum occlusion_mode {
+    OCCLUSION_OFF,
+    // Queries on the GPU, see occlusion.h
+    OCCLUSION_GPU,
+    // Rasterized on the CPU, see masked_occlusion.h
+    OCCLUSION_CPU
+};
+
 struct camera cam;
+enum camera_mode camera_mode = CAMERA_LIVE;
+// The light stops where it is, which lets its shadows be cached
+bool light_paused = false;
 
 struct vao_and_vbo {
     unsigned int VAO;
     unsigned int VBO;
 };
 
-unsigned int load_texture(char const* path)
+// Every map of a mesh's materials in one texture array, for --texture-atlas
+struct mesh_atlas {
+    struct texture_atlas atlas;
+    uint32_t material_count;
+    // Indexed by material, the last for submeshes without one
+    struct material_table materials;
+    // The mesh's vertex array with the material of each vertex and the per
+    // copy offsets of shader.vs
+    unsigned int VAO;
+    unsigned int material_buffer;
+    unsigned int instance_buffer;
+    // Instanced draws of the last frame
+    uint32_t draws;
+};
+
+// Textures for each material of a loaded mesh
+struct mesh_textures {
+    unsigned int* diffuse;
+    unsigned int* specular;
+    unsigned int fallback_diffuse;
+    unsigned int fallback_specular;
+    // Holds the maps instead of the arrays above with --texture-atlas
+    struct mesh_atlas* atlas;
+};
+
+/* Load the maps of every material, missing ones use the fallback textures.
+ * With 'uploads' the maps load in the background and the fallbacks stand in
+ * until they are there.
+ */
+struct mesh_textures load_mesh_textures(struct mesh const* m,
+    unsigned int fallback_diffuse, unsigned int fallback_specular,
+    struct upload_queue* uploads)
 {
-    stbi_set_flip_vertically_on_load(true);
+    struct mesh_textures t = {
+        .diffuse = calloc(m->material_count + 1, sizeof(unsigned int)),
+        .specular = calloc(m->material_count + 1, sizeof(unsigned int)),
+        .fallback_diffuse = fallback_diffuse,
+        .fallback_specular = fallback_specular
+    };
+    for (uint32_t i = 0; i < m->material_count; i++) {
+        struct mesh_material const* mat = &m->materials[i];
+        if (uploads != NULL) {
+            if (mat->diffuse_map[0]) {
+                upload_texture(uploads, mat->diffuse_map, true, &t.diffuse[i]);
+            }
+            if (mat->specular_map[0]) {
+                upload_texture(uploads, mat->specular_map, true,
+                    &t.specular[i]);
+            }
+            continue;
+        }
+        t.diffuse[i] = mat->diffuse_map[0]
+            ? texture_load(mat->diffuse_map, true)
+            : 0;
+        t.specular[i] = mat->specular_map[0]
+            ? texture_load(mat->specular_map, true)
+            : 0;
+    }
+    return t;
+}
 
-    int width;
+// The images load_mesh_atlas decodes on the pool
+struct atlas_images {
+    char const** paths;
+    struct texture_image* images;
+};
+
+void decode_atlas_image(void* data, unsigned int i)
+{
+    struct atlas_images* a = data;
+    texture_decode(a->paths[i], true, &a->images[i]);
+}
+
+/* Index of 'path' in 'paths', appending it if it is not there. Materials
+ * often share maps, each is packed once.
+ */
+uint32_t add_atlas_path(char const** paths, uint32_t* count, char const* path)
+{
+    for (uint32_t i = 0; i < *count; i++) {
+        if (strcmp(paths[i], path) == 0) {
+            return i;
+        }
+    }
+    paths[*count] = path;
+    return (*count)++;
+}
+
+/* Pack the maps of every material, decoded on 'pool', into an atlas and put
+ * the materials in a table. 'vertex_materials' are the table rows of the
+ * mesh's vertices, see mesh_split_vertex_materials. The container maps stand
+ * in for missing maps and maps that fail to load. False when there is no
+ * atlas, the maps have to be loaded one by one then.
+ */
+bool load_mesh_atlas(struct mesh_atlas* a, struct mesh const* m,
+    struct mesh_buffers const* buffers, uint32_t const* vertex_materials,
+    struct thread_pool* pool)
+{
+    memset(a, 0, sizeof(*a));
+    char const** paths = calloc(2 * m->material_count + 2,
+        sizeof(char const*));
+    uint32_t* diffuse = calloc(m->material_count + 1, sizeof(uint32_t));
+    uint32_t* specular = calloc(m->material_count + 1, sizeof(uint32_t));
+    uint32_t count = 0;
+    diffuse[m->material_count] = add_atlas_path(paths, &count,
+        "../src/container2.png");
+    specular[m->material_count] = add_atlas_path(paths, &count,
+        "../src/container2_specular.png");
+    for (uint32_t i = 0; i < m->material_count; i++) {
+        struct mesh_material const* mat = &m->materials[i];
+        diffuse[i] = mat->diffuse_map[0]
+            ? add_atlas_path(paths, &count, mat->diffuse_map)
+            : diffuse[m->material_count];
+        specular[i] = mat->specular_map[0]
+            ? add_atlas_path(paths, &count, mat->specular_map)
+            : specular[m->material_count];
+    }
+
+    struct texture_image* images = calloc(count, sizeof(struct texture_image));
+    struct atlas_images decode = { paths, images };
+    thread_pool_for(pool, count, decode_atlas_image, &decode);
+    struct atlas_entry* entries = calloc(count, sizeof(struct atlas_entry));
+    bool ok = images[0].data != NULL && images[1].data != NULL
+        && texture_atlas_build(&a->atlas, images, count, "material atlas",
+            entries);
+    struct material_table_entry* table = NULL;
+    if (ok) {
+        a->material_count = m->material_count;
+        table = calloc(m->material_count + 1,
+            sizeof(struct material_table_entry));
+        for (uint32_t i = 0; i <= m->material_count; i++) {
+            uint32_t d = images[diffuse[i]].data != NULL
+                ? diffuse[i]
+                : diffuse[m->material_count];
+            uint32_t sp = images[specular[i]].data != NULL
+                ? specular[i]
+                : specular[m->material_count];
+            memcpy(table[i].diffuse_rect, entries[d].rect,
+                sizeof(table[i].diffuse_rect));
+            memcpy(table[i].specular_rect, entries[sp].rect,
+                sizeof(table[i].specular_rect));
+            table[i].diffuse_layer = entries[d].layer;
+            table[i].specular_layer = entries[sp].layer;
+            table[i].shininess = i < m->material_count
+                ? m->materials[i].shininess
+                : 32.0f;
+        }
+        ok = material_table_init(&a->materials, table, m->material_count + 1,
+            "mesh materials");
+        if (!ok) {
+            texture_atlas_free(&a->atlas);
+        }
+    }
+    free(table);
+    for (uint32_t i = 0; i < count; i++) {
+        texture_image_free(&images[i]);
+    }
+    free(entries);
+    free(images);
+    free(paths);
+    free(diffuse);
+    free(specular);
+    if (!ok) {
+        return false;
+    }
+
+    // The attribute pointers move to each draw's first copy
+    glGenVertexArrays(1, &a->VAO);
+    glBindVertexArray(a->VAO);
+    glBindBuffer(GL_ARRAY_BUFFER, buffers->VBO);
+    vertex_format_setup(buffers->format);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, buffers->EBO);
+    a->material_buffer = gpu_buffer_create(GPU_MEMORY_VERTEX,
+        "mesh vertex materials");
+    glBindBuffer(GL_ARRAY_BUFFER, a->material_buffer);
+    gpu_buffer_data(a->material_buffer, GL_ARRAY_BUFFER,
+        m->vertex_count * sizeof(uint32_t), vertex_materials, GL_STATIC_DRAW);
+    glVertexAttribIPointer(4, 1, GL_UNSIGNED_INT, 0, (void*)0);
+    glEnableVertexAttribArray(4);
+    a->instance_buffer = gpu_buffer_create(GPU_MEMORY_VERTEX, "mesh copies");
+    glEnableVertexAttribArray(3);
+    glVertexAttribDivisor(3, 1);
+    glBindVertexArray(0);
+    printf("Texture atlas: %u maps in %u layers of %dx%d, %u of them"
+           " shared, %u materials\n",
+        count, a->atlas.layer_count, a->atlas.size, a->atlas.size,
+        a->atlas.layer_count - a->atlas.single_layers, a->materials.count);
+    return true;
+}
+
+void free_mesh_atlas(struct mesh_atlas* a)
+{
+    texture_atlas_free(&a->atlas);
+    material_table_free(&a->materials);
+    glDeleteVertexArrays(1, &a->VAO);
+    gpu_buffers_delete(1, &a->material_buffer);
+    gpu_buffers_delete(1, &a->instance_buffer);
+    memset(a, 0, sizeof(*a));
+}
+
+// Row of 'material' in the material table, the container's where it has none
+uint32_t mesh_atlas_material(struct mesh_atlas const* a, int32_t material)
+{
+    return material >= 0 && (uint32_t)material < a->material_count
+        ? (uint32_t)material
+        : a->material_count;
+}
+
+// Delete the maps of the 'material_count' materials, not the fallbacks
+void free_mesh_textures(struct mesh_textures* t, uint32_t material_count)
+{
+    if (t->diffuse != NULL) {
+        gpu_textures_delete(material_count, t->diffuse);
+        gpu_textures_delete(material_count, t->specular);
+    }
+    free(t->diffuse);
+    free(t->specular);
+    *t = (struct mesh_textures) { 0 };
+}
+
+// Maps of 'material', the fallbacks where it has none
+void mesh_material_maps(struct mesh_textures const* t, int32_t material,
+    unsigned int* diffuse, unsigned int* specular)
+{
+    *diffuse = material >= 0 ? t->diffuse[material] : 0;
+    *specular = material >= 0 ? t->specular[material] : 0;
+    *diffuse = *diffuse ? *diffuse : t->fallback_diffuse;
+    *specular = *specular ? *specular : t->fallback_specular;
+}
+
+void bind_mesh_material(void* data, int32_t material)
+{
+    struct mesh_textures const* t = data;
+    if (t->atlas != NULL) {
+        // The mesh's own vertex array has no material array, so drawing it
+        // reads this constant value instead
+        glVertexAttribI4ui(4, mesh_atlas_material(t->atlas, material), 0, 0,
+            0);
+        return;
+    }
+    unsigned int diffuse;
+    unsigned int specular;
+    mesh_material_maps(t, material, &diffuse, &specular);
+    glActiveTexture(GL_TEXTURE0);
+    glBindTexture(GL_TEXTURE_2D, diffuse);
+    glActiveTexture(GL_TEXTURE1);
+    glBindTexture(GL_TEXTURE_2D, specular);
+}
+
+// What draw_mesh_instance needs to draw one copy of the mesh
+struct mesh_instances {
+    struct mesh const* mesh;
+    struct mesh_buffers* buffers;
+    struct mesh_textures* textures;
+    struct shader* shader;
+    vec3* offsets;
+    // Level of detail each copy was drawn with last
+    uint32_t* lod;
+    vec3 eye;
+    float projection_scale;
+    float radius;
+    vec3 center;
+};
+
+/* Pick the level of detail of copy 'i'. Only touches the copy's own entry,
+ * so threads may do this for different copies at once.
+ */
+void select_mesh_instance_lod(struct mesh_instances* m, uint32_t i)
+{
+    // Distance to the bounding sphere, not to its center
+    vec3 center;
+    glm_vec3_add(m->offsets[i], m->center, center);
+    float distance = glm_vec3_distance(m->eye, center) - m->radius;
+    m->lod[i] = mesh_select_lod(m->mesh, distance, m->projection_scale,
+        MESH_LOD_PIXEL_ERROR, m->lod[i]);
+}
+
+// Pick the level of detail of copy 'i' and its model matrix
+void prepare_mesh_instance(struct mesh_instances* m, uint32_t i, mat4 model)
+{
+    select_mesh_instance_lod(m, i);
+    glm_mat4_identity(model);
+    glm_translate(model, m->offsets[i]);
+    glm_mat4_mul(model, m->buffers->dequant, model);
+}
+
+void draw_mesh_instance(void* data, uint32_t i)
+{
+    struct mesh_instances* m = data;
+    mat4 model;
+    prepare_mesh_instance(m, i, model);
+    shader_set_mat4(m->shader, "model", model);
+    mesh_draw_lod(m->mesh, m->buffers, m->lod[i], bind_mesh_material,
+        m->textures);
+}
+
+// Record what draw_mesh_instance does into 'cb'
+void record_mesh_instance(struct mesh_instances* m, struct command_buffer* cb,
+    GLint model_location, uint32_t i)
+{
+    mat4 model;
+    prepare_mesh_instance(m, i, model);
+    command_uniform_mat4(cb, model_location, model);
+    command_bind_vertex_array(cb, m->buffers->VAO);
+
+    struct mesh const* mesh = m->mesh;
+    uint32_t lod = m->lod[i] < mesh_lod_count(mesh)
+        ? m->lod[i]
+        : mesh_lod_count(mesh) - 1;
+    for (uint32_t s = 0; s < mesh->submesh_count; s++) {
+        struct mesh_submesh const* sub
+            = &mesh->submeshes[lod * mesh->submesh_count + s];
+        unsigned int diffuse;
+        unsigned int specular;
+        mesh_material_maps(m->textures, sub->material, &diffuse, &specular);
+        command_bind_texture(cb, 0, diffuse);
+        command_bind_texture(cb, 1, specular);
+        command_draw_elements(cb, GL_TRIANGLES, sub->index_count,
+            sub->index_offset * sizeof(uint32_t));
+    }
+}
+
+/* Draw the visible copies of the mesh with one instanced draw per level of
+ * detail. The maps are all in the atlas, the materials in its table and every
+ * vertex carries its material's row, so the submeshes of a level share a draw
+ * however many materials they use. The shader's model matrix has to be the
+ * dequantization. False when 'scratch' has no room for the copies' offsets,
+ * nothing is drawn then.
+ */
+bool draw_mesh_instanced(struct mesh_instances* m, struct mesh_atlas* atlas,
+    uint32_t const* visible, size_t visible_count, struct arena* scratch)
+{
+    struct mesh const* mesh = m->mesh;
+    uint32_t lod_count = mesh_lod_count(mesh);
+    vec3* offsets = arena_alloc(scratch, visible_count * sizeof(vec3),
+        ALLOCATOR_ALIGNMENT);
+    if (offsets == NULL) {
+        return false;
+    }
+
+    // Sort the copies by level of detail, counting first
+    uint32_t first[MESH_MAX_LODS + 1] = { 0 };
+    for (size_t v = 0; v < visible_count; v++) {
+        select_mesh_instance_lod(m, visible[v]);
+        uint32_t lod = m->lod[visible[v]] < lod_count ? m->lod[visible[v]]
+                                                      : lod_count - 1;
+        first[lod + 1]++;
+    }
+    for (uint32_t l = 0; l < lod_count; l++) {
+        first[l + 1] += first[l];
+    }
+    uint32_t next[MESH_MAX_LODS];
+    memcpy(next, first, sizeof(next));
+    for (size_t v = 0; v < visible_count; v++) {
+        uint32_t lod = m->lod[visible[v]] < lod_count ? m->lod[visible[v]]
+                                                      : lod_count - 1;
+        glm_vec3_copy(m->offsets[visible[v]], offsets[next[lod]++]);
+    }
+    glBindVertexArray(atlas->VAO);
+    glBindBuffer(GL_ARRAY_BUFFER, atlas->instance_buffer);
+    gpu_buffer_data(atlas->instance_buffer, GL_ARRAY_BUFFER,
+        visible_count * sizeof(vec3), offsets, GL_STREAM_DRAW);
+
+    // A level's submeshes follow each other in the index buffer
+    atlas->draws = 0;
+    for (uint32_t l = 0; l < lod_count; l++) {
+        GLsizei copies = first[l + 1] - first[l];
+        struct mesh_submesh const* subs
+            = &mesh->submeshes[l * mesh->submesh_count];
+        uint32_t index_count = 0;
+        for (uint32_t s = 0; s < mesh->submesh_count; s++) {
+            index_count += subs[s].index_count;
+        }
+        if (copies == 0 || index_count == 0) {
+            continue;
+        }
+        glVertexAttribPointer(3, 3, GL_FLOAT, GL_FALSE, sizeof(vec3),
+            (void*)(uintptr_t)(first[l] * sizeof(vec3)));
+        glDrawElementsInstanced(GL_TRIANGLES, index_count, GL_UNSIGNED_INT,
+            (void*)(uintptr_t)(subs[0].index_offset * sizeof(uint32_t)),
+            copies);
+        atlas->draws++;
+    }
+    return true;
+}
+
+/* The visible copies of the mesh split into one range per task, each task
+ * recording its range into its own command buffer
+ */
+struct mesh_recording {
+    struct mesh_instances* instances;
+    struct command_buffer* buffers;
+    unsigned int task_count;
+    uint32_t const* visible;
+    size_t visible_count;
+    GLint model_location;
+};
+
+void record_mesh_task(void* data, unsigned int task)
+{
+    struct mesh_recording const* r = data;
+    size_t begin = r->visible_count * task / r->task_count;
+    size_t end = r->visible_count * (task + 1) / r->task_count;
+    struct command_buffer* cb = &r->buffers[task];
+    command_buffer_reset(cb);
+    for (size_t v = begin; v < end; v++) {
+        record_mesh_instance(r->instances, cb, r->model_location,
+            r->visible[v]);
+    }
+}
+
+/* Rasterize the copies in 'objects' nearest to the camera as occluders, with
+ * the level of detail they were last drawn with. That level is within a
+ * pixel of the full mesh, and the occlusion buffer's pixels are larger.
+ */
+void add_mesh_occluders(struct masked_occlusion* mo,
+    struct mesh_instances* m, uint32_t const* objects, size_t count)
+{
+    uint32_t nearest[MESH_OCCLUDER_COUNT];
+    float nearest_distance[MESH_OCCLUDER_COUNT];
+    size_t nearest_count = 0;
+    for (size_t n = 0; n < count; n++) {
+        uint32_t i = objects[n];
+        float distance = glm_vec3_distance2(m->eye, m->offsets[i]);
+        if (nearest_count == MESH_OCCLUDER_COUNT
+            && distance >= nearest_distance[nearest_count - 1]) {
+            continue;
+        }
+        // Insertion into the short sorted list, dropping the farthest
+        size_t k = nearest_count < MESH_OCCLUDER_COUNT ? nearest_count++
+                                                       : nearest_count - 1;
+        for (; k > 0 && nearest_distance[k - 1] > distance; k--) {
+            nearest[k] = nearest[k - 1];
+            nearest_distance[k] = nearest_distance[k - 1];
+        }
+        nearest[k] = i;
+        nearest_distance[k] = distance;
+    }
+
+    struct mesh const* mesh = m->mesh;
+    for (size_t n = 0; n < nearest_count; n++) {
+        uint32_t i = nearest[n];
+        uint32_t lod = m->lod[i] < mesh_lod_count(mesh) ? m->lod[i] : 0;
+        mat4 model = GLM_MAT4_IDENTITY_INIT;
+        glm_translate(model, m->offsets[i]);
+        for (uint32_t k = 0; k < mesh->submesh_count; k++) {
+            struct mesh_submesh const* sub
+                = &mesh->submeshes[lod * mesh->submesh_count + k];
+            masked_occlusion_add(mo, mesh->vertices[0].position,
+                sizeof(struct mesh_vertex), mesh->indices + sub->index_offset,
+                sub->index_count, model);
+        }
+    }
+}
+
+void cube_model(vec3 position, float time, mat4 dest)
+{
+    glm_mat4_identity(dest);
+    glm_translate(dest, position);
+    vec3 rotate_vector = { 0.5f, 1.0f, 0.0f };
+    glm_rotate(dest, time * glm_rad(50.0f), rotate_vector);
+}
+
+/* Shadow casters are the cubes, then the floor, then the copies of the mesh.
+ * Only the cubes move.
+ */
+struct shadow_scene {
+    vec3* cube_positions;
+    float time;
+    unsigned int cube_VAO;
+    mat4 floor_model;
+    struct mesh_instances* instances;
+};
+
+void draw_shadow_caster(void* data, uint32_t caster, struct shader* shader)
+{
+    struct shadow_scene* scene = data;
+    mat4 model;
+    if (caster <= NUM_CUBES) {
+        if (caster < NUM_CUBES) {
+            cube_model(scene->cube_positions[caster], scene->time, model);
+        } else {
+            glm_mat4_copy(scene->floor_model, model);
+        }
+        shader_set_mat4(shader, "model", model);
+        glBindVertexArray(scene->cube_VAO);
+        glDrawArrays(GL_TRIANGLES, 0, 36);
+        return;
+    }
+    struct mesh_instances const* m = scene->instances;
+    uint32_t i = caster - NUM_CUBES - 1;
+    uint32_t lod = m->lod[i] < mesh_lod_count(m->mesh) ? m->lod[i] : 0;
+    glm_mat4_identity(model);
+    glm_translate(model, m->offsets[i]);
+    glm_mat4_mul(model, m->buffers->dequant, model);
+    shader_set_mat4(shader, "model", model);
+    mesh_draw_lod(m->mesh, m->buffers, lod, NULL, NULL);
+}
+
+// What bind_gltf_material needs to set up a glTF material
+struct gltf_material_binding {
+    struct gltf_scene const* scene;
+    struct shader* shader;
+    unsigned int fallback_diffuse;
+    unsigned int fallback_specular;
+};
+
+void bind_gltf_material(void* data, int32_t material)
+{
+    struct gltf_material_binding const* b = data;
+    struct gltf_material const* mat = material >= 0
+        ? &b->scene->materials[material]
+        : NULL;
+    unsigned int diffuse = mat ? mat->diffuse_map : 0;
+    unsigned int specular = mat ? mat->specular_map : 0;
+
+    glActiveTexture(GL_TEXTURE0);
+    glBindTexture(GL_TEXTURE_2D, diffuse ? diffuse : b->fallback_diffuse);
+    glActiveTexture(GL_TEXTURE1);
+    glBindTexture(GL_TEXTURE_2D, specular ? specular : b->fallback_specular);
+    shader_set_float(b->shader, "material.shininess",
+        mat ? mat->shininess : 32.f);
+}
+
+/* Everything the scene pass draws with. main fills it in, the render graph
+ * runs the pass later in the frame
+ */
+struct scene_pass {
+    // The render thread's copy, not the camera the input moves
+    struct camera* camera;
+    struct shader* shader;
+    struct shader* light_shader;
+    unsigned int cube_VAO;
+    unsigned int light_VAO;
+    unsigned int diffuse_map;
+    unsigned int specular_map;
+    vec3* cube_positions;
+    struct aabb_soa cube_bounds;
+    uint32_t* visible_cubes;
+    float* light_pos;
+    float time;
+    // Of the framebuffer, for picking levels of detail
     int height;
-    int nrChannels;
-    unsigned char* data = stbi_load(path, &width, &height,
-        &nrChannels, 0);
-    if (data == NULL) {
-        fprintf(stderr, "Failed to load texture\n");
-        stbi_image_free(data);
-        return 0;
+    bool print_stats;
+
+    // NULL for the shadows that are off
+    struct point_shadow* point_shadow;
+    struct cascaded_shadow* cascaded_shadow;
+    float* sun_direction;
+    // NULL without shadows, there is nothing to catch them then
+    vec4* floor_model;
+
+    struct mesh* mesh;
+    struct mesh_buffers* mesh_buffers;
+    struct mesh_instances* instances;
+    struct aabb_soa mesh_bounds;
+    uint32_t* visible_instances;
+    size_t mesh_instance_count;
+    enum occlusion_mode occlusion;
+    struct occlusion_culler* occlusion_culler;
+    struct masked_occlusion* masked_occlusion;
+    struct thread_pool* pool;
+    size_t cpu_hidden;
+    // One per recording task, copies of the mesh are recorded in parallel
+    struct command_buffer* command_buffers;
+    unsigned int command_buffer_count;
+    struct uniform_table* uniforms;
+    // Scratch for the per copy attributes of instanced draws
+    struct frame_arena* frame_arena;
+
+    struct gltf_scene* gltf;
+};
+
+void draw_scene(struct render_graph const* graph, void* data)
+{
+    (void)graph;
+    struct scene_pass* sc = data;
+    struct shader* s = sc->shader;
+    struct camera* camera = sc->camera;
+    glEnable(GL_DEPTH_TEST);
+    glUseProgram(s->ID);
+    if (sc->point_shadow != NULL) {
+        point_shadow_bind(sc->point_shadow, s, POINT_SHADOW_UNIT);
+    }
+    shader_set_int(s, "sun_enabled", sc->cascaded_shadow != NULL);
+    if (sc->cascaded_shadow != NULL) {
+        vec3 sun_diffuse = { 0.4f, 0.4f, 0.35f };
+        vec3 sun_specular = { 0.5f, 0.5f, 0.5f };
+        shader_set_vec3(s, "sun.direction", sc->sun_direction);
+        shader_set_vec3(s, "sun.diffuse", sun_diffuse);
+        shader_set_vec3(s, "sun.specular", sun_specular);
+        cascaded_shadow_bind(sc->cascaded_shadow, s, SUN_SHADOW_UNIT);
+    }
+
+    // Set light color
+    vec3 light_color = { 1.0f, 1.0f, 1.0f };
+
+    vec3 diffuse_color;
+    vec3 diffuse_factor = { 0.5f, 0.5f, 0.5f };
+    glm_vec3_mul(light_color, diffuse_factor, diffuse_color);
+
+    vec3 ambient_color;
+    vec3 ambient_factor = { 0.1f, 0.1f, 0.1f };
+    glm_vec3_mul(diffuse_color, ambient_factor, ambient_color);
+
+    shader_set_vec3(s, "light.ambient", ambient_color);
+
+    shader_set_vec3(s, "light.diffuse", diffuse_color);
+
+    vec3 object_light_specular_vec = { 1.0f, 1.0f, 1.0f };
+    shader_set_vec3(s, "light.specular", object_light_specular_vec);
+
+    shader_set_vec3(s, "light.position", sc->light_pos);
+
+    // Pass projection matrix to shader. Both matrices are cached by
+    // the camera and only recomputed after it has moved
+    vec4* projection = camera_get_projection_matrix(camera);
+    shader_set_mat4(s, "projection", projection);
+
+    // Camera view transformation
+    vec4* view = camera_get_view_matrix(camera);
+    shader_set_mat4(s, "view", view);
+    shader_set_vec3(s, "view_position", camera->camera_position);
+
+    size_t visible_count = cull_aabbs(sc->cube_bounds, NUM_CUBES,
+        camera_get_frustum_planes(camera), CULL_ALL_PLANES, sc->visible_cubes,
+        NULL);
+
+    // Other passes use the same units, so bind the maps every frame
+    shader_set_int(s, "material.specular", 1);
+    glActiveTexture(GL_TEXTURE0);
+    glBindTexture(GL_TEXTURE_2D, sc->diffuse_map);
+    glActiveTexture(GL_TEXTURE1);
+    glBindTexture(GL_TEXTURE_2D, sc->specular_map);
+
+    glBindVertexArray(sc->cube_VAO);
+    for (size_t v = 0; v < visible_count; v++) {
+        uint32_t i = sc->visible_cubes[v];
+        mat4 model;
+        cube_model(sc->cube_positions[i], sc->time, model);
+        shader_set_mat4(s, "model", model);
+
+        glDrawArrays(GL_TRIANGLES, 0, 36);
     }
-    GLenum format;
-    if (nrChannels == 1) {
-        format = GL_RED;
+    if (sc->floor_model != NULL) {
+        shader_set_mat4(s, "model", sc->floor_model);
+        glDrawArrays(GL_TRIANGLES, 0, 36);
     }
-    if (nrChannels == 3) {
-        format = GL_RGB;
+
+    if (sc->mesh->index_count > 0) {
+        shader_set_int(s, "octahedral_normals",
+            sc->mesh_buffers->format->octahedral_normals);
+        struct mesh_instances* instances = sc->instances;
+        struct mesh_atlas* atlas = instances->textures->atlas;
+        if (atlas != NULL) {
+            shader_set_int(s, "atlas", true);
+            glActiveTexture(GL_TEXTURE0 + ATLAS_UNIT);
+            glBindTexture(GL_TEXTURE_2D_ARRAY, atlas->atlas.texture);
+            material_table_bind(&atlas->materials, MATERIAL_TABLE_UNIT);
+        }
+        instances->shader = s;
+        instances->projection_scale = mesh_lod_projection_scale(camera->fov,
+            sc->height);
+        glm_vec3_copy(camera->camera_position, instances->eye);
+
+        uint32_t* visible_instances = sc->visible_instances;
+        size_t visible_instance_count = cull_aabbs(sc->mesh_bounds,
+            sc->mesh_instance_count, camera_get_frustum_planes(camera),
+            CULL_ALL_PLANES, visible_instances, NULL);
+        if (sc->occlusion == OCCLUSION_CPU) {
+            // Occluders first, then only what they leave visible is drawn
+            masked_occlusion_clear(sc->masked_occlusion,
+                camera_get_view_projection_matrix(camera));
+            add_mesh_occluders(sc->masked_occlusion, instances,
+                visible_instances, visible_instance_count);
+            masked_occlusion_flush(sc->masked_occlusion, sc->pool);
+            size_t in_view = visible_instance_count;
+            visible_instance_count = masked_occlusion_cull(
+                sc->masked_occlusion, sc->mesh_bounds, visible_instances,
+                visible_instance_count, visible_instances);
+            sc->cpu_hidden = in_view - visible_instance_count;
+        }
+        if (sc->occlusion == OCCLUSION_GPU) {
+            occlusion_draw(sc->occlusion_culler, sc->mesh_bounds,
+                visible_instances, visible_instance_count,
+                camera_get_view_projection_matrix(camera),
+                camera->camera_position, s, draw_mesh_instance, instances);
+        } else if (atlas != NULL) {
+            shader_set_mat4(s, "model", sc->mesh_buffers->dequant);
+            if (draw_mesh_instanced(instances, atlas, visible_instances,
+                    visible_instance_count,
+                    frame_arena_current(sc->frame_arena))) {
+                if (sc->print_stats) {
+                    printf("Texture atlas: %u instanced draws for %zu"
+                           " copies\n",
+                        atlas->draws, visible_instance_count);
+                }
+            } else {
+                for (size_t v = 0; v < visible_instance_count; v++) {
+                    draw_mesh_instance(instances, visible_instances[v]);
+                }
+            }
+        } else if (visible_instance_count >= MESH_RECORD_MIN_INSTANCES) {
+            struct mesh_recording recording = {
+                .instances = instances,
+                .buffers = sc->command_buffers,
+                .task_count = sc->command_buffer_count,
+                .visible = visible_instances,
+                .visible_count = visible_instance_count,
+                .model_location = sc->uniforms->locations[SCENE_UNIFORM_MODEL]
+            };
+            thread_pool_for(sc->pool, recording.task_count, record_mesh_task,
+                &recording);
+            struct command_stats cs = command_buffer_execute(
+                sc->command_buffers, sc->command_buffer_count);
+            if (sc->print_stats) {
+                printf("Commands: %u draws, %u commands from %u buffers, %u"
+                       " redundant binds skipped\n",
+                    cs.draws, cs.commands, sc->command_buffer_count,
+                    cs.redundant);
+            }
+        } else {
+            for (size_t v = 0; v < visible_instance_count; v++) {
+                draw_mesh_instance(instances, visible_instances[v]);
+            }
+        }
+        shader_set_int(s, "octahedral_normals", false);
+        shader_set_int(s, "atlas", false);
+
+        if (sc->occlusion != OCCLUSION_OFF && sc->print_stats) {
+            struct occlusion_stats const* st = &sc->occlusion_culler->stats;
+            if (sc->occlusion == OCCLUSION_GPU) {
+                printf("Occlusion: %u in view, %u queries, %u hidden\n",
+                    st->objects, st->queries, st->hidden);
+            } else {
+                printf("Occlusion: %zu in view, %zu hidden\n",
+                    visible_instance_count + sc->cpu_hidden, sc->cpu_hidden);
+            }
+        }
     }
-    if (nrChannels == 4) {
-        format = GL_RGBA;
+
+    if (sc->gltf->scene_node_count > 0) {
+        struct gltf_material_binding binding = {
+            .scene = sc->gltf,
+            .shader = s,
+            .fallback_diffuse = sc->diffuse_map,
+            .fallback_specular = sc->specular_map
+        };
+        mat4 transform = GLM_MAT4_IDENTITY_INIT;
+        gltf_draw(sc->gltf, s, transform, bind_gltf_material, &binding);
+        shader_set_float(s, "material.shininess", 32.f);
     }
 
-    unsigned int texture;
-    glGenTextures(1, &texture);
-    glBindTexture(GL_TEXTURE_2D, texture);
-    glTexImage2D(GL_TEXTURE_2D, 0, format, width, height, 0, format,
-        GL_UNSIGNED_BYTE, data);
+    // Render light
+    glUseProgram(sc->light_shader->ID);
+    shader_set_mat4(sc->light_shader, "projection", projection);
+    shader_set_mat4(sc->light_shader, "view", view);
+
+    mat4 model = GLM_MAT4_IDENTITY_INIT;
+
+    glm_translate(model, sc->light_pos);
 
-    glGenerateMipmap(GL_TEXTURE_2D);
+    vec3 light_scale = { 0.2f, 0.2f, 0.2f };
+    glm_scale(model, light_scale);
+    shader_set_mat4(sc->light_shader, "model", model);
+
+    glBindVertexArray(sc->light_VAO);
+    glDrawArrays(GL_TRIANGLES, 0, 36);
+}
 
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+// What the shadow passes update their maps with
+struct shadow_passes {
+    struct point_shadow* point_shadow;
+    struct cascaded_shadow* cascaded_shadow;
+    struct shadow_casters const* casters;
+    struct camera* camera;
+    float* light_pos;
+    float* sun_direction;
+};
+
+void draw_point_shadow(struct render_graph const* graph, void* data)
+{
+    (void)graph;
+    struct shadow_passes const* p = data;
+    point_shadow_update(p->point_shadow, p->light_pos, p->casters);
+}
+
+void draw_sun_shadow(struct render_graph const* graph, void* data)
+{
+    (void)graph;
+    struct shadow_passes const* p = data;
+    cascaded_shadow_update(p->cascaded_shadow, p->camera, p->sun_direction,
+        p->casters);
+}
+
+/* What the main thread hands the render thread every simulation tick. The
+ * render thread only sees these, never the state they were taken from.
+ */
+struct frame_snapshot {
+    struct camera_pose camera;
+    float time;
+    vec3 light_pos;
+    // Of the window, 0 while it is minimized
+    int width;
+    int height;
+};
+
+/* Everything the render thread draws with. It owns the GL context from when
+ * it starts until it is joined, the main thread stays off the GL meanwhile.
+ */
+struct render_loop {
+    GLFWwindow* window;
+    struct triple_buffer* snapshots;
+    // Of the snapshot being drawn, the passes point at these. The camera
+    // lives on between snapshots so its cached matrices do too
+    struct camera camera;
+    float* light_pos;
+
+    struct scene_pass* scene;
+    struct shadow_scene* shadow_scene;
+    struct shadow_passes* shadow_passes;
+    struct render_graph* graph;
+    struct render_target_pool* render_targets;
+    struct frame_arena* frame_arena;
+    // NULL when --post and --dynamic-resolution are not given
+    struct post_chain* post_chain;
+    struct dynamic_resolution* dynamic_resolution;
+    struct frame_pacer* pacer;
+    bool report_pacing;
+    bool report_gpu_memory;
+    // NULL when everything is uploaded up front
+    struct upload_queue* uploads;
+};
+
+// Declare, run and report the passes of one frame
+void render_frame(struct render_loop* r, struct frame_snapshot const* frame,
+    bool print_stats)
+{
+    struct render_graph* graph = r->graph;
+    struct scene_pass* scene = r->scene;
+    struct dynamic_resolution* dynamic_resolution = r->dynamic_resolution;
+    bool point_shadows = scene->point_shadow != NULL;
+    bool sun = scene->cascaded_shadow != NULL;
+    bool post = r->post_chain != NULL;
+    // Whatever the frame before last left in here is not read anymore
+    struct arena* scratch = frame_arena_begin(r->frame_arena);
+    if (r->uploads != NULL) {
+        upload_queue_publish(r->uploads);
+    }
+    r->shadow_scene->time = frame->time;
+    scene->time = frame->time;
+    scene->print_stats = print_stats;
+
+    int width = frame->width;
+    int height = frame->height;
+    int scene_width = width;
+    int scene_height = height;
+    if (dynamic_resolution != NULL) {
+        dynamic_resolution_size(dynamic_resolution, width, height,
+            &scene_width, &scene_height);
+    }
+    scene->height = scene_height;
+
+    // Declare the passes of this frame, the graph sorts out the rest
+    render_graph_reset(graph);
+    uint32_t backbuffer = render_graph_import_backbuffer(graph, "backbuffer",
+        width, height);
+    uint32_t scene_pass = render_graph_add_pass(graph, "scene", draw_scene,
+        scene);
+    if (point_shadows) {
+        uint32_t map = render_graph_import(graph, "point shadow");
+        uint32_t pass = render_graph_add_pass(graph, "point shadow",
+            draw_point_shadow, r->shadow_passes);
+        render_graph_write(graph, pass, map, false);
+        render_graph_read(graph, scene_pass, map);
+    }
+    if (sun) {
+        uint32_t map = render_graph_import(graph, "sun shadow");
+        uint32_t pass = render_graph_add_pass(graph, "sun shadow",
+            draw_sun_shadow, r->shadow_passes);
+        render_graph_write(graph, pass, map, false);
+        render_graph_read(graph, scene_pass, map);
+    }
+    // Minimized windows have nothing to draw into
+    bool scaled = scene_width != width || scene_height != height;
+    if ((post || scaled) && width > 0 && height > 0) {
+        uint32_t color = render_graph_create(graph, "scene", scene_width,
+            scene_height, post ? POST_SCENE_FORMAT : GL_RGBA8, true);
+        render_graph_write(graph, scene_pass, color, true);
+        // Tonemapping samples the scene over the whole screen, which
+        // stretches it already
+        if (post) {
+            post_chain_add_passes(r->post_chain, graph, color, backbuffer);
+        } else {
+            dynamic_resolution_add_upscale(dynamic_resolution, graph, color,
+                backbuffer);
+        }
+    } else {
+        render_graph_write(graph, scene_pass, backbuffer, true);
+    }
+    if (dynamic_resolution != NULL) {
+        dynamic_resolution_begin(dynamic_resolution);
+    }
+    if (render_graph_compile(graph)) {
+        render_graph_execute(graph);
+    }
+    if (dynamic_resolution != NULL) {
+        dynamic_resolution_end(dynamic_resolution);
+    }
+    render_target_pool_end_frame(r->render_targets);
+
+    if (print_stats && (point_shadows || sun)) {
+        struct shadow_stats const* ps
+            = &r->shadow_passes->point_shadow->cache.stats;
+        struct shadow_stats const* cs
+            = &r->shadow_passes->cascaded_shadow->cache.stats;
+        printf("Shadows: %u static and %u dynamic faces, %u static and"
+               " %u dynamic cascades, %u casters\n",
+            ps->static_layers, ps->dynamic_layers, cs->static_layers,
+            cs->dynamic_layers, ps->casters + cs->casters);
+    }
+    if (print_stats && post) {
+        struct render_graph_stats const* gs = &graph->stats;
+        printf("Render graph: %u passes, %u culled, %u transients in %u"
+               " targets, pool of %zu targets, %.1f MB, %zu of %zu bytes"
+               " scratch\n",
+            gs->passes, gs->culled, gs->transients, gs->targets,
+            r->render_targets->count,
+            r->render_targets->bytes / (1024.0 * 1024.0), scratch->peak,
+            scratch->capacity);
+    }
+    if (print_stats && dynamic_resolution != NULL) {
+        printf("Dynamic resolution: %.0f%%, %dx%d, GPU %.1f of %.1f ms\n",
+            dynamic_resolution->scale * 100.0f, scene_width, scene_height,
+            dynamic_resolution->gpu_ms, dynamic_resolution->budget_ms);
+    }
+    if (print_stats && r->uploads != NULL) {
+        struct upload_stats us = upload_queue_report(r->uploads);
+        if (us.in_flight > 0 || us.published > 0) {
+            printf("Uploads: %u published, %u in flight, longest publish"
+                   " %.3f ms\n",
+                us.published, us.in_flight, us.longest_publish_ms);
+        }
+    }
+    if (print_stats && r->report_gpu_memory) {
+        struct gpu_memory_stats ms = gpu_memory_report();
+        double const mb = 1024.0 * 1024.0;
+        printf("GPU memory: %.1f MB in %u objects, peak %.1f MB;",
+            ms.total.bytes / mb, ms.total.objects, ms.total.peak_bytes / mb);
+        for (int c = 0; c < GPU_MEMORY_CATEGORY_COUNT; c++) {
+            printf(" %s %.1f", gpu_memory_category_name(c),
+                ms.categories[c].bytes / mb);
+        }
+        printf(" MB\n");
+    }
+    if (print_stats && r->report_pacing) {
+        struct frame_pacing_stats fs = frame_pacer_report(r->pacer);
+        printf("Frame pacing: %u frames, %.2f ms mean, %.2f ms jitter,"
+               " %.2f to %.2f ms, %u late\n",
+            fs.frames, fs.mean_ms, fs.jitter_ms, fs.min_ms, fs.max_ms,
+            fs.late);
+    }
+}
 
-    stbi_image_free(data);
-    return texture;
+/* Draw the newest snapshot, swap and pace, until the main thread closes the
+ * exchange. A swap waiting for the display only holds up this thread.
+ */
+void* render_thread(void* data)
+{
+    struct render_loop* r = data;
+    glfwMakeContextCurrent(r->window);
+    float last_stats_time = 0.0f;
+    struct frame_snapshot const* frame;
+    while ((frame = triple_buffer_take(r->snapshots)) != NULL) {
+        camera_apply_pose(&r->camera, &frame->camera);
+        memcpy(r->light_pos, frame->light_pos, sizeof(vec3));
+        bool print_stats = frame->time - last_stats_time >= 1.0f;
+        if (print_stats) {
+            last_stats_time = frame->time;
+        }
+        render_frame(r, frame, print_stats);
+        glfwSwapBuffers(r->window);
+        frame_pacer_wait(r->pacer);
+    }
+    glfwMakeContextCurrent(NULL);
+    return NULL;
 }
 
 // Callback from GLFW that the window was resized
 void framebuffer_size_callback(GLFWwindow* window, int width, int height)
 {
     (void)window;
-    glViewport(0, 0, width, height);
+
+    // Minimized windows report a zero sized framebuffer
+    if (width > 0 && height > 0) {
+        camera_set_aspect(&cam, (float)width / (float)height);
+    }
 }
 
 // Calback from GLFW that mouse has moved
@@ -83,6 +1113,11 @@ void mouse_callback(GLFWwindow* window, double xpos, double ypos)
     // This will NOT be set back to true every time
     static bool first_mouse = true;
 
+    // A recorded path is flying the camera
+    if (camera_mode == CAMERA_PLAYBACK) {
+        return;
+    }
+
     if (first_mouse) {
         first_mouse = false;
         last_x = xpos;
@@ -101,6 +1136,9 @@ void scroll_callback(GLFWwindow* window, double xoffset, double yoffset)
 {
     (void)window;
     (void)xoffset;
+    if (camera_mode == CAMERA_PLAYBACK) {
+        return;
+    }
     camera_process_scroll(&cam, yoffset);
 }
 
@@ -109,6 +1147,16 @@ void process_input(GLFWwindow* window, struct camera* const cam, float delta_tim
     if (glfwGetKey(window, GLFW_KEY_ESCAPE) == GLFW_PRESS) {
         glfwSetWindowShouldClose(window, true);
     }
+    // Toggle once per press, not every frame the key is down
+    static bool light_key_down = false;
+    bool light_key = glfwGetKey(window, GLFW_KEY_L) == GLFW_PRESS;
+    if (light_key && !light_key_down) {
+        light_paused = !light_paused;
+    }
+    light_key_down = light_key;
+    if (camera_mode == CAMERA_PLAYBACK) {
+        return;
+    }
     // Controll camera
     if (glfwGetKey(window, GLFW_KEY_W) == GLFW_PRESS) {
         camera_process_keyboard(cam, FORWARD, delta_time);
@@ -123,11 +1171,13 @@ void process_input(GLFWwindow* window, struct camera* const cam, float delta_tim
         camera_process_keyboard(cam, RIGHT, delta_time);
     }
 }
-GLFWwindow* setupWindow()
+// 'samples' per pixel of the default framebuffer, 0 for no multisampling
+GLFWwindow* setupWindow(int samples)
 {
     glfwInit();
     glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
     glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
+    glfwWindowHint(GLFW_SAMPLES, samples);
 
     glfwWindowHint(GLFW_OPENGL_FORWARD_COMPAT, GL_TRUE);
     glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
@@ -162,8 +1212,7 @@ struct vao_and_vbo create_shape(float* vertices, unsigned long sizeVertices)
     glGenVertexArrays(1, &VAO);
 
     // Get buffer id
-    unsigned int VBO;
-    glGenBuffers(1, &VBO);
+    unsigned int VBO = gpu_buffer_create(GPU_MEMORY_VERTEX, "cube");
 
     // Bind it before using VBO
     glBindVertexArray(VAO);
@@ -172,21 +1221,11 @@ struct vao_and_vbo create_shape(float* vertices, unsigned long sizeVertices)
     glBindBuffer(GL_ARRAY_BUFFER, VBO);
 
     // Copy vertices to GPU memory
-    glBufferData(GL_ARRAY_BUFFER, sizeVertices, vertices, GL_STATIC_DRAW);
+    gpu_buffer_data(VBO, GL_ARRAY_BUFFER, sizeVertices, vertices,
+        GL_STATIC_DRAW);
 
     // Specify how opengl should interpret our verticies
-    // position
-    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 8 * sizeof(float),
-        (void*)0);
-    glEnableVertexAttribArray(0);
-
-    glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, 8 * sizeof(float),
-        (void*)(3 * sizeof(float)));
-    glEnableVertexAttribArray(1);
-
-    glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, 8 * sizeof(float),
-        (void*)(6 * sizeof(float)));
-    glEnableVertexAttribArray(2);
+    vertex_format_setup(&vertex_format_float);
 
     struct vao_and_vbo ret = {
         .VAO = VAO,
@@ -211,12 +1250,151 @@ unsigned int create_light(unsigned int VBO)
     return lightVAO;
 }
 
-int main(void)
+void print_usage(char const* program)
 {
-    GLFWwindow* window = setupWindow();
+    fprintf(stderr, "Usage: %s [--record <path file> | --play <path file>]"
+                    " [--obj <mesh file>] [--gltf <glTF file>]\n"
+                    "       [--vertex-format float|packed16|packed12]"
+                    " [--mesh-grid <n>]\n"
+                    "       [--occlusion [gpu|cpu]] [--shadows] [--sun]"
+                    " [--post [bloom,blur,fxaa|none]]\n"
+                    "       [--msaa <samples>] [--dynamic-resolution <fps>]\n"
+                    "       [--swap vsync|adaptive|off] [--fps-limit <fps>]"
+                    " [--gpu-memory]\n"
+                    "       [--texture-atlas]\n"
+                    "       %s --bench <name>\n",
+        program, program);
+}
+
+int main(int argc, char** argv)
+{
+    // Pick the math kernels for this CPU before anything uses them
+    math_dispatch_init();
+    math_batch_init();
+    cull_init();
+    printf("Math kernels: %s\n", simd_level_name(math_dispatch.level));
+
+    // Camera path to record to or play back from
+    char const* camera_path_file = NULL;
+    // Mesh to draw next to the cubes
+    char const* mesh_file = NULL;
+    // glTF scene to draw next to the cubes
+    char const* gltf_file = NULL;
+    // Vertex format of the mesh, NULL lets mesh_upload pick one
+    struct vertex_format const* vertex_format = NULL;
+    // The mesh is drawn n by n times, each copy picks its own level of detail
+    int mesh_grid = 1;
+    // Hide copies of the mesh behind others
+    enum occlusion_mode occlusion = OCCLUSION_OFF;
+    // Shadows of the point light, and a sun with cascaded shadows
+    bool point_shadows = false;
+    bool sun = false;
+    // Draw into an HDR target and tonemap it, with the listed effects
+    bool post = false;
+    struct post_settings post_settings = post_default_settings();
+    // Multisampling of the window, --post draws into targets without it
+    int msaa_samples = 0;
+    // Frame rate the scene resolution is lowered to hold, 0 keeps it native
+    float target_fps = 0.0f;
+    // How swaps wait for the display, and the frame rate to sleep down to
+    enum swap_mode swap_mode = SWAP_VSYNC;
+    double fps_limit = 0.0;
+    bool report_pacing = false;
+    // Print the GPU memory of each category once a second
+    bool report_gpu_memory = false;
+    // Pack the mesh's maps into one texture and draw its copies instanced
+    bool texture_atlas = false;
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--record") == 0 && i + 1 < argc) {
+            camera_mode = CAMERA_RECORD;
+            camera_path_file = argv[++i];
+        } else if (strcmp(argv[i], "--play") == 0 && i + 1 < argc) {
+            camera_mode = CAMERA_PLAYBACK;
+            camera_path_file = argv[++i];
+        } else if (strcmp(argv[i], "--obj") == 0 && i + 1 < argc) {
+            mesh_file = argv[++i];
+        } else if (strcmp(argv[i], "--gltf") == 0 && i + 1 < argc) {
+            gltf_file = argv[++i];
+        } else if (strcmp(argv[i], "--vertex-format") == 0 && i + 1 < argc
+            && (vertex_format = vertex_format_find(argv[i + 1])) != NULL) {
+            i++;
+        } else if (strcmp(argv[i], "--mesh-grid") == 0 && i + 1 < argc
+            && atoi(argv[i + 1]) > 0) {
+            mesh_grid = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--occlusion") == 0) {
+            occlusion = OCCLUSION_GPU;
+            if (i + 1 < argc && strcmp(argv[i + 1], "cpu") == 0) {
+                occlusion = OCCLUSION_CPU;
+                i++;
+            } else if (i + 1 < argc && strcmp(argv[i + 1], "gpu") == 0) {
+                i++;
+            }
+        } else if (strcmp(argv[i], "--shadows") == 0) {
+            point_shadows = true;
+        } else if (strcmp(argv[i], "--sun") == 0) {
+            sun = true;
+        } else if (strcmp(argv[i], "--post") == 0) {
+            post = true;
+            if (i + 1 < argc && strncmp(argv[i + 1], "--", 2) != 0) {
+                i++;
+                post_settings.bloom = strstr(argv[i], "bloom") != NULL;
+                post_settings.blur = strstr(argv[i], "blur") != NULL;
+                post_settings.fxaa = strstr(argv[i], "fxaa") != NULL;
+            }
+        } else if (strcmp(argv[i], "--msaa") == 0 && i + 1 < argc
+            && atoi(argv[i + 1]) > 0) {
+            msaa_samples = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--dynamic-resolution") == 0
+            && i + 1 < argc && atof(argv[i + 1]) > 0.0) {
+            target_fps = atof(argv[++i]);
+        } else if (strcmp(argv[i], "--swap") == 0 && i + 1 < argc) {
+            report_pacing = true;
+            i++;
+            if (strcmp(argv[i], "adaptive") == 0) {
+                swap_mode = SWAP_ADAPTIVE;
+            } else if (strcmp(argv[i], "off") == 0) {
+                swap_mode = SWAP_OFF;
+            } else if (strcmp(argv[i], "vsync") != 0) {
+                print_usage(argv[0]);
+                return 1;
+            }
+        } else if (strcmp(argv[i], "--fps-limit") == 0 && i + 1 < argc
+            && atof(argv[i + 1]) > 0.0) {
+            report_pacing = true;
+            fps_limit = atof(argv[++i]);
+        } else if (strcmp(argv[i], "--gpu-memory") == 0) {
+            report_gpu_memory = true;
+        } else if (strcmp(argv[i], "--texture-atlas") == 0) {
+            texture_atlas = true;
+        } else if (strcmp(argv[i], "--bench") == 0 && i + 1 < argc) {
+            return bench_run(argv[i + 1]);
+        } else {
+            print_usage(argv[0]);
+            return 1;
+        }
+    }
+
+    struct camera_path path;
+    camera_path_init(&path);
+    if (camera_mode == CAMERA_PLAYBACK
+        && !camera_path_load(&path, camera_path_file)) {
+        return 1;
+    }
+
+    // Mapped before anything else, the frames allocate nothing on the heap
+    struct frame_arena frame_arena;
+    if (!frame_arena_init(&frame_arena, FRAME_ARENA_SIZE,
+            ALLOCATOR_HUGE_PAGES)) {
+        return 1;
+    }
+
+    GLFWwindow* window = setupWindow(msaa_samples);
     if (window == NULL) {
         return 1;
     }
+    frame_pacer_set_swap(swap_mode);
+    struct upload_queue uploads;
+    bool background_uploads = upload_queue_init(&uploads, window);
 
     // Cube
     float vertices[] = {
@@ -268,15 +1446,207 @@ int main(void)
         { 0.0f, 0.0f, 0.0f }
     };
 
+    // Bounds of the cubes for frustum culling. However a unit cube is rotated
+    // it stays inside a box with half size sqrt(3) / 2 around its center
+    float cube_bounds_data[6][NUM_CUBES];
+    struct aabb_soa cube_bounds = {
+        cube_bounds_data[0], cube_bounds_data[1], cube_bounds_data[2],
+        cube_bounds_data[3], cube_bounds_data[4], cube_bounds_data[5]
+    };
+    for (int i = 0; i < NUM_CUBES; i++) {
+        cube_bounds.center_x[i] = cube_positions[i][0];
+        cube_bounds.center_y[i] = cube_positions[i][1];
+        cube_bounds.center_z[i] = cube_positions[i][2];
+        cube_bounds.extent_x[i] = 0.8660254f;
+        cube_bounds.extent_y[i] = 0.8660254f;
+        cube_bounds.extent_z[i] = 0.8660254f;
+    }
+    uint32_t visible_cubes[NUM_CUBES + CULL_OUTPUT_PADDING];
+
     struct vao_and_vbo shape = create_shape(vertices, sizeof(vertices));
-    unsigned int diffuse_map = load_texture("../src/container2.png");
+    unsigned int diffuse_map = texture_load("../src/container2.png", true);
 
-    unsigned int specular_map = load_texture("../src/container2_specular.png");
+    unsigned int specular_map = texture_load("../src/container2_specular.png",
+        true);
 
     unsigned int lightVAO = create_light(shape.VBO);
 
+    // Worker threads for loading
+    struct thread_pool pool;
+    thread_pool_init(&pool, 0);
+
+    struct mesh mesh = { 0 };
+    struct mesh_buffers mesh_buffers = { 0 };
+    struct mesh_textures mesh_textures = { 0 };
+    struct mesh_atlas mesh_atlas = { 0 };
+    if (mesh_file != NULL && obj_load(&mesh, mesh_file, &pool)) {
+        // Instanced draws take each vertex's material from the vertex
+        uint32_t* vertex_materials = texture_atlas
+            ? mesh_split_vertex_materials(&mesh)
+            : NULL;
+        mesh_buffers = mesh_upload(&mesh, vertex_format);
+        printf("Mesh vertex format: %s, %u bytes per vertex\n",
+            mesh_buffers.format->name, mesh_buffers.format->stride);
+        // The atlas needs every map at once, so it does not wait for uploads
+        if (texture_atlas && vertex_materials != NULL
+            && load_mesh_atlas(&mesh_atlas, &mesh, &mesh_buffers,
+                vertex_materials, &pool)) {
+            mesh_textures = (struct mesh_textures) {
+                .fallback_diffuse = diffuse_map,
+                .fallback_specular = specular_map,
+                .atlas = &mesh_atlas
+            };
+        } else {
+            mesh_textures = load_mesh_textures(&mesh, diffuse_map,
+                specular_map, background_uploads ? &uploads : NULL);
+        }
+        free(vertex_materials);
+    }
+
+    // Bounding sphere of the mesh for picking levels of detail
+    int mesh_instance_count = mesh_grid * mesh_grid;
+    struct mesh_instances instances = {
+        .mesh = &mesh,
+        .buffers = &mesh_buffers,
+        .textures = &mesh_textures,
+        .offsets = malloc(mesh_instance_count * sizeof(vec3)),
+        .lod = calloc(mesh_instance_count, sizeof(uint32_t)),
+        .radius = glm_vec3_distance(mesh.bounds_min, mesh.bounds_max) * 0.5f
+    };
+    glm_vec3_center(mesh.bounds_min, mesh.bounds_max, instances.center);
+
+    // Boxes of the copies for frustum and occlusion culling
+    float* mesh_bounds_data = malloc(6 * mesh_instance_count * sizeof(float));
+    struct aabb_soa mesh_bounds = {
+        mesh_bounds_data, mesh_bounds_data + mesh_instance_count,
+        mesh_bounds_data + 2 * mesh_instance_count,
+        mesh_bounds_data + 3 * mesh_instance_count,
+        mesh_bounds_data + 4 * mesh_instance_count,
+        mesh_bounds_data + 5 * mesh_instance_count
+    };
+    uint32_t* visible_instances = malloc(
+        (mesh_instance_count + CULL_OUTPUT_PADDING) * sizeof(uint32_t));
+    for (int i = 0; i < mesh_instance_count; i++) {
+        instances.offsets[i][0] = (i % mesh_grid) * instances.radius * 2.5f;
+        instances.offsets[i][1] = 0.0f;
+        instances.offsets[i][2] = -(i / mesh_grid) * instances.radius * 2.5f;
+        mesh_bounds.center_x[i] = instances.offsets[i][0] + instances.center[0];
+        mesh_bounds.center_y[i] = instances.offsets[i][1] + instances.center[1];
+        mesh_bounds.center_z[i] = instances.offsets[i][2] + instances.center[2];
+        mesh_bounds.extent_x[i] = (mesh.bounds_max[0] - mesh.bounds_min[0]) / 2;
+        mesh_bounds.extent_y[i] = (mesh.bounds_max[1] - mesh.bounds_min[1]) / 2;
+        mesh_bounds.extent_z[i] = (mesh.bounds_max[2] - mesh.bounds_min[2]) / 2;
+    }
+
+    struct occlusion_culler occlusion_culler = { 0 };
+    if (occlusion == OCCLUSION_GPU && mesh.index_count > 0
+        && !occlusion_init(&occlusion_culler, mesh_instance_count,
+            OCCLUSION_REQUERY_INTERVAL)) {
+        occlusion = OCCLUSION_OFF;
+    }
+    struct masked_occlusion masked_occlusion = { 0 };
+    if (occlusion == OCCLUSION_CPU
+        && !masked_occlusion_init(&masked_occlusion, 320, 192)) {
+        occlusion = OCCLUSION_OFF;
+    }
+    // A floor under everything to catch the shadows, a flattened cube
+    float grid_size = mesh.index_count > 0
+        ? (mesh_grid - 1) * instances.radius * 2.5f
+        : 0.0f;
+    float floor_y = mesh.index_count > 0
+        ? fminf(-1.0f, mesh.bounds_min[1])
+        : -1.0f;
+    vec3 floor_min = { -10.0f, floor_y - 0.1f, -10.0f - grid_size };
+    vec3 floor_max = { 10.0f + grid_size, floor_y, 10.0f };
+    struct shadow_scene shadow_scene = {
+        .cube_positions = cube_positions,
+        .cube_VAO = shape.VAO,
+        .instances = &instances
+    };
+    vec3 floor_center;
+    vec3 floor_size;
+    glm_vec3_center(floor_min, floor_max, floor_center);
+    glm_vec3_sub(floor_max, floor_min, floor_size);
+    glm_translate_make(shadow_scene.floor_model, floor_center);
+    glm_scale(shadow_scene.floor_model, floor_size);
+
+    size_t caster_count = NUM_CUBES + 1
+        + (mesh.index_count > 0 ? mesh_instance_count : 0);
+    float* caster_bounds_data = malloc(6 * caster_count * sizeof(float));
+    uint8_t* caster_dynamic = calloc(caster_count + 1, sizeof(uint8_t));
+    uint8_t* caster_moved = calloc(caster_count + 1, sizeof(uint8_t));
+    // The cubes turn inside boxes that stay the same, so they always moved
+    memset(caster_dynamic, 1, NUM_CUBES);
+    memset(caster_moved, 1, NUM_CUBES);
+    struct shadow_casters casters = {
+        .bounds = {
+            caster_bounds_data, caster_bounds_data + caster_count,
+            caster_bounds_data + 2 * caster_count,
+            caster_bounds_data + 3 * caster_count,
+            caster_bounds_data + 4 * caster_count,
+            caster_bounds_data + 5 * caster_count
+        },
+        .count = caster_count,
+        .dynamic = caster_dynamic,
+        .moved = caster_moved,
+        .draw = draw_shadow_caster,
+        .data = &shadow_scene
+    };
+    float* caster_axes[6] = {
+        casters.bounds.center_x, casters.bounds.center_y,
+        casters.bounds.center_z, casters.bounds.extent_x,
+        casters.bounds.extent_y, casters.bounds.extent_z
+    };
+    float* cube_axes[6] = {
+        cube_bounds.center_x, cube_bounds.center_y, cube_bounds.center_z,
+        cube_bounds.extent_x, cube_bounds.extent_y, cube_bounds.extent_z
+    };
+    float* mesh_axes[6] = {
+        mesh_bounds.center_x, mesh_bounds.center_y, mesh_bounds.center_z,
+        mesh_bounds.extent_x, mesh_bounds.extent_y, mesh_bounds.extent_z
+    };
+    for (int a = 0; a < 6; a++) {
+        memcpy(caster_axes[a], cube_axes[a], NUM_CUBES * sizeof(float));
+        caster_axes[a][NUM_CUBES] = a < 3 ? floor_center[a]
+                                          : floor_size[a - 3] / 2;
+        memcpy(caster_axes[a] + NUM_CUBES + 1, mesh_axes[a],
+            (caster_count - NUM_CUBES - 1) * sizeof(float));
+    }
+
+    struct point_shadow point_shadow = { 0 };
+    if (point_shadows && !point_shadow_init(&point_shadow, 1024, 25.0f)) {
+        point_shadows = false;
+    }
+    struct cascaded_shadow cascaded_shadow = { 0 };
+    if (sun && !cascaded_shadow_init(&cascaded_shadow, 2048, 4, 50.0f)) {
+        sun = false;
+    }
+    vec3 sun_direction = { -0.4f, -1.0f, -0.3f };
+    glm_vec3_normalize(sun_direction);
+
+    struct render_target_pool render_targets;
+    render_target_pool_init(&render_targets);
+    struct render_graph graph;
+    render_graph_init(&graph, &render_targets, &frame_arena);
+    struct post_chain post_chain = { 0 };
+    if (post) {
+        post_chain_init(&post_chain);
+        post_chain.settings = post_settings;
+    }
+    struct dynamic_resolution dynamic_resolution = { 0 };
+    if (target_fps > 0.0f) {
+        dynamic_resolution_init(&dynamic_resolution, 1000.0f / target_fps,
+            0.5f);
+    }
+
+    struct gltf_scene gltf = { 0 };
+    if (gltf_file != NULL) {
+        gltf_load(&gltf, gltf_file);
+    }
+
     // Initialize camera
     camera_init(&cam);
+    camera_set_aspect(&cam, (float)WINDOW_WIDTH / (float)WINDOW_HEIGHT);
 
     struct shader light_source_shader;
     shader_init(&light_source_shader, "../src/light_source_shader.vs",
@@ -295,101 +1665,225 @@ int main(void)
     shader_set_float(&s, "material.shininess", 32.f);
 
     glUseProgram(s.ID);
+    struct uniform_table scene_uniforms;
+    uniform_table_init(&scene_uniforms, s.ID, scene_uniform_names,
+        SCENE_UNIFORM_COUNT);
+    // A few ranges per thread, so threads that finish early take another
+    unsigned int command_buffer_count = thread_pool_concurrency(&pool) * 4;
+    struct command_buffer* command_buffers = calloc(command_buffer_count,
+        sizeof(struct command_buffer));
+    for (unsigned int i = 0; i < command_buffer_count; i++) {
+        command_buffer_init(&command_buffers[i]);
+    }
+    // Samplers of different types may not share a unit, even unused ones
+    shader_set_int(&s, "point_shadow_map", POINT_SHADOW_UNIT);
+    shader_set_int(&s, "sun_shadow_map", SUN_SHADOW_UNIT);
+    shader_set_int(&s, "atlas_maps", ATLAS_UNIT);
+    shader_set_int(&s, "materials", MATERIAL_TABLE_UNIT);
 
     glEnable(GL_DEPTH_TEST);
+    glClearColor(0.1f, 0.1f, 0.1f, 1.0f);
+
+    struct shadow_passes shadow_passes = {
+        .point_shadow = &point_shadow,
+        .cascaded_shadow = &cascaded_shadow,
+        .casters = &casters,
+        .light_pos = light_pos,
+        .sun_direction = sun_direction
+    };
+    struct scene_pass scene = {
+        .shader = &s,
+        .light_shader = &light_source_shader,
+        .cube_VAO = shape.VAO,
+        .light_VAO = lightVAO,
+        .diffuse_map = diffuse_map,
+        .specular_map = specular_map,
+        .cube_positions = cube_positions,
+        .cube_bounds = cube_bounds,
+        .visible_cubes = visible_cubes,
+        .light_pos = light_pos,
+        .point_shadow = point_shadows ? &point_shadow : NULL,
+        .cascaded_shadow = sun ? &cascaded_shadow : NULL,
+        .sun_direction = sun_direction,
+        .floor_model = point_shadows || sun ? shadow_scene.floor_model : NULL,
+        .mesh = &mesh,
+        .mesh_buffers = &mesh_buffers,
+        .instances = &instances,
+        .mesh_bounds = mesh_bounds,
+        .visible_instances = visible_instances,
+        .mesh_instance_count = mesh_instance_count,
+        .occlusion = occlusion,
+        .occlusion_culler = &occlusion_culler,
+        .masked_occlusion = &masked_occlusion,
+        .pool = &pool,
+        .command_buffers = command_buffers,
+        .command_buffer_count = command_buffer_count,
+        .uniforms = &scene_uniforms,
+        .frame_arena = &frame_arena,
+        .gltf = &gltf
+    };
 
     float delta_time = 0.0f;
-    float last_frame = 0.0f;
-
-    // Render loop:
-    while (!glfwWindowShouldClose(window)) {
-        process_input(window, &cam, delta_time);
-
-        glClearColor(0.1f, 0.1f, 0.1f, 1.0f);
-        glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
-
-        glUseProgram(s.ID);
-
-        // Set light color
-        vec3 light_color = { 1.0f, 1.0f, 1.0f };
-
-        vec3 diffuse_color;
-        vec3 diffuse_factor = { 0.5f, 0.5f, 0.5f };
-        glm_vec3_mul(light_color, diffuse_factor, diffuse_color);
-
-        vec3 ambient_color;
-        vec3 ambient_factor = { 0.1f, 0.1f, 0.1f };
-        glm_vec3_mul(diffuse_color, ambient_factor, ambient_color);
-
-        shader_set_vec3(&s, "light.ambient", ambient_color);
-
-        shader_set_vec3(&s, "light.diffuse", diffuse_color);
-
-        vec3 object_light_specular_vec = { 1.0f, 1.0f, 1.0f };
-        shader_set_vec3(&s, "light.specular", object_light_specular_vec);
-
-        shader_set_vec3(&s, "light.position", light_pos);
-
-        // Pass projection matrix to shader
-        mat4 projection;
-        glm_perspective(glm_rad(cam.fov),
-            (float)WINDOW_WIDTH / (float)WINDOW_HEIGHT, 0.1f, 100.0f,
-            projection);
-        shader_set_mat4(&s, "projection", projection);
-
-        // Camera view transformation
-        mat4 view;
-        camera_get_view_matrix(&cam, view);
-        shader_set_mat4(&s, "view", view);
+    float last_frame = glfwGetTime();
+
+    // Time that drives the animation. Follows the clock, except during
+    // playback where it steps by a fixed amount so every run draws the same
+    // frames no matter how fast the machine is
+    float scene_time = 0.0f;
+    float start_time = glfwGetTime();
+
+    struct frame_pacer pacer;
+    frame_pacer_init(&pacer, fps_limit);
+
+    // The main thread keeps its own light, the render thread draws a copy
+    vec3 sim_light_pos;
+    glm_vec3_copy(light_pos, sim_light_pos);
+    struct triple_buffer snapshots;
+    triple_buffer_init(&snapshots, sizeof(struct frame_snapshot));
+    struct render_loop render_loop = {
+        .window = window,
+        .snapshots = &snapshots,
+        .camera = cam,
+        .light_pos = light_pos,
+        .scene = &scene,
+        .shadow_scene = &shadow_scene,
+        .shadow_passes = &shadow_passes,
+        .graph = &graph,
+        .render_targets = &render_targets,
+        .frame_arena = &frame_arena,
+        .post_chain = post ? &post_chain : NULL,
+        .dynamic_resolution = target_fps > 0.0f ? &dynamic_resolution : NULL,
+        .pacer = &pacer,
+        .report_pacing = report_pacing,
+        .report_gpu_memory = report_gpu_memory,
+        .uploads = background_uploads ? &uploads : NULL
+    };
+    scene.camera = &render_loop.camera;
+    shadow_passes.camera = &render_loop.camera;
 
-        glBindVertexArray(shape.VAO);
-        for (int i = 0; i < NUM_CUBES; i++) {
-            mat4 model = GLM_MAT4_IDENTITY_INIT;
-            glm_translate(model, cube_positions[i]);
-            vec3 rotate_vector = { 0.5f, 1.0f, 0.0f };
-            glm_rotate(model, (float)glfwGetTime() * glm_rad(50.0f),
-                rotate_vector);
-            shader_set_mat4(&s, "model", model);
-            shader_set_vec3(&s, "view_position", cam.camera_position);
+    // The context can only be current on one thread at a time
+    glfwMakeContextCurrent(NULL);
+    pthread_t render_thread_id;
+    pthread_create(&render_thread_id, NULL, render_thread, &render_loop);
 
-            glDrawArrays(GL_TRIANGLES, 0, 36);
+    // Simulation loop: events, input and animation at a steady rate
+    double next_tick = glfwGetTime();
+    while (!glfwWindowShouldClose(window)) {
+        // Events wake the loop early, so the mouse turns the camera at once
+        double wait = next_tick - glfwGetTime();
+        if (wait > 0.0) {
+            glfwWaitEventsTimeout(wait);
+        } else {
+            glfwPollEvents();
+        }
+        double now = glfwGetTime();
+        if (now < next_tick) {
+            continue;
+        }
+        next_tick = fmax(next_tick + 1.0 / SIMULATION_RATE, now);
+        // Playback draws every snapshot, so it waits until the last is taken
+        if (camera_mode == CAMERA_PLAYBACK
+            && triple_buffer_pending(&snapshots)) {
+            continue;
         }
 
-        shader_set_int(&s, "material.specular", 1);
-
-        glActiveTexture(GL_TEXTURE0);
-        glBindTexture(GL_TEXTURE_2D, diffuse_map);
-
-        glActiveTexture(GL_TEXTURE1);
-        glBindTexture(GL_TEXTURE_2D, specular_map);
-
-        // Render light
-        glUseProgram(light_source_shader.ID);
-        shader_set_mat4(&light_source_shader, "projection", projection);
-        shader_set_mat4(&light_source_shader, "view", view);
+        delta_time = now - last_frame;
+        last_frame = now;
+        process_input(window, &cam, delta_time);
 
-        mat4 model = GLM_MAT4_IDENTITY_INIT;
+        if (camera_mode == CAMERA_PLAYBACK) {
+            if (scene_time > camera_path_duration(&path)) {
+                glfwSetWindowShouldClose(window, true);
+            }
+            camera_path_sample(&path, scene_time, &cam);
+        } else {
+            scene_time = now - start_time;
+            if (camera_mode == CAMERA_RECORD
+                && (path.count == 0
+                    || scene_time - camera_path_duration(&path)
+                        >= 1.0f / CAMERA_RECORD_RATE)) {
+                camera_path_record(&path, &cam, scene_time);
+            }
+        }
 
-        light_pos[0] = sin(glfwGetTime() * 1) * 5;
-        light_pos[1] = sin(glfwGetTime() * 3) * 4;
-        light_pos[2] = cos(glfwGetTime() * 1) * 5;
-        glm_translate(model, light_pos);
+        if (!light_paused) {
+            sim_light_pos[0] = sin(scene_time * 1) * 5;
+            sim_light_pos[1] = sin(scene_time * 3) * 4;
+            sim_light_pos[2] = cos(scene_time * 1) * 5;
+        }
 
-        vec3 light_scale = { 0.2f, 0.2f, 0.2f };
-        glm_scale(model, light_scale);
-        shader_set_mat4(&light_source_shader, "model", model);
+        struct frame_snapshot* snapshot = triple_buffer_write_slot(&snapshots);
+        camera_get_pose(&cam, &snapshot->camera);
+        snapshot->time = scene_time;
+        glm_vec3_copy(sim_light_pos, snapshot->light_pos);
+        glfwGetFramebufferSize(window, &snapshot->width, &snapshot->height);
+        triple_buffer_publish(&snapshots);
 
-        glBindVertexArray(lightVAO);
-        glDrawArrays(GL_TRIANGLES, 0, 36);
+        if (camera_mode == CAMERA_PLAYBACK) {
+            scene_time += PLAYBACK_TIME_STEP;
+        }
+    }
+    triple_buffer_close(&snapshots);
+    pthread_join(render_thread_id, NULL);
+    triple_buffer_free(&snapshots);
+    glfwMakeContextCurrent(window);
+    if (background_uploads) {
+        upload_queue_free(&uploads);
+    }
 
-        glfwSwapBuffers(window);
-        glfwPollEvents();
+    if (camera_mode == CAMERA_RECORD) {
+        // End where the camera stopped, not at the last regular key
+        camera_path_record(&path, &cam, scene_time);
+        camera_path_save(&path, camera_path_file);
+    }
+    camera_path_free(&path);
 
-        float current_frame = glfwGetTime();
-        delta_time = current_frame - last_frame;
-        last_frame = current_frame;
+    if (mesh.index_count > 0) {
+        mesh_buffers_delete(&mesh_buffers);
+    }
+    free_mesh_textures(&mesh_textures, mesh.material_count);
+    if (mesh_textures.atlas != NULL) {
+        free_mesh_atlas(&mesh_atlas);
+    }
+    mesh_free(&mesh);
+    free(instances.offsets);
+    free(instances.lod);
+    free(mesh_bounds_data);
+    free(visible_instances);
+    occlusion_free(&occlusion_culler);
+    masked_occlusion_free(&masked_occlusion);
+    free(caster_bounds_data);
+    free(caster_dynamic);
+    free(caster_moved);
+    if (point_shadows) {
+        point_shadow_free(&point_shadow);
+    }
+    if (sun) {
+        cascaded_shadow_free(&cascaded_shadow);
     }
+    gltf_free(&gltf);
+    if (post) {
+        post_chain_free(&post_chain);
+    }
+    if (target_fps > 0.0f) {
+        dynamic_resolution_free(&dynamic_resolution);
+    }
+    render_graph_free(&graph);
+    render_target_pool_free(&render_targets);
+    frame_arena_free(&frame_arena);
+    for (unsigned int i = 0; i < command_buffer_count; i++) {
+        command_buffer_free(&command_buffers[i]);
+    }
+    free(command_buffers);
+    uniform_table_free(&scene_uniforms);
+    thread_pool_destroy(&pool);
+
+    gpu_textures_delete(1, &diffuse_map);
+    gpu_textures_delete(1, &specular_map);
     glDeleteVertexArrays(1, &shape.VAO);
+    glDeleteVertexArrays(1, &lightVAO);
+    gpu_buffers_delete(1, &shape.VBO);
+    gpu_memory_shutdown();
     glfwTerminate();
     return 0;
 }
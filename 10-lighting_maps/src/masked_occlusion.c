@@ -0,0 +1,637 @@
+#include <cglm/cglm.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "masked_occlusion.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define MASKED_OCCLUSION_X86
+#endif
+
+#define TILE_W MASKED_OCCLUSION_TILE_WIDTH
+#define TILE_H MASKED_OCCLUSION_TILE_HEIGHT
+
+// Which side of an edge is inside, edges along a row bound nothing
+enum edge_kind {
+    EDGE_NONE,
+    EDGE_LEFT,
+    EDGE_RIGHT
+};
+
+/* Screen space triangle. Each edge is stored as the x where it crosses
+ * 'edge_y' and how x changes per row, the coverage of a row is then the span
+ * right of the left edges and left of the right edges. Depth is a plane in
+ * 1 / w, which is linear in screen space.
+ */
+struct masked_triangle {
+    float edge_x[3];
+    float edge_y[3];
+    float edge_dxdy[3];
+    uint8_t edge_kind[3];
+    float min_x;
+    float max_x;
+    float min_y;
+    float max_y;
+    float za;
+    float zb;
+    float zc;
+    float z_min;
+    int tile_x0;
+    int tile_x1;
+    int tile_y0;
+    int tile_y1;
+};
+
+bool masked_occlusion_init(struct masked_occlusion* mo, uint32_t width,
+    uint32_t height)
+{
+    memset(mo, 0, sizeof(*mo));
+    mo->tiles_x = (width + TILE_W - 1) / TILE_W;
+    mo->tiles_y = (height + TILE_H - 1) / TILE_H;
+    if (mo->tiles_x == 0 || mo->tiles_y == 0) {
+        fprintf(stderr, "masked_occlusion: empty buffer %ux%u\n", width,
+            height);
+        return false;
+    }
+    mo->width = mo->tiles_x * TILE_W;
+    mo->height = mo->tiles_y * TILE_H;
+
+    uint32_t tiles = mo->tiles_x * mo->tiles_y;
+    mo->masks = calloc(tiles * TILE_H, sizeof(uint32_t));
+    mo->z0 = calloc(tiles, sizeof(float));
+    mo->z1 = calloc(tiles, sizeof(float));
+    if (mo->masks == NULL || mo->z0 == NULL || mo->z1 == NULL) {
+        fprintf(stderr, "masked_occlusion: out of memory for %ux%u\n",
+            mo->width, mo->height);
+        masked_occlusion_free(mo);
+        return false;
+    }
+    glm_mat4_identity(mo->view_projection);
+    masked_occlusion_use_level(mo, cpu_simd_level());
+    return true;
+}
+
+void masked_occlusion_free(struct masked_occlusion* mo)
+{
+    free(mo->masks);
+    free(mo->z0);
+    free(mo->z1);
+    free(mo->triangles);
+    memset(mo, 0, sizeof(*mo));
+}
+
+void masked_occlusion_use_level(struct masked_occlusion* mo,
+    enum simd_level level)
+{
+    if (level > cpu_simd_level()) {
+        level = cpu_simd_level();
+    }
+    // The kernels go up to AVX2, AVX-512 machines run those
+    mo->level = level >= SIMD_AVX2 ? SIMD_AVX2 : SIMD_SCALAR;
+#ifndef MASKED_OCCLUSION_X86
+    mo->level = SIMD_SCALAR;
+#endif
+}
+
+void masked_occlusion_clear(struct masked_occlusion* mo,
+    mat4 view_projection)
+{
+    uint32_t tiles = mo->tiles_x * mo->tiles_y;
+    memset(mo->masks, 0, tiles * TILE_H * sizeof(uint32_t));
+    memset(mo->z0, 0, tiles * sizeof(float));
+    memset(mo->z1, 0, tiles * sizeof(float));
+    glm_mat4_copy(view_projection, mo->view_projection);
+    mo->triangle_count = 0;
+}
+
+static void setup_triangle(struct masked_occlusion* mo, vec4 clip[3])
+{
+    float x[3];
+    float y[3];
+    float z[3];
+    for (int i = 0; i < 3; i++) {
+        z[i] = 1.0f / clip[i][3];
+        x[i] = (clip[i][0] * z[i] * 0.5f + 0.5f) * mo->width;
+        y[i] = (clip[i][1] * z[i] * 0.5f + 0.5f) * mo->height;
+    }
+
+    // Twice the signed area, both windings are occluders
+    float area = (x[1] - x[0]) * (y[2] - y[0]) - (x[2] - x[0]) * (y[1] - y[0]);
+    if (fabsf(area) < 1e-6f) {
+        return;
+    }
+
+    struct masked_triangle t;
+    t.min_x = fminf(x[0], fminf(x[1], x[2]));
+    t.max_x = fmaxf(x[0], fmaxf(x[1], x[2]));
+    t.min_y = fminf(y[0], fminf(y[1], y[2]));
+    t.max_y = fmaxf(y[0], fmaxf(y[1], y[2]));
+    t.tile_x0 = (int)fmaxf(floorf(t.min_x / TILE_W), 0.0f);
+    t.tile_x1 = (int)fminf(floorf(t.max_x / TILE_W), mo->tiles_x - 1.0f);
+    t.tile_y0 = (int)fmaxf(floorf(t.min_y / TILE_H), 0.0f);
+    t.tile_y1 = (int)fminf(floorf(t.max_y / TILE_H), mo->tiles_y - 1.0f);
+    if (t.tile_x0 > t.tile_x1 || t.tile_y0 > t.tile_y1) {
+        return;
+    }
+
+    for (int i = 0; i < 3; i++) {
+        int j = (i + 1) % 3;
+        float dy = y[j] - y[i];
+        t.edge_x[i] = x[i];
+        t.edge_y[i] = y[i];
+        t.edge_dxdy[i] = dy != 0.0f ? (x[j] - x[i]) / dy : 0.0f;
+        // Inside is where the edge function has the sign of the area
+        t.edge_kind[i] = dy == 0.0f ? EDGE_NONE
+            : dy * area < 0.0f      ? EDGE_LEFT
+                                    : EDGE_RIGHT;
+    }
+
+    float dx1 = x[1] - x[0];
+    float dx2 = x[2] - x[0];
+    float dy1 = y[1] - y[0];
+    float dy2 = y[2] - y[0];
+    float dz1 = z[1] - z[0];
+    float dz2 = z[2] - z[0];
+    t.za = (dz1 * dy2 - dz2 * dy1) / area;
+    t.zb = (dx1 * dz2 - dx2 * dz1) / area;
+    t.zc = z[0] - t.za * x[0] - t.zb * y[0];
+    t.z_min = fminf(z[0], fminf(z[1], z[2]));
+
+    if (mo->triangle_count == mo->triangle_capacity) {
+        uint32_t capacity = mo->triangle_capacity ? mo->triangle_capacity * 2
+                                                  : 256;
+        struct masked_triangle* grown = realloc(mo->triangles,
+            capacity * sizeof(struct masked_triangle));
+        if (grown == NULL) {
+            fprintf(stderr, "masked_occlusion: out of memory for %u "
+                            "triangles\n",
+                capacity);
+            return;
+        }
+        mo->triangles = grown;
+        mo->triangle_capacity = capacity;
+    }
+    mo->triangles[mo->triangle_count++] = t;
+}
+
+// Distance in front of the near plane, z >= -w in OpenGL clip space
+static float near_distance(vec4 const v)
+{
+    return v[2] + v[3];
+}
+
+void masked_occlusion_add(struct masked_occlusion* mo, float const* positions,
+    size_t stride, uint32_t const* indices, uint32_t index_count, mat4 model)
+{
+    mat4 mvp;
+    glm_mat4_mul(mo->view_projection, model, mvp);
+
+    for (uint32_t i = 0; i + 2 < index_count; i += 3) {
+        vec4 in[3];
+        int inside = 0;
+        for (int k = 0; k < 3; k++) {
+            float const* p = (float const*)((char const*)positions
+                + indices[i + k] * stride);
+            vec4 v = { p[0], p[1], p[2], 1.0f };
+            glm_mat4_mulv(mvp, v, in[k]);
+            inside += near_distance(in[k]) >= 0.0f;
+        }
+        if (inside == 3) {
+            setup_triangle(mo, in);
+            continue;
+        }
+        if (inside == 0) {
+            continue;
+        }
+
+        /* Cut off the part behind the near plane, which leaves a triangle or
+         * a quad. The GPU never draws that part either.
+         */
+        vec4 poly[4];
+        int n = 0;
+        for (int k = 0; k < 3; k++) {
+            float* a = in[k];
+            float* b = in[(k + 1) % 3];
+            float da = near_distance(a);
+            float db = near_distance(b);
+            if (da >= 0.0f) {
+                glm_vec4_copy(a, poly[n++]);
+            }
+            if ((da >= 0.0f) != (db >= 0.0f)) {
+                glm_vec4_lerp(a, b, da / (da - db), poly[n++]);
+            }
+        }
+        vec4 tri[3];
+        for (int k = 1; k + 1 < n; k++) {
+            glm_vec4_copy(poly[0], tri[0]);
+            glm_vec4_copy(poly[k], tri[1]);
+            glm_vec4_copy(poly[k + 1], tri[2]);
+            setup_triangle(mo, tri);
+        }
+    }
+}
+
+/* Merge one triangle's coverage of a tile, whose pixels are all nearer than
+ * 'zt', into the tile. The working layer is thrown away when the triangle is
+ * much nearer than it, further from it than the layer is from z0, otherwise
+ * the two are merged at the farther depth.
+ */
+static inline void update_tile(uint32_t* mask, float* z0, float* z1,
+    uint32_t const cover[TILE_H], float zt)
+{
+    if (zt <= *z0) {
+        return;
+    }
+    uint32_t any_cover = 0;
+    uint32_t any_mask = 0;
+    for (int r = 0; r < TILE_H; r++) {
+        any_cover |= cover[r];
+        any_mask |= mask[r];
+    }
+    if (any_cover == 0) {
+        return;
+    }
+
+    if (any_mask == 0 || zt - *z1 > *z1 - *z0) {
+        *z1 = zt;
+        memcpy(mask, cover, TILE_H * sizeof(uint32_t));
+    } else {
+        *z1 = fminf(*z1, zt);
+        for (int r = 0; r < TILE_H; r++) {
+            mask[r] |= cover[r];
+        }
+    }
+
+    uint32_t full = ~0u;
+    for (int r = 0; r < TILE_H; r++) {
+        full &= mask[r];
+    }
+    if (full == ~0u) {
+        *z0 = *z1;
+        *z1 = 0.0f;
+        memset(mask, 0, TILE_H * sizeof(uint32_t));
+    }
+}
+
+// Farthest depth of the triangle's plane over the part of the tile it spans
+static inline float tile_depth(struct masked_triangle const* t, int tx, int ty)
+{
+    float x0 = fmaxf((float)(tx * TILE_W), t->min_x);
+    float x1 = fminf((float)((tx + 1) * TILE_W), t->max_x);
+    float y0 = fmaxf((float)(ty * TILE_H), t->min_y);
+    float y1 = fminf((float)((ty + 1) * TILE_H), t->max_y);
+    float z = t->za * (t->za < 0.0f ? x1 : x0)
+        + t->zb * (t->zb < 0.0f ? y1 : y0) + t->zc;
+    return fmaxf(z, t->z_min);
+}
+
+// Bits of the pixels at or right of 'start', pixel 0 is the highest bit
+static inline uint32_t bits_from(float start)
+{
+    if (start <= 0.0f) {
+        return ~0u;
+    }
+    if (start >= (float)TILE_W) {
+        return 0;
+    }
+    return ~0u >> (int)start;
+}
+
+static void raster_row_scalar(struct masked_occlusion* mo, int ty)
+{
+    for (uint32_t n = 0; n < mo->triangle_count; n++) {
+        struct masked_triangle const* t = &mo->triangles[n];
+        if (ty < t->tile_y0 || ty > t->tile_y1) {
+            continue;
+        }
+
+        // Edge crossings of the row centers, pixel centers are at + 0.5
+        float cross[3][TILE_H];
+        bool row_inside[TILE_H];
+        for (int r = 0; r < TILE_H; r++) {
+            float y = ty * TILE_H + r + 0.5f;
+            row_inside[r] = y >= t->min_y && y < t->max_y;
+            for (int e = 0; e < 3; e++) {
+                cross[e][r] = t->edge_x[e]
+                    + (y - t->edge_y[e]) * t->edge_dxdy[e] - 0.5f;
+            }
+        }
+
+        for (int tx = t->tile_x0; tx <= t->tile_x1; tx++) {
+            // Behind what already fills the tile, no need for coverage
+            uint32_t tile = ty * mo->tiles_x + tx;
+            float zt = tile_depth(t, tx, ty);
+            if (zt <= mo->z0[tile]) {
+                continue;
+            }
+            uint32_t cover[TILE_H];
+            for (int r = 0; r < TILE_H; r++) {
+                uint32_t bits = row_inside[r] ? ~0u : 0;
+                for (int e = 0; e < 3; e++) {
+                    uint32_t edge = bits_from(
+                        ceilf(cross[e][r] - (float)(tx * TILE_W)));
+                    if (t->edge_kind[e] == EDGE_LEFT) {
+                        bits &= edge;
+                    } else if (t->edge_kind[e] == EDGE_RIGHT) {
+                        bits &= ~edge;
+                    }
+                }
+                cover[r] = bits;
+            }
+            update_tile(mo->masks + tile * TILE_H, mo->z0 + tile,
+                mo->z1 + tile, cover, zt);
+        }
+    }
+}
+
+// Screen rectangle of a box and the depth of its nearest point
+struct screen_rect {
+    float min_x;
+    float max_x;
+    float min_y;
+    float max_y;
+    float max_z;
+};
+
+/* Project the corners of a box, which are the clip space center plus or
+ * minus the scaled axes. False if a corner is behind the near plane.
+ */
+static bool project_box_scalar(struct masked_occlusion const* mo,
+    vec3 center, vec3 extent, struct screen_rect* r)
+{
+    vec4 c = { center[0], center[1], center[2], 1.0f };
+    vec4 clip_center;
+    glm_mat4_mulv((vec4*)mo->view_projection, c, clip_center);
+    vec4 axes[3];
+    for (int a = 0; a < 3; a++) {
+        glm_vec4_scale((float*)mo->view_projection[a], extent[a], axes[a]);
+    }
+
+    *r = (struct screen_rect) { INFINITY, -INFINITY, INFINITY, -INFINITY,
+        0.0f };
+    for (int k = 0; k < 8; k++) {
+        vec4 v;
+        glm_vec4_copy(clip_center, v);
+        for (int a = 0; a < 3; a++) {
+            if (k & (1 << a)) {
+                glm_vec4_add(v, axes[a], v);
+            } else {
+                glm_vec4_sub(v, axes[a], v);
+            }
+        }
+        if (near_distance(v) < 0.0f) {
+            return false;
+        }
+        float z = 1.0f / v[3];
+        float x = (v[0] * z * 0.5f + 0.5f) * mo->width;
+        float y = (v[1] * z * 0.5f + 0.5f) * mo->height;
+        r->min_x = fminf(r->min_x, x);
+        r->max_x = fmaxf(r->max_x, x);
+        r->min_y = fminf(r->min_y, y);
+        r->max_y = fmaxf(r->max_y, y);
+        r->max_z = fmaxf(r->max_z, z);
+    }
+    return true;
+}
+
+static bool test_rect_scalar(struct masked_occlusion const* mo, int tx0,
+    int tx1, int ty0, int ty1, float z)
+{
+    for (int ty = ty0; ty <= ty1; ty++) {
+        for (int tx = tx0; tx <= tx1; tx++) {
+            if (z >= mo->z0[ty * mo->tiles_x + tx]) {
+                return true;
+            }
+        }
+    }
+    return false;
+}
+
+#ifdef MASKED_OCCLUSION_X86
+/* The 8 rows of a tile are the 8 lanes, so one variable shift per edge makes
+ * the coverage of the whole tile
+ */
+__attribute__((target("avx2,fma"))) static void raster_row_avx2(
+    struct masked_occlusion* mo, int ty)
+{
+    __m256 const row_y = _mm256_add_ps(
+        _mm256_setr_ps(0.5f, 1.5f, 2.5f, 3.5f, 4.5f, 5.5f, 6.5f, 7.5f),
+        _mm256_set1_ps((float)(ty * TILE_H)));
+    __m256i const ones = _mm256_set1_epi32(-1);
+    __m256 const zero = _mm256_setzero_ps();
+    __m256 const tile_width = _mm256_set1_ps((float)TILE_W);
+
+    for (uint32_t n = 0; n < mo->triangle_count; n++) {
+        struct masked_triangle const* t = &mo->triangles[n];
+        if (ty < t->tile_y0 || ty > t->tile_y1) {
+            continue;
+        }
+
+        __m256 inside = _mm256_and_ps(
+            _mm256_cmp_ps(row_y, _mm256_set1_ps(t->min_y), _CMP_GE_OQ),
+            _mm256_cmp_ps(row_y, _mm256_set1_ps(t->max_y), _CMP_LT_OQ));
+        __m256i row_inside = _mm256_castps_si256(inside);
+        __m256 cross[3];
+        for (int e = 0; e < 3; e++) {
+            cross[e] = _mm256_fmadd_ps(
+                _mm256_sub_ps(row_y, _mm256_set1_ps(t->edge_y[e])),
+                _mm256_set1_ps(t->edge_dxdy[e]),
+                _mm256_set1_ps(t->edge_x[e] - 0.5f));
+        }
+
+        for (int tx = t->tile_x0; tx <= t->tile_x1; tx++) {
+            uint32_t tile = ty * mo->tiles_x + tx;
+            float zt = tile_depth(t, tx, ty);
+            if (zt <= mo->z0[tile]) {
+                continue;
+            }
+            __m256 tile_x = _mm256_set1_ps((float)(tx * TILE_W));
+            __m256i bits = row_inside;
+            for (int e = 0; e < 3; e++) {
+                if (t->edge_kind[e] == EDGE_NONE) {
+                    continue;
+                }
+                __m256 start = _mm256_ceil_ps(_mm256_sub_ps(cross[e], tile_x));
+                start = _mm256_min_ps(_mm256_max_ps(start, zero), tile_width);
+                // Shifting by 32 or more gives 0, no special case needed
+                __m256i edge = _mm256_srlv_epi32(ones,
+                    _mm256_cvttps_epi32(start));
+                bits = t->edge_kind[e] == EDGE_LEFT
+                    ? _mm256_and_si256(bits, edge)
+                    : _mm256_andnot_si256(edge, bits);
+            }
+            uint32_t cover[TILE_H];
+            _mm256_storeu_si256((__m256i*)cover, bits);
+            update_tile(mo->masks + tile * TILE_H, mo->z0 + tile,
+                mo->z1 + tile, cover, zt);
+        }
+    }
+}
+
+__attribute__((target("avx2"))) static float reduce_min(__m256 v)
+{
+    __m128 m = _mm_min_ps(_mm256_castps256_ps128(v),
+        _mm256_extractf128_ps(v, 1));
+    m = _mm_min_ps(m, _mm_movehl_ps(m, m));
+    return _mm_cvtss_f32(_mm_min_ss(m, _mm_movehdup_ps(m)));
+}
+
+__attribute__((target("avx2"))) static float reduce_max(__m256 v)
+{
+    __m128 m = _mm_max_ps(_mm256_castps256_ps128(v),
+        _mm256_extractf128_ps(v, 1));
+    m = _mm_max_ps(m, _mm_movehl_ps(m, m));
+    return _mm_cvtss_f32(_mm_max_ss(m, _mm_movehdup_ps(m)));
+}
+
+// The 8 corners of the box are the 8 lanes
+__attribute__((target("avx2,fma"))) static bool project_box_avx2(
+    struct masked_occlusion const* mo, vec3 center, vec3 extent,
+    struct screen_rect* r)
+{
+    __m256 const sign[3] = {
+        _mm256_setr_ps(-1, 1, -1, 1, -1, 1, -1, 1),
+        _mm256_setr_ps(-1, -1, 1, 1, -1, -1, 1, 1),
+        _mm256_setr_ps(-1, -1, -1, -1, 1, 1, 1, 1)
+    };
+    __m256 corner[3];
+    for (int a = 0; a < 3; a++) {
+        corner[a] = _mm256_fmadd_ps(sign[a], _mm256_set1_ps(extent[a]),
+            _mm256_set1_ps(center[a]));
+    }
+    __m256 v[4];
+    for (int j = 0; j < 4; j++) {
+        mat4 const* m = (mat4 const*)&mo->view_projection;
+        v[j] = _mm256_fmadd_ps(_mm256_set1_ps((*m)[0][j]), corner[0],
+            _mm256_fmadd_ps(_mm256_set1_ps((*m)[1][j]), corner[1],
+                _mm256_fmadd_ps(_mm256_set1_ps((*m)[2][j]), corner[2],
+                    _mm256_set1_ps((*m)[3][j]))));
+    }
+    if (_mm256_movemask_ps(_mm256_cmp_ps(_mm256_add_ps(v[2], v[3]),
+            _mm256_setzero_ps(), _CMP_LT_OQ))) {
+        return false;
+    }
+    __m256 z = _mm256_div_ps(_mm256_set1_ps(1.0f), v[3]);
+    __m256 half_width = _mm256_set1_ps(0.5f * mo->width);
+    __m256 half_height = _mm256_set1_ps(0.5f * mo->height);
+    __m256 x = _mm256_fmadd_ps(_mm256_mul_ps(v[0], z), half_width,
+        half_width);
+    __m256 y = _mm256_fmadd_ps(_mm256_mul_ps(v[1], z), half_height,
+        half_height);
+    r->min_x = reduce_min(x);
+    r->max_x = reduce_max(x);
+    r->min_y = reduce_min(y);
+    r->max_y = reduce_max(y);
+    r->max_z = reduce_max(z);
+    return true;
+}
+
+__attribute__((target("avx2"))) static bool test_rect_avx2(
+    struct masked_occlusion const* mo, int tx0, int tx1, int ty0, int ty1,
+    float z)
+{
+    __m256 const box_z = _mm256_set1_ps(z);
+    __m256i const lane = _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7);
+    for (int ty = ty0; ty <= ty1; ty++) {
+        float const* row = mo->z0 + ty * mo->tiles_x;
+        for (int tx = tx0; tx <= tx1; tx += 8) {
+            // Lanes past tx1 are masked off, and not loaded at all
+            __m256i valid = _mm256_cmpgt_epi32(_mm256_set1_epi32(tx1 - tx + 1),
+                lane);
+            __m256 tiles = _mm256_maskload_ps(row + tx, valid);
+            __m256 nearer = _mm256_cmp_ps(box_z, tiles, _CMP_GE_OQ);
+            if (_mm256_movemask_ps(_mm256_and_ps(nearer,
+                    _mm256_castsi256_ps(valid)))) {
+                return true;
+            }
+        }
+    }
+    return false;
+}
+#endif
+
+static void raster_row_task(void* data, unsigned int index)
+{
+    struct masked_occlusion* mo = data;
+#ifdef MASKED_OCCLUSION_X86
+    if (mo->level >= SIMD_AVX2) {
+        raster_row_avx2(mo, (int)index);
+        return;
+    }
+#endif
+    raster_row_scalar(mo, (int)index);
+}
+
+void masked_occlusion_flush(struct masked_occlusion* mo,
+    struct thread_pool* pool)
+{
+    // Rows of tiles share nothing, so each task owns its row
+    if (pool != NULL) {
+        thread_pool_for(pool, mo->tiles_y, raster_row_task, mo);
+    } else {
+        for (uint32_t ty = 0; ty < mo->tiles_y; ty++) {
+            raster_row_task(mo, ty);
+        }
+    }
+    mo->triangle_count = 0;
+}
+
+static bool project_box(struct masked_occlusion const* mo, vec3 center,
+    vec3 extent, struct screen_rect* r)
+{
+#ifdef MASKED_OCCLUSION_X86
+    if (mo->level >= SIMD_AVX2) {
+        return project_box_avx2(mo, center, extent, r);
+    }
+#endif
+    return project_box_scalar(mo, center, extent, r);
+}
+
+bool masked_occlusion_test_aabb(struct masked_occlusion const* mo,
+    vec3 center, vec3 extent)
+{
+    // A box reaching past the near plane is too close to say anything
+    struct screen_rect r;
+    if (!project_box(mo, center, extent, &r)) {
+        return true;
+    }
+
+    // Nothing of it is on screen
+    if (r.max_x < 0.0f || r.max_y < 0.0f || r.min_x >= mo->width
+        || r.min_y >= mo->height) {
+        return false;
+    }
+    int tx0 = (int)fmaxf(floorf(r.min_x / TILE_W), 0.0f);
+    int tx1 = (int)fminf(floorf(r.max_x / TILE_W), mo->tiles_x - 1.0f);
+    int ty0 = (int)fmaxf(floorf(r.min_y / TILE_H), 0.0f);
+    int ty1 = (int)fminf(floorf(r.max_y / TILE_H), mo->tiles_y - 1.0f);
+#ifdef MASKED_OCCLUSION_X86
+    if (mo->level >= SIMD_AVX2) {
+        return test_rect_avx2(mo, tx0, tx1, ty0, ty1, r.max_z);
+    }
+#endif
+    return test_rect_scalar(mo, tx0, tx1, ty0, ty1, r.max_z);
+}
+
+size_t masked_occlusion_cull(struct masked_occlusion const* mo,
+    struct aabb_soa boxes, uint32_t const* objects, size_t count,
+    uint32_t* visible)
+{
+    size_t n = 0;
+    for (size_t k = 0; k < count; k++) {
+        uint32_t i = objects[k];
+        vec3 center = {
+            boxes.center_x[i], boxes.center_y[i], boxes.center_z[i]
+        };
+        vec3 extent = {
+            boxes.extent_x[i], boxes.extent_y[i], boxes.extent_z[i]
+        };
+        if (masked_occlusion_test_aabb(mo, center, extent)) {
+            visible[n++] = i;
+        }
+    }
+    return n;
+}
@@ -0,0 +1,93 @@
+#ifndef MASKED_OCCLUSION_H
+#define MASKED_OCCLUSION_H
+#include <cglm/cglm.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "cpu_features.h"
+#include "math_batch.h"
+#include "thread_pool.h"
+
+// A tile is 32 pixels wide, one bit each, and 8 rows high
+#define MASKED_OCCLUSION_TILE_WIDTH 32
+#define MASKED_OCCLUSION_TILE_HEIGHT 8
+
+// Occluder triangle after clipping and projection, see masked_occlusion.c
+struct masked_triangle;
+
+/* CPU occlusion culling after Hasselgren, Andersson and Akenine-Möller,
+ * "Masked Software Occlusion Culling".
+ *
+ * Occluders are rasterized into a small depth buffer made of tiles. Each
+ * tile keeps a coverage bit per pixel and two depths instead of a depth per
+ * pixel: every pixel of the tile is nearer than z0, and the pixels whose bit
+ * is set are also nearer than z1. Once the bits fill up, z1 becomes the new
+ * z0. Depths are 1 / w, so larger is nearer and a cleared tile is 0.
+ *
+ * Boxes are then tested against z0 of the tiles their screen rectangle
+ * touches, on the CPU before any draw call is made. Like the GPU it samples
+ * pixel centers, so a box is only reported hidden when it is behind the
+ * occluders at the resolution of the buffer.
+ */
+struct masked_occlusion {
+    uint32_t width;
+    uint32_t height;
+    uint32_t tiles_x;
+    uint32_t tiles_y;
+    uint32_t* masks;
+    float* z0;
+    float* z1;
+
+    mat4 view_projection;
+    enum simd_level level;
+
+    // Occluder triangles since the last clear, rasterized by flush
+    struct masked_triangle* triangles;
+    uint32_t triangle_count;
+    uint32_t triangle_capacity;
+};
+
+/* Buffer of at least 'width' by 'height' pixels, rounded up to whole tiles.
+ * Picks the AVX2 kernels when the CPU has them.
+ */
+bool masked_occlusion_init(struct masked_occlusion* mo, uint32_t width,
+    uint32_t height);
+
+void masked_occlusion_free(struct masked_occlusion* mo);
+
+// Use the scalar or AVX2 kernels, capped to what the CPU supports
+void masked_occlusion_use_level(struct masked_occlusion* mo,
+    enum simd_level level);
+
+// Empty the buffer and set the camera for the next frame
+void masked_occlusion_clear(struct masked_occlusion* mo,
+    mat4 view_projection);
+
+/* Queue the triangles 'indices' of an occluder with 'index_count' indices.
+ * Positions are three floats every 'stride' bytes from 'positions' and are
+ * moved by 'model' first. Triangles are clipped to the near plane here and
+ * drawn by masked_occlusion_flush. Occluders must lie inside the object they
+ * stand for, or they would hide things that are not hidden.
+ */
+void masked_occlusion_add(struct masked_occlusion* mo, float const* positions,
+    size_t stride, uint32_t const* indices, uint32_t index_count, mat4 model);
+
+/* Rasterize the queued occluders, one row of tiles per task on 'pool'.
+ * 'pool' may be NULL to do it all on the calling thread.
+ */
+void masked_occlusion_flush(struct masked_occlusion* mo,
+    struct thread_pool* pool);
+
+// False when the box is certainly hidden behind the occluders
+bool masked_occlusion_test_aabb(struct masked_occlusion const* mo,
+    vec3 center, vec3 extent);
+
+/* Test the 'count' boxes listed in 'objects' and write the ones that may be
+ * visible to 'visible', in the same order. Returns how many were written.
+ * 'visible' may be 'objects'.
+ */
+size_t masked_occlusion_cull(struct masked_occlusion const* mo,
+    struct aabb_soa boxes, uint32_t const* objects, size_t count,
+    uint32_t* visible);
+#endif
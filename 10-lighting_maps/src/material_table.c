@@ -0,0 +1,50 @@
+#include <glad/glad.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "gpu_memory.h"
+#include "material_table.h"
+
+_Static_assert(sizeof(struct material_table_entry)
+        == MATERIAL_TABLE_TEXELS * 4 * sizeof(float),
+    "material table entries have to be whole texels");
+
+bool material_table_init(struct material_table* t,
+    struct material_table_entry const* entries, uint32_t count,
+    char const* label)
+{
+    memset(t, 0, sizeof(*t));
+    GLint max_texels;
+    glGetIntegerv(GL_MAX_TEXTURE_BUFFER_SIZE, &max_texels);
+    if ((uint64_t)count * MATERIAL_TABLE_TEXELS > (uint64_t)max_texels) {
+        fprintf(stderr, "material_table: %s has %u materials, at most %d\n",
+            label, count, max_texels / MATERIAL_TABLE_TEXELS);
+        return false;
+    }
+    t->count = count;
+    t->buffer = gpu_buffer_create(GPU_MEMORY_UNIFORM, label);
+    glBindBuffer(GL_TEXTURE_BUFFER, t->buffer);
+    gpu_buffer_data(t->buffer, GL_TEXTURE_BUFFER,
+        count * sizeof(struct material_table_entry), entries, GL_STATIC_DRAW);
+    glBindBuffer(GL_TEXTURE_BUFFER, 0);
+
+    glGenTextures(1, &t->texture);
+    glBindTexture(GL_TEXTURE_BUFFER, t->texture);
+    glTexBuffer(GL_TEXTURE_BUFFER, GL_RGBA32F, t->buffer);
+    glBindTexture(GL_TEXTURE_BUFFER, 0);
+    return true;
+}
+
+void material_table_free(struct material_table* t)
+{
+    glDeleteTextures(1, &t->texture);
+    gpu_buffers_delete(1, &t->buffer);
+    memset(t, 0, sizeof(*t));
+}
+
+void material_table_bind(struct material_table const* t, int unit)
+{
+    glActiveTexture(GL_TEXTURE0 + unit);
+    glBindTexture(GL_TEXTURE_BUFFER, t->texture);
+    glActiveTexture(GL_TEXTURE0);
+}
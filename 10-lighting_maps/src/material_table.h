@@ -0,0 +1,43 @@
+#ifndef MATERIAL_TABLE_H
+#define MATERIAL_TABLE_H
+#include <stdbool.h>
+#include <stdint.h>
+
+// RGBA32F texels each material takes in the table
+#define MATERIAL_TABLE_TEXELS 3
+
+/* What shader.fs needs to shade with a material whose maps are in a texture
+ * atlas, laid out as the texels it fetches
+ */
+struct material_table_entry {
+    // Offset and size of the maps in their layers, see atlas_entry
+    float diffuse_rect[4];
+    float specular_rect[4];
+    float diffuse_layer;
+    float specular_layer;
+    float shininess;
+    float unused;
+};
+
+/* Every material in one buffer texture. Vertices carry an index into it
+ * instead of the material being set through uniforms, so changing materials
+ * no longer splits draws and any number of them share an instanced draw.
+ */
+struct material_table {
+    unsigned int buffer;
+    // The samplerBuffer view of 'buffer', it has no storage of its own
+    unsigned int texture;
+    uint32_t count;
+};
+
+/* Upload 'count' entries. False when the table would be larger than a buffer
+ * texture can be.
+ */
+bool material_table_init(struct material_table* t,
+    struct material_table_entry const* entries, uint32_t count,
+    char const* label);
+void material_table_free(struct material_table* t);
+
+// Bind the table to texture unit 'unit' for a samplerBuffer
+void material_table_bind(struct material_table const* t, int unit);
+#endif
@@ -0,0 +1,331 @@
+#include <cglm/cglm.h>
+#include <math.h>
+
+#include "math_batch.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define MATH_BATCH_X86
+#endif
+
+struct batch_kernels {
+    void (*mat4_mul)(struct mat4_soa a, struct mat4_soa b,
+        struct mat4_soa dest, size_t begin, size_t end);
+    void (*transform_points)(mat4 m, struct vec3_soa in, struct vec3_soa out,
+        size_t begin, size_t end);
+    void (*transform_vectors)(mat4 m, struct vec3_soa in,
+        struct vec3_soa out, size_t begin, size_t end);
+    void (*transform_aabbs)(mat4 m, struct aabb_soa in, struct aabb_soa out,
+        size_t begin, size_t end);
+    void (*normalize)(struct vec3_soa in, struct vec3_soa out, size_t begin,
+        size_t end);
+    void (*quat_mat4)(struct quat_soa q, struct mat4_soa dest, size_t begin,
+        size_t end);
+};
+
+/* Scalar reference kernels. They work on [begin, end) so the SIMD kernels can
+ * hand them the elements left over after the last full vector.
+ */
+static void mat4_mul_scalar(struct mat4_soa a, struct mat4_soa b,
+    struct mat4_soa dest, size_t begin, size_t end)
+{
+    for (size_t i = begin; i < end; i++) {
+        float r[16];
+        for (int col = 0; col < 4; col++) {
+            for (int row = 0; row < 4; row++) {
+                r[col * 4 + row] = a.m[0 * 4 + row][i] * b.m[col * 4 + 0][i]
+                    + a.m[1 * 4 + row][i] * b.m[col * 4 + 1][i]
+                    + a.m[2 * 4 + row][i] * b.m[col * 4 + 2][i]
+                    + a.m[3 * 4 + row][i] * b.m[col * 4 + 3][i];
+            }
+        }
+        for (int k = 0; k < 16; k++) {
+            dest.m[k][i] = r[k];
+        }
+    }
+}
+
+static void transform_points_scalar(mat4 m, struct vec3_soa in,
+    struct vec3_soa out, size_t begin, size_t end)
+{
+    for (size_t i = begin; i < end; i++) {
+        float x = in.x[i];
+        float y = in.y[i];
+        float z = in.z[i];
+        out.x[i] = m[0][0] * x + m[1][0] * y + m[2][0] * z + m[3][0];
+        out.y[i] = m[0][1] * x + m[1][1] * y + m[2][1] * z + m[3][1];
+        out.z[i] = m[0][2] * x + m[1][2] * y + m[2][2] * z + m[3][2];
+    }
+}
+
+static void transform_vectors_scalar(mat4 m, struct vec3_soa in,
+    struct vec3_soa out, size_t begin, size_t end)
+{
+    for (size_t i = begin; i < end; i++) {
+        float x = in.x[i];
+        float y = in.y[i];
+        float z = in.z[i];
+        out.x[i] = m[0][0] * x + m[1][0] * y + m[2][0] * z;
+        out.y[i] = m[0][1] * x + m[1][1] * y + m[2][1] * z;
+        out.z[i] = m[0][2] * x + m[1][2] * y + m[2][2] * z;
+    }
+}
+
+/* Center moves like a point. The new half size along an axis is the sum of
+ * the old half sizes projected onto it, |m| * extent (Arvo's method).
+ */
+static void transform_aabbs_scalar(mat4 m, struct aabb_soa in,
+    struct aabb_soa out, size_t begin, size_t end)
+{
+    for (size_t i = begin; i < end; i++) {
+        float cx = in.center_x[i];
+        float cy = in.center_y[i];
+        float cz = in.center_z[i];
+        float ex = in.extent_x[i];
+        float ey = in.extent_y[i];
+        float ez = in.extent_z[i];
+        out.center_x[i] = m[0][0] * cx + m[1][0] * cy + m[2][0] * cz + m[3][0];
+        out.center_y[i] = m[0][1] * cx + m[1][1] * cy + m[2][1] * cz + m[3][1];
+        out.center_z[i] = m[0][2] * cx + m[1][2] * cy + m[2][2] * cz + m[3][2];
+        out.extent_x[i] = fabsf(m[0][0]) * ex + fabsf(m[1][0]) * ey
+            + fabsf(m[2][0]) * ez;
+        out.extent_y[i] = fabsf(m[0][1]) * ex + fabsf(m[1][1]) * ey
+            + fabsf(m[2][1]) * ez;
+        out.extent_z[i] = fabsf(m[0][2]) * ex + fabsf(m[1][2]) * ey
+            + fabsf(m[2][2]) * ez;
+    }
+}
+
+static void normalize_scalar(struct vec3_soa in, struct vec3_soa out,
+    size_t begin, size_t end)
+{
+    for (size_t i = begin; i < end; i++) {
+        float x = in.x[i];
+        float y = in.y[i];
+        float z = in.z[i];
+        float len2 = x * x + y * y + z * z;
+        float inv = len2 > 0.0f ? 1.0f / sqrtf(len2) : 0.0f;
+        out.x[i] = x * inv;
+        out.y[i] = y * inv;
+        out.z[i] = z * inv;
+    }
+}
+
+static void quat_mat4_scalar(struct quat_soa q, struct mat4_soa dest,
+    size_t begin, size_t end)
+{
+    for (size_t i = begin; i < end; i++) {
+        float x = q.x[i];
+        float y = q.y[i];
+        float z = q.z[i];
+        float w = q.w[i];
+        float norm2 = x * x + y * y + z * z + w * w;
+        float s = norm2 > 0.0f ? 2.0f / norm2 : 0.0f;
+
+        float xx = s * x * x, xy = s * x * y, xz = s * x * z;
+        float yy = s * y * y, yz = s * y * z, zz = s * z * z;
+        float wx = s * w * x, wy = s * w * y, wz = s * w * z;
+
+        dest.m[0][i] = 1.0f - yy - zz;
+        dest.m[1][i] = xy + wz;
+        dest.m[2][i] = xz - wy;
+        dest.m[3][i] = 0.0f;
+        dest.m[4][i] = xy - wz;
+        dest.m[5][i] = 1.0f - xx - zz;
+        dest.m[6][i] = yz + wx;
+        dest.m[7][i] = 0.0f;
+        dest.m[8][i] = xz + wy;
+        dest.m[9][i] = yz - wx;
+        dest.m[10][i] = 1.0f - xx - yy;
+        dest.m[11][i] = 0.0f;
+        dest.m[12][i] = 0.0f;
+        dest.m[13][i] = 0.0f;
+        dest.m[14][i] = 0.0f;
+        dest.m[15][i] = 1.0f;
+    }
+}
+
+static struct batch_kernels const kernels_scalar = {
+    .mat4_mul = mat4_mul_scalar,
+    .transform_points = transform_points_scalar,
+    .transform_vectors = transform_vectors_scalar,
+    .transform_aabbs = transform_aabbs_scalar,
+    .normalize = normalize_scalar,
+    .quat_mat4 = quat_mat4_scalar
+};
+
+#ifdef MATH_BATCH_X86
+/* The SIMD kernels are written once in math_batch_simd.h against the small
+ * set of vector operations below and instantiated for each instruction set.
+ */
+#define BATCH_NAME(name) name##_sse2
+#define BATCH_TARGET __attribute__((target("sse2")))
+#define BATCH_WIDTH 4
+#define bvec __m128
+#define bload(p) _mm_loadu_ps(p)
+#define bstore(p, v) _mm_storeu_ps((p), (v))
+#define bset1(x) _mm_set1_ps(x)
+#define badd(a, b) _mm_add_ps((a), (b))
+#define bsub(a, b) _mm_sub_ps((a), (b))
+#define bmul(a, b) _mm_mul_ps((a), (b))
+#define bfmadd(a, b, c) _mm_add_ps(_mm_mul_ps((a), (b)), (c))
+#define babs(a) _mm_andnot_ps(_mm_set1_ps(-0.0f), (a))
+#define bsqrt(a) _mm_sqrt_ps(a)
+#define bdiv_positive(a, b) \
+    _mm_and_ps(_mm_cmpgt_ps((b), _mm_setzero_ps()), _mm_div_ps((a), (b)))
+#include "math_batch_simd.h"
+
+#define BATCH_NAME(name) name##_avx2
+#define BATCH_TARGET __attribute__((target("avx2,fma")))
+#define BATCH_WIDTH 8
+#define bvec __m256
+#define bload(p) _mm256_loadu_ps(p)
+#define bstore(p, v) _mm256_storeu_ps((p), (v))
+#define bset1(x) _mm256_set1_ps(x)
+#define badd(a, b) _mm256_add_ps((a), (b))
+#define bsub(a, b) _mm256_sub_ps((a), (b))
+#define bmul(a, b) _mm256_mul_ps((a), (b))
+#define bfmadd(a, b, c) _mm256_fmadd_ps((a), (b), (c))
+#define babs(a) _mm256_andnot_ps(_mm256_set1_ps(-0.0f), (a))
+#define bsqrt(a) _mm256_sqrt_ps(a)
+#define bdiv_positive(a, b)                                              \
+    _mm256_and_ps(_mm256_cmp_ps((b), _mm256_setzero_ps(), _CMP_GT_OQ), \
+        _mm256_div_ps((a), (b)))
+#include "math_batch_simd.h"
+
+#define BATCH_NAME(name) name##_avx512
+#define BATCH_TARGET __attribute__((target("avx512f")))
+#define BATCH_WIDTH 16
+#define bvec __m512
+#define bload(p) _mm512_loadu_ps(p)
+#define bstore(p, v) _mm512_storeu_ps((p), (v))
+#define bset1(x) _mm512_set1_ps(x)
+#define badd(a, b) _mm512_add_ps((a), (b))
+#define bsub(a, b) _mm512_sub_ps((a), (b))
+#define bmul(a, b) _mm512_mul_ps((a), (b))
+#define bfmadd(a, b, c) _mm512_fmadd_ps((a), (b), (c))
+#define babs(a) _mm512_abs_ps(a)
+#define bsqrt(a) _mm512_sqrt_ps(a)
+#define bdiv_positive(a, b)                                            \
+    _mm512_maskz_div_ps(                                               \
+        _mm512_cmp_ps_mask((b), _mm512_setzero_ps(), _CMP_GT_OQ), (a), \
+        (b))
+#include "math_batch_simd.h"
+
+static struct batch_kernels const kernels_sse2 = {
+    .mat4_mul = mat4_mul_sse2,
+    .transform_points = transform_points_sse2,
+    .transform_vectors = transform_vectors_sse2,
+    .transform_aabbs = transform_aabbs_sse2,
+    .normalize = normalize_sse2,
+    .quat_mat4 = quat_mat4_sse2
+};
+
+static struct batch_kernels const kernels_avx2 = {
+    .mat4_mul = mat4_mul_avx2,
+    .transform_points = transform_points_avx2,
+    .transform_vectors = transform_vectors_avx2,
+    .transform_aabbs = transform_aabbs_avx2,
+    .normalize = normalize_avx2,
+    .quat_mat4 = quat_mat4_avx2
+};
+
+static struct batch_kernels const kernels_avx512 = {
+    .mat4_mul = mat4_mul_avx512,
+    .transform_points = transform_points_avx512,
+    .transform_vectors = transform_vectors_avx512,
+    .transform_aabbs = transform_aabbs_avx512,
+    .normalize = normalize_avx512,
+    .quat_mat4 = quat_mat4_avx512
+};
+#endif
+
+static struct batch_kernels const* kernels = &kernels_scalar;
+static enum simd_level kernels_level = SIMD_SCALAR;
+
+void math_batch_init(void)
+{
+    math_batch_use_level(cpu_simd_level());
+}
+
+void math_batch_use_level(enum simd_level level)
+{
+    if (level > cpu_simd_level()) {
+        level = cpu_simd_level();
+    }
+
+    kernels = &kernels_scalar;
+    kernels_level = SIMD_SCALAR;
+#ifdef MATH_BATCH_X86
+    // There is no separate AVX set, 8 wide without FMA is not worth it
+    if (level >= SIMD_SSE2) {
+        kernels = &kernels_sse2;
+        kernels_level = SIMD_SSE2;
+    }
+    if (level >= SIMD_AVX2) {
+        kernels = &kernels_avx2;
+        kernels_level = SIMD_AVX2;
+    }
+    if (level >= SIMD_AVX512) {
+        kernels = &kernels_avx512;
+        kernels_level = SIMD_AVX512;
+    }
+#endif
+}
+
+enum simd_level math_batch_level(void)
+{
+    return kernels_level;
+}
+
+void batch_mat4_mul(struct mat4_soa a, struct mat4_soa b,
+    struct mat4_soa dest, size_t count)
+{
+    kernels->mat4_mul(a, b, dest, 0, count);
+}
+
+void batch_transform_points(mat4 m, struct vec3_soa in, struct vec3_soa out,
+    size_t count)
+{
+    kernels->transform_points(m, in, out, 0, count);
+}
+
+void batch_transform_vectors(mat4 m, struct vec3_soa in, struct vec3_soa out,
+    size_t count)
+{
+    kernels->transform_vectors(m, in, out, 0, count);
+}
+
+void batch_transform_aabbs(mat4 m, struct aabb_soa in, struct aabb_soa out,
+    size_t count)
+{
+    kernels->transform_aabbs(m, in, out, 0, count);
+}
+
+void batch_normalize(struct vec3_soa in, struct vec3_soa out, size_t count)
+{
+    kernels->normalize(in, out, 0, count);
+}
+
+void batch_quat_mat4(struct quat_soa q, struct mat4_soa dest, size_t count)
+{
+    kernels->quat_mat4(q, dest, 0, count);
+}
+
+void batch_mat4_from_soa(struct mat4_soa soa, mat4* dest, size_t count)
+{
+    for (size_t i = 0; i < count; i++) {
+        for (int k = 0; k < 16; k++) {
+            dest[i][k / 4][k % 4] = soa.m[k][i];
+        }
+    }
+}
+
+void batch_mat4_to_soa(mat4* src, struct mat4_soa soa, size_t count)
+{
+    for (size_t i = 0; i < count; i++) {
+        for (int k = 0; k < 16; k++) {
+            soa.m[k][i] = src[i][k / 4][k % 4];
+        }
+    }
+}
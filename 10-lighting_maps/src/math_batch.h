@@ -0,0 +1,79 @@
+#ifndef MATH_BATCH_H
+#define MATH_BATCH_H
+#include <cglm/cglm.h>
+#include <stddef.h>
+
+#include "cpu_features.h"
+
+/* Structure-of-arrays buffers. Every pointer is a separate array holding one
+ * component of 'count' elements, so the kernels below can load 4, 8 or 16
+ * elements with a single instruction. Arrays do not need to be aligned.
+ */
+struct vec3_soa {
+    float* x;
+    float* y;
+    float* z;
+};
+
+struct quat_soa {
+    float* x;
+    float* y;
+    float* z;
+    float* w;
+};
+
+// Axis aligned boxes stored as center and half size
+struct aabb_soa {
+    float* center_x;
+    float* center_y;
+    float* center_z;
+    float* extent_x;
+    float* extent_y;
+    float* extent_z;
+};
+
+// 4x4 matrices, m[column * 4 + row] is one array like in cglm's mat4
+struct mat4_soa {
+    float* m[16];
+};
+
+/* Each operation has a scalar reference and SSE2, AVX2+FMA and AVX-512
+ * kernels. math_batch_init picks the widest one the CPU supports, before
+ * that the scalar ones are used. In place operation (out == in) is allowed.
+ */
+void math_batch_init(void);
+
+/* Use the kernels for 'level' instead, capped to what the CPU supports. The
+ * microbenchmark uses this to compare the kernel sets on one machine.
+ */
+void math_batch_use_level(enum simd_level level);
+
+// Level of the kernels in use
+enum simd_level math_batch_level(void);
+
+// dest[i] = a[i] * b[i]
+void batch_mat4_mul(struct mat4_soa a, struct mat4_soa b,
+    struct mat4_soa dest, size_t count);
+
+// out[i] = m * (in[i], 1), the w component is assumed to stay 1
+void batch_transform_points(mat4 m, struct vec3_soa in, struct vec3_soa out,
+    size_t count);
+
+// out[i] = m * (in[i], 0)
+void batch_transform_vectors(mat4 m, struct vec3_soa in, struct vec3_soa out,
+    size_t count);
+
+// Bounding boxes of the boxes in 'in' after transforming them with 'm'
+void batch_transform_aabbs(mat4 m, struct aabb_soa in, struct aabb_soa out,
+    size_t count);
+
+// Zero length vectors stay zero, like glm_vec3_normalize
+void batch_normalize(struct vec3_soa in, struct vec3_soa out, size_t count);
+
+// Rotation matrices of the quaternions, which do not need to be unit length
+void batch_quat_mat4(struct quat_soa q, struct mat4_soa dest, size_t count);
+
+// Move between cglm's mat4 and the SoA layout, for GL uploads for example
+void batch_mat4_from_soa(struct mat4_soa soa, mat4* dest, size_t count);
+void batch_mat4_to_soa(mat4* src, struct mat4_soa soa, size_t count);
+#endif
@@ -0,0 +1,190 @@
+/* SIMD kernels for math_batch.c. This file is included once per instruction
+ * set with BATCH_NAME, BATCH_TARGET, BATCH_WIDTH, bvec and the b* vector
+ * operations defined, and undefines them again at the end. No include guard
+ * on purpose.
+ *
+ * Every kernel does full vectors of BATCH_WIDTH elements and hands the rest to
+ * the scalar reference kernel.
+ */
+
+BATCH_TARGET static void BATCH_NAME(mat4_mul)(struct mat4_soa a,
+    struct mat4_soa b, struct mat4_soa dest, size_t begin, size_t end)
+{
+    size_t i = begin;
+    for (; i + BATCH_WIDTH <= end; i += BATCH_WIDTH) {
+        bvec av[16];
+        for (int k = 0; k < 16; k++) {
+            av[k] = bload(a.m[k] + i);
+        }
+        // All results are computed before any store so dest may alias a or b
+        bvec r[16];
+        for (int col = 0; col < 4; col++) {
+            bvec b0 = bload(b.m[col * 4 + 0] + i);
+            bvec b1 = bload(b.m[col * 4 + 1] + i);
+            bvec b2 = bload(b.m[col * 4 + 2] + i);
+            bvec b3 = bload(b.m[col * 4 + 3] + i);
+            for (int row = 0; row < 4; row++) {
+                bvec sum = bmul(av[0 * 4 + row], b0);
+                sum = bfmadd(av[1 * 4 + row], b1, sum);
+                sum = bfmadd(av[2 * 4 + row], b2, sum);
+                r[col * 4 + row] = bfmadd(av[3 * 4 + row], b3, sum);
+            }
+        }
+        for (int k = 0; k < 16; k++) {
+            bstore(dest.m[k] + i, r[k]);
+        }
+    }
+    mat4_mul_scalar(a, b, dest, i, end);
+}
+
+BATCH_TARGET static void BATCH_NAME(transform_points)(mat4 m,
+    struct vec3_soa in, struct vec3_soa out, size_t begin, size_t end)
+{
+    bvec m00 = bset1(m[0][0]), m01 = bset1(m[0][1]), m02 = bset1(m[0][2]);
+    bvec m10 = bset1(m[1][0]), m11 = bset1(m[1][1]), m12 = bset1(m[1][2]);
+    bvec m20 = bset1(m[2][0]), m21 = bset1(m[2][1]), m22 = bset1(m[2][2]);
+    bvec m30 = bset1(m[3][0]), m31 = bset1(m[3][1]), m32 = bset1(m[3][2]);
+
+    size_t i = begin;
+    for (; i + BATCH_WIDTH <= end; i += BATCH_WIDTH) {
+        bvec x = bload(in.x + i);
+        bvec y = bload(in.y + i);
+        bvec z = bload(in.z + i);
+        bstore(out.x + i, bfmadd(m00, x, bfmadd(m10, y, bfmadd(m20, z, m30))));
+        bstore(out.y + i, bfmadd(m01, x, bfmadd(m11, y, bfmadd(m21, z, m31))));
+        bstore(out.z + i, bfmadd(m02, x, bfmadd(m12, y, bfmadd(m22, z, m32))));
+    }
+    transform_points_scalar(m, in, out, i, end);
+}
+
+BATCH_TARGET static void BATCH_NAME(transform_vectors)(mat4 m,
+    struct vec3_soa in, struct vec3_soa out, size_t begin, size_t end)
+{
+    bvec m00 = bset1(m[0][0]), m01 = bset1(m[0][1]), m02 = bset1(m[0][2]);
+    bvec m10 = bset1(m[1][0]), m11 = bset1(m[1][1]), m12 = bset1(m[1][2]);
+    bvec m20 = bset1(m[2][0]), m21 = bset1(m[2][1]), m22 = bset1(m[2][2]);
+
+    size_t i = begin;
+    for (; i + BATCH_WIDTH <= end; i += BATCH_WIDTH) {
+        bvec x = bload(in.x + i);
+        bvec y = bload(in.y + i);
+        bvec z = bload(in.z + i);
+        bstore(out.x + i, bfmadd(m00, x, bfmadd(m10, y, bmul(m20, z))));
+        bstore(out.y + i, bfmadd(m01, x, bfmadd(m11, y, bmul(m21, z))));
+        bstore(out.z + i, bfmadd(m02, x, bfmadd(m12, y, bmul(m22, z))));
+    }
+    transform_vectors_scalar(m, in, out, i, end);
+}
+
+BATCH_TARGET static void BATCH_NAME(transform_aabbs)(mat4 m,
+    struct aabb_soa in, struct aabb_soa out, size_t begin, size_t end)
+{
+    bvec m00 = bset1(m[0][0]), m01 = bset1(m[0][1]), m02 = bset1(m[0][2]);
+    bvec m10 = bset1(m[1][0]), m11 = bset1(m[1][1]), m12 = bset1(m[1][2]);
+    bvec m20 = bset1(m[2][0]), m21 = bset1(m[2][1]), m22 = bset1(m[2][2]);
+    bvec m30 = bset1(m[3][0]), m31 = bset1(m[3][1]), m32 = bset1(m[3][2]);
+    bvec a00 = babs(m00), a01 = babs(m01), a02 = babs(m02);
+    bvec a10 = babs(m10), a11 = babs(m11), a12 = babs(m12);
+    bvec a20 = babs(m20), a21 = babs(m21), a22 = babs(m22);
+
+    size_t i = begin;
+    for (; i + BATCH_WIDTH <= end; i += BATCH_WIDTH) {
+        bvec cx = bload(in.center_x + i);
+        bvec cy = bload(in.center_y + i);
+        bvec cz = bload(in.center_z + i);
+        bvec ex = bload(in.extent_x + i);
+        bvec ey = bload(in.extent_y + i);
+        bvec ez = bload(in.extent_z + i);
+        bstore(out.center_x + i,
+            bfmadd(m00, cx, bfmadd(m10, cy, bfmadd(m20, cz, m30))));
+        bstore(out.center_y + i,
+            bfmadd(m01, cx, bfmadd(m11, cy, bfmadd(m21, cz, m31))));
+        bstore(out.center_z + i,
+            bfmadd(m02, cx, bfmadd(m12, cy, bfmadd(m22, cz, m32))));
+        bstore(out.extent_x + i,
+            bfmadd(a00, ex, bfmadd(a10, ey, bmul(a20, ez))));
+        bstore(out.extent_y + i,
+            bfmadd(a01, ex, bfmadd(a11, ey, bmul(a21, ez))));
+        bstore(out.extent_z + i,
+            bfmadd(a02, ex, bfmadd(a12, ey, bmul(a22, ez))));
+    }
+    transform_aabbs_scalar(m, in, out, i, end);
+}
+
+BATCH_TARGET static void BATCH_NAME(normalize)(struct vec3_soa in,
+    struct vec3_soa out, size_t begin, size_t end)
+{
+    bvec one = bset1(1.0f);
+
+    size_t i = begin;
+    for (; i + BATCH_WIDTH <= end; i += BATCH_WIDTH) {
+        bvec x = bload(in.x + i);
+        bvec y = bload(in.y + i);
+        bvec z = bload(in.z + i);
+        bvec len = bsqrt(bfmadd(x, x, bfmadd(y, y, bmul(z, z))));
+        // Exact division rather than rsqrt so results match the scalar code
+        bvec inv = bdiv_positive(one, len);
+        bstore(out.x + i, bmul(x, inv));
+        bstore(out.y + i, bmul(y, inv));
+        bstore(out.z + i, bmul(z, inv));
+    }
+    normalize_scalar(in, out, i, end);
+}
+
+BATCH_TARGET static void BATCH_NAME(quat_mat4)(struct quat_soa q,
+    struct mat4_soa dest, size_t begin, size_t end)
+{
+    bvec zero = bset1(0.0f);
+    bvec one = bset1(1.0f);
+    bvec two = bset1(2.0f);
+
+    size_t i = begin;
+    for (; i + BATCH_WIDTH <= end; i += BATCH_WIDTH) {
+        bvec x = bload(q.x + i);
+        bvec y = bload(q.y + i);
+        bvec z = bload(q.z + i);
+        bvec w = bload(q.w + i);
+        bvec norm2 = bfmadd(x, x, bfmadd(y, y, bfmadd(z, z, bmul(w, w))));
+        bvec s = bdiv_positive(two, norm2);
+
+        bvec sx = bmul(s, x);
+        bvec sy = bmul(s, y);
+        bvec sz = bmul(s, z);
+        bvec xx = bmul(sx, x), xy = bmul(sx, y), xz = bmul(sx, z);
+        bvec yy = bmul(sy, y), yz = bmul(sy, z), zz = bmul(sz, z);
+        bvec wx = bmul(sx, w), wy = bmul(sy, w), wz = bmul(sz, w);
+
+        bstore(dest.m[0] + i, bsub(bsub(one, yy), zz));
+        bstore(dest.m[1] + i, badd(xy, wz));
+        bstore(dest.m[2] + i, bsub(xz, wy));
+        bstore(dest.m[3] + i, zero);
+        bstore(dest.m[4] + i, bsub(xy, wz));
+        bstore(dest.m[5] + i, bsub(bsub(one, xx), zz));
+        bstore(dest.m[6] + i, badd(yz, wx));
+        bstore(dest.m[7] + i, zero);
+        bstore(dest.m[8] + i, badd(xz, wy));
+        bstore(dest.m[9] + i, bsub(yz, wx));
+        bstore(dest.m[10] + i, bsub(bsub(one, xx), yy));
+        bstore(dest.m[11] + i, zero);
+        bstore(dest.m[12] + i, zero);
+        bstore(dest.m[13] + i, zero);
+        bstore(dest.m[14] + i, zero);
+        bstore(dest.m[15] + i, one);
+    }
+    quat_mat4_scalar(q, dest, i, end);
+}
+
+#undef BATCH_NAME
+#undef BATCH_TARGET
+#undef BATCH_WIDTH
+#undef bvec
+#undef bload
+#undef bstore
+#undef bset1
+#undef badd
+#undef bsub
+#undef bmul
+#undef bfmadd
+#undef babs
+#undef bsqrt
+#undef bdiv_positive
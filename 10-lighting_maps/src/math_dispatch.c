@@ -0,0 +1,176 @@
+#include <cglm/cglm.h>
+
+#include "math_dispatch.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define MATH_DISPATCH_X86
+#endif
+
+/* cglm functions are inline only, these give them an address. Without -m
+ * flags cglm compiles to its SSE2 path on x86 and NEON or scalar elsewhere.
+ */
+static void mat4_mul_default(mat4 m1, mat4 m2, mat4 dest)
+{
+    glm_mat4_mul(m1, m2, dest);
+}
+
+static void mat4_mulv_default(mat4 m, vec4 v, vec4 dest)
+{
+    glm_mat4_mulv(m, v, dest);
+}
+
+static void mat4_inv_default(mat4 mat, mat4 dest)
+{
+    glm_mat4_inv(mat, dest);
+}
+
+static void mul_affine_default(mat4 m1, mat4 m2, mat4 dest)
+{
+    glm_mul(m1, m2, dest);
+}
+
+static void quat_mul_default(versor p, versor q, versor dest)
+{
+    glm_quat_mul(p, q, dest);
+}
+
+static void quat_mat4_default(versor q, mat4 dest)
+{
+    glm_quat_mat4(q, dest);
+}
+
+struct math_dispatch math_dispatch = {
+    .mat4_mul = mat4_mul_default,
+    .mat4_mulv = mat4_mulv_default,
+    .mat4_inv = mat4_inv_default,
+    .mul_affine = mul_affine_default,
+    .quat_mul = quat_mul_default,
+    .quat_mat4 = quat_mat4_default,
+    .level = SIMD_SCALAR
+};
+
+#ifdef MATH_DISPATCH_X86
+/* All kernels use unaligned loads and stores. Without -mavx cglm only aligns
+ * mat4 to 16 bytes.
+ *
+ * Column-major: column j of m1 * m2 is the sum over k of m1 column k times
+ * m2[j][k]. The 256 bit versions do two result columns at once, with column k
+ * of m1 copied into both halves of the register.
+ */
+__attribute__((target("avx"))) static void mat4_mul_avx(mat4 m1, mat4 m2,
+    mat4 dest)
+{
+    __m256 a0 = _mm256_broadcast_ps((__m128 const*)m1[0]);
+    __m256 a1 = _mm256_broadcast_ps((__m128 const*)m1[1]);
+    __m256 a2 = _mm256_broadcast_ps((__m128 const*)m1[2]);
+    __m256 a3 = _mm256_broadcast_ps((__m128 const*)m1[3]);
+
+    for (int j = 0; j < 4; j += 2) {
+        __m256 b = _mm256_loadu_ps(m2[j]);
+        __m256 r = _mm256_mul_ps(a0, _mm256_permute_ps(b, 0x00));
+        r = _mm256_add_ps(r, _mm256_mul_ps(a1, _mm256_permute_ps(b, 0x55)));
+        r = _mm256_add_ps(r, _mm256_mul_ps(a2, _mm256_permute_ps(b, 0xaa)));
+        r = _mm256_add_ps(r, _mm256_mul_ps(a3, _mm256_permute_ps(b, 0xff)));
+        _mm256_storeu_ps(dest[j], r);
+    }
+}
+
+__attribute__((target("avx2,fma"))) static void mat4_mul_avx2(mat4 m1,
+    mat4 m2, mat4 dest)
+{
+    __m256 a0 = _mm256_broadcast_ps((__m128 const*)m1[0]);
+    __m256 a1 = _mm256_broadcast_ps((__m128 const*)m1[1]);
+    __m256 a2 = _mm256_broadcast_ps((__m128 const*)m1[2]);
+    __m256 a3 = _mm256_broadcast_ps((__m128 const*)m1[3]);
+
+    for (int j = 0; j < 4; j += 2) {
+        __m256 b = _mm256_loadu_ps(m2[j]);
+        // Two independent chains hide some of the FMA latency
+        __m256 r0 = _mm256_mul_ps(a0, _mm256_permute_ps(b, 0x00));
+        __m256 r1 = _mm256_mul_ps(a1, _mm256_permute_ps(b, 0x55));
+        r0 = _mm256_fmadd_ps(a2, _mm256_permute_ps(b, 0xaa), r0);
+        r1 = _mm256_fmadd_ps(a3, _mm256_permute_ps(b, 0xff), r1);
+        _mm256_storeu_ps(dest[j], _mm256_add_ps(r0, r1));
+    }
+}
+
+// The whole matrix fits in one register, all four columns at once
+__attribute__((target("avx512f"))) static void mat4_mul_avx512(mat4 m1,
+    mat4 m2, mat4 dest)
+{
+    __m512 a0 = _mm512_broadcast_f32x4(_mm_loadu_ps(m1[0]));
+    __m512 a1 = _mm512_broadcast_f32x4(_mm_loadu_ps(m1[1]));
+    __m512 a2 = _mm512_broadcast_f32x4(_mm_loadu_ps(m1[2]));
+    __m512 a3 = _mm512_broadcast_f32x4(_mm_loadu_ps(m1[3]));
+    __m512 b = _mm512_loadu_ps(m2[0]);
+
+    __m512 r0 = _mm512_mul_ps(a0, _mm512_permute_ps(b, 0x00));
+    __m512 r1 = _mm512_mul_ps(a1, _mm512_permute_ps(b, 0x55));
+    r0 = _mm512_fmadd_ps(a2, _mm512_permute_ps(b, 0xaa), r0);
+    r1 = _mm512_fmadd_ps(a3, _mm512_permute_ps(b, 0xff), r1);
+    _mm512_storeu_ps(dest[0], _mm512_add_ps(r0, r1));
+}
+
+__attribute__((target("avx2,fma"))) static void mat4_mulv_avx2(mat4 m,
+    vec4 v, vec4 dest)
+{
+    __m128 r0 = _mm_mul_ps(_mm_loadu_ps(m[0]), _mm_set1_ps(v[0]));
+    __m128 r1 = _mm_mul_ps(_mm_loadu_ps(m[1]), _mm_set1_ps(v[1]));
+    r0 = _mm_fmadd_ps(_mm_loadu_ps(m[2]), _mm_set1_ps(v[2]), r0);
+    r1 = _mm_fmadd_ps(_mm_loadu_ps(m[3]), _mm_set1_ps(v[3]), r1);
+    _mm_storeu_ps(dest, _mm_add_ps(r0, r1));
+}
+
+/* For the rest cglm's SSE2 code is already a good algorithm. Compiling it
+ * again inside an AVX2+FMA function gets VEX encoding and lets the compiler
+ * fuse its multiply-adds.
+ */
+__attribute__((target("avx2,fma"))) static void mat4_inv_avx2(mat4 mat,
+    mat4 dest)
+{
+    glm_mat4_inv(mat, dest);
+}
+
+__attribute__((target("avx2,fma"))) static void mul_affine_avx2(mat4 m1,
+    mat4 m2, mat4 dest)
+{
+    glm_mul(m1, m2, dest);
+}
+
+__attribute__((target("avx2,fma"))) static void quat_mul_avx2(versor p,
+    versor q, versor dest)
+{
+    glm_quat_mul(p, q, dest);
+}
+
+__attribute__((target("avx2,fma"))) static void quat_mat4_avx2(versor q,
+    mat4 dest)
+{
+    glm_quat_mat4(q, dest);
+}
+#endif
+
+void math_dispatch_init(void)
+{
+    enum simd_level level = cpu_simd_level();
+    math_dispatch.level = level;
+
+#ifdef MATH_DISPATCH_X86
+    // Each level keeps whatever the level below picked unless it has better
+    if (level >= SIMD_AVX) {
+        math_dispatch.mat4_mul = mat4_mul_avx;
+    }
+    if (level >= SIMD_AVX2) {
+        math_dispatch.mat4_mul = mat4_mul_avx2;
+        math_dispatch.mat4_mulv = mat4_mulv_avx2;
+        math_dispatch.mat4_inv = mat4_inv_avx2;
+        math_dispatch.mul_affine = mul_affine_avx2;
+        math_dispatch.quat_mul = quat_mul_avx2;
+        math_dispatch.quat_mat4 = quat_mat4_avx2;
+    }
+    if (level >= SIMD_AVX512) {
+        math_dispatch.mat4_mul = mat4_mul_avx512;
+    }
+#endif
+}
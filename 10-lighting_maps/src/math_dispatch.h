@@ -0,0 +1,59 @@
+#ifndef MATH_DISPATCH_H
+#define MATH_DISPATCH_H
+#include <cglm/cglm.h>
+
+#include "cpu_features.h"
+
+/* The hot cglm entry points behind function pointers, so one binary can use
+ * the widest SIMD path of the machine it runs on. cglm itself picks its path
+ * from compiler flags and we build without any -m flags.
+ *
+ * Before math_dispatch_init the table points at plain cglm, so calling these
+ * early is safe, just slower.
+ */
+struct math_dispatch {
+    void (*mat4_mul)(mat4 m1, mat4 m2, mat4 dest);
+    void (*mat4_mulv)(mat4 m, vec4 v, vec4 dest);
+    void (*mat4_inv)(mat4 mat, mat4 dest);
+    // Multiplies two affine transforms, like glm_mul
+    void (*mul_affine)(mat4 m1, mat4 m2, mat4 dest);
+    void (*quat_mul)(versor p, versor q, versor dest);
+    void (*quat_mat4)(versor q, mat4 dest);
+    enum simd_level level;
+};
+
+extern struct math_dispatch math_dispatch;
+
+// Pick the kernels for the running CPU. Call once at startup
+void math_dispatch_init(void);
+
+static inline void math_mat4_mul(mat4 m1, mat4 m2, mat4 dest)
+{
+    math_dispatch.mat4_mul(m1, m2, dest);
+}
+
+static inline void math_mat4_mulv(mat4 m, vec4 v, vec4 dest)
+{
+    math_dispatch.mat4_mulv(m, v, dest);
+}
+
+static inline void math_mat4_inv(mat4 mat, mat4 dest)
+{
+    math_dispatch.mat4_inv(mat, dest);
+}
+
+static inline void math_mul_affine(mat4 m1, mat4 m2, mat4 dest)
+{
+    math_dispatch.mul_affine(m1, m2, dest);
+}
+
+static inline void math_quat_mul(versor p, versor q, versor dest)
+{
+    math_dispatch.quat_mul(p, q, dest);
+}
+
+static inline void math_quat_mat4(versor q, mat4 dest)
+{
+    math_dispatch.quat_mat4(q, dest);
+}
+#endif
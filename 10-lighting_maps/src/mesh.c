@@ -0,0 +1,462 @@
+#include <cglm/cglm.h>
+#include <glad/glad.h>
+#include <fcntl.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "gpu_memory.h"
+#include "mesh.h"
+#include "vertex_format.h"
+
+/* Cache file layout: this header, then the vertex, index, submesh, material
+ * and dependency arrays exactly as they are in memory. Bump the version
+ * whenever one of the structs, or the processing of the mesh, changes.
+ */
+#define MESH_CACHE_MAGIC "MSHC"
+#define MESH_CACHE_VERSION 4
+
+struct mesh_cache_header {
+    char magic[4];
+    uint32_t version;
+    uint64_t source_size;
+    int64_t source_mtime;
+    uint32_t vertex_count;
+    uint32_t index_count;
+    uint32_t submesh_count;
+    uint32_t material_count;
+    uint32_t lod_count;
+    uint32_t dependency_count;
+    float lod_error[MESH_MAX_LODS];
+    float bounds_min[3];
+    float bounds_max[3];
+};
+
+void mesh_free(struct mesh* m)
+{
+    free(m->vertices);
+    free(m->indices);
+    free(m->submeshes);
+    free(m->materials);
+    *m = (struct mesh) { 0 };
+}
+
+void mesh_compute_bounds(struct mesh* m)
+{
+    if (m->vertex_count == 0) {
+        glm_vec3_zero(m->bounds_min);
+        glm_vec3_zero(m->bounds_max);
+        return;
+    }
+    glm_vec3_copy(m->vertices[0].position, m->bounds_min);
+    glm_vec3_copy(m->vertices[0].position, m->bounds_max);
+    for (uint32_t i = 1; i < m->vertex_count; i++) {
+        glm_vec3_minv(m->bounds_min, m->vertices[i].position, m->bounds_min);
+        glm_vec3_maxv(m->bounds_max, m->vertices[i].position, m->bounds_max);
+    }
+}
+
+void mesh_compute_normals(struct mesh* m)
+{
+    for (uint32_t i = 0; i < m->vertex_count; i++) {
+        glm_vec3_zero(m->vertices[i].normal);
+    }
+    for (uint32_t i = 0; i + 2 < m->index_count; i += 3) {
+        struct mesh_vertex* a = &m->vertices[m->indices[i]];
+        struct mesh_vertex* b = &m->vertices[m->indices[i + 1]];
+        struct mesh_vertex* c = &m->vertices[m->indices[i + 2]];
+
+        // Not normalized, so bigger triangles count more
+        vec3 ab;
+        vec3 ac;
+        vec3 n;
+        glm_vec3_sub(b->position, a->position, ab);
+        glm_vec3_sub(c->position, a->position, ac);
+        glm_vec3_cross(ab, ac, n);
+
+        glm_vec3_add(a->normal, n, a->normal);
+        glm_vec3_add(b->normal, n, b->normal);
+        glm_vec3_add(c->normal, n, c->normal);
+    }
+    for (uint32_t i = 0; i < m->vertex_count; i++) {
+        glm_vec3_normalize(m->vertices[i].normal);
+    }
+}
+
+// Vertices of mesh_split_vertex_materials, copies appended to the mesh's
+struct vertex_split {
+    struct mesh_vertex* vertices;
+    uint32_t* material;
+    // Copies of a vertex are chained from it, the chains are rarely longer
+    // than the few materials meeting at a seam
+    uint32_t* next_copy;
+    uint32_t count;
+    uint32_t capacity;
+};
+
+static bool split_reserve(struct vertex_split* sp, uint32_t capacity)
+{
+    struct mesh_vertex* vertices = realloc(sp->vertices,
+        capacity * sizeof(struct mesh_vertex));
+    sp->vertices = vertices ? vertices : sp->vertices;
+    uint32_t* material = realloc(sp->material, capacity * sizeof(uint32_t));
+    sp->material = material ? material : sp->material;
+    uint32_t* next_copy = realloc(sp->next_copy, capacity * sizeof(uint32_t));
+    sp->next_copy = next_copy ? next_copy : sp->next_copy;
+    if (vertices == NULL || material == NULL || next_copy == NULL) {
+        return false;
+    }
+    sp->capacity = capacity;
+    return true;
+}
+
+// Copy of 'v' with material 'mat', made if there is none yet
+static bool split_vertex(struct vertex_split* sp, uint32_t v, uint32_t mat,
+    uint32_t* copy)
+{
+    uint32_t last = v;
+    while (v != UINT32_MAX && sp->material[v] != UINT32_MAX
+        && sp->material[v] != mat) {
+        last = v;
+        v = sp->next_copy[v];
+    }
+    if (v == UINT32_MAX) {
+        if (sp->count == sp->capacity
+            && !split_reserve(sp, sp->capacity * 2)) {
+            return false;
+        }
+        v = sp->count++;
+        sp->vertices[v] = sp->vertices[last];
+        sp->next_copy[last] = v;
+        sp->next_copy[v] = UINT32_MAX;
+    }
+    sp->material[v] = mat;
+    *copy = v;
+    return true;
+}
+
+uint32_t* mesh_split_vertex_materials(struct mesh* m)
+{
+    struct vertex_split sp = { .count = m->vertex_count };
+    uint32_t* indices = malloc((m->index_count + 1) * sizeof(uint32_t));
+    bool ok = indices != NULL && split_reserve(&sp, m->vertex_count + 16);
+    if (ok) {
+        memcpy(sp.vertices, m->vertices,
+            m->vertex_count * sizeof(struct mesh_vertex));
+        memcpy(indices, m->indices, m->index_count * sizeof(uint32_t));
+        memset(sp.material, 0xff, m->vertex_count * sizeof(uint32_t));
+        memset(sp.next_copy, 0xff, m->vertex_count * sizeof(uint32_t));
+    }
+
+    uint32_t submeshes = m->submesh_count * mesh_lod_count(m);
+    for (uint32_t s = 0; s < submeshes && ok; s++) {
+        struct mesh_submesh const* sub = &m->submeshes[s];
+        uint32_t mat = sub->material >= 0
+                && (uint32_t)sub->material < m->material_count
+            ? (uint32_t)sub->material
+            : m->material_count;
+        uint32_t end = sub->index_offset + sub->index_count;
+        for (uint32_t i = sub->index_offset; i < end && ok; i++) {
+            ok = split_vertex(&sp, indices[i], mat, &indices[i]);
+        }
+    }
+    free(sp.next_copy);
+    if (!ok) {
+        fprintf(stderr, "mesh: out of memory splitting vertices by"
+                        " material\n");
+        free(sp.vertices);
+        free(sp.material);
+        free(indices);
+        return NULL;
+    }
+
+    // Vertices no submesh uses, like those only dropped levels used
+    for (uint32_t v = 0; v < sp.count; v++) {
+        if (sp.material[v] == UINT32_MAX) {
+            sp.material[v] = m->material_count;
+        }
+    }
+    free(m->vertices);
+    free(m->indices);
+    m->vertices = sp.vertices;
+    m->indices = indices;
+    m->vertex_count = sp.count;
+    return sp.material;
+}
+
+bool mesh_cache_write(struct mesh const* m, char const* cache_path,
+    uint64_t source_size, int64_t source_mtime,
+    struct mesh_cache_dependency const* dependencies,
+    uint32_t dependency_count)
+{
+    // Write next to the cache and rename, so a crash never leaves half a cache
+    char tmp_path[1024];
+    snprintf(tmp_path, sizeof(tmp_path), "%s.tmp", cache_path);
+
+    FILE* file = fopen(tmp_path, "wb");
+    if (file == NULL) {
+        fprintf(stderr, "mesh.c, %s:", tmp_path);
+        perror(NULL);
+        return false;
+    }
+
+    struct mesh_cache_header header = {
+        .version = MESH_CACHE_VERSION,
+        .source_size = source_size,
+        .source_mtime = source_mtime,
+        .vertex_count = m->vertex_count,
+        .index_count = m->index_count,
+        .submesh_count = m->submesh_count,
+        .material_count = m->material_count,
+        .lod_count = mesh_lod_count(m),
+        .dependency_count = dependency_count
+    };
+    uint32_t submesh_total = m->submesh_count * header.lod_count;
+    memcpy(header.lod_error, m->lod_error, sizeof(header.lod_error));
+    memcpy(header.magic, MESH_CACHE_MAGIC, sizeof(header.magic));
+    memcpy(header.bounds_min, m->bounds_min, sizeof(header.bounds_min));
+    memcpy(header.bounds_max, m->bounds_max, sizeof(header.bounds_max));
+
+    bool ok = fwrite(&header, sizeof(header), 1, file) == 1
+        && fwrite(m->vertices, sizeof(*m->vertices), m->vertex_count, file)
+            == m->vertex_count
+        && fwrite(m->indices, sizeof(*m->indices), m->index_count, file)
+            == m->index_count
+        && fwrite(m->submeshes, sizeof(*m->submeshes), submesh_total, file)
+            == submesh_total
+        && fwrite(m->materials, sizeof(*m->materials), m->material_count, file)
+            == m->material_count
+        && fwrite(dependencies, sizeof(*dependencies), dependency_count, file)
+            == dependency_count;
+    if (fclose(file) != 0) {
+        ok = false;
+    }
+    if (!ok || rename(tmp_path, cache_path) != 0) {
+        fprintf(stderr, "mesh.c, %s: failed to write mesh cache\n", cache_path);
+        remove(tmp_path);
+        return false;
+    }
+    return true;
+}
+
+// Copy 'count' elements of 'size' bytes out of the mapped cache
+static void* copy_array(unsigned char const** cursor, size_t size,
+    uint32_t count)
+{
+    if (count == 0) {
+        return NULL;
+    }
+    void* array = malloc(size * count);
+    if (array != NULL) {
+        memcpy(array, *cursor, size * count);
+    }
+    *cursor += size * count;
+    return array;
+}
+
+static bool is_terminated(char const* string, size_t size)
+{
+    return memchr(string, '\0', size) != NULL;
+}
+
+/* True when the 'count' dependencies at 'data' are all as they were when the
+ * cache was written. They are copied out, the mapping may not be aligned.
+ */
+static bool dependencies_unchanged(unsigned char const* data, uint32_t count)
+{
+    for (uint32_t i = 0; i < count; i++) {
+        struct mesh_cache_dependency d;
+        memcpy(&d, data + i * sizeof(d), sizeof(d));
+        if (!is_terminated(d.path, sizeof(d.path))) {
+            return false;
+        }
+        struct stat st;
+        bool exists = stat(d.path, &st) == 0;
+        if (exists ? (uint64_t)st.st_size != d.size || st.st_mtime != d.mtime
+                   : d.size != MESH_CACHE_MISSING) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// Everything drawing the mesh indexes with stays in its arrays
+static bool mesh_valid(struct mesh const* m)
+{
+    for (uint32_t i = 0; i < m->index_count; i++) {
+        if (m->indices[i] >= m->vertex_count) {
+            return false;
+        }
+    }
+    for (uint32_t s = 0; s < m->submesh_count * m->lod_count; s++) {
+        struct mesh_submesh const* sub = &m->submeshes[s];
+        if ((uint64_t)sub->index_offset + sub->index_count > m->index_count
+            || sub->material < -1
+            || (sub->material >= 0
+                && (uint32_t)sub->material >= m->material_count)) {
+            return false;
+        }
+    }
+    for (uint32_t i = 0; i < m->material_count; i++) {
+        struct mesh_material const* mat = &m->materials[i];
+        if (!is_terminated(mat->name, sizeof(mat->name))
+            || !is_terminated(mat->diffuse_map, sizeof(mat->diffuse_map))
+            || !is_terminated(mat->specular_map, sizeof(mat->specular_map))) {
+            return false;
+        }
+    }
+    return true;
+}
+
+bool mesh_cache_read(struct mesh* m, char const* cache_path,
+    uint64_t source_size, int64_t source_mtime)
+{
+    int fd = open(cache_path, O_RDONLY);
+    if (fd == -1) {
+        return false;
+    }
+    struct stat st;
+    if (fstat(fd, &st) != 0
+        || (size_t)st.st_size < sizeof(struct mesh_cache_header)) {
+        close(fd);
+        return false;
+    }
+    size_t file_size = st.st_size;
+    unsigned char const* data = mmap(NULL, file_size, PROT_READ, MAP_PRIVATE,
+        fd, 0);
+    close(fd);
+    if (data == MAP_FAILED) {
+        return false;
+    }
+
+    struct mesh_cache_header header;
+    memcpy(&header, data, sizeof(header));
+    uint64_t submesh_total = (uint64_t)header.submesh_count * header.lod_count;
+    uint64_t expected = sizeof(header)
+        + (uint64_t)header.vertex_count * sizeof(struct mesh_vertex)
+        + (uint64_t)header.index_count * sizeof(uint32_t)
+        + submesh_total * sizeof(struct mesh_submesh)
+        + (uint64_t)header.material_count * sizeof(struct mesh_material)
+        + (uint64_t)header.dependency_count
+            * sizeof(struct mesh_cache_dependency);
+    if (memcmp(header.magic, MESH_CACHE_MAGIC, sizeof(header.magic)) != 0
+        || header.version != MESH_CACHE_VERSION
+        || header.source_size != source_size
+        || header.source_mtime != source_mtime
+        || header.lod_count == 0 || header.lod_count > MESH_MAX_LODS
+        || submesh_total > UINT32_MAX
+        || header.dependency_count > MESH_CACHE_MAX_DEPENDENCIES
+        || expected != file_size
+        || !dependencies_unchanged(data + file_size
+                - header.dependency_count
+                    * sizeof(struct mesh_cache_dependency),
+            header.dependency_count)) {
+        munmap((void*)data, file_size);
+        return false;
+    }
+
+    unsigned char const* cursor = data + sizeof(header);
+    *m = (struct mesh) {
+        .vertex_count = header.vertex_count,
+        .index_count = header.index_count,
+        .submesh_count = header.submesh_count,
+        .lod_count = header.lod_count,
+        .material_count = header.material_count
+    };
+    memcpy(m->lod_error, header.lod_error, sizeof(m->lod_error));
+    m->vertices = copy_array(&cursor, sizeof(*m->vertices), m->vertex_count);
+    m->indices = copy_array(&cursor, sizeof(*m->indices), m->index_count);
+    m->submeshes = copy_array(&cursor, sizeof(*m->submeshes),
+        (uint32_t)submesh_total);
+    m->materials = copy_array(&cursor, sizeof(*m->materials),
+        m->material_count);
+    memcpy(m->bounds_min, header.bounds_min, sizeof(header.bounds_min));
+    memcpy(m->bounds_max, header.bounds_max, sizeof(header.bounds_max));
+    munmap((void*)data, file_size);
+
+    if ((m->vertex_count && !m->vertices) || (m->index_count && !m->indices)
+        || (m->submesh_count && !m->submeshes)
+        || (m->material_count && !m->materials)) {
+        fprintf(stderr, "mesh.c: out of memory\n");
+        mesh_free(m);
+        return false;
+    }
+    if (!mesh_valid(m)) {
+        fprintf(stderr, "mesh.c, %s: corrupt mesh cache, ignoring it\n",
+            cache_path);
+        mesh_free(m);
+        return false;
+    }
+    return true;
+}
+
+struct mesh_buffers mesh_upload(struct mesh const* m,
+    struct vertex_format const* format)
+{
+    struct mesh_buffers buffers;
+    buffers.format = format ? format : vertex_format_pick(m);
+    glGenVertexArrays(1, &buffers.VAO);
+    buffers.VBO = gpu_buffer_create(GPU_MEMORY_VERTEX, "mesh vertices");
+    buffers.EBO = gpu_buffer_create(GPU_MEMORY_INDEX, "mesh indices");
+
+    glBindVertexArray(buffers.VAO);
+
+    void* vertices = vertex_format_pack(buffers.format, m->vertices,
+        m->vertex_count, (float*)m->bounds_min, (float*)m->bounds_max,
+        buffers.dequant);
+    glBindBuffer(GL_ARRAY_BUFFER, buffers.VBO);
+    gpu_buffer_data(buffers.VBO, GL_ARRAY_BUFFER,
+        (size_t)m->vertex_count * buffers.format->stride, vertices,
+        GL_STATIC_DRAW);
+    free(vertices);
+
+    // The element buffer binding is part of the VAO state
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, buffers.EBO);
+    gpu_buffer_data(buffers.EBO, GL_ELEMENT_ARRAY_BUFFER,
+        m->index_count * sizeof(uint32_t), m->indices, GL_STATIC_DRAW);
+
+    vertex_format_setup(buffers.format);
+
+    glBindVertexArray(0);
+    return buffers;
+}
+
+void mesh_buffers_delete(struct mesh_buffers* buffers)
+{
+    glDeleteVertexArrays(1, &buffers->VAO);
+    gpu_buffers_delete(1, &buffers->VBO);
+    gpu_buffers_delete(1, &buffers->EBO);
+    *buffers = (struct mesh_buffers) { 0 };
+}
+
+void mesh_draw(struct mesh const* m, struct mesh_buffers const* buffers,
+    void (*bind_material)(void* data, int32_t material), void* data)
+{
+    mesh_draw_lod(m, buffers, 0, bind_material, data);
+}
+
+uint32_t mesh_draw_lod(struct mesh const* m, struct mesh_buffers const* buffers,
+    uint32_t lod, void (*bind_material)(void* data, int32_t material),
+    void* data)
+{
+    if (lod >= mesh_lod_count(m)) {
+        lod = mesh_lod_count(m) - 1;
+    }
+    uint32_t triangles = 0;
+    glBindVertexArray(buffers->VAO);
+    for (uint32_t i = 0; i < m->submesh_count; i++) {
+        struct mesh_submesh const* sub
+            = &m->submeshes[lod * m->submesh_count + i];
+        if (bind_material != NULL) {
+            bind_material(data, sub->material);
+        }
+        glDrawElements(GL_TRIANGLES, sub->index_count, GL_UNSIGNED_INT,
+            (void*)(sub->index_offset * sizeof(uint32_t)));
+        triangles += sub->index_count / 3;
+    }
+    return triangles;
+}
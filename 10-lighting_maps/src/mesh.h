@@ -0,0 +1,130 @@
+#ifndef MESH_H
+#define MESH_H
+#include <cglm/cglm.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+// Same layout as the cube in main.c: position, normal, texture coords
+struct mesh_vertex {
+    float position[3];
+    float normal[3];
+    float uv[2];
+};
+
+struct mesh_material {
+    char name[64];
+    vec3 diffuse_color;
+    vec3 specular_color;
+    float shininess;
+    // Paths relative to the working directory, empty when there is no map
+    char diffuse_map[256];
+    char specular_map[256];
+};
+
+// Most levels of detail a mesh carries, the full mesh included
+#define MESH_MAX_LODS 8
+
+// A run of triangles sharing a material, -1 when it has none
+struct mesh_submesh {
+    uint32_t index_offset;
+    uint32_t index_count;
+    int32_t material;
+};
+
+/* Indexed triangle mesh as loaded from disk. Simplified levels of detail
+ * share the vertices and append their indices, level n draws the submeshes
+ * from n * submesh_count on.
+ */
+struct mesh {
+    struct mesh_vertex* vertices;
+    uint32_t vertex_count;
+    uint32_t* indices;
+    uint32_t index_count;
+    struct mesh_submesh* submeshes;
+    // Submeshes of one level of detail
+    uint32_t submesh_count;
+    // 0 is the same as 1, a mesh without simplified levels
+    uint32_t lod_count;
+    // How far, in model units, each level's surface may be from the full one
+    float lod_error[MESH_MAX_LODS];
+    struct mesh_material* materials;
+    uint32_t material_count;
+    vec3 bounds_min;
+    vec3 bounds_max;
+};
+
+struct vertex_format;
+
+// GL objects holding a mesh, the indexed version of main.c's vao_and_vbo
+struct mesh_buffers {
+    unsigned int VAO;
+    unsigned int VBO;
+    unsigned int EBO;
+    struct vertex_format const* format;
+    // Takes quantized positions back to model space, goes right of the model
+    // matrix
+    mat4 dequant;
+};
+
+static inline uint32_t mesh_lod_count(struct mesh const* m)
+{
+    return m->lod_count > 0 ? m->lod_count : 1;
+}
+
+void mesh_free(struct mesh* m);
+
+void mesh_compute_bounds(struct mesh* m);
+
+// Area weighted vertex normals from the triangles, for files that have none
+void mesh_compute_normals(struct mesh* m);
+
+/* Give every vertex the material of the submeshes using it. Vertices that
+ * submeshes of different materials share are copied, and the indices of all
+ * but the first material move to the copies. Returns the material of each
+ * vertex, 'material_count' for submeshes without one, or NULL when out of
+ * memory, leaving the mesh as it was.
+ */
+uint32_t* mesh_split_vertex_materials(struct mesh* m);
+
+// Most files besides the source a mesh cache can depend on
+#define MESH_CACHE_MAX_DEPENDENCIES 16
+
+// Size of a dependency that did not exist when the cache was written
+#define MESH_CACHE_MISSING UINT64_MAX
+
+// A file the mesh was read from besides the source, like an MTL file
+struct mesh_cache_dependency {
+    char path[1024];
+    uint64_t size;
+    int64_t mtime;
+};
+
+/* Binary cache of a processed mesh. 'source_size' and 'source_mtime' identify
+ * the file it came from, a cache written for other values is not loaded. The
+ * dependencies are stored in the cache and checked against the files when it
+ * is read. Both return false on error or a stale cache, reading also when the
+ * cache does not describe a valid mesh.
+ */
+bool mesh_cache_write(struct mesh const* m, char const* cache_path,
+    uint64_t source_size, int64_t source_mtime,
+    struct mesh_cache_dependency const* dependencies,
+    uint32_t dependency_count);
+bool mesh_cache_read(struct mesh* m, char const* cache_path,
+    uint64_t source_size, int64_t source_mtime);
+
+/* Upload vertices in 'format' and the indices, and set up the vertex
+ * attributes from the format. NULL picks one with vertex_format_pick.
+ */
+struct mesh_buffers mesh_upload(struct mesh const* m,
+    struct vertex_format const* format);
+void mesh_buffers_delete(struct mesh_buffers* buffers);
+
+// Draw every submesh, calling 'bind_material' first if it is not NULL
+void mesh_draw(struct mesh const* m, struct mesh_buffers const* buffers,
+    void (*bind_material)(void* data, int32_t material), void* data);
+
+// mesh_draw for level of detail 'lod', returns the triangles drawn
+uint32_t mesh_draw_lod(struct mesh const* m, struct mesh_buffers const* buffers,
+    uint32_t lod, void (*bind_material)(void* data, int32_t material),
+    void* data);
+#endif
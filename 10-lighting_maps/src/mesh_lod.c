@@ -0,0 +1,541 @@
+#include <math.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "mesh_lod.h"
+
+#define NO_VERTEX UINT32_MAX
+// A level that keeps more than this of the one before is not worth having
+#define MIN_REDUCTION 0.9f
+// Collapses may turn a triangle by at most about 85 degrees
+#define MIN_NORMAL_COS 0.1f
+// Every pass collapses many edges, this only guards against getting stuck
+#define MAX_PASSES 100
+// Below this a level could already cover only a few pixels
+#define MIN_LOD_TRIANGLES 16
+
+/* Sum of squared distances to a set of planes, weighted by triangle area.
+ * Kept in double since the terms cancel out near the planes.
+ */
+struct quadric {
+    double a2, ab, ac, ad;
+    double b2, bc, bd;
+    double c2, cd;
+    double d2;
+    double weight;
+};
+
+struct collapse {
+    float cost;
+    uint32_t from;
+    uint32_t to;
+};
+
+static void quadric_add_plane(struct quadric* q, vec3 n, double d,
+    double weight)
+{
+    double a = n[0];
+    double b = n[1];
+    double c = n[2];
+    q->a2 += weight * a * a;
+    q->ab += weight * a * b;
+    q->ac += weight * a * c;
+    q->ad += weight * a * d;
+    q->b2 += weight * b * b;
+    q->bc += weight * b * c;
+    q->bd += weight * b * d;
+    q->c2 += weight * c * c;
+    q->cd += weight * c * d;
+    q->d2 += weight * d * d;
+    q->weight += weight;
+}
+
+static void quadric_add(struct quadric* q, struct quadric const* other)
+{
+    double* dst = &q->a2;
+    double const* src = &other->a2;
+    for (size_t i = 0; i < sizeof(struct quadric) / sizeof(double); i++) {
+        dst[i] += src[i];
+    }
+}
+
+// Weighted mean squared distance of 'p' to the planes of both quadrics
+static float collapse_cost(struct quadric const* q0, struct quadric const* q1,
+    float const* p)
+{
+    struct quadric q = *q0;
+    quadric_add(&q, q1);
+    double x = p[0];
+    double y = p[1];
+    double z = p[2];
+    double e = q.a2 * x * x + 2 * q.ab * x * y + 2 * q.ac * x * z
+        + 2 * q.ad * x + q.b2 * y * y + 2 * q.bc * y * z + 2 * q.bd * y
+        + q.c2 * z * z + 2 * q.cd * z + q.d2;
+    return q.weight > 0.0 ? (float)fabs(e / q.weight) : 0.0f;
+}
+
+static int compare_collapses(void const* a, void const* b)
+{
+    float ca = ((struct collapse const*)a)->cost;
+    float cb = ((struct collapse const*)b)->cost;
+    return (ca > cb) - (ca < cb);
+}
+
+struct welded_vertex {
+    float position[3];
+    uint32_t id;
+};
+
+static int compare_positions(void const* a, void const* b)
+{
+    struct welded_vertex const* va = a;
+    struct welded_vertex const* vb = b;
+    for (int i = 0; i < 3; i++) {
+        if (va->position[i] != vb->position[i]) {
+            return va->position[i] < vb->position[i] ? -1 : 1;
+        }
+    }
+    return (va->id > vb->id) - (va->id < vb->id);
+}
+
+static int compare_edges(void const* a, void const* b)
+{
+    uint64_t ea = *(uint64_t const*)a;
+    uint64_t eb = *(uint64_t const*)b;
+    return (ea > eb) - (ea < eb);
+}
+
+static void triangle_normal(float const* a, float const* b, float const* c,
+    vec3 n)
+{
+    vec3 ab;
+    vec3 ac;
+    glm_vec3_sub((float*)b, (float*)a, ab);
+    glm_vec3_sub((float*)c, (float*)a, ac);
+    glm_vec3_cross(ab, ac, n);
+}
+
+/* Simplification state, in local vertex numbers. Vertices at the same
+ * position are welded into the lowest numbered one, which is what 'weld'
+ * maps to and what edges and quadrics are about.
+ */
+struct simplifier {
+    uint32_t vertex_count;
+    float (*positions)[3];
+    uint32_t* weld;
+    bool* locked;
+    struct quadric* quadrics;
+
+    uint32_t* indices;
+    uint32_t index_count;
+
+    // Triangles around each welded vertex, rebuilt every pass
+    uint32_t* adjacency_offset;
+    uint32_t* adjacency_count;
+    uint32_t* adjacency;
+};
+
+static void weld_positions(struct simplifier* s)
+{
+    struct welded_vertex* sorted = malloc(
+        (s->vertex_count + 1) * sizeof(struct welded_vertex));
+    for (uint32_t v = 0; v < s->vertex_count; v++) {
+        memcpy(sorted[v].position, s->positions[v], sizeof(float) * 3);
+        sorted[v].id = v;
+    }
+    qsort(sorted, s->vertex_count, sizeof(struct welded_vertex),
+        compare_positions);
+    for (uint32_t i = 0; i < s->vertex_count;) {
+        uint32_t end = i + 1;
+        while (end < s->vertex_count
+            && memcmp(sorted[end].position, sorted[i].position,
+                   sizeof(float) * 3)
+                == 0) {
+            end++;
+        }
+        // Several vertices at one spot are a seam in the normals or texture
+        // coords, moving one of them would tear it open
+        for (uint32_t j = i; j < end; j++) {
+            s->weld[sorted[j].id] = sorted[i].id;
+            s->locked[sorted[j].id] = end - i > 1;
+        }
+        i = end;
+    }
+    free(sorted);
+}
+
+// Edges without exactly two triangles are on a border, which stays fixed
+static void lock_borders(struct simplifier* s)
+{
+    uint32_t triangle_count = s->index_count / 3;
+    uint64_t* edges = malloc((triangle_count * 3 + 1) * sizeof(uint64_t));
+    uint32_t edge_count = 0;
+    for (uint32_t t = 0; t < triangle_count; t++) {
+        for (int k = 0; k < 3; k++) {
+            uint32_t a = s->weld[s->indices[t * 3 + k]];
+            uint32_t b = s->weld[s->indices[t * 3 + (k + 1) % 3]];
+            if (a != b) {
+                edges[edge_count++] = a < b ? (uint64_t)a << 32 | b
+                                            : (uint64_t)b << 32 | a;
+            }
+        }
+    }
+    qsort(edges, edge_count, sizeof(uint64_t), compare_edges);
+    for (uint32_t i = 0; i < edge_count;) {
+        uint32_t end = i + 1;
+        while (end < edge_count && edges[end] == edges[i]) {
+            end++;
+        }
+        if (end - i != 2) {
+            s->locked[edges[i] >> 32] = true;
+            s->locked[edges[i] & 0xffffffff] = true;
+        }
+        i = end;
+    }
+    free(edges);
+}
+
+static void build_quadrics(struct simplifier* s)
+{
+    for (uint32_t t = 0; t < s->index_count / 3; t++) {
+        uint32_t const* tri = s->indices + t * 3;
+        vec3 n;
+        triangle_normal(s->positions[tri[0]], s->positions[tri[1]],
+            s->positions[tri[2]], n);
+        float area = glm_vec3_norm(n);
+        if (area == 0.0f) {
+            continue;
+        }
+        glm_vec3_scale(n, 1.0f / area, n);
+        double d = -glm_vec3_dot(n, s->positions[tri[0]]);
+        for (int k = 0; k < 3; k++) {
+            quadric_add_plane(&s->quadrics[s->weld[tri[k]]], n, d, area);
+        }
+    }
+}
+
+static void build_adjacency(struct simplifier* s)
+{
+    memset(s->adjacency_count, 0, s->vertex_count * sizeof(uint32_t));
+    for (uint32_t i = 0; i < s->index_count; i++) {
+        s->adjacency_count[s->weld[s->indices[i]]]++;
+    }
+    uint32_t offset = 0;
+    for (uint32_t v = 0; v < s->vertex_count; v++) {
+        s->adjacency_offset[v] = offset;
+        offset += s->adjacency_count[v];
+        s->adjacency_count[v] = 0;
+    }
+    for (uint32_t t = 0; t < s->index_count / 3; t++) {
+        for (int k = 0; k < 3; k++) {
+            uint32_t v = s->weld[s->indices[t * 3 + k]];
+            s->adjacency[s->adjacency_offset[v] + s->adjacency_count[v]++] = t;
+        }
+    }
+}
+
+/* Check that moving 'from' onto 'to' turns no triangle around 'from' over.
+ * Returns false if it does, otherwise how many triangles the collapse removes
+ * in 'removed'.
+ */
+static bool collapse_is_valid(struct simplifier const* s, uint32_t from,
+    uint32_t to, uint32_t* removed)
+{
+    *removed = 0;
+    uint32_t const* list = s->adjacency + s->adjacency_offset[from];
+    for (uint32_t i = 0; i < s->adjacency_count[from]; i++) {
+        uint32_t const* tri = s->indices + list[i] * 3;
+        uint32_t corners[3];
+        bool shared = false;
+        for (int k = 0; k < 3; k++) {
+            corners[k] = s->weld[tri[k]];
+            shared = shared || corners[k] == to;
+        }
+        if (shared) {
+            (*removed)++;
+            continue;
+        }
+        vec3 before;
+        triangle_normal(s->positions[corners[0]], s->positions[corners[1]],
+            s->positions[corners[2]], before);
+        for (int k = 0; k < 3; k++) {
+            if (corners[k] == from) {
+                corners[k] = to;
+            }
+        }
+        vec3 after;
+        triangle_normal(s->positions[corners[0]], s->positions[corners[1]],
+            s->positions[corners[2]], after);
+        float lengths = glm_vec3_norm(before) * glm_vec3_norm(after);
+        if (glm_vec3_dot(before, after) <= MIN_NORMAL_COS * lengths) {
+            return false;
+        }
+    }
+    return true;
+}
+
+/* One pass of collapses, cheapest first, each vertex involved in at most
+ * one of them so the checks stay valid. Returns how many were done.
+ */
+static uint32_t collapse_pass(struct simplifier* s, uint32_t target,
+    float* max_cost, struct collapse* candidates, uint32_t* collapse_to,
+    bool* touched)
+{
+    build_adjacency(s);
+
+    uint32_t candidate_count = 0;
+    for (uint32_t i = 0; i < s->index_count; i++) {
+        uint32_t a = s->weld[s->indices[i]];
+        uint32_t b = s->weld[s->indices[i - i % 3 + (i + 1) % 3]];
+        if (a == b) {
+            continue;
+        }
+        // Both directions, each edge shows up once per triangle
+        if (!s->locked[a]) {
+            candidates[candidate_count++] = (struct collapse) {
+                collapse_cost(&s->quadrics[a], &s->quadrics[b],
+                    s->positions[b]),
+                a, b
+            };
+        }
+        if (!s->locked[b]) {
+            candidates[candidate_count++] = (struct collapse) {
+                collapse_cost(&s->quadrics[a], &s->quadrics[b],
+                    s->positions[a]),
+                b, a
+            };
+        }
+    }
+    qsort(candidates, candidate_count, sizeof(struct collapse),
+        compare_collapses);
+
+    memset(touched, 0, s->vertex_count * sizeof(bool));
+    uint32_t to_remove = (s->index_count - target) / 3;
+    uint32_t removed = 0;
+    uint32_t collapses = 0;
+    for (uint32_t c = 0; c < candidate_count && removed < to_remove; c++) {
+        uint32_t from = candidates[c].from;
+        uint32_t to = candidates[c].to;
+        uint32_t removes;
+        if (touched[from] || touched[to]
+            || !collapse_is_valid(s, from, to, &removes)) {
+            continue;
+        }
+        collapse_to[from] = to;
+        quadric_add(&s->quadrics[to], &s->quadrics[from]);
+        if (candidates[c].cost > *max_cost) {
+            *max_cost = candidates[c].cost;
+        }
+        removed += removes;
+        collapses++;
+
+        // Neighbours of 'from' changed triangles, their checks would be stale
+        uint32_t const* list = s->adjacency + s->adjacency_offset[from];
+        for (uint32_t i = 0; i < s->adjacency_count[from]; i++) {
+            for (int k = 0; k < 3; k++) {
+                touched[s->weld[s->indices[list[i] * 3 + k]]] = true;
+            }
+        }
+        touched[to] = true;
+    }
+
+    // Apply the collapses and drop the triangles that became degenerate.
+    // Only unlocked vertices move, which have no other vertex welded to them
+    uint32_t out = 0;
+    for (uint32_t t = 0; t < s->index_count / 3; t++) {
+        uint32_t tri[3];
+        for (int k = 0; k < 3; k++) {
+            tri[k] = s->indices[t * 3 + k];
+            if (collapse_to[s->weld[tri[k]]] != NO_VERTEX) {
+                tri[k] = collapse_to[s->weld[tri[k]]];
+            }
+        }
+        if (s->weld[tri[0]] != s->weld[tri[1]]
+            && s->weld[tri[1]] != s->weld[tri[2]]
+            && s->weld[tri[0]] != s->weld[tri[2]]) {
+            memcpy(s->indices + out, tri, sizeof(tri));
+            out += 3;
+        }
+    }
+    s->index_count = out;
+    for (uint32_t v = 0; v < s->vertex_count; v++) {
+        collapse_to[v] = NO_VERTEX;
+    }
+    return collapses;
+}
+
+uint32_t mesh_simplify(uint32_t* out, uint32_t const* indices,
+    uint32_t index_count, struct mesh_vertex const* vertices,
+    uint32_t vertex_count, uint32_t target_index_count, float* error)
+{
+    *error = 0.0f;
+    index_count -= index_count % 3;
+
+    // Number the vertices used from 0, so nothing is as big as the whole mesh
+    uint32_t* local_id = malloc((vertex_count + 1) * sizeof(uint32_t));
+    memset(local_id, 0xff, (vertex_count + 1) * sizeof(uint32_t));
+    uint32_t* global_id = malloc((index_count + 1) * sizeof(uint32_t));
+    struct simplifier s = {
+        .indices = out,
+        .index_count = index_count
+    };
+    for (uint32_t i = 0; i < index_count; i++) {
+        uint32_t v = indices[i];
+        if (local_id[v] == NO_VERTEX) {
+            local_id[v] = s.vertex_count;
+            global_id[s.vertex_count++] = v;
+        }
+        out[i] = local_id[v];
+    }
+    free(local_id);
+
+    uint32_t n = s.vertex_count + 1;
+    s.positions = malloc(n * sizeof(float[3]));
+    for (uint32_t v = 0; v < s.vertex_count; v++) {
+        memcpy(s.positions[v], vertices[global_id[v]].position,
+            sizeof(float) * 3);
+    }
+    s.weld = malloc(n * sizeof(uint32_t));
+    s.locked = calloc(n, sizeof(bool));
+    s.quadrics = calloc(n, sizeof(struct quadric));
+    s.adjacency_offset = malloc(n * sizeof(uint32_t));
+    s.adjacency_count = malloc(n * sizeof(uint32_t));
+    s.adjacency = malloc((index_count + 1) * sizeof(uint32_t));
+    struct collapse* candidates = malloc(
+        (index_count * 2 + 1) * sizeof(struct collapse));
+    uint32_t* collapse_to = malloc(n * sizeof(uint32_t));
+    memset(collapse_to, 0xff, n * sizeof(uint32_t));
+    bool* touched = malloc(n * sizeof(bool));
+
+    weld_positions(&s);
+    lock_borders(&s);
+    build_quadrics(&s);
+
+    float max_cost = 0.0f;
+    for (int pass = 0; pass < MAX_PASSES && s.index_count > target_index_count;
+         pass++) {
+        if (collapse_pass(&s, target_index_count, &max_cost, candidates,
+                collapse_to, touched)
+            == 0) {
+            break;
+        }
+    }
+    *error = sqrtf(max_cost);
+
+    for (uint32_t i = 0; i < s.index_count; i++) {
+        out[i] = global_id[out[i]];
+    }
+
+    free(touched);
+    free(collapse_to);
+    free(candidates);
+    free(s.adjacency);
+    free(s.adjacency_count);
+    free(s.adjacency_offset);
+    free(s.quadrics);
+    free(s.locked);
+    free(s.weld);
+    free(s.positions);
+    free(global_id);
+    return s.index_count;
+}
+
+void mesh_generate_lods(struct mesh* m, float ratio, uint32_t max_lods)
+{
+    if (max_lods > MESH_MAX_LODS) {
+        max_lods = MESH_MAX_LODS;
+    }
+    m->lod_count = 1;
+    m->lod_error[0] = 0.0f;
+    if (m->submesh_count == 0 || max_lods < 2) {
+        return;
+    }
+    m->submeshes = realloc(m->submeshes,
+        m->submesh_count * max_lods * sizeof(struct mesh_submesh));
+
+    for (uint32_t lod = 1; lod < max_lods; lod++) {
+        struct mesh_submesh const* previous
+            = m->submeshes + (lod - 1) * m->submesh_count;
+        struct mesh_submesh* current = m->submeshes + lod * m->submesh_count;
+        uint32_t index_count_before = m->index_count;
+        uint32_t previous_total = 0;
+        uint32_t total = 0;
+        float error = 0.0f;
+
+        for (uint32_t s = 0; s < m->submesh_count; s++) {
+            uint32_t count = previous[s].index_count;
+            uint32_t target = (uint32_t)(count / 3 * ratio) * 3;
+            uint32_t* simplified = malloc((count + 1) * sizeof(uint32_t));
+            float submesh_error;
+            uint32_t simplified_count = mesh_simplify(simplified,
+                m->indices + previous[s].index_offset, count, m->vertices,
+                m->vertex_count, target, &submesh_error);
+
+            m->indices = realloc(m->indices,
+                (m->index_count + simplified_count + 1) * sizeof(uint32_t));
+            memcpy(m->indices + m->index_count, simplified,
+                simplified_count * sizeof(uint32_t));
+            current[s] = (struct mesh_submesh) {
+                .index_offset = m->index_count,
+                .index_count = simplified_count,
+                .material = previous[s].material
+            };
+            m->index_count += simplified_count;
+            free(simplified);
+
+            previous_total += count;
+            total += simplified_count;
+            error = glm_max(error, submesh_error);
+        }
+
+        // Nothing left to take away without tearing seams or borders
+        if (total > previous_total * MIN_REDUCTION) {
+            m->index_count = index_count_before;
+            break;
+        }
+        // Errors of the levels in between add up at worst
+        m->lod_error[lod] = m->lod_error[lod - 1] + error;
+        m->lod_count++;
+        if (total / 3 < MIN_LOD_TRIANGLES) {
+            break;
+        }
+    }
+}
+
+float mesh_lod_projection_scale(float fov_degrees, float viewport_height)
+{
+    return viewport_height / (2.0f * tanf(glm_rad(fov_degrees) * 0.5f));
+}
+
+uint32_t mesh_select_lod(struct mesh const* m, float distance,
+    float projection_scale, float max_pixel_error, uint32_t current_lod)
+{
+    // Coarser levels have to fit a tighter limit than finer levels need to
+    // be kept, the gap in between is what stops the flicker
+    float const hysteresis = 0.75f;
+    uint32_t lod_count = mesh_lod_count(m);
+    distance = glm_max(distance, 1e-4f);
+    if (current_lod >= lod_count) {
+        current_lod = lod_count - 1;
+    }
+
+    // Errors only grow with the level, so the last fitting level is the
+    // coarsest
+    uint32_t lod = 0;
+    uint32_t coarser = 0;
+    for (uint32_t i = 1; i < lod_count; i++) {
+        float pixels = m->lod_error[i] * projection_scale / distance;
+        if (pixels <= max_pixel_error) {
+            lod = i;
+        }
+        if (pixels <= max_pixel_error * hysteresis) {
+            coarser = i;
+        }
+    }
+    if (lod < current_lod) {
+        // The current level is too coarse now, switch right away
+        return lod;
+    }
+    return coarser > current_lod ? coarser : current_lod;
+}
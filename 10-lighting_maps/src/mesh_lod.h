@@ -0,0 +1,33 @@
+#ifndef MESH_LOD_H
+#define MESH_LOD_H
+#include <stdint.h>
+
+#include "mesh.h"
+
+/* Append simplified levels of detail to 'm', each with about 'ratio' of the
+ * triangles of the one before, until 'max_lods' levels (the full mesh
+ * included, at most MESH_MAX_LODS) or until simplification gets stuck.
+ * Uses quadric error edge collapses onto existing vertices, so every level
+ * shares the vertex buffer. Vertices on seams and open borders stay put.
+ */
+void mesh_generate_lods(struct mesh* m, float ratio, uint32_t max_lods);
+
+/* Simplify one triangle list to about 'target_index_count' indices, written
+ * to 'out' which must hold 'index_count'. Returns the index count, and in
+ * 'error' the largest surface error introduced in model units.
+ */
+uint32_t mesh_simplify(uint32_t* out, uint32_t const* indices,
+    uint32_t index_count, struct mesh_vertex const* vertices,
+    uint32_t vertex_count, uint32_t target_index_count, float* error);
+
+// Pixels per model unit at distance 1, for a vertical field of view
+float mesh_lod_projection_scale(float fov_degrees, float viewport_height);
+
+/* Coarsest level whose error projects to at most 'max_pixel_error' pixels at
+ * 'distance'. A level only gets coarser once it is comfortably below the
+ * limit, so an instance sitting at a switching distance does not flicker
+ * between two levels. 'current_lod' is the level it was drawn with last.
+ */
+uint32_t mesh_select_lod(struct mesh const* m, float distance,
+    float projection_scale, float max_pixel_error, uint32_t current_lod);
+#endif
@@ -0,0 +1,478 @@
+#include <math.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "mesh_optimize.h"
+
+// Scoring from Forsyth's article, tuned for an LRU cache of 32 entries
+#define FORSYTH_CACHE_SIZE 32
+#define CACHE_DECAY_POWER 1.5f
+#define LAST_TRIANGLE_SCORE 0.75f
+#define VALENCE_BOOST_SCALE 2.0f
+#define VALENCE_BOOST_POWER 0.5f
+// Vertices with more triangles than this share the last valence score
+#define MAX_VALENCE 64
+
+#define NO_VERTEX UINT32_MAX
+
+struct forsyth_tables {
+    float cache[FORSYTH_CACHE_SIZE];
+    float valence[MAX_VALENCE];
+};
+
+static void init_tables(struct forsyth_tables* tables)
+{
+    for (int i = 0; i < FORSYTH_CACHE_SIZE; i++) {
+        // The three vertices of the last triangle get a fixed score, so
+        // the algorithm does not just keep adding triangles next to it
+        tables->cache[i] = i < 3 ? LAST_TRIANGLE_SCORE
+                                 : powf(1.0f
+                                         - (i - 3) / (float)(FORSYTH_CACHE_SIZE - 3),
+                                     CACHE_DECAY_POWER);
+    }
+    tables->valence[0] = 0.0f;
+    for (int i = 1; i < MAX_VALENCE; i++) {
+        // Vertices with few triangles left are worth finishing off
+        tables->valence[i] = VALENCE_BOOST_SCALE
+            * powf((float)i, -VALENCE_BOOST_POWER);
+    }
+}
+
+static float vertex_score(struct forsyth_tables const* tables,
+    int32_t cache_position, uint32_t live_triangles)
+{
+    if (live_triangles == 0) {
+        return -1.0f;
+    }
+    float score = cache_position >= 0 ? tables->cache[cache_position] : 0.0f;
+    return score
+        + tables->valence[live_triangles < MAX_VALENCE ? live_triangles
+                                                       : MAX_VALENCE - 1];
+}
+
+void optimize_vertex_cache(uint32_t* indices, uint32_t index_count,
+    uint32_t vertex_count)
+{
+    uint32_t triangle_count = index_count / 3;
+    if (triangle_count < 2) {
+        return;
+    }
+    struct forsyth_tables tables;
+    init_tables(&tables);
+
+    // Triangles using each vertex, the first 'live' of them not drawn yet
+    uint32_t* live = calloc(vertex_count + 1, sizeof(uint32_t));
+    uint32_t* adjacency_offset = malloc((vertex_count + 1) * sizeof(uint32_t));
+    uint32_t* adjacency = malloc(triangle_count * 3 * sizeof(uint32_t));
+    int32_t* cache_position = malloc((vertex_count + 1) * sizeof(int32_t));
+    float* score = malloc((vertex_count + 1) * sizeof(float));
+    float* triangle_score = malloc(triangle_count * sizeof(float));
+    bool* emitted = calloc(triangle_count, sizeof(bool));
+    uint32_t* output = malloc(triangle_count * 3 * sizeof(uint32_t));
+
+    for (uint32_t i = 0; i < triangle_count * 3; i++) {
+        live[indices[i]]++;
+    }
+    // Offsets start at the end of each list and count down while filling
+    uint32_t offset = 0;
+    for (uint32_t v = 0; v < vertex_count; v++) {
+        offset += live[v];
+        adjacency_offset[v] = offset;
+        cache_position[v] = -1;
+        score[v] = vertex_score(&tables, -1, live[v]);
+    }
+    for (uint32_t t = 0; t < triangle_count; t++) {
+        for (int k = 0; k < 3; k++) {
+            adjacency[--adjacency_offset[indices[t * 3 + k]]] = t;
+        }
+    }
+
+    int64_t best = -1;
+    float best_score = -1.0f;
+    for (uint32_t t = 0; t < triangle_count; t++) {
+        uint32_t const* tri = indices + t * 3;
+        triangle_score[t] = score[tri[0]] + score[tri[1]] + score[tri[2]];
+        if (triangle_score[t] > best_score) {
+            best = t;
+            best_score = triangle_score[t];
+        }
+    }
+
+    uint32_t cache[FORSYTH_CACHE_SIZE + 3];
+    uint32_t cache_count = 0;
+    uint32_t next_unemitted = 0;
+    for (uint32_t out = 0; out < triangle_count; out++) {
+        if (best < 0) {
+            // Nothing in the cache has triangles left, start somewhere new
+            while (emitted[next_unemitted]) {
+                next_unemitted++;
+            }
+            best = next_unemitted;
+        }
+        uint32_t t = (uint32_t)best;
+        uint32_t const* tri = indices + t * 3;
+        emitted[t] = true;
+        memcpy(output + out * 3, tri, 3 * sizeof(uint32_t));
+
+        for (int k = 0; k < 3; k++) {
+            uint32_t* list = adjacency + adjacency_offset[tri[k]];
+            uint32_t n = live[tri[k]];
+            for (uint32_t i = 0; i < n; i++) {
+                if (list[i] == t) {
+                    list[i] = list[n - 1];
+                    live[tri[k]]--;
+                    break;
+                }
+            }
+        }
+
+        // The triangle's vertices move to the front of the LRU cache
+        uint32_t new_cache[FORSYTH_CACHE_SIZE + 3];
+        uint32_t new_count = 0;
+        for (int k = 0; k < 3; k++) {
+            if (k == 0 || (tri[k] != tri[0] && (k == 1 || tri[k] != tri[1]))) {
+                new_cache[new_count++] = tri[k];
+            }
+        }
+        for (uint32_t i = 0; i < cache_count; i++) {
+            uint32_t v = cache[i];
+            if (v != tri[0] && v != tri[1] && v != tri[2]) {
+                new_cache[new_count++] = v;
+            }
+        }
+
+        // Only vertices that were or are in the cache changed score, and
+        // only their triangles can have become the best
+        for (uint32_t i = 0; i < new_count; i++) {
+            uint32_t v = new_cache[i];
+            cache_position[v] = i < FORSYTH_CACHE_SIZE ? (int32_t)i : -1;
+            score[v] = vertex_score(&tables, cache_position[v], live[v]);
+        }
+        best = -1;
+        best_score = -1.0f;
+        for (uint32_t i = 0; i < new_count; i++) {
+            uint32_t v = new_cache[i];
+            uint32_t const* list = adjacency + adjacency_offset[v];
+            for (uint32_t j = 0; j < live[v]; j++) {
+                uint32_t const* other = indices + list[j] * 3;
+                float s = score[other[0]] + score[other[1]] + score[other[2]];
+                triangle_score[list[j]] = s;
+                if (s > best_score) {
+                    best = list[j];
+                    best_score = s;
+                }
+            }
+        }
+
+        cache_count = new_count < FORSYTH_CACHE_SIZE ? new_count
+                                                     : FORSYTH_CACHE_SIZE;
+        memcpy(cache, new_cache, cache_count * sizeof(uint32_t));
+    }
+    memcpy(indices, output, triangle_count * 3 * sizeof(uint32_t));
+
+    free(live);
+    free(adjacency_offset);
+    free(adjacency);
+    free(cache_position);
+    free(score);
+    free(triangle_score);
+    free(emitted);
+    free(output);
+}
+
+/* FIFO cache simulation. A vertex is in the cache while fewer than the cache
+ * size misses happened since its own, so a timestamp per vertex is enough.
+ */
+struct cache_sim {
+    uint32_t* timestamps;
+    uint32_t timestamp;
+};
+
+static void cache_sim_init(struct cache_sim* sim, uint32_t vertex_count)
+{
+    sim->timestamps = calloc(vertex_count + 1, sizeof(uint32_t));
+    sim->timestamp = MESH_ANALYZE_CACHE_SIZE + 1;
+}
+
+static void cache_sim_flush(struct cache_sim* sim)
+{
+    sim->timestamp += MESH_ANALYZE_CACHE_SIZE + 1;
+}
+
+static uint32_t cache_sim_triangle(struct cache_sim* sim, uint32_t const* tri)
+{
+    uint32_t misses = 0;
+    for (int k = 0; k < 3; k++) {
+        if (sim->timestamp - sim->timestamps[tri[k]] > MESH_ANALYZE_CACHE_SIZE) {
+            sim->timestamps[tri[k]] = sim->timestamp++;
+            misses++;
+        }
+    }
+    return misses;
+}
+
+struct mesh_cache_stats mesh_analyze_vertex_cache(uint32_t const* indices,
+    uint32_t index_count, uint32_t vertex_count)
+{
+    struct mesh_cache_stats stats = { 0 };
+    uint32_t triangle_count = index_count / 3;
+    if (triangle_count == 0) {
+        return stats;
+    }
+    struct cache_sim sim;
+    cache_sim_init(&sim, vertex_count);
+    bool* used = calloc(vertex_count + 1, sizeof(bool));
+    uint32_t used_count = 0;
+    uint32_t misses = 0;
+    for (uint32_t t = 0; t < triangle_count; t++) {
+        misses += cache_sim_triangle(&sim, indices + t * 3);
+        for (int k = 0; k < 3; k++) {
+            if (!used[indices[t * 3 + k]]) {
+                used[indices[t * 3 + k]] = true;
+                used_count++;
+            }
+        }
+    }
+    stats.acmr = (float)misses / triangle_count;
+    stats.atvr = (float)misses / used_count;
+    free(used);
+    free(sim.timestamps);
+    return stats;
+}
+
+struct cluster_key {
+    float key;
+    uint32_t cluster;
+};
+
+static int compare_cluster_keys(void const* a, void const* b)
+{
+    struct cluster_key const* ka = a;
+    struct cluster_key const* kb = b;
+    // Largest first, ties keep the cache friendly order
+    if (ka->key != kb->key) {
+        return ka->key > kb->key ? -1 : 1;
+    }
+    return ka->cluster < kb->cluster ? -1 : ka->cluster > kb->cluster;
+}
+
+// Area weighted centroid and summed normal of a run of triangles
+static void cluster_shape(uint32_t const* indices, uint32_t first,
+    uint32_t end, struct mesh_vertex const* vertices, vec3 centroid,
+    vec3 normal)
+{
+    glm_vec3_zero(centroid);
+    glm_vec3_zero(normal);
+    float area = 0.0f;
+    for (uint32_t t = first; t < end; t++) {
+        float const* a = vertices[indices[t * 3]].position;
+        float const* b = vertices[indices[t * 3 + 1]].position;
+        float const* c = vertices[indices[t * 3 + 2]].position;
+        vec3 ab;
+        vec3 ac;
+        vec3 n;
+        glm_vec3_sub((float*)b, (float*)a, ab);
+        glm_vec3_sub((float*)c, (float*)a, ac);
+        glm_vec3_cross(ab, ac, n);
+        float triangle_area = glm_vec3_norm(n);
+
+        vec3 center;
+        glm_vec3_add((float*)a, (float*)b, center);
+        glm_vec3_add(center, (float*)c, center);
+        glm_vec3_muladds(center, triangle_area / 3.0f, centroid);
+        glm_vec3_add(normal, n, normal);
+        area += triangle_area;
+    }
+    if (area > 0.0f) {
+        glm_vec3_scale(centroid, 1.0f / area, centroid);
+    }
+}
+
+void optimize_overdraw(uint32_t* indices, uint32_t index_count,
+    struct mesh_vertex const* vertices, uint32_t vertex_count,
+    float threshold)
+{
+    uint32_t triangle_count = index_count / 3;
+    if (triangle_count < 2) {
+        return;
+    }
+    struct cache_sim sim;
+    cache_sim_init(&sim, vertex_count);
+
+    // Hard boundaries: triangles that miss on every vertex start over anyway
+    uint32_t* hard = malloc((triangle_count + 1) * sizeof(uint32_t));
+    uint32_t hard_count = 0;
+    for (uint32_t t = 0; t < triangle_count; t++) {
+        if (cache_sim_triangle(&sim, indices + t * 3) == 3 || t == 0) {
+            hard[hard_count++] = t;
+        }
+    }
+    hard[hard_count] = triangle_count;
+
+    // Soft boundaries: split where the cluster so far is already about as
+    // good as the whole cluster, so losing the cache there costs little
+    uint32_t* clusters = malloc((triangle_count + 1) * sizeof(uint32_t));
+    uint32_t cluster_count = 0;
+    for (uint32_t h = 0; h < hard_count; h++) {
+        uint32_t first = hard[h];
+        uint32_t end = hard[h + 1];
+
+        cache_sim_flush(&sim);
+        uint32_t misses = 0;
+        for (uint32_t t = first; t < end; t++) {
+            misses += cache_sim_triangle(&sim, indices + t * 3);
+        }
+        float target = (float)misses / (end - first) * threshold;
+
+        cache_sim_flush(&sim);
+        clusters[cluster_count++] = first;
+        uint32_t start = first;
+        misses = 0;
+        for (uint32_t t = first; t + 1 < end; t++) {
+            misses += cache_sim_triangle(&sim, indices + t * 3);
+            if ((float)misses / (t + 1 - start) <= target) {
+                clusters[cluster_count++] = t + 1;
+                start = t + 1;
+                misses = 0;
+                cache_sim_flush(&sim);
+            }
+        }
+    }
+    clusters[cluster_count] = triangle_count;
+
+    // Clusters facing away from the middle are on the outside and occlude
+    // the rest, so they go first
+    vec3 mesh_centroid;
+    vec3 mesh_normal;
+    cluster_shape(indices, 0, triangle_count, vertices, mesh_centroid,
+        mesh_normal);
+    struct cluster_key* keys = malloc(cluster_count * sizeof(struct cluster_key));
+    for (uint32_t c = 0; c < cluster_count; c++) {
+        vec3 centroid;
+        vec3 normal;
+        cluster_shape(indices, clusters[c], clusters[c + 1], vertices, centroid,
+            normal);
+        glm_vec3_normalize(normal);
+        vec3 offset;
+        glm_vec3_sub(centroid, mesh_centroid, offset);
+        keys[c].key = glm_vec3_dot(offset, normal);
+        keys[c].cluster = c;
+    }
+    qsort(keys, cluster_count, sizeof(struct cluster_key),
+        compare_cluster_keys);
+
+    uint32_t* output = malloc(triangle_count * 3 * sizeof(uint32_t));
+    uint32_t out = 0;
+    for (uint32_t c = 0; c < cluster_count; c++) {
+        uint32_t first = clusters[keys[c].cluster];
+        uint32_t count = clusters[keys[c].cluster + 1] - first;
+        memcpy(output + out * 3, indices + first * 3,
+            count * 3 * sizeof(uint32_t));
+        out += count;
+    }
+    memcpy(indices, output, triangle_count * 3 * sizeof(uint32_t));
+
+    free(output);
+    free(keys);
+    free(clusters);
+    free(hard);
+    free(sim.timestamps);
+}
+
+uint32_t optimize_vertex_fetch(struct mesh_vertex* vertices,
+    uint32_t vertex_count, uint32_t* indices, uint32_t index_count)
+{
+    uint32_t* remap = malloc((vertex_count + 1) * sizeof(uint32_t));
+    memset(remap, 0xff, (vertex_count + 1) * sizeof(uint32_t));
+    uint32_t next = 0;
+    for (uint32_t i = 0; i < index_count; i++) {
+        uint32_t v = indices[i];
+        if (remap[v] == NO_VERTEX) {
+            remap[v] = next++;
+        }
+        indices[i] = remap[v];
+    }
+
+    struct mesh_vertex* moved = malloc((next + 1) * sizeof(struct mesh_vertex));
+    for (uint32_t v = 0; v < vertex_count; v++) {
+        if (remap[v] != NO_VERTEX) {
+            moved[remap[v]] = vertices[v];
+        }
+    }
+    memcpy(vertices, moved, next * sizeof(struct mesh_vertex));
+    free(moved);
+    free(remap);
+    return next;
+}
+
+// Indices of the full detail level, which come first
+static uint32_t lod0_index_count(struct mesh const* m)
+{
+    if (m->submesh_count == 0) {
+        return m->index_count;
+    }
+    uint32_t count = 0;
+    for (uint32_t s = 0; s < m->submesh_count; s++) {
+        count += m->submeshes[s].index_count;
+    }
+    return count;
+}
+
+void mesh_optimize(struct mesh* m, struct mesh_optimize_stats* stats)
+{
+    if (stats != NULL) {
+        stats->before = mesh_analyze_vertex_cache(m->indices,
+            lod0_index_count(m), m->vertex_count);
+    }
+
+    /* Every submesh is optimized on its own with vertices numbered from 0,
+     * so the per vertex arrays of the passes are only as big as the submesh
+     */
+    uint32_t* local_id = malloc((m->vertex_count + 1) * sizeof(uint32_t));
+    memset(local_id, 0xff, (m->vertex_count + 1) * sizeof(uint32_t));
+    uint32_t* global_id = malloc((m->vertex_count + 1) * sizeof(uint32_t));
+    uint32_t submesh_total = m->submesh_count * mesh_lod_count(m);
+    for (uint32_t s = 0; s < submesh_total; s++) {
+        uint32_t* indices = m->indices + m->submeshes[s].index_offset;
+        uint32_t count = m->submeshes[s].index_count;
+        uint32_t* local = malloc((count + 1) * sizeof(uint32_t));
+        uint32_t local_count = 0;
+        for (uint32_t i = 0; i < count; i++) {
+            uint32_t v = indices[i];
+            if (local_id[v] == NO_VERTEX) {
+                local_id[v] = local_count;
+                global_id[local_count++] = v;
+            }
+            local[i] = local_id[v];
+        }
+        struct mesh_vertex* vertices = malloc(
+            (local_count + 1) * sizeof(struct mesh_vertex));
+        for (uint32_t v = 0; v < local_count; v++) {
+            vertices[v] = m->vertices[global_id[v]];
+        }
+
+        optimize_vertex_cache(local, count, local_count);
+        optimize_overdraw(local, count, vertices, local_count, 1.05f);
+
+        for (uint32_t i = 0; i < count; i++) {
+            indices[i] = global_id[local[i]];
+        }
+        for (uint32_t v = 0; v < local_count; v++) {
+            local_id[global_id[v]] = NO_VERTEX;
+        }
+        free(vertices);
+        free(local);
+    }
+    free(global_id);
+    free(local_id);
+
+    m->vertex_count = optimize_vertex_fetch(m->vertices, m->vertex_count,
+        m->indices, m->index_count);
+    mesh_compute_bounds(m);
+
+    if (stats != NULL) {
+        stats->after = mesh_analyze_vertex_cache(m->indices,
+            lod0_index_count(m), m->vertex_count);
+    }
+}
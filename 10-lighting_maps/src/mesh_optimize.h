@@ -0,0 +1,58 @@
+#ifndef MESH_OPTIMIZE_H
+#define MESH_OPTIMIZE_H
+#include <stdint.h>
+
+#include "mesh.h"
+
+// Cache size the numbers are reported for, a typical post-transform cache
+#define MESH_ANALYZE_CACHE_SIZE 16
+
+/* Average cache miss ratio (vertex shader runs per triangle, 0.5 at best)
+ * and average transform to vertex ratio (runs per unique vertex, 1 at best)
+ */
+struct mesh_cache_stats {
+    float acmr;
+    float atvr;
+};
+
+struct mesh_optimize_stats {
+    struct mesh_cache_stats before;
+    struct mesh_cache_stats after;
+};
+
+/* Reorder the triangles of every submesh, of every level of detail, for the
+ * post-transform vertex cache and then for less overdraw, and the vertices
+ * for fetch locality. Unused vertices are dropped. The mesh looks the same
+ * afterwards. 'stats' may be NULL, it covers the full detail level.
+ */
+void mesh_optimize(struct mesh* m, struct mesh_optimize_stats* stats);
+
+// Simulate a FIFO cache of MESH_ANALYZE_CACHE_SIZE vertices
+struct mesh_cache_stats mesh_analyze_vertex_cache(uint32_t const* indices,
+    uint32_t index_count, uint32_t vertex_count);
+
+/* The passes of mesh_optimize, for index buffers built some other way. They
+ * work on triangle lists of vertices below 'vertex_count' and have to run in
+ * this order, every one keeps what the ones before it gained.
+ */
+
+// Tom Forsyth's linear-speed vertex cache optimisation
+void optimize_vertex_cache(uint32_t* indices, uint32_t index_count,
+    uint32_t vertex_count);
+
+/* Split the triangles where the cache is flushed anyway, or where that costs
+ * less than 'threshold' times the ACMR (1.05 is a good value), and draw the
+ * outward facing clusters first. From Sander, Nehab and Barczak, "Fast
+ * Triangle Reordering for Vertex Locality and Reduced Overdraw".
+ */
+void optimize_overdraw(uint32_t* indices, uint32_t index_count,
+    struct mesh_vertex const* vertices, uint32_t vertex_count,
+    float threshold);
+
+/* Renumber the vertices in order of first use and move them to match, so
+ * the vertex fetch reads memory front to back. Returns the new vertex count,
+ * unused vertices are dropped.
+ */
+uint32_t optimize_vertex_fetch(struct mesh_vertex* vertices,
+    uint32_t vertex_count, uint32_t* indices, uint32_t index_count);
+#endif
@@ -0,0 +1,763 @@
+#include <fcntl.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "mesh_lod.h"
+#include "mesh_optimize.h"
+#include "obj_loader.h"
+
+// Chunks per thread, more than one evens out chunks with more faces
+#define CHUNKS_PER_THREAD 4
+// Small files are not worth splitting
+#define MIN_CHUNK_SIZE (64 * 1024)
+// 'mtllib' lines remembered per chunk, files normally have one at the top
+#define MAX_MTLLIBS_PER_CHUNK 4
+
+/* Parsing happens in two parallel passes over the same chunks. The first
+ * counts what each chunk holds, so the second knows where in the shared
+ * arrays its results go and how many vertices came before it in the file,
+ * which relative indices need.
+ */
+struct obj_chunk {
+    char const* begin;
+    char const* end;
+
+    uint32_t position_count;
+    uint32_t normal_count;
+    uint32_t uv_count;
+    uint32_t triangle_count;
+    uint32_t material_run_count;
+
+    // Offsets into the shared arrays, from the prefix sums of the counts
+    uint32_t position_base;
+    uint32_t normal_base;
+    uint32_t uv_base;
+    uint32_t triangle_base;
+    uint32_t material_run_base;
+
+    // Start of the 'mtllib' lines in the chunk
+    char const* mtllibs[MAX_MTLLIBS_PER_CHUNK];
+    uint32_t mtllib_count;
+
+    // Set if a face referenced something that does not exist
+    bool bad_index;
+};
+
+// Triangles from 'first_triangle' on use the material called 'name'
+struct material_run {
+    uint32_t first_triangle;
+    char const* name;
+    uint32_t name_length;
+};
+
+struct obj_parse {
+    struct obj_chunk* chunks;
+    unsigned int chunk_count;
+
+    float* positions;
+    float* normals;
+    float* uvs;
+    // Position, uv and normal index for every triangle corner, -1 if missing
+    int32_t* corners;
+    struct material_run* material_runs;
+
+    // Totals over the whole file
+    uint32_t position_count;
+    uint32_t normal_count;
+    uint32_t uv_count;
+};
+
+static char const* skip_spaces(char const* p, char const* end)
+{
+    while (p < end && (*p == ' ' || *p == '\t')) {
+        p++;
+    }
+    return p;
+}
+
+static char const* line_end(char const* p, char const* end)
+{
+    char const* newline = memchr(p, '\n', end - p);
+    return newline ? newline : end;
+}
+
+// Does the line at 'p' start with 'keyword' followed by a space?
+static bool starts_with(char const* p, char const* end, char const* keyword)
+{
+    size_t length = strlen(keyword);
+    return (size_t)(end - p) > length && memcmp(p, keyword, length) == 0
+        && (p[length] == ' ' || p[length] == '\t');
+}
+
+static double const powers_of_ten[] = {
+    1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+    1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+};
+
+/* Much faster than strtof, which also can not be used on the mapped file as
+ * it is not null terminated. Collects up to 19 digits in an integer and scales
+ * once at the end, which is exact enough for floats.
+ */
+static char const* parse_float(char const* p, char const* end, float* out)
+{
+    p = skip_spaces(p, end);
+
+    bool negative = false;
+    if (p < end && (*p == '-' || *p == '+')) {
+        negative = *p == '-';
+        p++;
+    }
+
+    uint64_t mantissa = 0;
+    int digits = 0;
+    int exponent = 0;
+    while (p < end && *p >= '0' && *p <= '9') {
+        if (digits < 19) {
+            mantissa = mantissa * 10 + (*p - '0');
+            digits += mantissa != 0;
+        } else {
+            exponent++;
+        }
+        p++;
+    }
+    if (p < end && *p == '.') {
+        p++;
+        while (p < end && *p >= '0' && *p <= '9') {
+            if (digits < 19) {
+                mantissa = mantissa * 10 + (*p - '0');
+                digits += mantissa != 0;
+                exponent--;
+            }
+            p++;
+        }
+    }
+    if (p < end && (*p == 'e' || *p == 'E')) {
+        p++;
+        bool negative_exponent = false;
+        if (p < end && (*p == '-' || *p == '+')) {
+            negative_exponent = *p == '-';
+            p++;
+        }
+        int e = 0;
+        while (p < end && *p >= '0' && *p <= '9') {
+            if (e < 1000) {
+                e = e * 10 + (*p - '0');
+            }
+            p++;
+        }
+        exponent += negative_exponent ? -e : e;
+    }
+
+    double value = (double)mantissa;
+    int magnitude = exponent < 0 ? -exponent : exponent;
+    while (magnitude > 22) {
+        value = exponent < 0 ? value / 1e22 : value * 1e22;
+        magnitude -= 22;
+    }
+    value = exponent < 0 ? value / powers_of_ten[magnitude]
+                         : value * powers_of_ten[magnitude];
+
+    *out = (float)(negative ? -value : value);
+    return p;
+}
+
+static char const* parse_int(char const* p, char const* end, int32_t* out)
+{
+    bool negative = false;
+    if (p < end && (*p == '-' || *p == '+')) {
+        negative = *p == '-';
+        p++;
+    }
+    int64_t value = 0;
+    while (p < end && *p >= '0' && *p <= '9') {
+        if (value < INT32_MAX) {
+            value = value * 10 + (*p - '0');
+        }
+        p++;
+    }
+    if (value > INT32_MAX) {
+        value = INT32_MAX;
+    }
+    *out = (int32_t)(negative ? -value : value);
+    return p;
+}
+
+// Number of vertices in the face on the line starting at 'p'
+static uint32_t count_face_corners(char const* p, char const* end)
+{
+    uint32_t corners = 0;
+    p = skip_spaces(p, end);
+    while (p < end && *p != '\r' && *p != '#') {
+        corners++;
+        while (p < end && *p != ' ' && *p != '\t' && *p != '\r') {
+            p++;
+        }
+        p = skip_spaces(p, end);
+    }
+    return corners;
+}
+
+static void count_chunk(void* data, unsigned int index)
+{
+    struct obj_parse* parse = data;
+    struct obj_chunk* chunk = &parse->chunks[index];
+
+    char const* p = chunk->begin;
+    while (p < chunk->end) {
+        char const* end = line_end(p, chunk->end);
+        char const* line = skip_spaces(p, end);
+        if (starts_with(line, end, "v")) {
+            chunk->position_count++;
+        } else if (starts_with(line, end, "vn")) {
+            chunk->normal_count++;
+        } else if (starts_with(line, end, "vt")) {
+            chunk->uv_count++;
+        } else if (starts_with(line, end, "f")) {
+            uint32_t corners = count_face_corners(line + 2, end);
+            if (corners >= 3) {
+                chunk->triangle_count += corners - 2;
+            }
+        } else if (starts_with(line, end, "usemtl")) {
+            chunk->material_run_count++;
+        } else if (starts_with(line, end, "mtllib")
+            && chunk->mtllib_count < MAX_MTLLIBS_PER_CHUNK) {
+            chunk->mtllibs[chunk->mtllib_count++] = line;
+        }
+        p = end + 1;
+    }
+}
+
+/* Turn a 1 based or negative relative OBJ index into a 0 based one. 'seen'
+ * is how many elements of that kind came before this line, 'total' how many
+ * there are in the file.
+ */
+static int32_t resolve_index(int32_t index, uint32_t seen, uint32_t total,
+    bool* bad)
+{
+    int64_t resolved;
+    if (index > 0) {
+        resolved = (int64_t)index - 1;
+    } else if (index < 0) {
+        resolved = (int64_t)seen + index;
+    } else {
+        return -1;
+    }
+    if (resolved < 0 || resolved >= total) {
+        *bad = true;
+        return -1;
+    }
+    return (int32_t)resolved;
+}
+
+// Parse one 'v', 'v/t', 'v//n' or 'v/t/n' corner into three indices
+static char const* parse_corner(char const* p, char const* end,
+    struct obj_parse const* parse, struct obj_chunk* chunk, uint32_t positions, uint32_t uvs,
+    uint32_t normals, int32_t out[3])
+{
+    int32_t index[3] = { 0, 0, 0 };
+    p = parse_int(p, end, &index[0]);
+    if (p < end && *p == '/') {
+        p++;
+        if (p < end && *p != '/') {
+            p = parse_int(p, end, &index[1]);
+        }
+        if (p < end && *p == '/') {
+            p = parse_int(p + 1, end, &index[2]);
+        }
+    }
+    out[0] = resolve_index(index[0], positions, parse->position_count,
+        &chunk->bad_index);
+    out[1] = resolve_index(index[1], uvs, parse->uv_count, &chunk->bad_index);
+    out[2] = resolve_index(index[2], normals, parse->normal_count,
+        &chunk->bad_index);
+    if (index[0] == 0) {
+        chunk->bad_index = true;
+    }
+    return skip_spaces(p, end);
+}
+
+static void parse_chunk(void* data, unsigned int index)
+{
+    struct obj_parse* parse = data;
+    struct obj_chunk* chunk = &parse->chunks[index];
+
+    uint32_t positions = chunk->position_base;
+    uint32_t normals = chunk->normal_base;
+    uint32_t uvs = chunk->uv_base;
+    uint32_t triangles = chunk->triangle_base;
+    uint32_t runs = chunk->material_run_base;
+
+    char const* p = chunk->begin;
+    while (p < chunk->end) {
+        char const* end = line_end(p, chunk->end);
+        char const* line = skip_spaces(p, end);
+        if (starts_with(line, end, "v")) {
+            float* v = &parse->positions[positions++ * 3];
+            line = parse_float(line + 1, end, &v[0]);
+            line = parse_float(line, end, &v[1]);
+            parse_float(line, end, &v[2]);
+        } else if (starts_with(line, end, "vn")) {
+            float* n = &parse->normals[normals++ * 3];
+            line = parse_float(line + 2, end, &n[0]);
+            line = parse_float(line, end, &n[1]);
+            parse_float(line, end, &n[2]);
+        } else if (starts_with(line, end, "vt")) {
+            float* t = &parse->uvs[uvs++ * 2];
+            line = parse_float(line + 2, end, &t[0]);
+            parse_float(line, end, &t[1]);
+        } else if (starts_with(line, end, "f")) {
+            // Fan out from the first corner: (0, 1, 2), (0, 2, 3), ...
+            int32_t first[3];
+            int32_t previous[3];
+            int32_t current[3];
+            line = skip_spaces(line + 1, end);
+            uint32_t corners = count_face_corners(line, end);
+            for (uint32_t c = 0; c < corners; c++) {
+                line = parse_corner(line, end, parse, chunk, positions, uvs,
+                    normals, current);
+                if (c == 0) {
+                    memcpy(first, current, sizeof(first));
+                } else if (c >= 2) {
+                    int32_t* out = &parse->corners[triangles++ * 9];
+                    memcpy(out, first, sizeof(first));
+                    memcpy(out + 3, previous, sizeof(previous));
+                    memcpy(out + 6, current, sizeof(current));
+                }
+                memcpy(previous, current, sizeof(previous));
+            }
+        } else if (starts_with(line, end, "usemtl")) {
+            char const* name = skip_spaces(line + 6, end);
+            char const* name_end = end;
+            while (name_end > name
+                && (name_end[-1] == '\r' || name_end[-1] == ' ')) {
+                name_end--;
+            }
+            parse->material_runs[runs++] = (struct material_run) {
+                .first_triangle = triangles,
+                .name = name,
+                .name_length = name_end - name
+            };
+        }
+        p = end + 1;
+    }
+}
+
+// The MTL files a mesh was read from, they key its cache with the OBJ
+struct mtl_files {
+    struct mesh_cache_dependency files[MESH_CACHE_MAX_DEPENDENCIES];
+    uint32_t count;
+    // Set when there were more than fit, the mesh is not cached then
+    bool overflow;
+};
+
+// Remember 'path' as it is now, 'file' is NULL when it could not be opened
+static void add_mtl_file(struct mtl_files* mtls, char const* path, FILE* file)
+{
+    if (mtls->count == MESH_CACHE_MAX_DEPENDENCIES
+        || strlen(path) >= sizeof(mtls->files[0].path)) {
+        mtls->overflow = true;
+        return;
+    }
+    struct mesh_cache_dependency* d = &mtls->files[mtls->count++];
+    memset(d, 0, sizeof(*d));
+    snprintf(d->path, sizeof(d->path), "%s", path);
+    struct stat st;
+    if (file != NULL && fstat(fileno(file), &st) == 0) {
+        d->size = st.st_size;
+        d->mtime = st.st_mtime;
+    } else {
+        d->size = MESH_CACHE_MISSING;
+    }
+}
+
+/* Parsed MTL materials are appended to 'm' and the file to 'mtls'. 'dir' is
+ * prefixed to map paths.
+ */
+static void load_mtl(struct mesh* m, char const* path, char const* dir,
+    struct mtl_files* mtls)
+{
+    FILE* file = fopen(path, "r");
+    add_mtl_file(mtls, path, file);
+    if (file == NULL) {
+        fprintf(stderr, "obj_loader.c, %s:", path);
+        perror(NULL);
+        return;
+    }
+
+    char line[1024];
+    struct mesh_material* current = NULL;
+    while (fgets(line, sizeof(line), file) != NULL) {
+        line[strcspn(line, "\r\n")] = '\0';
+        char const* p = skip_spaces(line, line + strlen(line));
+        char const* end = p + strlen(p);
+
+        if (starts_with(p, end, "newmtl")) {
+            struct mesh_material* materials = realloc(m->materials,
+                (m->material_count + 1) * sizeof(*materials));
+            if (materials == NULL) {
+                break;
+            }
+            m->materials = materials;
+            current = &m->materials[m->material_count++];
+            *current = (struct mesh_material) {
+                .diffuse_color = { 0.8f, 0.8f, 0.8f },
+                .specular_color = { 0.5f, 0.5f, 0.5f },
+                .shininess = 32.0f
+            };
+            snprintf(current->name, sizeof(current->name), "%s",
+                skip_spaces(p + 6, end));
+        } else if (current == NULL) {
+            continue;
+        } else if (starts_with(p, end, "Kd")) {
+            p = parse_float(p + 2, end, &current->diffuse_color[0]);
+            p = parse_float(p, end, &current->diffuse_color[1]);
+            parse_float(p, end, &current->diffuse_color[2]);
+        } else if (starts_with(p, end, "Ks")) {
+            p = parse_float(p + 2, end, &current->specular_color[0]);
+            p = parse_float(p, end, &current->specular_color[1]);
+            parse_float(p, end, &current->specular_color[2]);
+        } else if (starts_with(p, end, "Ns")) {
+            parse_float(p + 2, end, &current->shininess);
+        } else if (starts_with(p, end, "map_Kd")) {
+            snprintf(current->diffuse_map, sizeof(current->diffuse_map), "%s%s",
+                dir, skip_spaces(p + 6, end));
+        } else if (starts_with(p, end, "map_Ks")) {
+            snprintf(current->specular_map, sizeof(current->specular_map),
+                "%s%s", dir, skip_spaces(p + 6, end));
+        }
+    }
+    fclose(file);
+}
+
+/* Load the MTL files named on the 'mtllib' lines the count pass found. One
+ * line can name several files.
+ */
+static void load_mtllibs(struct mesh* m, struct obj_parse const* parse,
+    char const* end_of_file, char const* dir, struct mtl_files* mtls)
+{
+    for (unsigned int c = 0; c < parse->chunk_count; c++) {
+        struct obj_chunk const* chunk = &parse->chunks[c];
+        for (uint32_t l = 0; l < chunk->mtllib_count; l++) {
+            char const* end = line_end(chunk->mtllibs[l], end_of_file);
+            char const* name = skip_spaces(chunk->mtllibs[l] + 6, end);
+            while (name < end && *name != '\r') {
+                char const* name_end = name;
+                while (name_end < end && *name_end != ' ' && *name_end != '\t'
+                    && *name_end != '\r') {
+                    name_end++;
+                }
+                char mtl_path[1024];
+                snprintf(mtl_path, sizeof(mtl_path), "%s%.*s", dir,
+                    (int)(name_end - name), name);
+                load_mtl(m, mtl_path, dir, mtls);
+                name = skip_spaces(name_end, end);
+            }
+        }
+    }
+}
+
+static int32_t find_material(struct mesh const* m,
+    struct material_run const* run)
+{
+    for (uint32_t i = 0; i < m->material_count; i++) {
+        if (strlen(m->materials[i].name) == run->name_length
+            && memcmp(m->materials[i].name, run->name, run->name_length) == 0) {
+            return (int32_t)i;
+        }
+    }
+    return -1;
+}
+
+static uint32_t hash_corner(int32_t const corner[3])
+{
+    uint32_t h = (uint32_t)corner[0] * 0x9e3779b1u;
+    h ^= (uint32_t)corner[1] * 0x85ebca77u + (h << 6) + (h >> 2);
+    h ^= (uint32_t)corner[2] * 0xc2b2ae3du + (h << 6) + (h >> 2);
+    return h;
+}
+
+/* Merge corners with the same position, uv and normal into one vertex. Open
+ * addressing over vertex indices, the keys are kept per vertex in 'keys'.
+ */
+static bool build_vertices(struct mesh* m, struct obj_parse const* parse,
+    uint32_t triangle_count, uint32_t position_count, uint32_t uv_count,
+    uint32_t normal_count, bool* has_normals)
+{
+    uint32_t corner_count = triangle_count * 3;
+    uint32_t capacity = 16;
+    while (capacity < corner_count + corner_count / 2) {
+        capacity *= 2;
+    }
+
+    uint32_t* table = malloc(capacity * sizeof(uint32_t));
+    int32_t* keys = malloc((size_t)corner_count * 3 * sizeof(int32_t));
+    m->vertices = malloc((size_t)corner_count * sizeof(struct mesh_vertex));
+    m->indices = malloc((size_t)corner_count * sizeof(uint32_t));
+    if (table == NULL || keys == NULL || m->vertices == NULL
+        || m->indices == NULL) {
+        free(table);
+        free(keys);
+        return false;
+    }
+    memset(table, 0xff, capacity * sizeof(uint32_t));
+
+    *has_normals = normal_count > 0;
+    uint32_t vertex_count = 0;
+    for (uint32_t c = 0; c < corner_count; c++) {
+        int32_t const* corner = &parse->corners[c * 3];
+        uint32_t slot = hash_corner(corner) & (capacity - 1);
+        for (;;) {
+            uint32_t v = table[slot];
+            if (v == UINT32_MAX) {
+                break;
+            }
+            if (memcmp(&keys[v * 3], corner, 3 * sizeof(int32_t)) == 0) {
+                break;
+            }
+            slot = (slot + 1) & (capacity - 1);
+        }
+
+        if (table[slot] == UINT32_MAX) {
+            uint32_t v = vertex_count++;
+            table[slot] = v;
+            memcpy(&keys[v * 3], corner, 3 * sizeof(int32_t));
+
+            struct mesh_vertex* vertex = &m->vertices[v];
+            *vertex = (struct mesh_vertex) { 0 };
+            if (corner[0] >= 0 && (uint32_t)corner[0] < position_count) {
+                memcpy(vertex->position, &parse->positions[corner[0] * 3],
+                    sizeof(vertex->position));
+            }
+            if (corner[1] >= 0 && (uint32_t)corner[1] < uv_count) {
+                memcpy(vertex->uv, &parse->uvs[corner[1] * 2],
+                    sizeof(vertex->uv));
+            }
+            if (corner[2] >= 0 && (uint32_t)corner[2] < normal_count) {
+                memcpy(vertex->normal, &parse->normals[corner[2] * 3],
+                    sizeof(vertex->normal));
+            } else {
+                *has_normals = false;
+            }
+        }
+        m->indices[c] = table[slot];
+    }
+    free(table);
+    free(keys);
+
+    m->vertex_count = vertex_count;
+    m->index_count = corner_count;
+    struct mesh_vertex* shrunk = realloc(m->vertices,
+        vertex_count * sizeof(struct mesh_vertex));
+    if (shrunk != NULL || vertex_count == 0) {
+        m->vertices = shrunk;
+    }
+    return true;
+}
+
+// One submesh per material run, triangles before the first run get none
+static bool build_submeshes(struct mesh* m, struct obj_parse const* parse,
+    uint32_t run_count, uint32_t triangle_count)
+{
+    m->submeshes = malloc((run_count + 1) * sizeof(struct mesh_submesh));
+    if (m->submeshes == NULL) {
+        return false;
+    }
+
+    uint32_t start = 0;
+    int32_t material = -1;
+    for (uint32_t r = 0; r <= run_count; r++) {
+        uint32_t end = r < run_count ? parse->material_runs[r].first_triangle
+                                     : triangle_count;
+        if (end > start) {
+            m->submeshes[m->submesh_count++] = (struct mesh_submesh) {
+                .index_offset = start * 3,
+                .index_count = (end - start) * 3,
+                .material = material
+            };
+        }
+        if (r < run_count) {
+            material = find_material(m, &parse->material_runs[r]);
+            start = end;
+        }
+    }
+    return true;
+}
+
+// Split the file into chunks that end on line boundaries
+static unsigned int split_chunks(struct obj_chunk* chunks,
+    unsigned int max_chunks, char const* data, size_t size)
+{
+    size_t chunk_size = size / max_chunks;
+    if (chunk_size < MIN_CHUNK_SIZE) {
+        chunk_size = MIN_CHUNK_SIZE;
+    }
+
+    unsigned int count = 0;
+    char const* p = data;
+    char const* end_of_file = data + size;
+    while (p < end_of_file && count < max_chunks) {
+        char const* end = p + chunk_size;
+        if (end >= end_of_file || count == max_chunks - 1) {
+            end = end_of_file;
+        } else {
+            end = line_end(end, end_of_file);
+            end = end < end_of_file ? end + 1 : end_of_file;
+        }
+        chunks[count++] = (struct obj_chunk) { .begin = p, .end = end };
+        p = end;
+    }
+    return count;
+}
+
+static bool parse_obj(struct mesh* m, char const* data, size_t size,
+    char const* dir, struct thread_pool* pool, struct mtl_files* mtls)
+{
+    unsigned int max_chunks = thread_pool_concurrency(pool) * CHUNKS_PER_THREAD;
+    struct obj_parse parse = { 0 };
+    parse.chunks = calloc(max_chunks, sizeof(struct obj_chunk));
+    if (parse.chunks == NULL) {
+        return false;
+    }
+    parse.chunk_count = split_chunks(parse.chunks, max_chunks, data, size);
+
+    thread_pool_for(pool, parse.chunk_count, count_chunk, &parse);
+
+    uint32_t positions = 0, normals = 0, uvs = 0, triangles = 0, runs = 0;
+    for (unsigned int i = 0; i < parse.chunk_count; i++) {
+        struct obj_chunk* chunk = &parse.chunks[i];
+        chunk->position_base = positions;
+        chunk->normal_base = normals;
+        chunk->uv_base = uvs;
+        chunk->triangle_base = triangles;
+        chunk->material_run_base = runs;
+        positions += chunk->position_count;
+        normals += chunk->normal_count;
+        uvs += chunk->uv_count;
+        triangles += chunk->triangle_count;
+        runs += chunk->material_run_count;
+    }
+
+    parse.position_count = positions;
+    parse.normal_count = normals;
+    parse.uv_count = uvs;
+
+    parse.positions = malloc((size_t)positions * 3 * sizeof(float) + 1);
+    parse.normals = malloc((size_t)normals * 3 * sizeof(float) + 1);
+    parse.uvs = malloc((size_t)uvs * 2 * sizeof(float) + 1);
+    parse.corners = malloc((size_t)triangles * 9 * sizeof(int32_t) + 1);
+    parse.material_runs = malloc(runs * sizeof(struct material_run) + 1);
+
+    bool ok = parse.positions && parse.normals && parse.uvs && parse.corners
+        && parse.material_runs;
+    if (!ok) {
+        fprintf(stderr, "obj_loader.c: out of memory\n");
+    }
+    bool bad_index = false;
+    if (ok) {
+        thread_pool_for(pool, parse.chunk_count, parse_chunk, &parse);
+        for (unsigned int i = 0; i < parse.chunk_count && !bad_index; i++) {
+            bad_index = parse.chunks[i].bad_index;
+        }
+        if (bad_index) {
+            fprintf(stderr, "obj_loader.c: face with an invalid index\n");
+            ok = false;
+        }
+    }
+    if (ok) {
+        bool has_normals;
+        load_mtllibs(m, &parse, data + size, dir, mtls);
+        ok = build_vertices(m, &parse, triangles, positions, uvs, normals,
+                 &has_normals)
+            && build_submeshes(m, &parse, runs, triangles);
+        if (!ok) {
+            fprintf(stderr, "obj_loader.c: out of memory\n");
+        }
+        if (ok && !has_normals) {
+            mesh_compute_normals(m);
+        }
+        mesh_compute_bounds(m);
+    }
+
+    free(parse.chunks);
+    free(parse.positions);
+    free(parse.normals);
+    free(parse.uvs);
+    free(parse.corners);
+    free(parse.material_runs);
+    if (!ok) {
+        mesh_free(m);
+    }
+    return ok;
+}
+
+bool obj_load(struct mesh* m, char const* path, struct thread_pool* pool)
+{
+    *m = (struct mesh) { 0 };
+
+    int fd = open(path, O_RDONLY);
+    if (fd == -1) {
+        fprintf(stderr, "obj_loader.c, %s:", path);
+        perror(NULL);
+        return false;
+    }
+    struct stat st;
+    if (fstat(fd, &st) != 0) {
+        fprintf(stderr, "obj_loader.c, %s:", path);
+        perror(NULL);
+        close(fd);
+        return false;
+    }
+
+    char cache_path[1024];
+    snprintf(cache_path, sizeof(cache_path), "%s.meshcache", path);
+    if (mesh_cache_read(m, cache_path, st.st_size, st.st_mtime)) {
+        close(fd);
+        return true;
+    }
+    if (st.st_size == 0) {
+        close(fd);
+        return true;
+    }
+
+    size_t size = st.st_size;
+    char const* data = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (data == MAP_FAILED) {
+        fprintf(stderr, "obj_loader.c, %s:", path);
+        perror(NULL);
+        return false;
+    }
+    // Every chunk is read front to back
+    madvise((void*)data, size, MADV_SEQUENTIAL);
+
+    // Map paths in the MTL files are relative to the OBJ file
+    char dir[1024] = "";
+    char const* slash = strrchr(path, '/');
+    if (slash != NULL) {
+        snprintf(dir, sizeof(dir), "%.*s/", (int)(slash - path), path);
+    }
+
+    struct mtl_files mtls = { 0 };
+    bool ok = parse_obj(m, data, size, dir, pool, &mtls);
+    munmap((void*)data, size);
+
+    if (ok) {
+        // Simplify and reorder once here, the cache then keeps the result
+        mesh_generate_lods(m, 0.5f, MESH_MAX_LODS);
+        struct mesh_optimize_stats stats;
+        mesh_optimize(m, &stats);
+        printf("%s: %u levels of detail, ACMR %.3f -> %.3f, ATVR %.3f -> %.3f\n",
+            path, m->lod_count, stats.before.acmr, stats.after.acmr,
+            stats.before.atvr, stats.after.atvr);
+        if (!mtls.overflow) {
+            mesh_cache_write(m, cache_path, st.st_size, st.st_mtime,
+                mtls.files, mtls.count);
+        }
+    }
+    return ok;
+}
@@ -0,0 +1,20 @@
+#ifndef OBJ_LOADER_H
+#define OBJ_LOADER_H
+#include <stdbool.h>
+
+#include "mesh.h"
+#include "thread_pool.h"
+
+/* Load a Wavefront OBJ file and the MTL libraries it references into an
+ * indexed mesh. Vertices that share position, normal and texture coords are
+ * merged, polygons are split into triangles and every 'usemtl' starts a new
+ * submesh. Levels of detail are added with mesh_generate_lods and the result
+ * is reordered for the GPU with mesh_optimize.
+ *
+ * The file is mapped into memory and parsed in parallel on 'pool'. The result
+ * is stored next to it in '<path>.meshcache', later loads of an unchanged
+ * file and MTL libraries just copy that. Faces with indices that do not
+ * exist fail the load. Returns false on error.
+ */
+bool obj_load(struct mesh* m, char const* path, struct thread_pool* pool);
+#endif
@@ -0,0 +1,229 @@
+#include <glad/glad.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "gpu_memory.h"
+#include "occlusion.h"
+
+#define OCCLUSION_VISIBLE (1u << 0)
+// A query was issued and its result has not been read yet
+#define OCCLUSION_PENDING (1u << 1)
+
+/* Boxes are grown a little so the faces of a box shaped object do not fail
+ * the depth test against the object itself
+ */
+#define OCCLUSION_BOX_SCALE 1.01f
+#define OCCLUSION_BOX_MARGIN 0.001f
+
+/* How close the camera may get to a box before it is treated as being inside
+ * it, the near plane would cut the box open well before the eye touches it
+ */
+#define OCCLUSION_EYE_MARGIN 0.25f
+
+bool occlusion_init(struct occlusion_culler* c, uint32_t object_count,
+    uint32_t requery_interval)
+{
+    memset(c, 0, sizeof(*c));
+    c->object_count = object_count;
+    c->requery_interval = requery_interval > 0 ? requery_interval : 1;
+    c->queries = calloc(object_count + 1, sizeof(unsigned int));
+    c->flags = calloc(object_count + 1, sizeof(uint8_t));
+    c->last_seen_frame = calloc(object_count + 1, sizeof(uint32_t));
+    c->last_query_frame = calloc(object_count + 1, sizeof(uint32_t));
+    c->drawn = calloc(object_count + 1, sizeof(uint32_t));
+    c->tested = calloc(object_count + 1, sizeof(uint32_t));
+    c->hidden = calloc(object_count + 1, sizeof(uint32_t));
+    if (c->queries == NULL || c->flags == NULL || c->last_seen_frame == NULL
+        || c->last_query_frame == NULL || c->drawn == NULL
+        || c->tested == NULL || c->hidden == NULL) {
+        fprintf(stderr, "occlusion: out of memory for %u objects\n",
+            object_count);
+        occlusion_free(c);
+        return false;
+    }
+    glGenQueries(object_count, c->queries);
+
+    // Nothing was seen in the frame before the first one
+    memset(c->last_seen_frame, 0xff, object_count * sizeof(uint32_t));
+
+    shader_init(&c->box_shader, "../src/occlusion_box.vs",
+        "../src/occlusion_box.fs");
+
+    // Unit cube around the origin, scaled to each box in the vertex shader
+    float const corners[] = {
+        -0.5f, -0.5f, -0.5f, 0.5f, -0.5f, -0.5f,
+        0.5f, 0.5f, -0.5f, -0.5f, 0.5f, -0.5f,
+        -0.5f, -0.5f, 0.5f, 0.5f, -0.5f, 0.5f,
+        0.5f, 0.5f, 0.5f, -0.5f, 0.5f, 0.5f
+    };
+    uint8_t const faces[] = {
+        0, 2, 1, 0, 3, 2, 4, 5, 6, 4, 6, 7,
+        0, 4, 7, 0, 7, 3, 1, 2, 6, 1, 6, 5,
+        0, 1, 5, 0, 5, 4, 3, 7, 6, 3, 6, 2
+    };
+    glGenVertexArrays(1, &c->box_VAO);
+    c->box_VBO = gpu_buffer_create(GPU_MEMORY_VERTEX, "occlusion box");
+    c->box_EBO = gpu_buffer_create(GPU_MEMORY_INDEX, "occlusion box");
+    glBindVertexArray(c->box_VAO);
+    glBindBuffer(GL_ARRAY_BUFFER, c->box_VBO);
+    gpu_buffer_data(c->box_VBO, GL_ARRAY_BUFFER, sizeof(corners), corners,
+        GL_STATIC_DRAW);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, c->box_EBO);
+    gpu_buffer_data(c->box_EBO, GL_ELEMENT_ARRAY_BUFFER, sizeof(faces), faces,
+        GL_STATIC_DRAW);
+    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 3 * sizeof(float),
+        (void*)0);
+    glEnableVertexAttribArray(0);
+    glBindVertexArray(0);
+    return true;
+}
+
+void occlusion_free(struct occlusion_culler* c)
+{
+    if (c->queries != NULL && c->object_count > 0) {
+        glDeleteQueries(c->object_count, c->queries);
+    }
+    if (c->box_VAO != 0) {
+        glDeleteVertexArrays(1, &c->box_VAO);
+        gpu_buffers_delete(1, &c->box_VBO);
+        gpu_buffers_delete(1, &c->box_EBO);
+        glDeleteProgram(c->box_shader.ID);
+    }
+    free(c->queries);
+    free(c->flags);
+    free(c->last_seen_frame);
+    free(c->last_query_frame);
+    free(c->drawn);
+    free(c->tested);
+    free(c->hidden);
+    memset(c, 0, sizeof(*c));
+}
+
+static bool eye_inside(struct aabb_soa bounds, uint32_t i, vec3 eye)
+{
+    return fabsf(eye[0] - bounds.center_x[i])
+        <= bounds.extent_x[i] + OCCLUSION_EYE_MARGIN
+        && fabsf(eye[1] - bounds.center_y[i])
+        <= bounds.extent_y[i] + OCCLUSION_EYE_MARGIN
+        && fabsf(eye[2] - bounds.center_z[i])
+        <= bounds.extent_z[i] + OCCLUSION_EYE_MARGIN;
+}
+
+// Read the results that have arrived, without waiting for any of them
+static void read_results(struct occlusion_culler* c, uint32_t const* objects,
+    size_t count)
+{
+    for (size_t n = 0; n < count; n++) {
+        uint32_t i = objects[n];
+        if (!(c->flags[i] & OCCLUSION_PENDING)) {
+            continue;
+        }
+        GLuint available = GL_FALSE;
+        glGetQueryObjectuiv(c->queries[i], GL_QUERY_RESULT_AVAILABLE,
+            &available);
+        if (!available) {
+            continue;
+        }
+        GLuint passed = GL_FALSE;
+        glGetQueryObjectuiv(c->queries[i], GL_QUERY_RESULT, &passed);
+        c->flags[i] = passed ? OCCLUSION_VISIBLE : 0;
+    }
+}
+
+void occlusion_draw(struct occlusion_culler* c, struct aabb_soa bounds,
+    uint32_t const* objects, size_t count, mat4 view_projection, vec3 eye,
+    struct shader const* shader, void (*draw)(void* data, uint32_t object),
+    void* data)
+{
+    uint32_t const frame = ++c->frame;
+    read_results(c, objects, count);
+
+    uint32_t drawn_count = 0;
+    uint32_t tested_count = 0;
+    uint32_t hidden_count = 0;
+    for (size_t n = 0; n < count; n++) {
+        uint32_t i = objects[n];
+
+        /* Results from before the object left the view say nothing about it
+         * now. Draw it and test it within the next few frames, spread out so
+         * objects coming into view together are not tested together forever
+         */
+        if (c->last_seen_frame[i] != frame - 1) {
+            c->flags[i] = OCCLUSION_VISIBLE;
+            c->last_query_frame[i] = frame - c->requery_interval
+                + i % c->requery_interval;
+        }
+        c->last_seen_frame[i] = frame;
+
+        if (eye_inside(bounds, i, eye)) {
+            c->flags[i] = OCCLUSION_VISIBLE;
+            c->drawn[drawn_count++] = i;
+        } else if (c->flags[i] & OCCLUSION_VISIBLE) {
+            c->drawn[drawn_count++] = i;
+            if (!(c->flags[i] & OCCLUSION_PENDING)
+                && frame - c->last_query_frame[i] >= c->requery_interval) {
+                c->tested[tested_count++] = i;
+            }
+        } else {
+            c->hidden[hidden_count++] = i;
+            // A query still in flight is used as it is
+            if (!(c->flags[i] & OCCLUSION_PENDING)) {
+                c->tested[tested_count++] = i;
+            }
+        }
+    }
+
+    // Visible objects first, they are what occludes the rest
+    glUseProgram(shader->ID);
+    for (uint32_t n = 0; n < drawn_count; n++) {
+        draw(data, c->drawn[n]);
+    }
+
+    if (tested_count > 0) {
+        glUseProgram(c->box_shader.ID);
+        shader_set_mat4(&c->box_shader, "view_projection", view_projection);
+        glColorMask(GL_FALSE, GL_FALSE, GL_FALSE, GL_FALSE);
+        glDepthMask(GL_FALSE);
+        glBindVertexArray(c->box_VAO);
+        for (uint32_t n = 0; n < tested_count; n++) {
+            uint32_t i = c->tested[n];
+            vec3 center = {
+                bounds.center_x[i], bounds.center_y[i], bounds.center_z[i]
+            };
+            vec3 size = {
+                bounds.extent_x[i], bounds.extent_y[i], bounds.extent_z[i]
+            };
+            glm_vec3_scale(size, 2.0f * OCCLUSION_BOX_SCALE, size);
+            glm_vec3_adds(size, OCCLUSION_BOX_MARGIN, size);
+            shader_set_vec3(&c->box_shader, "box_center", center);
+            shader_set_vec3(&c->box_shader, "box_size", size);
+
+            glBeginQuery(GL_ANY_SAMPLES_PASSED, c->queries[i]);
+            glDrawElements(GL_TRIANGLES, 36, GL_UNSIGNED_BYTE, (void*)0);
+            glEndQuery(GL_ANY_SAMPLES_PASSED);
+            c->flags[i] |= OCCLUSION_PENDING;
+            c->last_query_frame[i] = frame;
+        }
+        glDepthMask(GL_TRUE);
+        glColorMask(GL_TRUE, GL_TRUE, GL_TRUE, GL_TRUE);
+        glUseProgram(shader->ID);
+    }
+
+    /* The GPU waits for the box, the CPU does not. If the box turns out to
+     * be visible the object is drawn this frame, so nothing pops in late
+     */
+    for (uint32_t n = 0; n < hidden_count; n++) {
+        uint32_t i = c->hidden[n];
+        glBeginConditionalRender(c->queries[i], GL_QUERY_WAIT);
+        draw(data, i);
+        glEndConditionalRender();
+    }
+
+    c->stats = (struct occlusion_stats) {
+        .objects = count,
+        .queries = tested_count,
+        .hidden = hidden_count
+    };
+}
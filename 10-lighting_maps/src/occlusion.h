@@ -0,0 +1,72 @@
+#ifndef OCCLUSION_H
+#define OCCLUSION_H
+#include <cglm/cglm.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "math_batch.h"
+#include "shader.h"
+
+// Frames a visible object is drawn without asking the GPU again
+#define OCCLUSION_REQUERY_INTERVAL 8
+
+// What the last occlusion_draw did
+struct occlusion_stats {
+    // Objects that were passed in, after frustum culling
+    uint32_t objects;
+    // Bounding boxes drawn with a query around them
+    uint32_t queries;
+    // Objects the last results said were hidden, drawn conditionally
+    uint32_t hidden;
+};
+
+/* Occlusion culling with GL_ANY_SAMPLES_PASSED queries on bounding boxes.
+ *
+ * Every object has one query. Objects that were visible last time are drawn
+ * right away and only have their box tested every 'requery_interval' frames.
+ * The boxes of hidden objects are tested every frame against what the
+ * visible ones left in the depth buffer, and the object is drawn inside a
+ * conditional render on that query, so the GPU skips it without the CPU ever
+ * waiting for a result. Results are only read once they are available.
+ */
+struct occlusion_culler {
+    uint32_t object_count;
+    uint32_t requery_interval;
+    uint32_t frame;
+
+    unsigned int* queries;
+    // Per object OCCLUSION_* flags and the frames it was last seen or tested
+    uint8_t* flags;
+    uint32_t* last_seen_frame;
+    uint32_t* last_query_frame;
+
+    // Scratch lists for one occlusion_draw call
+    uint32_t* drawn;
+    uint32_t* tested;
+    uint32_t* hidden;
+
+    struct shader box_shader;
+    unsigned int box_VAO;
+    unsigned int box_VBO;
+    unsigned int box_EBO;
+
+    struct occlusion_stats stats;
+};
+
+// Create queries for objects 0 to 'object_count' - 1
+bool occlusion_init(struct occlusion_culler* c, uint32_t object_count,
+    uint32_t requery_interval);
+
+void occlusion_free(struct occlusion_culler* c);
+
+/* Draw the 'count' objects listed in 'objects', which index 'bounds'. 'draw'
+ * is called for each object that may be visible, with 'shader' in use, and
+ * must not change the depth state. 'eye' is the camera position, objects
+ * whose box contains it are never tested since the near plane clips the box.
+ */
+void occlusion_draw(struct occlusion_culler* c, struct aabb_soa bounds,
+    uint32_t const* objects, size_t count, mat4 view_projection, vec3 eye,
+    struct shader const* shader, void (*draw)(void* data, uint32_t object),
+    void* data);
+#endif
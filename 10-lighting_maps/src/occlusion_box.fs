@@ -0,0 +1,8 @@
+#version 330 core
+// Only the depth test matters, color writes are masked off
+out vec4 FragColor;
+
+void main()
+{
+    FragColor = vec4(1.0);
+}
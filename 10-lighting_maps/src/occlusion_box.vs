@@ -0,0 +1,11 @@
+#version 330 core
+layout (location = 0) in vec3 aPos;
+
+uniform mat4 view_projection;
+uniform vec3 box_center;
+uniform vec3 box_size;
+
+void main()
+{
+    gl_Position = view_projection * vec4(box_center + aPos * box_size, 1.0);
+}
@@ -0,0 +1,223 @@
+#include <math.h>
+#include <string.h>
+
+#include "post.h"
+
+/* Targets smaller than the screen do without alpha and some precision. All of
+ * them sharing one format lets the blur reuse the targets the bloom released.
+ */
+#define POST_REDUCED_FORMAT GL_R11F_G11F_B10F
+
+struct post_settings post_default_settings(void)
+{
+    return (struct post_settings) {
+        .bloom = true,
+        .bloom_threshold = 0.8f,
+        .bloom_strength = 0.3f,
+        .bloom_scale = 0.5f,
+        .bloom_levels = 5,
+        .blur = false,
+        .blur_scale = 0.25f,
+        .blur_radius = 4.0f,
+        .exposure = 1.0f,
+        .fxaa = false
+    };
+}
+
+void post_chain_init(struct post_chain* chain)
+{
+    memset(chain, 0, sizeof(*chain));
+    chain->settings = post_default_settings();
+    shader_init(&chain->downsample, "../src/post_fullscreen.vs",
+        "../src/post_downsample.fs");
+    shader_init(&chain->upsample, "../src/post_fullscreen.vs",
+        "../src/post_upsample.fs");
+    shader_init(&chain->blur, "../src/post_fullscreen.vs",
+        "../src/post_blur.fs");
+    shader_init(&chain->tonemap, "../src/post_fullscreen.vs",
+        "../src/post_tonemap.fs");
+    shader_init(&chain->fxaa, "../src/post_fullscreen.vs",
+        "../src/post_fxaa.fs");
+    glGenVertexArrays(1, &chain->empty_VAO);
+
+    // Samplers other than 'source' are on fixed units
+    glUseProgram(chain->upsample.ID);
+    shader_set_int(&chain->upsample, "base", 1);
+    glUseProgram(chain->tonemap.ID);
+    shader_set_int(&chain->tonemap, "bloom", 1);
+}
+
+void post_chain_free(struct post_chain* chain)
+{
+    glDeleteProgram(chain->downsample.ID);
+    glDeleteProgram(chain->upsample.ID);
+    glDeleteProgram(chain->blur.ID);
+    glDeleteProgram(chain->tonemap.ID);
+    glDeleteProgram(chain->fxaa.ID);
+    glDeleteVertexArrays(1, &chain->empty_VAO);
+    memset(chain, 0, sizeof(*chain));
+}
+
+// Size of a pass target, never smaller than a pixel
+static int scaled(int size, float scale)
+{
+    int s = (int)lroundf(size * scale);
+    return s > 0 ? s : 1;
+}
+
+static void bind_texture(struct render_graph const* g, int unit,
+    uint32_t resource)
+{
+    glActiveTexture(GL_TEXTURE0 + unit);
+    glBindTexture(GL_TEXTURE_2D, render_graph_texture(g, resource));
+}
+
+static void run_pass(struct render_graph const* g, void* data)
+{
+    struct post_pass const* p = data;
+    struct post_chain const* chain = p->chain;
+    struct shader* s = p->shader;
+    glDisable(GL_DEPTH_TEST);
+    glBindVertexArray(chain->empty_VAO);
+    glUseProgram(s->ID);
+    if (s == &chain->downsample) {
+        shader_set_float(s, "threshold", p->threshold);
+    } else if (s == &chain->upsample) {
+        bind_texture(g, 1, p->base);
+    } else if (s == &chain->blur) {
+        shader_set_float(s, "radius", chain->settings.blur_radius);
+        shader_set_int(s, "horizontal", p->horizontal);
+    } else if (s == &chain->tonemap) {
+        shader_set_float(s, "exposure", chain->settings.exposure);
+        shader_set_float(s, "bloom_strength", p->bloom != UINT32_MAX
+                ? chain->settings.bloom_strength
+                : 0.0f);
+        if (p->bloom != UINT32_MAX) {
+            bind_texture(g, 1, p->bloom);
+        }
+    }
+    bind_texture(g, 0, p->source);
+    glDrawArrays(GL_TRIANGLES, 0, 3);
+}
+
+// Declare a pass sampling 'source' and 'base' into 'target'
+static struct post_pass* add_pass(struct post_chain* chain,
+    struct render_graph* g, char const* name, struct shader* shader,
+    uint32_t source, uint32_t base, uint32_t target)
+{
+    struct post_pass* p = &chain->passes[chain->pass_count++];
+    *p = (struct post_pass) {
+        .chain = chain,
+        .shader = shader,
+        .source = source,
+        .base = base,
+        .bloom = UINT32_MAX
+    };
+    uint32_t pass = render_graph_add_pass(g, name, run_pass, p);
+    render_graph_read(g, pass, source);
+    if (base != UINT32_MAX) {
+        render_graph_read(g, pass, base);
+    }
+    render_graph_write(g, pass, target, false);
+    return p;
+}
+
+static uint32_t add_target(struct render_graph* g, char const* name,
+    int width, int height)
+{
+    return render_graph_create(g, name, width, height, POST_REDUCED_FORMAT,
+        false);
+}
+
+/* Downsample the bright parts of 'scene' into up to 'bloom_levels' targets
+ * and add them back up, each level into a new target the size of the next
+ * larger one. Returns the last of those.
+ */
+static uint32_t add_bloom(struct post_chain* chain, struct render_graph* g,
+    uint32_t scene)
+{
+    struct post_settings const* set = &chain->settings;
+    uint32_t levels[POST_MAX_BLOOM_LEVELS];
+    uint32_t level_count = set->bloom_levels < POST_MAX_BLOOM_LEVELS
+        ? set->bloom_levels
+        : POST_MAX_BLOOM_LEVELS;
+
+    int width = scaled(g->resources[scene].width, set->bloom_scale);
+    int height = scaled(g->resources[scene].height, set->bloom_scale);
+    uint32_t source = scene;
+    uint32_t count = 0;
+    for (; count < level_count || count == 0; count++) {
+        // Halving a level of a pixel or two only blurs the edges
+        if (count > 0 && (width < 2 || height < 2)) {
+            break;
+        }
+        levels[count] = add_target(g, "bloom down", width, height);
+        struct post_pass* p = add_pass(chain, g, "bloom down",
+            &chain->downsample, source, UINT32_MAX, levels[count]);
+        // Only the first pass keeps the bright parts alone
+        p->threshold = count == 0 ? set->bloom_threshold : 0.0f;
+        source = levels[count];
+        width = scaled(width, 0.5f);
+        height = scaled(height, 0.5f);
+    }
+
+    uint32_t sum = levels[count - 1];
+    for (uint32_t l = count - 1; l > 0; l--) {
+        struct render_graph_resource const* base = &g->resources[levels[l - 1]];
+        uint32_t up = add_target(g, "bloom up", base->width, base->height);
+        add_pass(chain, g, "bloom up", &chain->upsample, sum, levels[l - 1],
+            up);
+        sum = up;
+    }
+    return sum;
+}
+
+/* Shrink 'scene' and blur it horizontally, then vertically. The three
+ * targets are alive two at a time, so the last one reuses the first.
+ */
+static uint32_t add_blur(struct post_chain* chain, struct render_graph* g,
+    uint32_t scene)
+{
+    struct post_settings const* set = &chain->settings;
+    int width = scaled(g->resources[scene].width, set->blur_scale);
+    int height = scaled(g->resources[scene].height, set->blur_scale);
+    uint32_t small = add_target(g, "blur", width, height);
+    uint32_t across = add_target(g, "blur", width, height);
+    uint32_t blurred = add_target(g, "blur", width, height);
+    struct post_pass* p = add_pass(chain, g, "blur shrink",
+        &chain->downsample, scene, UINT32_MAX, small);
+    p->threshold = 0.0f;
+    p = add_pass(chain, g, "blur horizontal", &chain->blur, small,
+        UINT32_MAX, across);
+    p->horizontal = true;
+    add_pass(chain, g, "blur vertical", &chain->blur, across, UINT32_MAX,
+        blurred);
+    return blurred;
+}
+
+void post_chain_add_passes(struct post_chain* chain, struct render_graph* g,
+    uint32_t scene, uint32_t output)
+{
+    struct post_settings const* set = &chain->settings;
+    chain->pass_count = 0;
+    uint32_t bloom = set->bloom ? add_bloom(chain, g, scene) : UINT32_MAX;
+    uint32_t image = set->blur ? add_blur(chain, g, scene) : scene;
+
+    // FXAA needs the colors it sees on screen, so it runs after tonemapping
+    uint32_t tonemapped = output;
+    if (set->fxaa) {
+        struct render_graph_resource const* r = &g->resources[scene];
+        tonemapped = render_graph_create(g, "tonemapped", r->width,
+            r->height, GL_RGBA8, false);
+    }
+    struct post_pass* p = add_pass(chain, g, "tonemap", &chain->tonemap,
+        image, UINT32_MAX, tonemapped);
+    if (bloom != UINT32_MAX && set->bloom_strength > 0.0f) {
+        p->bloom = bloom;
+        render_graph_read(g, g->pass_count - 1, bloom);
+    }
+    if (set->fxaa) {
+        add_pass(chain, g, "fxaa", &chain->fxaa, tonemapped, UINT32_MAX,
+            output);
+    }
+}
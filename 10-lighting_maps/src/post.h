@@ -0,0 +1,99 @@
+#ifndef POST_H
+#define POST_H
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "render_graph.h"
+#include "shader.h"
+
+// Format of the scene target post_chain_run takes, colors may exceed 1
+#define POST_SCENE_FORMAT GL_RGBA16F
+
+// Most halvings the bloom goes down by
+#define POST_MAX_BLOOM_LEVELS 8
+
+// Downsample and upsample per bloom level, three for blur, tonemap and FXAA
+#define POST_MAX_PASSES (2 * POST_MAX_BLOOM_LEVELS + 5)
+
+/* Which passes run and how large their targets are, as a fraction of the
+ * output. Changing these between frames is fine, targets of the old sizes
+ * just drop out of the pool.
+ */
+struct post_settings {
+    // Glow around everything brighter than 'bloom_threshold'. With no
+    // strength the render graph culls the bloom passes
+    bool bloom;
+    float bloom_threshold;
+    float bloom_strength;
+    // Size of the first bloom level, each further level is half the one before
+    float bloom_scale;
+    uint32_t bloom_levels;
+
+    // Blur the whole image, radius in pixels of the blur target
+    bool blur;
+    float blur_scale;
+    float blur_radius;
+
+    float exposure;
+
+    // Smooth the edges of the tonemapped image
+    bool fxaa;
+};
+
+struct post_chain;
+
+// One fullscreen pass of the chain
+struct post_pass {
+    struct post_chain* chain;
+    struct shader* shader;
+    // Render graph resources the pass samples, 'base' and 'bloom' may be unset
+    uint32_t source;
+    uint32_t base;
+    uint32_t bloom;
+    float threshold;
+    bool horizontal;
+};
+
+/* Fullscreen passes from the HDR scene to the screen, declared in a render
+ * graph. Every intermediate target is a transient that lives from the pass
+ * writing it to the last pass reading it, so the graph lets passes that run
+ * later reuse the targets of earlier ones and the memory stays about the same
+ * however many passes are enabled.
+ *
+ * The passes are
+ *   - bloom: the bright parts are downsampled into a chain of ever smaller
+ *     targets and added back up level by level with a tent filter
+ *   - blur: the scene shrunk into a small target and blurred with a
+ *     separable Gaussian, the two directions ping-ponging between targets
+ *   - tonemap: exposure, ACES filmic curve and gamma, adding the bloom
+ *   - fxaa: anti-aliasing on the tonemapped image, a single pass that costs
+ *     a fraction of what multisampling the scene does
+ */
+struct post_chain {
+    struct post_settings settings;
+
+    struct shader downsample;
+    struct shader upsample;
+    struct shader blur;
+    struct shader tonemap;
+    struct shader fxaa;
+    // Fullscreen triangles take their corners from gl_VertexID
+    unsigned int empty_VAO;
+
+    // Passes of the frame being declared
+    struct post_pass passes[POST_MAX_PASSES];
+    uint32_t pass_count;
+};
+
+// Settings that look fine with the demo scene
+struct post_settings post_default_settings(void);
+
+void post_chain_init(struct post_chain* chain);
+void post_chain_free(struct post_chain* chain);
+
+/* Declare the passes from 'scene', a POST_SCENE_FORMAT transient, to
+ * 'output'. The chain has to outlive the execution of the graph.
+ */
+void post_chain_add_passes(struct post_chain* chain, struct render_graph* g,
+    uint32_t scene, uint32_t output);
+#endif
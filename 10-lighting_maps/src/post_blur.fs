@@ -0,0 +1,27 @@
+#version 330 core
+out vec4 frag_color;
+
+in vec2 uv;
+
+uniform sampler2D source;
+uniform bool horizontal;
+// In texels, the Gaussian's sigma is half of it
+uniform float radius;
+
+void main()
+{
+    vec2 texel = 1.0 / vec2(textureSize(source, 0));
+    vec2 step = horizontal ? vec2(texel.x, 0.0) : vec2(0.0, texel.y);
+
+    float sigma = max(radius * 0.5, 0.5);
+    int taps = int(ceil(radius));
+    vec3 color = texture(source, uv).rgb;
+    float total = 1.0;
+    for (int i = 1; i <= taps; i++) {
+        float weight = exp(-float(i * i) / (2.0 * sigma * sigma));
+        color += (texture(source, uv + step * float(i)).rgb
+            + texture(source, uv - step * float(i)).rgb) * weight;
+        total += 2.0 * weight;
+    }
+    frag_color = vec4(color / total, 1.0);
+}
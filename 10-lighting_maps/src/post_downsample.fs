@@ -0,0 +1,23 @@
+#version 330 core
+out vec4 frag_color;
+
+in vec2 uv;
+
+uniform sampler2D source;
+// Only what is brighter than this is kept, 0 keeps everything
+uniform float threshold;
+
+void main()
+{
+    // Four bilinear taps average the 4 by 4 source texels around this one
+    vec2 texel = 1.0 / vec2(textureSize(source, 0));
+    vec3 color = texture(source, uv + texel * vec2(-1.0, -1.0)).rgb
+        + texture(source, uv + texel * vec2(1.0, -1.0)).rgb
+        + texture(source, uv + texel * vec2(-1.0, 1.0)).rgb
+        + texture(source, uv + texel * vec2(1.0, 1.0)).rgb;
+    color *= 0.25;
+
+    float brightness = max(color.r, max(color.g, color.b));
+    color *= max(brightness - threshold, 0.0) / max(brightness, 1e-4);
+    frag_color = vec4(color, 1.0);
+}
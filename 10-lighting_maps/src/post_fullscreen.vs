@@ -0,0 +1,9 @@
+#version 330 core
+// One triangle that covers the screen, drawn with glDrawArrays of 3 vertices
+out vec2 uv;
+
+void main()
+{
+    uv = vec2((gl_VertexID << 1) & 2, gl_VertexID & 2);
+    gl_Position = vec4(uv * 2.0 - 1.0, 0.0, 1.0);
+}
@@ -0,0 +1,133 @@
+#version 330 core
+out vec4 frag_color;
+
+in vec2 uv;
+
+// Gamma corrected color with its luma in alpha
+uniform sampler2D source;
+
+// Lottes' FXAA 3.11 with the tuning of its quality preset 12
+#define EDGE_THRESHOLD 0.166
+#define EDGE_THRESHOLD_MIN 0.0833
+#define SUBPIXEL_QUALITY 0.75
+#define SEARCH_STEPS 12
+
+const float step_sizes[SEARCH_STEPS] = float[](1.0, 1.0, 1.0, 1.0, 1.0,
+    1.5, 2.0, 2.0, 2.0, 2.0, 4.0, 8.0);
+
+float luma(vec2 p)
+{
+    return textureLod(source, p, 0.0).a;
+}
+
+float luma_at(ivec2 offset)
+{
+    return textureLodOffset(source, uv, 0.0, offset).a;
+}
+
+void main()
+{
+    vec4 center = textureLod(source, uv, 0.0);
+    float l_c = center.a;
+    float l_n = luma_at(ivec2(0, 1));
+    float l_s = luma_at(ivec2(0, -1));
+    float l_e = luma_at(ivec2(1, 0));
+    float l_w = luma_at(ivec2(-1, 0));
+    float l_min = min(l_c, min(min(l_n, l_s), min(l_e, l_w)));
+    float l_max = max(l_c, max(max(l_n, l_s), max(l_e, l_w)));
+    float range = l_max - l_min;
+    // Most pixels are not on an edge and stop here
+    if (range < max(EDGE_THRESHOLD_MIN, l_max * EDGE_THRESHOLD)) {
+        frag_color = vec4(center.rgb, 1.0);
+        return;
+    }
+
+    float l_ne = luma_at(ivec2(1, 1));
+    float l_nw = luma_at(ivec2(-1, 1));
+    float l_se = luma_at(ivec2(1, -1));
+    float l_sw = luma_at(ivec2(-1, -1));
+    float l_ns = l_n + l_s;
+    float l_we = l_w + l_e;
+    float l_west_corners = l_nw + l_sw;
+    float l_east_corners = l_ne + l_se;
+    float l_north_corners = l_nw + l_ne;
+    float l_south_corners = l_sw + l_se;
+
+    // Is the edge across rows or across columns
+    float edge_h = abs(-2.0 * l_w + l_west_corners)
+        + abs(-2.0 * l_c + l_ns) * 2.0 + abs(-2.0 * l_e + l_east_corners);
+    float edge_v = abs(-2.0 * l_n + l_north_corners)
+        + abs(-2.0 * l_c + l_we) * 2.0 + abs(-2.0 * l_s + l_south_corners);
+    bool horizontal = edge_h >= edge_v;
+
+    // Which side of this pixel the edge is on
+    vec2 texel = 1.0 / vec2(textureSize(source, 0));
+    float l_1 = horizontal ? l_s : l_w;
+    float l_2 = horizontal ? l_n : l_e;
+    float gradient_1 = l_1 - l_c;
+    float gradient_2 = l_2 - l_c;
+    bool steepest_1 = abs(gradient_1) >= abs(gradient_2);
+    float gradient_scaled = 0.25 * max(abs(gradient_1), abs(gradient_2));
+    float step_length = horizontal ? texel.y : texel.x;
+    float l_local;
+    if (steepest_1) {
+        step_length = -step_length;
+        l_local = 0.5 * (l_1 + l_c);
+    } else {
+        l_local = 0.5 * (l_2 + l_c);
+    }
+
+    // Walk along the edge both ways until it ends
+    vec2 on_edge = uv;
+    if (horizontal) {
+        on_edge.y += step_length * 0.5;
+    } else {
+        on_edge.x += step_length * 0.5;
+    }
+    vec2 offset = horizontal ? vec2(texel.x, 0.0) : vec2(0.0, texel.y);
+    vec2 uv_1 = on_edge - offset;
+    vec2 uv_2 = on_edge + offset;
+    float end_1 = luma(uv_1) - l_local;
+    float end_2 = luma(uv_2) - l_local;
+    bool reached_1 = abs(end_1) >= gradient_scaled;
+    bool reached_2 = abs(end_2) >= gradient_scaled;
+    for (int i = 1; i < SEARCH_STEPS && !(reached_1 && reached_2); i++) {
+        if (!reached_1) {
+            uv_1 -= offset * step_sizes[i];
+            end_1 = luma(uv_1) - l_local;
+            reached_1 = abs(end_1) >= gradient_scaled;
+        }
+        if (!reached_2) {
+            uv_2 += offset * step_sizes[i];
+            end_2 = luma(uv_2) - l_local;
+            reached_2 = abs(end_2) >= gradient_scaled;
+        }
+    }
+
+    // Pixels near the end of the edge move the most
+    float distance_1 = horizontal ? uv.x - uv_1.x : uv.y - uv_1.y;
+    float distance_2 = horizontal ? uv_2.x - uv.x : uv_2.y - uv.y;
+    bool nearest_1 = distance_1 < distance_2;
+    float edge_offset = 0.5 - min(distance_1, distance_2)
+        / (distance_1 + distance_2);
+    bool center_smaller = l_c < l_local;
+    if (((nearest_1 ? end_1 : end_2) < 0.0) == center_smaller) {
+        edge_offset = 0.0;
+    }
+
+    // Details smaller than a pixel are blurred by how much they stick out
+    float l_average = (2.0 * (l_ns + l_we) + l_west_corners + l_east_corners)
+        / 12.0;
+    float subpixel = clamp(abs(l_average - l_c) / range, 0.0, 1.0);
+    subpixel = (-2.0 * subpixel + 3.0) * subpixel * subpixel;
+    float final_offset = max(edge_offset,
+        subpixel * subpixel * SUBPIXEL_QUALITY);
+
+    vec2 final_uv = uv;
+    if (horizontal) {
+        final_uv.y += final_offset * step_length;
+    } else {
+        final_uv.x += final_offset * step_length;
+    }
+    frag_color = vec4(textureLod(source, final_uv, 0.0).rgb, 1.0);
+}
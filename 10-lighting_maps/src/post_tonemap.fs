@@ -0,0 +1,25 @@
+#version 330 core
+out vec4 frag_color;
+
+in vec2 uv;
+
+uniform sampler2D scene;
+uniform sampler2D bloom;
+uniform float bloom_strength;
+uniform float exposure;
+
+// Narkowicz's fit of the ACES filmic curve
+vec3 aces(vec3 x)
+{
+    return clamp((x * (2.51 * x + 0.03)) / (x * (2.43 * x + 0.59) + 0.14),
+        0.0, 1.0);
+}
+
+void main()
+{
+    vec3 color = texture(scene, uv).rgb;
+    color += texture(bloom, uv).rgb * bloom_strength;
+    color = pow(aces(color * exposure), vec3(1.0 / 2.2));
+    // FXAA finds edges by luma, see post_fxaa.fs
+    frag_color = vec4(color, dot(color, vec3(0.299, 0.587, 0.114)));
+}
@@ -0,0 +1,24 @@
+#version 330 core
+out vec4 frag_color;
+
+in vec2 uv;
+
+// The smaller level, filtered up onto 'base'
+uniform sampler2D source;
+uniform sampler2D base;
+
+void main()
+{
+    // 3 by 3 tent filter
+    vec2 texel = 1.0 / vec2(textureSize(source, 0));
+    vec3 color = texture(source, uv).rgb * 4.0;
+    color += (texture(source, uv + vec2(texel.x, 0.0)).rgb
+        + texture(source, uv - vec2(texel.x, 0.0)).rgb
+        + texture(source, uv + vec2(0.0, texel.y)).rgb
+        + texture(source, uv - vec2(0.0, texel.y)).rgb) * 2.0;
+    color += texture(source, uv + texel).rgb
+        + texture(source, uv - texel).rgb
+        + texture(source, uv + vec2(texel.x, -texel.y)).rgb
+        + texture(source, uv + vec2(-texel.x, texel.y)).rgb;
+    frag_color = vec4(texture(base, uv).rgb + color / 16.0, 1.0);
+}
@@ -0,0 +1,347 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "render_graph.h"
+
+// Framebuffer binding the graph has not set itself
+#define UNKNOWN_FRAMEBUFFER 0xffffffffu
+
+void render_graph_init(struct render_graph* g, struct render_target_pool* pool,
+    struct frame_arena* frame_arena)
+{
+    memset(g, 0, sizeof(*g));
+    g->pool = pool;
+    g->frame_arena = frame_arena;
+}
+
+void render_graph_free(struct render_graph* g)
+{
+    free(g->passes);
+    free(g->resources);
+    free(g->order);
+    memset(g, 0, sizeof(*g));
+}
+
+void render_graph_reset(struct render_graph* g)
+{
+    g->pass_count = 0;
+    g->resource_count = 0;
+    g->order_count = 0;
+}
+
+static uint32_t add_resource(struct render_graph* g,
+    struct render_graph_resource r)
+{
+    if (g->resource_count == g->resource_capacity) {
+        g->resource_capacity = g->resource_capacity
+            ? g->resource_capacity * 2
+            : 16;
+        g->resources = realloc(g->resources,
+            g->resource_capacity * sizeof(struct render_graph_resource));
+    }
+    g->resources[g->resource_count] = r;
+    return g->resource_count++;
+}
+
+uint32_t render_graph_create(struct render_graph* g, char const* name,
+    int width, int height, GLenum format, bool depth)
+{
+    return add_resource(g, (struct render_graph_resource) {
+        .name = name,
+        .kind = RENDER_GRAPH_TRANSIENT,
+        .width = width,
+        .height = height,
+        .format = format,
+        .depth = depth
+    });
+}
+
+uint32_t render_graph_import_backbuffer(struct render_graph* g,
+    char const* name, int width, int height)
+{
+    return add_resource(g, (struct render_graph_resource) {
+        .name = name,
+        .kind = RENDER_GRAPH_BACKBUFFER,
+        .width = width,
+        .height = height,
+        .depth = true
+    });
+}
+
+uint32_t render_graph_import(struct render_graph* g, char const* name)
+{
+    return add_resource(g, (struct render_graph_resource) {
+        .name = name,
+        .kind = RENDER_GRAPH_EXTERNAL
+    });
+}
+
+uint32_t render_graph_add_pass(struct render_graph* g, char const* name,
+    void (*execute)(struct render_graph const* graph, void* data),
+    void* data)
+{
+    if (g->pass_count == g->pass_capacity) {
+        g->pass_capacity = g->pass_capacity ? g->pass_capacity * 2 : 16;
+        g->passes = realloc(g->passes,
+            g->pass_capacity * sizeof(struct render_graph_pass));
+        g->order = realloc(g->order, g->pass_capacity * sizeof(uint32_t));
+    }
+    g->passes[g->pass_count] = (struct render_graph_pass) {
+        .name = name,
+        .execute = execute,
+        .data = data
+    };
+    return g->pass_count++;
+}
+
+void render_graph_read(struct render_graph* g, uint32_t pass,
+    uint32_t resource)
+{
+    struct render_graph_pass* p = &g->passes[pass];
+    if (p->read_count == RENDER_GRAPH_MAX_ACCESSES) {
+        fprintf(stderr, "render_graph: %s reads too many resources\n",
+            p->name);
+        return;
+    }
+    p->reads[p->read_count++] = resource;
+}
+
+void render_graph_write(struct render_graph* g, uint32_t pass,
+    uint32_t resource, bool clear)
+{
+    struct render_graph_pass* p = &g->passes[pass];
+    if (p->write_count == RENDER_GRAPH_MAX_ACCESSES) {
+        fprintf(stderr, "render_graph: %s writes too many resources\n",
+            p->name);
+        return;
+    }
+    if (clear) {
+        p->clears |= 1u << p->write_count;
+    }
+    p->writes[p->write_count++] = resource;
+}
+
+static bool contains(uint32_t const* list, uint32_t count, uint32_t value)
+{
+    for (uint32_t i = 0; i < count; i++) {
+        if (list[i] == value) {
+            return true;
+        }
+    }
+    return false;
+}
+
+// True when pass 'before' has to run before pass 'after'
+static bool depends_on(struct render_graph const* g, uint32_t after,
+    uint32_t before)
+{
+    struct render_graph_pass const* a = &g->passes[after];
+    struct render_graph_pass const* b = &g->passes[before];
+    for (uint32_t w = 0; w < b->write_count; w++) {
+        uint32_t r = b->writes[w];
+        if (contains(a->writes, a->write_count, r)) {
+            // Writers of the same resource keep the order they were added in
+            if (before < after) {
+                return true;
+            }
+        } else if (contains(a->reads, a->read_count, r)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+bool render_graph_compile(struct render_graph* g)
+{
+    // Sort, picking the earliest added pass whose dependencies all ran
+    bool* scheduled = arena_calloc(frame_arena_current(g->frame_arena),
+        g->pass_count + 1, sizeof(bool));
+    if (scheduled == NULL) {
+        g->order_count = 0;
+        return false;
+    }
+    uint32_t* sorted = g->order;
+    for (uint32_t n = 0; n < g->pass_count; n++) {
+        uint32_t next = g->pass_count;
+        for (uint32_t i = 0; i < g->pass_count && next == g->pass_count;
+             i++) {
+            if (scheduled[i]) {
+                continue;
+            }
+            bool ready = true;
+            for (uint32_t j = 0; j < g->pass_count && ready; j++) {
+                ready = j == i || scheduled[j] || !depends_on(g, i, j);
+            }
+            if (ready) {
+                next = i;
+            }
+        }
+        if (next == g->pass_count) {
+            fprintf(stderr, "render_graph: passes depend on each other in a"
+                            " cycle\n");
+            g->order_count = 0;
+            return false;
+        }
+        scheduled[next] = true;
+        sorted[n] = next;
+    }
+
+    // Walk back from the backbuffer, keeping what it was made from
+    for (uint32_t r = 0; r < g->resource_count; r++) {
+        g->resources[r].needed
+            = g->resources[r].kind == RENDER_GRAPH_BACKBUFFER;
+    }
+    for (uint32_t n = g->pass_count; n-- > 0;) {
+        struct render_graph_pass* p = &g->passes[sorted[n]];
+        p->alive = false;
+        for (uint32_t w = 0; w < p->write_count && !p->alive; w++) {
+            p->alive = g->resources[p->writes[w]].needed;
+        }
+        for (uint32_t k = 0; k < p->read_count && p->alive; k++) {
+            g->resources[p->reads[k]].needed = true;
+        }
+    }
+
+    g->order_count = 0;
+    for (uint32_t n = 0; n < g->pass_count; n++) {
+        if (g->passes[sorted[n]].alive) {
+            sorted[g->order_count++] = sorted[n];
+        }
+    }
+    for (uint32_t r = 0; r < g->resource_count; r++) {
+        g->resources[r].first_use = UINT32_MAX;
+        g->resources[r].last_use = 0;
+        g->resources[r].target = NULL;
+    }
+    for (uint32_t n = 0; n < g->order_count; n++) {
+        struct render_graph_pass const* p = &g->passes[sorted[n]];
+        for (uint32_t k = 0; k < p->read_count + p->write_count; k++) {
+            uint32_t r = k < p->read_count ? p->reads[k]
+                                           : p->writes[k - p->read_count];
+            struct render_graph_resource* res = &g->resources[r];
+            if (res->first_use == UINT32_MAX) {
+                res->first_use = n;
+            }
+            res->last_use = n;
+        }
+    }
+    g->stats = (struct render_graph_stats) {
+        .passes = g->order_count,
+        .culled = g->pass_count - g->order_count
+    };
+    return true;
+}
+
+// Take the transients the 'n'th pass uses first from the pool
+static void acquire_transients(struct render_graph* g, uint32_t n,
+    struct render_target** seen)
+{
+    for (uint32_t r = 0; r < g->resource_count; r++) {
+        struct render_graph_resource* res = &g->resources[r];
+        if (res->kind != RENDER_GRAPH_TRANSIENT || res->first_use != n) {
+            continue;
+        }
+        res->target = render_target_acquire(g->pool, res->width,
+            res->height, res->format, res->depth);
+        if (res->target == NULL) {
+            continue;
+        }
+        g->stats.transients++;
+        bool aliased = false;
+        for (uint32_t t = 0; t < g->stats.targets && !aliased; t++) {
+            aliased = seen[t] == res->target;
+        }
+        if (!aliased) {
+            seen[g->stats.targets++] = res->target;
+        }
+    }
+}
+
+static void release_transients(struct render_graph* g, uint32_t n)
+{
+    for (uint32_t r = 0; r < g->resource_count; r++) {
+        struct render_graph_resource* res = &g->resources[r];
+        if (res->target != NULL && res->last_use == n) {
+            render_target_release(g->pool, res->target);
+            res->target = NULL;
+        }
+    }
+}
+
+// False when a transient the pass uses could not be created
+static bool has_targets(struct render_graph const* g,
+    struct render_graph_pass const* p)
+{
+    for (uint32_t k = 0; k < p->read_count + p->write_count; k++) {
+        uint32_t r = k < p->read_count ? p->reads[k]
+                                       : p->writes[k - p->read_count];
+        struct render_graph_resource const* res = &g->resources[r];
+        if (res->kind == RENDER_GRAPH_TRANSIENT && res->target == NULL) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// Bind what the pass draws into and clear the writes it asked to
+static void begin_pass(struct render_graph const* g,
+    struct render_graph_pass const* p, unsigned int* bound)
+{
+    struct render_graph_resource const* target = NULL;
+    for (uint32_t w = 0; w < p->write_count && target == NULL; w++) {
+        struct render_graph_resource const* res = &g->resources[p->writes[w]];
+        if (res->kind != RENDER_GRAPH_EXTERNAL) {
+            target = res;
+        }
+    }
+    if (target == NULL) {
+        // The pass binds its own, whatever it leaves is unknown
+        *bound = UNKNOWN_FRAMEBUFFER;
+        return;
+    }
+    unsigned int framebuffer = target->target ? target->target->framebuffer
+                                              : 0;
+    if (framebuffer != *bound) {
+        glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+        *bound = framebuffer;
+    }
+    glViewport(0, 0, target->width, target->height);
+
+    for (uint32_t w = 0; w < p->write_count; w++) {
+        struct render_graph_resource const* res = &g->resources[p->writes[w]];
+        if (res == target && (p->clears & (1u << w))) {
+            glClear(GL_COLOR_BUFFER_BIT
+                | (res->depth ? GL_DEPTH_BUFFER_BIT | GL_STENCIL_BUFFER_BIT
+                              : 0));
+        }
+    }
+}
+
+void render_graph_execute(struct render_graph* g)
+{
+    struct render_target** seen = arena_calloc(
+        frame_arena_current(g->frame_arena), g->resource_count + 1,
+        sizeof(struct render_target*));
+    if (seen == NULL) {
+        return;
+    }
+    unsigned int bound = UNKNOWN_FRAMEBUFFER;
+    for (uint32_t n = 0; n < g->order_count; n++) {
+        struct render_graph_pass const* p = &g->passes[g->order[n]];
+        acquire_transients(g, n, seen);
+        if (has_targets(g, p)) {
+            begin_pass(g, p, &bound);
+            p->execute(g, p->data);
+        }
+        release_transients(g, n);
+    }
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+}
+
+unsigned int render_graph_texture(struct render_graph const* g,
+    uint32_t resource)
+{
+    struct render_target const* t = g->resources[resource].target;
+    return t ? t->color : 0;
+}
@@ -0,0 +1,141 @@
+#ifndef RENDER_GRAPH_H
+#define RENDER_GRAPH_H
+#include <glad/glad.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "allocator.h"
+#include "render_target.h"
+
+// Most resources one pass can read, and most it can write
+#define RENDER_GRAPH_MAX_ACCESSES 8
+
+enum render_graph_resource_kind {
+    // Created by the graph for one frame, see render_graph_create
+    RENDER_GRAPH_TRANSIENT,
+    // The default framebuffer, what the frame is for
+    RENDER_GRAPH_BACKBUFFER,
+    // Owned by someone else, like a cached shadow map
+    RENDER_GRAPH_EXTERNAL
+};
+
+struct render_graph_resource {
+    char const* name;
+    enum render_graph_resource_kind kind;
+    int width;
+    int height;
+    GLenum format;
+    bool depth;
+    // Set between the first and last pass that uses a transient
+    struct render_target* target;
+    // Indices into the execution order, only valid after compiling
+    uint32_t first_use;
+    uint32_t last_use;
+    bool needed;
+};
+
+struct render_graph;
+
+struct render_graph_pass {
+    char const* name;
+    void (*execute)(struct render_graph const* graph, void* data);
+    void* data;
+    uint32_t reads[RENDER_GRAPH_MAX_ACCESSES];
+    uint32_t read_count;
+    uint32_t writes[RENDER_GRAPH_MAX_ACCESSES];
+    uint32_t write_count;
+    // Bit per write, set when the pass wants that resource cleared first
+    uint32_t clears;
+    bool alive;
+};
+
+// What the last render_graph_execute did
+struct render_graph_stats {
+    uint32_t passes;
+    uint32_t culled;
+    uint32_t transients;
+    // GL targets behind those transients, fewer when they were aliased
+    uint32_t targets;
+};
+
+/* A frame graph. Every frame the passes are declared with the resources they
+ * read and write, then the graph
+ *   - orders them so every pass runs after the passes writing what it reads
+ *   - drops the passes whose writes nothing that is kept reads, keeping the
+ *     ones that write the backbuffer
+ *   - takes each transient from the pool right before its first use and hands
+ *     it back right after its last, so transients that are not alive at the
+ *     same time share a GL texture
+ *   - binds the framebuffer of the first transient or backbuffer a pass
+ *     writes, unless it is bound already, and clears what the pass asked for
+ *
+ * Passes that only read a resource see what all its writers wrote. A pass
+ * that reads and writes the same resource, like one that blends onto it,
+ * runs after the writers declared before it and before the ones declared
+ * after it. Passes writing external resources bind what they need themselves.
+ *
+ * Scratch memory for compiling and executing comes from the current arena of
+ * 'frame_arena', the arrays of passes and resources only grow, so a frame
+ * declaring what the one before did allocates nothing.
+ */
+struct render_graph {
+    struct render_target_pool* pool;
+    struct frame_arena* frame_arena;
+
+    struct render_graph_pass* passes;
+    uint32_t pass_count;
+    uint32_t pass_capacity;
+    struct render_graph_resource* resources;
+    uint32_t resource_count;
+    uint32_t resource_capacity;
+
+    // Alive passes in the order they run
+    uint32_t* order;
+    uint32_t order_count;
+
+    struct render_graph_stats stats;
+};
+
+void render_graph_init(struct render_graph* g, struct render_target_pool* pool,
+    struct frame_arena* frame_arena);
+void render_graph_free(struct render_graph* g);
+
+// Forget the passes and resources of the last frame
+void render_graph_reset(struct render_graph* g);
+
+// A color target, with a depth and stencil buffer if 'depth' is set
+uint32_t render_graph_create(struct render_graph* g, char const* name,
+    int width, int height, GLenum format, bool depth);
+
+uint32_t render_graph_import_backbuffer(struct render_graph* g,
+    char const* name, int width, int height);
+
+uint32_t render_graph_import(struct render_graph* g, char const* name);
+
+/* 'execute' draws the pass. It is called with the framebuffer bound, if the
+ * pass writes one the graph knows, and may change any state but that binding.
+ * Passes that only write external resources may bind anything.
+ */
+uint32_t render_graph_add_pass(struct render_graph* g, char const* name,
+    void (*execute)(struct render_graph const* graph, void* data),
+    void* data);
+
+void render_graph_read(struct render_graph* g, uint32_t pass,
+    uint32_t resource);
+
+void render_graph_write(struct render_graph* g, uint32_t pass,
+    uint32_t resource, bool clear);
+
+/* Order and cull the passes and work out when each transient lives. False
+ * when the passes depend on each other in a cycle or the frame arena is full.
+ */
+bool render_graph_compile(struct render_graph* g);
+
+// Run the alive passes. Leaves the default framebuffer bound
+void render_graph_execute(struct render_graph* g);
+
+// Color texture of a transient, for the passes that read it
+unsigned int render_graph_texture(struct render_graph const* g,
+    uint32_t resource);
+#endif
@@ -0,0 +1,139 @@
+#include <stdio.h>
+#include <string.h>
+
+#include "gpu_memory.h"
+#include "render_target.h"
+
+static size_t target_bytes(struct render_target const* t)
+{
+    size_t pixels = (size_t)t->width * t->height;
+    // Depth and stencil is GL_DEPTH24_STENCIL8
+    return pixels * (gpu_memory_format_bytes(t->format)
+        + (t->depth ? gpu_memory_format_bytes(GL_DEPTH24_STENCIL8) : 0));
+}
+
+static void delete_target(struct render_target_pool* pool,
+    struct render_target* t)
+{
+    glDeleteFramebuffers(1, &t->framebuffer);
+    gpu_textures_delete(1, &t->color);
+    if (t->depth) {
+        gpu_renderbuffers_delete(1, &t->depth);
+    }
+    object_pool_release(&pool->memory, t);
+}
+
+static struct render_target* create_target(struct render_target_pool* pool,
+    int width, int height, GLenum format, bool depth)
+{
+    struct render_target* t = object_pool_alloc(&pool->memory);
+    if (t == NULL) {
+        return NULL;
+    }
+    memset(t, 0, sizeof(*t));
+    t->width = width;
+    t->height = height;
+    t->format = format;
+
+    t->color = gpu_texture_create(GPU_MEMORY_RENDER_TARGET, "render target");
+    glBindTexture(GL_TEXTURE_2D, t->color);
+    // The data type does not matter without data, GL_FLOAT fits every format
+    gpu_texture_image_2d(t->color, GL_TEXTURE_2D, 0, format, width, height,
+        GL_RGBA, GL_FLOAT, NULL);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+
+    glGenFramebuffers(1, &t->framebuffer);
+    glBindFramebuffer(GL_FRAMEBUFFER, t->framebuffer);
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0,
+        GL_TEXTURE_2D, t->color, 0);
+    if (depth) {
+        t->depth = gpu_renderbuffer_create(GPU_MEMORY_RENDER_TARGET,
+            "render target depth");
+        glBindRenderbuffer(GL_RENDERBUFFER, t->depth);
+        gpu_renderbuffer_storage(t->depth, GL_DEPTH24_STENCIL8, width,
+            height);
+        glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_STENCIL_ATTACHMENT,
+            GL_RENDERBUFFER, t->depth);
+    }
+    GLenum status = glCheckFramebufferStatus(GL_FRAMEBUFFER);
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    if (status != GL_FRAMEBUFFER_COMPLETE) {
+        fprintf(stderr, "render_target: %dx%d framebuffer incomplete, 0x%x\n",
+            width, height, status);
+        delete_target(pool, t);
+        return NULL;
+    }
+    return t;
+}
+
+void render_target_pool_init(struct render_target_pool* pool)
+{
+    memset(pool, 0, sizeof(*pool));
+    object_pool_init(&pool->memory, sizeof(struct render_target),
+        RENDER_TARGET_MAX_TARGETS, 0);
+}
+
+void render_target_pool_free(struct render_target_pool* pool)
+{
+    for (size_t i = 0; i < pool->count; i++) {
+        delete_target(pool, pool->targets[i]);
+    }
+    object_pool_free(&pool->memory);
+    memset(pool, 0, sizeof(*pool));
+}
+
+struct render_target* render_target_acquire(struct render_target_pool* pool,
+    int width, int height, GLenum format, bool depth)
+{
+    for (size_t i = 0; i < pool->count; i++) {
+        struct render_target* t = pool->targets[i];
+        if (!t->in_use && t->width == width && t->height == height
+            && t->format == format && (t->depth != 0) == depth) {
+            t->in_use = true;
+            t->last_used_frame = pool->frame;
+            return t;
+        }
+    }
+
+    struct render_target* t = create_target(pool, width, height, format,
+        depth);
+    if (t == NULL) {
+        return NULL;
+    }
+    pool->targets[pool->count++] = t;
+    pool->bytes += target_bytes(t);
+    t->in_use = true;
+    t->last_used_frame = pool->frame;
+    return t;
+}
+
+void render_target_release(struct render_target_pool* pool,
+    struct render_target* target)
+{
+    (void)pool;
+    target->in_use = false;
+}
+
+void render_target_pool_end_frame(struct render_target_pool* pool)
+{
+    size_t kept = 0;
+    for (size_t i = 0; i < pool->count; i++) {
+        struct render_target* t = pool->targets[i];
+        if (t->in_use) {
+            fprintf(stderr, "render_target: %dx%d target was not released\n",
+                t->width, t->height);
+            t->in_use = false;
+        }
+        if (pool->frame - t->last_used_frame >= RENDER_TARGET_KEEP_FRAMES) {
+            pool->bytes -= target_bytes(t);
+            delete_target(pool, t);
+        } else {
+            pool->targets[kept++] = t;
+        }
+    }
+    pool->count = kept;
+    pool->frame++;
+}
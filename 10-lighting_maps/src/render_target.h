@@ -0,0 +1,70 @@
+#ifndef RENDER_TARGET_H
+#define RENDER_TARGET_H
+#include <glad/glad.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "allocator.h"
+
+// Frames a free target is kept around before its memory is given back
+#define RENDER_TARGET_KEEP_FRAMES 3
+
+// Most targets a pool holds at once, used or not
+#define RENDER_TARGET_MAX_TARGETS 128
+
+/* A framebuffer with one color texture and optionally a depth and stencil
+ * renderbuffer. The texture filters linearly and clamps to the edge, which is
+ * what the post processing passes sample it with.
+ */
+struct render_target {
+    unsigned int framebuffer;
+    unsigned int color;
+    // 0 without depth
+    unsigned int depth;
+    int width;
+    int height;
+    GLenum format;
+    bool in_use;
+    uint32_t last_used_frame;
+};
+
+/* Render targets reused by size and format. Passes acquire the targets they
+ * need and release them as soon as nothing reads them anymore, so passes run
+ * one after the other share the same few textures. Targets that were not used
+ * for a few frames, like the ones of a size the window no longer has, are
+ * deleted at the end of the frame.
+ */
+struct render_target_pool {
+    // Targets come from 'memory' so acquired pointers stay valid while the
+    // list is compacted, and resizing the window allocates nothing
+    struct object_pool memory;
+    struct render_target* targets[RENDER_TARGET_MAX_TARGETS];
+    size_t count;
+    uint32_t frame;
+    // Memory of all targets in the pool, used or not
+    size_t bytes;
+};
+
+void render_target_pool_init(struct render_target_pool* pool);
+
+// Deletes every target, acquired or not
+void render_target_pool_free(struct render_target_pool* pool);
+
+/* A free target of this size and color format, created when there is none.
+ * 'depth' adds a depth and stencil buffer. Returns NULL when the framebuffer
+ * can not be created or the pool holds RENDER_TARGET_MAX_TARGETS already.
+ */
+struct render_target* render_target_acquire(struct render_target_pool* pool,
+    int width, int height, GLenum format, bool depth);
+
+// Hand a target back for the next acquire
+void render_target_release(struct render_target_pool* pool,
+    struct render_target* target);
+
+/* Delete targets that have been free for RENDER_TARGET_KEEP_FRAMES frames.
+ * Every target should have been released by now, the ones that were not are
+ * reported and released.
+ */
+void render_target_pool_end_frame(struct render_target_pool* pool);
+#endif
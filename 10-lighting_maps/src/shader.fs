@@ -2,6 +2,8 @@
 in vec3 Normal;
 in vec3 frag_position;
 in vec2 TexCoords;
+in float view_depth;
+flat in uint material_index;
 
 out vec4 frag_color;
 
@@ -20,30 +22,123 @@ struct Light {
     vec3 specular;
 };
 
+// A directional light, like the sun
+struct Sun {
+    vec3 direction;
+
+    vec3 diffuse;
+    vec3 specular;
+};
+
+// Same as SHADOW_MAX_CASCADES in shadow.h
+#define MAX_CASCADES 4
+
 uniform Material material;
 uniform Light light;
 
 uniform vec3 view_position;
 
+// Maps of every material in the layers of one texture, see texture_atlas.h,
+// and the materials in a table, see material_table.h. 'material' is unused
+uniform bool atlas;
+uniform sampler2DArray atlas_maps;
+uniform samplerBuffer materials;
+
+// Shadows of the point light, see shadow.h
+uniform bool point_shadows;
+uniform samplerCubeShadow point_shadow_map;
+uniform float point_shadow_far;
+
+uniform bool sun_enabled;
+uniform Sun sun;
+uniform sampler2DArrayShadow sun_shadow_map;
+uniform mat4 sun_matrices[MAX_CASCADES];
+uniform float cascade_splits[MAX_CASCADES];
+uniform int cascade_count;
+
+// How much of the point light reaches this fragment
+float point_shadow(vec3 norm, vec3 light_dir)
+{
+    if (!point_shadows) {
+        return 1.0;
+    }
+    vec3 to_fragment = frag_position - light.position;
+    // Surfaces turned away from the light need more bias
+    float bias = mix(0.05, 0.01, max(dot(norm, light_dir), 0.0));
+    float reference = (length(to_fragment) - bias) / point_shadow_far;
+    return texture(point_shadow_map, vec4(to_fragment, reference));
+}
+
+float sun_shadow(vec3 norm)
+{
+    if (view_depth > cascade_splits[cascade_count - 1]) {
+        return 1.0;
+    }
+    int cascade = 0;
+    while (cascade < cascade_count - 1 && view_depth > cascade_splits[cascade]) {
+        cascade++;
+    }
+    // Texels grow with every cascade, and so does the offset they need
+    vec3 offset = norm * 0.02 * float(cascade + 1);
+    vec4 position = sun_matrices[cascade] * vec4(frag_position + offset, 1.0);
+    vec3 coords = position.xyz / position.w * 0.5 + 0.5;
+    return texture(sun_shadow_map,
+        vec4(coords.xy, float(cascade), coords.z - 0.001));
+}
+
+// The atlas clamps, so coordinates are wrapped here. Gradients of the
+// unwrapped ones keep the wrap from picking the smallest mip at the seams
+vec3 atlas_texel(vec4 rect, float layer)
+{
+    vec2 uv = rect.xy + fract(TexCoords) * rect.zw;
+    return textureGrad(atlas_maps, vec3(uv, layer), dFdx(TexCoords) * rect.zw,
+        dFdy(TexCoords) * rect.zw).rgb;
+}
 
 void main()
 {
+    vec3 diffuse_texel;
+    vec3 specular_texel;
+    float shininess;
+    if (atlas) {
+        // Same layout as material_table_entry
+        int row = int(material_index) * 3;
+        vec4 layers = texelFetch(materials, row + 2);
+        diffuse_texel = atlas_texel(texelFetch(materials, row), layers.x);
+        specular_texel = atlas_texel(texelFetch(materials, row + 1), layers.y);
+        shininess = layers.z;
+    } else {
+        diffuse_texel = vec3(texture(material.diffuse, TexCoords));
+        specular_texel = vec3(texture(material.specular, TexCoords));
+        shininess = material.shininess;
+    }
 
-    vec3 ambient = light.ambient * vec3(texture(material.diffuse, TexCoords));
+    vec3 ambient = light.ambient * diffuse_texel;
 
     // Diffuse
     vec3 norm = normalize(Normal);
     vec3 light_dir = normalize(light.position - frag_position);
     float diff = max(dot(norm, light_dir), 0.0);
-    vec3 diffuse = light.diffuse * diff * vec3(texture(material.diffuse, TexCoords));
+    vec3 diffuse = light.diffuse * diff * diffuse_texel;
 
 
     // Specular
     vec3 view_dir = normalize(view_position - frag_position);
     vec3 reflect_dir = reflect(-light_dir, norm);
-    float spec = pow(max(dot(view_dir, reflect_dir), 0.0), material.shininess);
-    vec3 specular = light.specular * spec * vec3(texture(material.specular, TexCoords));
+    float spec = pow(max(dot(view_dir, reflect_dir), 0.0), shininess);
+    vec3 specular = light.specular * spec * specular_texel;
+
+    vec3 result = ambient + point_shadow(norm, light_dir) * (diffuse + specular);
 
-    vec3 result = ambient + diffuse + specular;
+    if (sun_enabled) {
+        vec3 sun_dir = -sun.direction;
+        float sun_diff = max(dot(norm, sun_dir), 0.0);
+        vec3 sun_reflect = reflect(-sun_dir, norm);
+        float sun_spec = pow(max(dot(view_dir, sun_reflect), 0.0),
+            shininess);
+        vec3 lit = sun.diffuse * sun_diff * diffuse_texel
+            + sun.specular * sun_spec * specular_texel;
+        result += sun_shadow(norm) * lit;
+    }
     frag_color = vec4(result, 1.0);
 }
@@ -2,20 +2,44 @@
 layout (location = 0) in vec3 aPos;
 layout (location = 1) in vec3 aNormal;
 layout (location = 2) in vec2 aTexCoords;
+// Per copy of the mesh with --texture-atlas. Without an array the offset reads
+// as zero, which leaves everything else where the model puts it
+layout (location = 3) in vec3 instance_offset;
+// Row of the material table, per vertex with --texture-atlas. Without an array
+// it reads as what bind_mesh_material set
+layout (location = 4) in uint vertex_material;
 
 uniform mat4 model;
 uniform mat4 view;
 uniform mat4 projection;
+// Normals are stored folded onto an octahedron, see vertex_format.c
+uniform bool octahedral_normals;
 
 out vec3 Normal;
 out vec3 frag_position;
 out vec2 TexCoords;
+// Distance in front of the camera, picks the shadow cascade
+out float view_depth;
+// Row of the material table
+flat out uint material_index;
+
+vec3 oct_decode(vec2 e)
+{
+    vec3 n = vec3(e, 1.0 - abs(e.x) - abs(e.y));
+    // The lower half was folded out into the corners
+    float t = max(-n.z, 0.0);
+    n.x += n.x >= 0.0 ? -t : t;
+    n.y += n.y >= 0.0 ? -t : t;
+    return normalize(n);
+}
 
 void main()
 {
     TexCoords = aTexCoords;
+    material_index = vertex_material;
 
-    gl_Position = projection * view * model * vec4(aPos, 1.0);
-    Normal = aNormal;
-    frag_position = vec3(model * vec4(aPos, 1.0));
+    frag_position = vec3(model * vec4(aPos, 1.0)) + instance_offset;
+    gl_Position = projection * view * vec4(frag_position, 1.0);
+    Normal = octahedral_normals ? oct_decode(aNormal.xy) : aNormal;
+    view_depth = -(view * vec4(frag_position, 1.0)).z;
 }
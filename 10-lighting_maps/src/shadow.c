@@ -0,0 +1,498 @@
+#include <glad/glad.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "cull.h"
+#include "gpu_memory.h"
+#include "shadow.h"
+
+// Near plane of the cube faces, casters closer to the light cast nothing
+#define POINT_SHADOW_NEAR 0.05f
+
+// Mix of logarithmic and even cascade splits, 1 is all logarithmic
+#define CASCADE_SPLIT_LAMBDA 0.75f
+
+// Face directions and up vectors in the order of GL_TEXTURE_CUBE_MAP_*
+static struct {
+    vec3 direction;
+    vec3 up;
+} const cube_faces[6] = {
+    { { 1.0f, 0.0f, 0.0f }, { 0.0f, -1.0f, 0.0f } },
+    { { -1.0f, 0.0f, 0.0f }, { 0.0f, -1.0f, 0.0f } },
+    { { 0.0f, 1.0f, 0.0f }, { 0.0f, 0.0f, 1.0f } },
+    { { 0.0f, -1.0f, 0.0f }, { 0.0f, 0.0f, -1.0f } },
+    { { 0.0f, 0.0f, 1.0f }, { 0.0f, -1.0f, 0.0f } },
+    { { 0.0f, 0.0f, -1.0f }, { 0.0f, -1.0f, 0.0f } },
+};
+
+// Depth only framebuffer, the texture is attached per layer when drawing
+static unsigned int create_depth_framebuffer(void)
+{
+    unsigned int framebuffer;
+    glGenFramebuffers(1, &framebuffer);
+    glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+    glDrawBuffer(GL_NONE);
+    glReadBuffer(GL_NONE);
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    return framebuffer;
+}
+
+static void attach_layer(unsigned int framebuffer, unsigned int texture,
+    uint32_t layer, bool cube)
+{
+    glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+    if (cube) {
+        glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT,
+            GL_TEXTURE_CUBE_MAP_POSITIVE_X + layer, texture, 0);
+    } else {
+        glFramebufferTextureLayer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT,
+            texture, 0, layer);
+    }
+}
+
+void shadow_cache_invalidate(struct shadow_cache* cache)
+{
+    for (uint32_t l = 0; l < cache->layer_count; l++) {
+        cache->static_dirty[l] = true;
+        cache->dynamic_dirty[l] = true;
+    }
+}
+
+static void shadow_cache_free(struct shadow_cache* cache)
+{
+    free(cache->drawn_bounds);
+    free(cache->visible);
+    memset(cache, 0, sizeof(*cache));
+}
+
+static bool box_in_layer(struct shadow_cache const* cache, uint32_t layer,
+    float const box[6], unsigned int plane_mask)
+{
+    vec3 minmax[2] = {
+        { box[0] - box[3], box[1] - box[4], box[2] - box[5] },
+        { box[0] + box[3], box[1] + box[4], box[2] + box[5] }
+    };
+    vec4 planes[6];
+    memcpy(planes, cache->planes[layer], sizeof(planes));
+    // Planes left out of the mask can not cull anything
+    for (int p = 0; p < 6; p++) {
+        if (!(plane_mask & (1u << p))) {
+            glm_vec4_copy((vec4) { 0.0f, 0.0f, 0.0f, 1.0f }, planes[p]);
+        }
+    }
+    return glm_aabb_frustum(minmax, planes);
+}
+
+/* Mark the layers a dynamic caster moved in or out of. Casters that were
+ * added or removed make every layer dirty.
+ */
+static void mark_moved_casters(struct shadow_cache* cache,
+    struct shadow_casters const* casters, unsigned int plane_mask)
+{
+    if (casters->count != cache->drawn_count) {
+        float* bounds = realloc(cache->drawn_bounds,
+            (casters->count + 1) * 6 * sizeof(float));
+        if (bounds == NULL) {
+            fprintf(stderr, "shadow: out of memory for %zu casters\n",
+                casters->count);
+            return;
+        }
+        memset(bounds, 0, (casters->count + 1) * 6 * sizeof(float));
+        cache->drawn_bounds = bounds;
+        cache->drawn_count = casters->count;
+        shadow_cache_invalidate(cache);
+    }
+
+    struct aabb_soa const* b = &casters->bounds;
+    for (size_t i = 0; i < casters->count; i++) {
+        if (!casters->dynamic[i]) {
+            continue;
+        }
+        float now[6] = {
+            b->center_x[i], b->center_y[i], b->center_z[i],
+            b->extent_x[i], b->extent_y[i], b->extent_z[i]
+        };
+        float* before = cache->drawn_bounds + i * 6;
+        bool moved = casters->moved != NULL && casters->moved[i];
+        if (!moved && memcmp(now, before, sizeof(now)) == 0) {
+            continue;
+        }
+        for (uint32_t l = 0; l < cache->layer_count; l++) {
+            if (!cache->dynamic_dirty[l]
+                && (box_in_layer(cache, l, now, plane_mask)
+                    || box_in_layer(cache, l, before, plane_mask))) {
+                cache->dynamic_dirty[l] = true;
+            }
+        }
+        memcpy(before, now, sizeof(now));
+    }
+}
+
+// Draw the static or the dynamic casters inside 'layer'
+static void draw_casters(struct shadow_cache* cache, uint32_t layer,
+    struct shadow_casters const* casters, struct shader* shader,
+    unsigned int plane_mask, bool dynamic)
+{
+    size_t needed = casters->count + CULL_OUTPUT_PADDING;
+    if (cache->visible_capacity < needed) {
+        uint32_t* visible = realloc(cache->visible, needed * sizeof(uint32_t));
+        if (visible == NULL) {
+            fprintf(stderr, "shadow: out of memory for %zu casters\n",
+                casters->count);
+            return;
+        }
+        cache->visible = visible;
+        cache->visible_capacity = needed;
+    }
+
+    size_t count = cull_aabbs(casters->bounds, casters->count,
+        cache->planes[layer], plane_mask, cache->visible, NULL);
+    for (size_t n = 0; n < count; n++) {
+        uint32_t i = cache->visible[n];
+        if (!casters->dynamic[i] == !dynamic) {
+            casters->draw(casters->data, i, shader);
+            cache->stats.casters++;
+        }
+    }
+}
+
+/* Redraw the dirty layers: the static casters into the static texture if
+ * that is out of date, a copy of it into the sampled texture and the dynamic
+ * casters on top. 'shader' has to be in use.
+ */
+static void update_layers(struct shadow_cache* cache,
+    struct shadow_casters const* casters, struct shader* shader,
+    unsigned int plane_mask, unsigned int size, bool cube,
+    unsigned int framebuffer, unsigned int texture,
+    unsigned int static_framebuffer, unsigned int static_texture)
+{
+    GLint viewport[4];
+    GLint draw_framebuffer;
+    GLint read_framebuffer;
+    glGetIntegerv(GL_VIEWPORT, viewport);
+    glGetIntegerv(GL_DRAW_FRAMEBUFFER_BINDING, &draw_framebuffer);
+    glGetIntegerv(GL_READ_FRAMEBUFFER_BINDING, &read_framebuffer);
+    glViewport(0, 0, size, size);
+
+    for (uint32_t l = 0; l < cache->layer_count; l++) {
+        if (!cache->dynamic_dirty[l] && !cache->static_dirty[l]) {
+            continue;
+        }
+        shader_set_mat4(shader, "light_view_projection",
+            cache->view_projection[l]);
+
+        attach_layer(static_framebuffer, static_texture, l, cube);
+        if (cache->static_dirty[l]) {
+            glClear(GL_DEPTH_BUFFER_BIT);
+            draw_casters(cache, l, casters, shader, plane_mask, false);
+            cache->static_dirty[l] = false;
+            cache->stats.static_layers++;
+        }
+
+        attach_layer(framebuffer, texture, l, cube);
+        glBindFramebuffer(GL_READ_FRAMEBUFFER, static_framebuffer);
+        glBlitFramebuffer(0, 0, size, size, 0, 0, size, size,
+            GL_DEPTH_BUFFER_BIT, GL_NEAREST);
+        draw_casters(cache, l, casters, shader, plane_mask, true);
+        cache->dynamic_dirty[l] = false;
+        cache->stats.dynamic_layers++;
+    }
+
+    glBindFramebuffer(GL_DRAW_FRAMEBUFFER, draw_framebuffer);
+    glBindFramebuffer(GL_READ_FRAMEBUFFER, read_framebuffer);
+    glViewport(viewport[0], viewport[1], viewport[2], viewport[3]);
+}
+
+static void set_depth_texture_parameters(GLenum target, bool compare)
+{
+    glTexParameteri(target, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    glTexParameteri(target, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glTexParameteri(target, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(target, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    glTexParameteri(target, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
+    if (compare) {
+        // Lookups return how much of the filtered footprint is lit
+        glTexParameteri(target, GL_TEXTURE_COMPARE_MODE,
+            GL_COMPARE_REF_TO_TEXTURE);
+        glTexParameteri(target, GL_TEXTURE_COMPARE_FUNC, GL_LEQUAL);
+    }
+}
+
+static unsigned int create_depth_cube(unsigned int size, bool compare)
+{
+    unsigned int texture = gpu_texture_create(GPU_MEMORY_RENDER_TARGET,
+        "point shadow");
+    glBindTexture(GL_TEXTURE_CUBE_MAP, texture);
+    for (int f = 0; f < 6; f++) {
+        gpu_texture_image_2d(texture, GL_TEXTURE_CUBE_MAP_POSITIVE_X + f, 0,
+            GL_DEPTH_COMPONENT24, size, size, GL_DEPTH_COMPONENT, GL_FLOAT,
+            NULL);
+    }
+    set_depth_texture_parameters(GL_TEXTURE_CUBE_MAP, compare);
+    return texture;
+}
+
+bool point_shadow_init(struct point_shadow* ps, unsigned int size,
+    float far_plane)
+{
+    memset(ps, 0, sizeof(*ps));
+    ps->size = size;
+    ps->far_plane = far_plane;
+    ps->cube = create_depth_cube(size, true);
+    ps->static_cube = create_depth_cube(size, false);
+    ps->framebuffer = create_depth_framebuffer();
+    ps->static_framebuffer = create_depth_framebuffer();
+    shader_init(&ps->shader, "../src/shadow_depth.vs",
+        "../src/shadow_point.fs");
+    ps->cache.layer_count = 6;
+    shadow_cache_invalidate(&ps->cache);
+
+    attach_layer(ps->framebuffer, ps->cube, 0, true);
+    GLenum status = glCheckFramebufferStatus(GL_FRAMEBUFFER);
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    if (status != GL_FRAMEBUFFER_COMPLETE) {
+        fprintf(stderr, "shadow: cube framebuffer incomplete, 0x%x\n", status);
+        point_shadow_free(ps);
+        return false;
+    }
+    return true;
+}
+
+void point_shadow_free(struct point_shadow* ps)
+{
+    gpu_textures_delete(1, &ps->cube);
+    gpu_textures_delete(1, &ps->static_cube);
+    glDeleteFramebuffers(1, &ps->framebuffer);
+    glDeleteFramebuffers(1, &ps->static_framebuffer);
+    glDeleteProgram(ps->shader.ID);
+    shadow_cache_free(&ps->cache);
+    memset(ps, 0, sizeof(*ps));
+}
+
+void point_shadow_update(struct point_shadow* ps, vec3 light_position,
+    struct shadow_casters const* casters)
+{
+    struct shadow_cache* cache = &ps->cache;
+    cache->stats = (struct shadow_stats) { 0 };
+
+    if (!ps->valid || !glm_vec3_eqv(ps->light_position, light_position)) {
+        mat4 projection;
+        glm_perspective(glm_rad(90.0f), 1.0f, POINT_SHADOW_NEAR,
+            ps->far_plane, projection);
+        for (int f = 0; f < 6; f++) {
+            vec3 center;
+            mat4 view;
+            glm_vec3_add(light_position, (float*)cube_faces[f].direction,
+                center);
+            glm_lookat(light_position, center, (float*)cube_faces[f].up,
+                view);
+            glm_mat4_mul(projection, view, cache->view_projection[f]);
+            glm_frustum_planes(cache->view_projection[f], cache->planes[f]);
+        }
+        glm_vec3_copy(light_position, ps->light_position);
+        ps->valid = true;
+        shadow_cache_invalidate(cache);
+    }
+    mark_moved_casters(cache, casters, CULL_ALL_PLANES);
+
+    glUseProgram(ps->shader.ID);
+    shader_set_vec3(&ps->shader, "light_position", light_position);
+    shader_set_float(&ps->shader, "far_plane", ps->far_plane);
+    update_layers(cache, casters, &ps->shader, CULL_ALL_PLANES, ps->size,
+        true, ps->framebuffer, ps->cube, ps->static_framebuffer,
+        ps->static_cube);
+}
+
+void point_shadow_bind(struct point_shadow const* ps, struct shader* s,
+    int unit)
+{
+    glActiveTexture(GL_TEXTURE0 + unit);
+    glBindTexture(GL_TEXTURE_CUBE_MAP, ps->cube);
+    shader_set_int(s, "point_shadow_map", unit);
+    shader_set_float(s, "point_shadow_far", ps->far_plane);
+    shader_set_int(s, "point_shadows", true);
+}
+
+static unsigned int create_depth_array(unsigned int size, uint32_t layers,
+    bool compare)
+{
+    unsigned int texture = gpu_texture_create(GPU_MEMORY_RENDER_TARGET,
+        "sun shadow");
+    glBindTexture(GL_TEXTURE_2D_ARRAY, texture);
+    gpu_texture_image_3d(texture, GL_TEXTURE_2D_ARRAY, 0, GL_DEPTH_COMPONENT24,
+        size, size, layers, GL_DEPTH_COMPONENT, GL_FLOAT, NULL);
+    set_depth_texture_parameters(GL_TEXTURE_2D_ARRAY, compare);
+    // Outside the cascade counts as lit
+    float const border[] = { 1.0f, 1.0f, 1.0f, 1.0f };
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_S,
+        GL_CLAMP_TO_BORDER);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_T,
+        GL_CLAMP_TO_BORDER);
+    glTexParameterfv(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_BORDER_COLOR, border);
+    return texture;
+}
+
+bool cascaded_shadow_init(struct cascaded_shadow* cs, unsigned int size,
+    uint32_t cascade_count, float shadow_distance)
+{
+    memset(cs, 0, sizeof(*cs));
+    if (cascade_count == 0 || cascade_count > SHADOW_MAX_CASCADES) {
+        fprintf(stderr, "shadow: %u cascades, at most %d are supported\n",
+            cascade_count, SHADOW_MAX_CASCADES);
+        return false;
+    }
+    cs->size = size;
+    cs->cascade_count = cascade_count;
+    cs->shadow_distance = shadow_distance;
+    cs->texture = create_depth_array(size, cascade_count, true);
+    cs->static_texture = create_depth_array(size, cascade_count, false);
+    cs->framebuffer = create_depth_framebuffer();
+    cs->static_framebuffer = create_depth_framebuffer();
+    shader_init(&cs->shader, "../src/shadow_depth.vs",
+        "../src/shadow_directional.fs");
+    cs->cache.layer_count = cascade_count;
+    shadow_cache_invalidate(&cs->cache);
+
+    attach_layer(cs->framebuffer, cs->texture, 0, false);
+    GLenum status = glCheckFramebufferStatus(GL_FRAMEBUFFER);
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    if (status != GL_FRAMEBUFFER_COMPLETE) {
+        fprintf(stderr, "shadow: cascade framebuffer incomplete, 0x%x\n",
+            status);
+        cascaded_shadow_free(cs);
+        return false;
+    }
+    return true;
+}
+
+void cascaded_shadow_free(struct cascaded_shadow* cs)
+{
+    gpu_textures_delete(1, &cs->texture);
+    gpu_textures_delete(1, &cs->static_texture);
+    glDeleteFramebuffers(1, &cs->framebuffer);
+    glDeleteFramebuffers(1, &cs->static_framebuffer);
+    glDeleteProgram(cs->shader.ID);
+    shadow_cache_free(&cs->cache);
+    memset(cs, 0, sizeof(*cs));
+}
+
+/* Light matrix of the part of the view between depths 'near' and 'far'. The
+ * cascade is a bounding sphere of that part, so turning the camera does not
+ * change its size, and it moves in whole texels so the shadow edges do not
+ * crawl when the camera moves.
+ */
+static void fit_cascade(struct cascaded_shadow const* cs,
+    struct camera* cam, mat4 light_view, float near, float far, mat4 dest)
+{
+    vec4* inverse = camera_get_inverse_view_projection_matrix(cam);
+    float range = cam->far_plane - cam->near_plane;
+    float t0 = (near - cam->near_plane) / range;
+    float t1 = (far - cam->near_plane) / range;
+
+    vec3 corners[8];
+    vec3 center = { 0.0f, 0.0f, 0.0f };
+    for (int k = 0; k < 4; k++) {
+        vec4 ndc_near = { k & 1 ? 1.0f : -1.0f, k & 2 ? 1.0f : -1.0f, -1.0f,
+            1.0f };
+        vec4 ndc_far = { ndc_near[0], ndc_near[1], 1.0f, 1.0f };
+        vec4 a;
+        vec4 b;
+        glm_mat4_mulv(inverse, ndc_near, a);
+        glm_mat4_mulv(inverse, ndc_far, b);
+        glm_vec3_scale(a, 1.0f / a[3], a);
+        glm_vec3_scale(b, 1.0f / b[3], b);
+        // View depth is linear along the ray from the eye
+        glm_vec3_lerp(a, b, t0, corners[k]);
+        glm_vec3_lerp(a, b, t1, corners[k + 4]);
+        glm_vec3_add(center, corners[k], center);
+        glm_vec3_add(center, corners[k + 4], center);
+    }
+    glm_vec3_scale(center, 1.0f / 8.0f, center);
+    float radius = 0.0f;
+    for (int k = 0; k < 8; k++) {
+        radius = fmaxf(radius, glm_vec3_distance(center, corners[k]));
+    }
+    radius = ceilf(radius * 16.0f) / 16.0f;
+
+    vec3 light_center;
+    glm_mat4_mulv3(light_view, center, 1.0f, light_center);
+    float texel = 2.0f * radius / cs->size;
+    light_center[0] = floorf(light_center[0] / texel) * texel;
+    light_center[1] = floorf(light_center[1] / texel) * texel;
+
+    // Casters in front of the near plane are clamped onto it when drawn
+    mat4 projection;
+    glm_ortho(light_center[0] - radius, light_center[0] + radius,
+        light_center[1] - radius, light_center[1] + radius,
+        -light_center[2] - radius, -light_center[2] + radius, projection);
+    glm_mat4_mul(projection, light_view, dest);
+}
+
+void cascaded_shadow_update(struct cascaded_shadow* cs, struct camera* cam,
+    vec3 light_direction, struct shadow_casters const* casters)
+{
+    struct shadow_cache* cache = &cs->cache;
+    cache->stats = (struct shadow_stats) { 0 };
+
+    // Looking down the light from the origin, only the rotation matters
+    vec3 origin = { 0.0f, 0.0f, 0.0f };
+    vec3 up = { 0.0f, 1.0f, 0.0f };
+    if (fabsf(light_direction[1]) > 0.99f) {
+        up[1] = 0.0f;
+        up[2] = 1.0f;
+    }
+    mat4 light_view;
+    glm_lookat(origin, light_direction, up, light_view);
+
+    float near = cam->near_plane;
+    float far = fminf(cs->shadow_distance, cam->far_plane);
+    for (uint32_t c = 0; c < cs->cascade_count; c++) {
+        float f = (c + 1.0f) / cs->cascade_count;
+        float log_split = near * powf(far / near, f);
+        float even_split = near + (far - near) * f;
+        cs->splits[c] = CASCADE_SPLIT_LAMBDA * log_split
+            + (1.0f - CASCADE_SPLIT_LAMBDA) * even_split;
+
+        mat4 view_projection;
+        fit_cascade(cs, cam, light_view, c == 0 ? near : cs->splits[c - 1],
+            cs->splits[c], view_projection);
+        if (memcmp(view_projection, cache->view_projection[c],
+                sizeof(mat4))
+            != 0) {
+            glm_mat4_copy(view_projection, cache->view_projection[c]);
+            glm_frustum_planes(view_projection, cache->planes[c]);
+            cache->static_dirty[c] = true;
+            cache->dynamic_dirty[c] = true;
+        }
+    }
+    glm_vec3_copy(light_direction, cs->light_direction);
+
+    // Casters between the light and a cascade still shade it
+    unsigned int plane_mask = CULL_ALL_PLANES & ~(1u << 4);
+    mark_moved_casters(cache, casters, plane_mask);
+
+    glUseProgram(cs->shader.ID);
+    glEnable(GL_DEPTH_CLAMP);
+    update_layers(cache, casters, &cs->shader, plane_mask, cs->size, false,
+        cs->framebuffer, cs->texture, cs->static_framebuffer,
+        cs->static_texture);
+    glDisable(GL_DEPTH_CLAMP);
+}
+
+void cascaded_shadow_bind(struct cascaded_shadow const* cs, struct shader* s,
+    int unit)
+{
+    glActiveTexture(GL_TEXTURE0 + unit);
+    glBindTexture(GL_TEXTURE_2D_ARRAY, cs->texture);
+    shader_set_int(s, "sun_shadow_map", unit);
+    shader_set_int(s, "cascade_count", cs->cascade_count);
+    for (uint32_t c = 0; c < cs->cascade_count; c++) {
+        char name[32];
+        snprintf(name, sizeof(name), "cascade_splits[%u]", c);
+        shader_set_float(s, name, cs->splits[c]);
+        snprintf(name, sizeof(name), "sun_matrices[%u]", c);
+        shader_set_mat4(s, name, (vec4*)cs->cache.view_projection[c]);
+    }
+}
@@ -0,0 +1,129 @@
+#ifndef SHADOW_H
+#define SHADOW_H
+#include <cglm/cglm.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "camera.h"
+#include "math_batch.h"
+#include "shader.h"
+
+// Most cascades of a directional light, shader.fs has the same limit
+#define SHADOW_MAX_CASCADES 4
+
+/* Everything that casts shadows, as boxes for culling and a callback that
+ * sets "model" on 'shader' and draws caster 'caster'.
+ *
+ * Static casters are drawn once into a cached layer that is only redrawn when
+ * the light moves. Dynamic casters are drawn on top of a copy of that layer,
+ * in the faces or cascades they are in now or were in when last drawn, and
+ * only when they moved. A dynamic caster has moved when its box changed or
+ * its entry in 'moved' is set, for movement the box does not show.
+ */
+struct shadow_casters {
+    struct aabb_soa bounds;
+    size_t count;
+    // Per caster, nonzero for the ones that can move
+    uint8_t const* dynamic;
+    // Per caster, nonzero if it moved since the last update. May be NULL
+    uint8_t const* moved;
+    void (*draw)(void* data, uint32_t caster, struct shader* shader);
+    void* data;
+};
+
+// What the last update drew, faces or cascades that were not redrawn are free
+struct shadow_stats {
+    uint32_t static_layers;
+    uint32_t dynamic_layers;
+    uint32_t casters;
+};
+
+/* Bookkeeping shared by both kinds of shadows. A layer is one face of the
+ * cube or one cascade.
+ */
+struct shadow_cache {
+    uint32_t layer_count;
+    bool static_dirty[6];
+    bool dynamic_dirty[6];
+    mat4 view_projection[6];
+    vec4 planes[6][6];
+    // Boxes of the dynamic casters when they were last drawn, 6 per caster
+    float* drawn_bounds;
+    size_t drawn_count;
+    uint32_t* visible;
+    size_t visible_capacity;
+    struct shadow_stats stats;
+};
+
+/* Omnidirectional shadows of a point light. The depth of each face of the
+ * cube is the distance to the light divided by 'far_plane', so shader.fs can
+ * compare distances in any direction.
+ */
+struct point_shadow {
+    unsigned int size;
+    float far_plane;
+    // Sampled by shader.fs as a samplerCubeShadow
+    unsigned int cube;
+    // Static casters only, copied into 'cube' before the dynamic ones
+    unsigned int static_cube;
+    unsigned int framebuffer;
+    unsigned int static_framebuffer;
+    struct shader shader;
+    vec3 light_position;
+    bool valid;
+    struct shadow_cache cache;
+};
+
+/* Cascaded shadows of a directional light. The view range up to
+ * 'shadow_distance' is split into cascades that each get a layer of an array
+ * texture, nearer cascades cover less and so get sharper shadows.
+ */
+struct cascaded_shadow {
+    unsigned int size;
+    uint32_t cascade_count;
+    float shadow_distance;
+    // Sampled by shader.fs as a sampler2DArrayShadow
+    unsigned int texture;
+    unsigned int static_texture;
+    unsigned int framebuffer;
+    unsigned int static_framebuffer;
+    struct shader shader;
+    // View depth where each cascade ends
+    float splits[SHADOW_MAX_CASCADES];
+    vec3 light_direction;
+    struct shadow_cache cache;
+};
+
+bool point_shadow_init(struct point_shadow* ps, unsigned int size,
+    float far_plane);
+void point_shadow_free(struct point_shadow* ps);
+
+/* Redraw the faces that changed. Leaves the framebuffer, viewport and program
+ * as they were except for the program, which has to be set again.
+ */
+void point_shadow_update(struct point_shadow* ps, vec3 light_position,
+    struct shadow_casters const* casters);
+
+// Set the point shadow uniforms of shader.fs and bind the cube to 'unit'
+void point_shadow_bind(struct point_shadow const* ps, struct shader* s,
+    int unit);
+
+bool cascaded_shadow_init(struct cascaded_shadow* cs, unsigned int size,
+    uint32_t cascade_count, float shadow_distance);
+void cascaded_shadow_free(struct cascaded_shadow* cs);
+
+/* Fit the cascades to the view of 'cam' and redraw the ones that changed.
+ * Cascades snap to whole texels, so they only change when the camera moved
+ * further than a texel or the light turned. Same state rules as
+ * point_shadow_update.
+ */
+void cascaded_shadow_update(struct cascaded_shadow* cs, struct camera* cam,
+    vec3 light_direction, struct shadow_casters const* casters);
+
+void cascaded_shadow_bind(struct cascaded_shadow const* cs, struct shader* s,
+    int unit);
+
+// Static casters changed, redraw everything on the next update
+void shadow_cache_invalidate(struct shadow_cache* cache);
+#endif
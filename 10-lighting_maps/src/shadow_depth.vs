@@ -0,0 +1,13 @@
+#version 330 core
+layout (location = 0) in vec3 aPos;
+
+uniform mat4 model;
+uniform mat4 light_view_projection;
+
+out vec3 world_position;
+
+void main()
+{
+    world_position = vec3(model * vec4(aPos, 1.0));
+    gl_Position = light_view_projection * vec4(world_position, 1.0);
+}
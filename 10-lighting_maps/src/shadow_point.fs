@@ -0,0 +1,11 @@
+#version 330 core
+in vec3 world_position;
+
+uniform vec3 light_position;
+uniform float far_plane;
+
+void main()
+{
+    // Distance to the light instead of depth, the same in every face
+    gl_FragDepth = length(world_position - light_position) / far_plane;
+}
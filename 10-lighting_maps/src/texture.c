@@ -0,0 +1,85 @@
+#include <glad/glad.h>
+
+#define STB_IMAGE_IMPLEMENTATION
+#include "stb_image.h"
+
+#include <stdio.h>
+
+#include "gpu_memory.h"
+#include "texture.h"
+
+unsigned int texture_create(struct texture_image* image, char const* label)
+{
+    GLenum format = GL_RGB;
+    if (image->channels == 1) {
+        format = GL_RED;
+    }
+    if (image->channels == 2) {
+        format = GL_RG;
+    }
+    if (image->channels == 4) {
+        format = GL_RGBA;
+    }
+
+    unsigned int texture = gpu_texture_create(GPU_MEMORY_TEXTURE, label);
+    glBindTexture(GL_TEXTURE_2D, texture);
+    // Rows of odd sized RGB and single channel images are not 4 byte aligned
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+    gpu_texture_image_2d(texture, GL_TEXTURE_2D, 0, format, image->width,
+        image->height, format, GL_UNSIGNED_BYTE, image->data);
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+
+    gpu_texture_mipmaps(texture, GL_TEXTURE_2D);
+
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+
+    stbi_image_free(image->data);
+    image->data = NULL;
+    return texture;
+}
+
+bool texture_decode(char const* path, bool flip, struct texture_image* image)
+{
+    // The flag is per thread, decoding may happen on several at once
+    stbi_set_flip_vertically_on_load_thread(flip);
+    image->data = stbi_load(path, &image->width, &image->height,
+        &image->channels, 0);
+    if (image->data == NULL) {
+        fprintf(stderr, "Failed to load texture %s\n", path);
+        return false;
+    }
+    return true;
+}
+
+void texture_image_free(struct texture_image* image)
+{
+    stbi_image_free(image->data);
+    image->data = NULL;
+}
+
+unsigned int texture_load(char const* path, bool flip)
+{
+    struct texture_image image;
+    if (!texture_decode(path, flip, &image)) {
+        return 0;
+    }
+    return texture_create(&image, path);
+}
+
+unsigned int texture_load_memory(unsigned char const* data, size_t size,
+    bool flip)
+{
+    stbi_set_flip_vertically_on_load_thread(flip);
+
+    struct texture_image image;
+    image.data = stbi_load_from_memory(data, (int)size, &image.width,
+        &image.height, &image.channels, 0);
+    if (image.data == NULL) {
+        fprintf(stderr, "Failed to load texture from memory\n");
+        return 0;
+    }
+    return texture_create(&image, "image in memory");
+}
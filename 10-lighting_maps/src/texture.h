@@ -0,0 +1,34 @@
+#ifndef TEXTURE_H
+#define TEXTURE_H
+#include <stdbool.h>
+#include <stddef.h>
+
+/* Load an image into a mipmapped, repeating 2D texture. Images are stored top
+ * row first, 'flip' turns them so texture coordinate (0, 0) is the bottom left
+ * like OpenGL expects. Returns 0 on failure. Delete the texture with
+ * gpu_textures_delete.
+ */
+unsigned int texture_load(char const* path, bool flip);
+
+// Same as texture_load for an encoded image (PNG, JPEG...) already in memory
+unsigned int texture_load_memory(unsigned char const* data, size_t size,
+    bool flip);
+
+// Pixels of a decoded image, 8 bits per channel
+struct texture_image {
+    unsigned char* data;
+    int width;
+    int height;
+    int channels;
+};
+
+/* The two halves of texture_load. Decoding needs no GL context and may run on
+ * any thread; creating frees the pixels. 'label' names the texture in GPU
+ * memory reports.
+ */
+bool texture_decode(char const* path, bool flip, struct texture_image* image);
+unsigned int texture_create(struct texture_image* image, char const* label);
+
+// Free the pixels of an image that was decoded but not created
+void texture_image_free(struct texture_image* image);
+#endif
@@ -0,0 +1,307 @@
+#include <glad/glad.h>
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "gpu_memory.h"
+#include "texture_atlas.h"
+
+void skyline_init(struct skyline* s, int width, int height)
+{
+    memset(s, 0, sizeof(*s));
+    s->width = width;
+    s->height = height;
+    s->capacity = 16;
+    s->nodes = malloc(s->capacity * sizeof(struct skyline_node));
+    s->nodes[0] = (struct skyline_node) { 0, 0, width };
+    s->count = 1;
+}
+
+void skyline_free(struct skyline* s)
+{
+    free(s->nodes);
+    memset(s, 0, sizeof(*s));
+}
+
+/* Lowest 'y' a rectangle with its left edge on node 'i' can sit at, -1 when it
+ * sticks out of the right or top
+ */
+static int skyline_fit(struct skyline const* s, uint32_t i, int width,
+    int height)
+{
+    if (s->nodes[i].x + width > s->width) {
+        return -1;
+    }
+    int y = 0;
+    // The nodes span the whole width, so they run out after the rectangle
+    for (int left = width; left > 0; i++) {
+        y = s->nodes[i].y > y ? s->nodes[i].y : y;
+        if (y + height > s->height) {
+            return -1;
+        }
+        left -= s->nodes[i].width;
+    }
+    return y;
+}
+
+static void remove_node(struct skyline* s, uint32_t i)
+{
+    memmove(&s->nodes[i], &s->nodes[i + 1],
+        (s->count - i - 1) * sizeof(struct skyline_node));
+    s->count--;
+}
+
+bool skyline_pack(struct skyline* s, int width, int height, int* x, int* y)
+{
+    uint32_t best = UINT32_MAX;
+    int best_y = INT_MAX;
+    int best_width = INT_MAX;
+    for (uint32_t i = 0; i < s->count; i++) {
+        int fit = skyline_fit(s, i, width, height);
+        if (fit >= 0
+            && (fit < best_y
+                || (fit == best_y && s->nodes[i].width < best_width))) {
+            best = i;
+            best_y = fit;
+            best_width = s->nodes[i].width;
+        }
+    }
+    if (best == UINT32_MAX) {
+        return false;
+    }
+    *x = s->nodes[best].x;
+    *y = best_y;
+
+    if (s->count == s->capacity) {
+        s->capacity *= 2;
+        s->nodes = realloc(s->nodes,
+            s->capacity * sizeof(struct skyline_node));
+    }
+    memmove(&s->nodes[best + 1], &s->nodes[best],
+        (s->count - best) * sizeof(struct skyline_node));
+    s->nodes[best] = (struct skyline_node) { *x, best_y + height, width };
+    s->count++;
+
+    // Cut the segments the new one covers
+    for (uint32_t i = best + 1; i < s->count;) {
+        struct skyline_node const* prev = &s->nodes[i - 1];
+        struct skyline_node* node = &s->nodes[i];
+        int overlap = prev->x + prev->width - node->x;
+        if (overlap <= 0) {
+            break;
+        }
+        node->x += overlap;
+        node->width -= overlap;
+        if (node->width > 0) {
+            break;
+        }
+        remove_node(s, i);
+    }
+    for (uint32_t i = 0; i + 1 < s->count;) {
+        if (s->nodes[i].y == s->nodes[i + 1].y) {
+            s->nodes[i].width += s->nodes[i + 1].width;
+            remove_node(s, i + 1);
+        } else {
+            i++;
+        }
+    }
+    return true;
+}
+
+static int round_up(int value, int multiple)
+{
+    return (value + multiple - 1) / multiple * multiple;
+}
+
+// Size of an image packed with its padding
+static void block_size(struct texture_image const* image, int* width,
+    int* height)
+{
+    *width = round_up(image->width + 2 * TEXTURE_ATLAS_PADDING,
+        TEXTURE_ATLAS_PADDING);
+    *height = round_up(image->height + 2 * TEXTURE_ATLAS_PADDING,
+        TEXTURE_ATLAS_PADDING);
+}
+
+/* Copy 'image' into a 'width' by 'height' RGBA block with the image starting
+ * at 'inset', everything around it wrapped like GL_REPEAT would. One channel
+ * images become gray, two channel ones red and green like GL_RG.
+ */
+static void fill_block(struct texture_image const* image, unsigned char* block,
+    int width, int height, int inset)
+{
+    int channels = image->channels;
+    for (int y = 0; y < height; y++) {
+        int sy = ((y - inset) % image->height + image->height) % image->height;
+        for (int x = 0; x < width; x++) {
+            int sx = ((x - inset) % image->width + image->width)
+                % image->width;
+            unsigned char const* src
+                = image->data + ((size_t)sy * image->width + sx) * channels;
+            unsigned char* dst = block + ((size_t)y * width + x) * 4;
+            dst[0] = src[0];
+            dst[1] = channels == 1 ? src[0] : src[1];
+            dst[2] = channels == 1 ? src[0] : channels == 2 ? 0 : src[2];
+            dst[3] = channels == 4 ? src[3] : 255;
+        }
+    }
+}
+
+struct placement {
+    uint32_t image;
+    int x;
+    int y;
+    uint32_t layer;
+    bool single;
+};
+
+struct packed_image {
+    uint32_t image;
+    int height;
+};
+
+// Taller blocks first, the skyline stays flatter that way
+static int compare_height(void const* a, void const* b)
+{
+    return ((struct packed_image const*)b)->height
+        - ((struct packed_image const*)a)->height;
+}
+
+bool texture_atlas_build(struct texture_atlas* a,
+    struct texture_image const* images, uint32_t count, char const* label,
+    struct atlas_entry* entries)
+{
+    memset(a, 0, sizeof(*a));
+    int size = TEXTURE_ATLAS_MIN_SIZE;
+    for (uint32_t i = 0; i < count; i++) {
+        while (images[i].data != NULL
+            && (size < images[i].width || size < images[i].height)) {
+            size *= 2;
+        }
+    }
+    GLint max_size;
+    glGetIntegerv(GL_MAX_TEXTURE_SIZE, &max_size);
+    if (size > max_size) {
+        fprintf(stderr, "texture_atlas: %s needs %dx%d layers, at most %d\n",
+            label, size, size, max_size);
+        return false;
+    }
+
+    // Images too large to pack with padding get a layer of their own
+    struct placement* placements = calloc(count + 1, sizeof(*placements));
+    struct packed_image* packed = calloc(count + 1, sizeof(*packed));
+    uint32_t placement_count = 0;
+    uint32_t packed_count = 0;
+    uint32_t layers = 0;
+    for (uint32_t i = 0; i < count; i++) {
+        int width;
+        int height;
+        block_size(&images[i], &width, &height);
+        if (images[i].data == NULL) {
+            continue;
+        } else if (width > size || height > size) {
+            placements[placement_count++] = (struct placement) {
+                .image = i,
+                .layer = layers++,
+                .single = true
+            };
+        } else {
+            packed[packed_count++] = (struct packed_image) { i, height };
+        }
+    }
+    a->single_layers = layers;
+
+    qsort(packed, packed_count, sizeof(*packed), compare_height);
+    struct skyline* skylines = calloc(packed_count + 1,
+        sizeof(struct skyline));
+    uint32_t skyline_count = 0;
+    for (uint32_t p = 0; p < packed_count; p++) {
+        int width;
+        int height;
+        block_size(&images[packed[p].image], &width, &height);
+        struct placement* place = &placements[placement_count++];
+        *place = (struct placement) { .image = packed[p].image };
+        uint32_t s = 0;
+        while (s < skyline_count
+            && !skyline_pack(&skylines[s], width, height, &place->x,
+                &place->y)) {
+            s++;
+        }
+        if (s == skyline_count) {
+            skyline_init(&skylines[skyline_count++], size, size);
+            skyline_pack(&skylines[s], width, height, &place->x, &place->y);
+        }
+        place->layer = a->single_layers + s;
+    }
+    layers += skyline_count;
+    for (uint32_t s = 0; s < skyline_count; s++) {
+        skyline_free(&skylines[s]);
+    }
+    free(skylines);
+    free(packed);
+
+    GLint max_layers;
+    glGetIntegerv(GL_MAX_ARRAY_TEXTURE_LAYERS, &max_layers);
+    if (layers == 0 || layers > (uint32_t)max_layers) {
+        fprintf(stderr, "texture_atlas: %s needs %u layers, at most %d\n",
+            label, layers, max_layers);
+        free(placements);
+        return false;
+    }
+    a->size = size;
+    a->layer_count = layers;
+    a->texture = gpu_texture_create(GPU_MEMORY_TEXTURE, label);
+    glBindTexture(GL_TEXTURE_2D_ARRAY, a->texture);
+    gpu_texture_image_3d(a->texture, GL_TEXTURE_2D_ARRAY, 0, GL_RGBA8, size,
+        size, layers, GL_RGBA, GL_UNSIGNED_BYTE, NULL);
+
+    unsigned char* block = malloc((size_t)size * size * 4);
+    for (uint32_t p = 0; p < placement_count; p++) {
+        struct placement const* place = &placements[p];
+        struct texture_image const* image = &images[place->image];
+        int width = size;
+        int height = size;
+        int inset = 0;
+        if (!place->single) {
+            block_size(image, &width, &height);
+            inset = TEXTURE_ATLAS_PADDING;
+        }
+        fill_block(image, block, width, height, inset);
+        glTexSubImage3D(GL_TEXTURE_2D_ARRAY, 0, place->x, place->y,
+            place->layer, width, height, 1, GL_RGBA, GL_UNSIGNED_BYTE, block);
+        entries[place->image] = (struct atlas_entry) {
+            .rect = {
+                (float)(place->x + inset) / size,
+                (float)(place->y + inset) / size,
+                (float)image->width / size,
+                (float)image->height / size
+            },
+            .layer = (float)place->layer
+        };
+    }
+    free(block);
+
+    // Levels past the padding would blend packed images into each other
+    if (layers > a->single_layers) {
+        int max_level = 0;
+        while ((2 << max_level) <= TEXTURE_ATLAS_PADDING) {
+            max_level++;
+        }
+        glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAX_LEVEL, max_level);
+    }
+    gpu_texture_mipmaps(a->texture, GL_TEXTURE_2D_ARRAY);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER,
+        GL_LINEAR_MIPMAP_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    free(placements);
+    return true;
+}
+
+void texture_atlas_free(struct texture_atlas* a)
+{
+    gpu_textures_delete(1, &a->texture);
+    memset(a, 0, sizeof(*a));
+}
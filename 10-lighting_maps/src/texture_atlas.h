@@ -0,0 +1,71 @@
+#ifndef TEXTURE_ATLAS_H
+#define TEXTURE_ATLAS_H
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "texture.h"
+
+/* Texels around every packed image, filled with the image wrapped around.
+ * Packed images also start and end on multiples of this, so mip levels up to
+ * log2 of it never mix neighboring images.
+ */
+#define TEXTURE_ATLAS_PADDING 8
+
+// Smallest layer an atlas has, however small its images are
+#define TEXTURE_ATLAS_MIN_SIZE 256
+
+struct skyline_node {
+    int x;
+    int y;
+    int width;
+};
+
+/* Bottom left rectangle packer. The top edge of what has been placed is kept
+ * as a list of horizontal segments from left to right, and each rectangle goes
+ * where it ends up lowest, on the narrowest segment when there is a tie.
+ */
+struct skyline {
+    struct skyline_node* nodes;
+    uint32_t count;
+    uint32_t capacity;
+    int width;
+    int height;
+};
+
+void skyline_init(struct skyline* s, int width, int height);
+void skyline_free(struct skyline* s);
+
+// Place a rectangle, false when it fits nowhere
+bool skyline_pack(struct skyline* s, int width, int height, int* x, int* y);
+
+// Where an image of an atlas ended up
+struct atlas_entry {
+    // Offset and size of the image in the texture coordinates of its layer
+    float rect[4];
+    float layer;
+};
+
+/* Images of any size in the layers of one GL_TEXTURE_2D_ARRAY, so drawing
+ * with a different image only takes other coordinates, not another bind.
+ * Every layer is a square power of two fitting the largest image. Images
+ * about that large get a layer each, the others are packed several to a
+ * layer with a skyline. Sample the images with their rect and wrap the
+ * coordinates by hand, the texture clamps.
+ */
+struct texture_atlas {
+    unsigned int texture;
+    int size;
+    uint32_t layer_count;
+    // Layers holding a single image, the others hold packed ones
+    uint32_t single_layers;
+};
+
+/* Upload the images and write where each went to 'entries'. Images without
+ * data are skipped and their entries left alone, the pixels are not freed.
+ * False when no texture large enough can be made.
+ */
+bool texture_atlas_build(struct texture_atlas* a,
+    struct texture_image const* images, uint32_t count, char const* label,
+    struct atlas_entry* entries);
+void texture_atlas_free(struct texture_atlas* a);
+#endif
@@ -0,0 +1,143 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include "thread_pool.h"
+
+// Claim and run tasks of the current job until there are none left
+static void run_tasks(struct thread_pool* pool)
+{
+    for (;;) {
+        unsigned int index = atomic_fetch_add(&pool->next_task, 1);
+        if (index >= pool->task_count) {
+            return;
+        }
+        pool->task(pool->data, index);
+        atomic_fetch_sub(&pool->tasks_left, 1);
+    }
+}
+
+static void* worker_main(void* arg)
+{
+    struct thread_pool* pool = arg;
+    unsigned long seen = 0;
+
+    pthread_mutex_lock(&pool->lock);
+    for (;;) {
+        while (pool->generation == seen && !pool->shutting_down) {
+            pthread_cond_wait(&pool->work_ready, &pool->lock);
+        }
+        if (pool->shutting_down) {
+            break;
+        }
+        seen = pool->generation;
+        pool->active_workers++;
+        pthread_mutex_unlock(&pool->lock);
+
+        run_tasks(pool);
+
+        pthread_mutex_lock(&pool->lock);
+        pool->active_workers--;
+        if (pool->active_workers == 0) {
+            pthread_cond_signal(&pool->work_done);
+        }
+    }
+    pthread_mutex_unlock(&pool->lock);
+    return NULL;
+}
+
+bool thread_pool_init(struct thread_pool* pool, unsigned int thread_count)
+{
+    *pool = (struct thread_pool) { 0 };
+    pthread_mutex_init(&pool->lock, NULL);
+    pthread_cond_init(&pool->work_ready, NULL);
+    pthread_cond_init(&pool->work_done, NULL);
+    atomic_init(&pool->next_task, 0);
+    atomic_init(&pool->tasks_left, 0);
+
+    if (thread_count == 0) {
+        long cores = sysconf(_SC_NPROCESSORS_ONLN);
+        thread_count = cores > 1 ? (unsigned int)cores - 1 : 0;
+    }
+    if (thread_count == 0) {
+        return true;
+    }
+
+    pool->threads = malloc(thread_count * sizeof(pthread_t));
+    if (pool->threads == NULL) {
+        return false;
+    }
+    for (unsigned int i = 0; i < thread_count; i++) {
+        if (pthread_create(&pool->threads[i], NULL, worker_main, pool) != 0) {
+            fprintf(stderr, "thread_pool.c: started only %u of %u threads\n",
+                i, thread_count);
+            break;
+        }
+        pool->thread_count++;
+    }
+    return pool->thread_count > 0;
+}
+
+void thread_pool_destroy(struct thread_pool* pool)
+{
+    pthread_mutex_lock(&pool->lock);
+    pool->shutting_down = true;
+    pthread_cond_broadcast(&pool->work_ready);
+    pthread_mutex_unlock(&pool->lock);
+
+    for (unsigned int i = 0; i < pool->thread_count; i++) {
+        pthread_join(pool->threads[i], NULL);
+    }
+    free(pool->threads);
+
+    pthread_cond_destroy(&pool->work_done);
+    pthread_cond_destroy(&pool->work_ready);
+    pthread_mutex_destroy(&pool->lock);
+    pool->threads = NULL;
+    pool->thread_count = 0;
+}
+
+unsigned int thread_pool_concurrency(struct thread_pool const* pool)
+{
+    return pool->thread_count + 1;
+}
+
+void thread_pool_for(struct thread_pool* pool, unsigned int task_count,
+    void (*task)(void* data, unsigned int index), void* data)
+{
+    if (task_count == 0) {
+        return;
+    }
+    // Not worth waking anyone up
+    if (task_count == 1 || pool->thread_count == 0) {
+        for (unsigned int i = 0; i < task_count; i++) {
+            task(data, i);
+        }
+        return;
+    }
+
+    pthread_mutex_lock(&pool->lock);
+    // Workers that woke up late for the previous job may still be leaving it
+    while (pool->active_workers != 0) {
+        pthread_cond_wait(&pool->work_done, &pool->lock);
+    }
+    pool->task = task;
+    pool->data = data;
+    pool->task_count = task_count;
+    atomic_store(&pool->next_task, 0);
+    atomic_store(&pool->tasks_left, task_count);
+    pool->generation++;
+    pthread_cond_broadcast(&pool->work_ready);
+    pthread_mutex_unlock(&pool->lock);
+
+    run_tasks(pool);
+
+    /* Tasks can still be running on workers. Every worker that claimed one is
+     * counted in active_workers until it has finished it.
+     */
+    pthread_mutex_lock(&pool->lock);
+    while (atomic_load(&pool->tasks_left) != 0 || pool->active_workers != 0) {
+        pthread_cond_wait(&pool->work_done, &pool->lock);
+    }
+    pthread_mutex_unlock(&pool->lock);
+}
@@ -0,0 +1,43 @@
+#ifndef THREAD_POOL_H
+#define THREAD_POOL_H
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+
+/* Persistent worker threads for data parallel work. Jobs are a number of
+ * independent tasks, the calling thread helps out and returns once all of them
+ * are done. Only one thread may submit jobs to a pool at a time.
+ */
+struct thread_pool {
+    pthread_t* threads;
+    unsigned int thread_count;
+
+    pthread_mutex_t lock;
+    pthread_cond_t work_ready;
+    pthread_cond_t work_done;
+    unsigned long generation;
+    // Workers inside a job, a new job waits for them to leave the old one
+    unsigned int active_workers;
+    bool shutting_down;
+
+    // The job currently running
+    void (*task)(void* data, unsigned int index);
+    void* data;
+    unsigned int task_count;
+    atomic_uint next_task;
+    atomic_uint tasks_left;
+};
+
+/* Start 'thread_count' workers, 0 means one per core besides the caller.
+ * Returns false if no thread could be started, jobs then run on the caller.
+ */
+bool thread_pool_init(struct thread_pool* pool, unsigned int thread_count);
+void thread_pool_destroy(struct thread_pool* pool);
+
+// Workers plus the submitting thread, the most tasks that run at once
+unsigned int thread_pool_concurrency(struct thread_pool const* pool);
+
+// Run task(data, i) for every i below 'task_count' and wait for all of them
+void thread_pool_for(struct thread_pool* pool, unsigned int task_count,
+    void (*task)(void* data, unsigned int index), void* data);
+#endif
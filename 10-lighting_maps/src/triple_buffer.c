@@ -0,0 +1,75 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include "triple_buffer.h"
+
+void triple_buffer_init(struct triple_buffer* tb, size_t slot_size)
+{
+    memset(tb, 0, sizeof(*tb));
+    tb->slots = calloc(3, slot_size);
+    tb->slot_size = slot_size;
+    tb->write = 0;
+    tb->latest = 1;
+    tb->read = 2;
+    pthread_mutex_init(&tb->lock, NULL);
+    pthread_cond_init(&tb->published, NULL);
+}
+
+void triple_buffer_free(struct triple_buffer* tb)
+{
+    pthread_mutex_destroy(&tb->lock);
+    pthread_cond_destroy(&tb->published);
+    free(tb->slots);
+    memset(tb, 0, sizeof(*tb));
+}
+
+void* triple_buffer_write_slot(struct triple_buffer* tb)
+{
+    // Only the producer changes 'write', it needs no lock to read it
+    return tb->slots + tb->write * tb->slot_size;
+}
+
+void triple_buffer_publish(struct triple_buffer* tb)
+{
+    pthread_mutex_lock(&tb->lock);
+    unsigned int filled = tb->write;
+    tb->write = tb->latest;
+    tb->latest = filled;
+    tb->fresh = true;
+    pthread_cond_signal(&tb->published);
+    pthread_mutex_unlock(&tb->lock);
+}
+
+bool triple_buffer_pending(struct triple_buffer* tb)
+{
+    pthread_mutex_lock(&tb->lock);
+    bool fresh = tb->fresh;
+    pthread_mutex_unlock(&tb->lock);
+    return fresh;
+}
+
+void const* triple_buffer_take(struct triple_buffer* tb)
+{
+    pthread_mutex_lock(&tb->lock);
+    while (!tb->fresh && !tb->closed) {
+        pthread_cond_wait(&tb->published, &tb->lock);
+    }
+    if (tb->closed) {
+        pthread_mutex_unlock(&tb->lock);
+        return NULL;
+    }
+    unsigned int newest = tb->latest;
+    tb->latest = tb->read;
+    tb->read = newest;
+    tb->fresh = false;
+    pthread_mutex_unlock(&tb->lock);
+    return tb->slots + newest * tb->slot_size;
+}
+
+void triple_buffer_close(struct triple_buffer* tb)
+{
+    pthread_mutex_lock(&tb->lock);
+    tb->closed = true;
+    pthread_cond_signal(&tb->published);
+    pthread_mutex_unlock(&tb->lock);
+}
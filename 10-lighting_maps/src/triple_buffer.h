@@ -0,0 +1,45 @@
+#ifndef TRIPLE_BUFFER_H
+#define TRIPLE_BUFFER_H
+#include <pthread.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+/* Hands the newest of a stream of values from one thread to another. Of the
+ * three slots the producer fills one, one holds the value published last and
+ * the consumer reads the third. Publishing and taking only swap slot indices
+ * under the lock, so neither thread ever waits for the other to finish with
+ * its slot: a slow consumer skips values, a slow producer is read again.
+ */
+struct triple_buffer {
+    unsigned char* slots;
+    size_t slot_size;
+    // Slot indices of the producer, of the latest value and of the consumer
+    unsigned int write;
+    unsigned int latest;
+    unsigned int read;
+    // Published since the consumer last took a value
+    bool fresh;
+    bool closed;
+
+    pthread_mutex_t lock;
+    pthread_cond_t published;
+};
+
+void triple_buffer_init(struct triple_buffer* tb, size_t slot_size);
+void triple_buffer_free(struct triple_buffer* tb);
+
+// Slot the producer fills before publishing it
+void* triple_buffer_write_slot(struct triple_buffer* tb);
+void triple_buffer_publish(struct triple_buffer* tb);
+
+// True while the consumer has not taken the value published last
+bool triple_buffer_pending(struct triple_buffer* tb);
+
+/* Wait for a value newer than the one taken before and return it, valid
+ * until the next take. NULL once the buffer is closed.
+ */
+void const* triple_buffer_take(struct triple_buffer* tb);
+
+// Wake the consumer and make every take from now on return NULL
+void triple_buffer_close(struct triple_buffer* tb);
+#endif
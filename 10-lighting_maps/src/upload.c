@@ -0,0 +1,234 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "gpu_memory.h"
+#include "texture.h"
+#include "upload.h"
+
+static double now_seconds(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static void free_request(struct upload_request* r)
+{
+    free(r->path);
+    free(r->data);
+    free(r);
+}
+
+static void upload(struct upload_request* r)
+{
+    if (r->kind == UPLOAD_TEXTURE) {
+        struct texture_image image;
+        if (texture_decode(r->path, r->flip, &image)) {
+            r->object = texture_create(&image, r->path);
+        }
+    } else {
+        // Buffers have no type, any target will do to fill them
+        r->object = gpu_buffer_create(r->category, "uploaded buffer");
+        glBindBuffer(GL_COPY_WRITE_BUFFER, r->object);
+        gpu_buffer_data(r->object, GL_COPY_WRITE_BUFFER, r->size, r->data,
+            r->usage);
+        glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+        free(r->data);
+        r->data = NULL;
+    }
+    if (r->object != 0) {
+        r->fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    }
+}
+
+static void* upload_thread(void* data)
+{
+    struct upload_queue* q = data;
+    glfwMakeContextCurrent(q->context);
+    pthread_mutex_lock(&q->lock);
+    while (true) {
+        while (q->pending == NULL && !q->stopping) {
+            pthread_cond_wait(&q->work, &q->lock);
+        }
+        if (q->stopping) {
+            break;
+        }
+        struct upload_request* r = q->pending;
+        q->pending = r->next;
+        if (q->pending == NULL) {
+            q->pending_tail = &q->pending;
+        }
+        pthread_mutex_unlock(&q->lock);
+
+        upload(r);
+        // The fence has to reach the GPU before the render thread can see it
+        glFlush();
+
+        pthread_mutex_lock(&q->lock);
+        r->next = NULL;
+        *q->uploaded_tail = r;
+        q->uploaded_tail = &r->next;
+    }
+    pthread_mutex_unlock(&q->lock);
+    glfwMakeContextCurrent(NULL);
+    return NULL;
+}
+
+bool upload_queue_init(struct upload_queue* q, GLFWwindow* window)
+{
+    memset(q, 0, sizeof(*q));
+    // Hints stay set from the render window, this one only must not show
+    glfwWindowHint(GLFW_VISIBLE, GLFW_FALSE);
+    q->context = glfwCreateWindow(1, 1, "upload", NULL, window);
+    glfwWindowHint(GLFW_VISIBLE, GLFW_TRUE);
+    if (q->context == NULL) {
+        fprintf(stderr, "upload: no context to share objects with\n");
+        return false;
+    }
+    q->pending_tail = &q->pending;
+    q->uploaded_tail = &q->uploaded;
+    pthread_mutex_init(&q->lock, NULL);
+    pthread_cond_init(&q->work, NULL);
+    if (pthread_create(&q->thread, NULL, upload_thread, q) != 0) {
+        fprintf(stderr, "upload: could not start the thread\n");
+        pthread_mutex_destroy(&q->lock);
+        pthread_cond_destroy(&q->work);
+        glfwDestroyWindow(q->context);
+        q->context = NULL;
+        return false;
+    }
+    return true;
+}
+
+static void delete_requests(struct upload_request* r)
+{
+    while (r != NULL) {
+        struct upload_request* next = r->next;
+        if (r->fence != NULL) {
+            glDeleteSync(r->fence);
+        }
+        if (r->object != 0 && r->kind == UPLOAD_TEXTURE) {
+            gpu_textures_delete(1, &r->object);
+        } else if (r->object != 0) {
+            gpu_buffers_delete(1, &r->object);
+        }
+        free_request(r);
+        r = next;
+    }
+}
+
+void upload_queue_free(struct upload_queue* q)
+{
+    pthread_mutex_lock(&q->lock);
+    q->stopping = true;
+    pthread_cond_signal(&q->work);
+    pthread_mutex_unlock(&q->lock);
+    pthread_join(q->thread, NULL);
+
+    delete_requests(q->pending);
+    delete_requests(q->uploaded);
+    delete_requests(q->fenced);
+    pthread_mutex_destroy(&q->lock);
+    pthread_cond_destroy(&q->work);
+    glfwDestroyWindow(q->context);
+    memset(q, 0, sizeof(*q));
+}
+
+static void enqueue(struct upload_queue* q, struct upload_request* r)
+{
+    pthread_mutex_lock(&q->lock);
+    *q->pending_tail = r;
+    q->pending_tail = &r->next;
+    q->in_flight++;
+    pthread_cond_signal(&q->work);
+    pthread_mutex_unlock(&q->lock);
+}
+
+void upload_texture(struct upload_queue* q, char const* path, bool flip,
+    unsigned int* destination)
+{
+    struct upload_request* r = calloc(1, sizeof(struct upload_request));
+    r->kind = UPLOAD_TEXTURE;
+    r->path = strdup(path);
+    r->flip = flip;
+    r->destination = destination;
+    enqueue(q, r);
+}
+
+void upload_buffer(struct upload_queue* q, void const* data, size_t size,
+    GLenum usage, enum gpu_memory_category category, unsigned int* destination)
+{
+    struct upload_request* r = calloc(1, sizeof(struct upload_request));
+    r->kind = UPLOAD_BUFFER;
+    r->data = malloc(size);
+    memcpy(r->data, data, size);
+    r->size = size;
+    r->usage = usage;
+    r->category = category;
+    r->destination = destination;
+    enqueue(q, r);
+}
+
+uint32_t upload_queue_publish(struct upload_queue* q)
+{
+    double start = now_seconds();
+    pthread_mutex_lock(&q->lock);
+    struct upload_request* uploaded = q->uploaded;
+    q->uploaded = NULL;
+    q->uploaded_tail = &q->uploaded;
+    pthread_mutex_unlock(&q->lock);
+
+    // Newly uploaded ones go after the ones still waiting, keeping the order
+    struct upload_request** tail = &q->fenced;
+    while (*tail != NULL) {
+        tail = &(*tail)->next;
+    }
+    *tail = uploaded;
+
+    uint32_t published = 0;
+    struct upload_request** link = &q->fenced;
+    while (*link != NULL) {
+        struct upload_request* r = *link;
+        if (r->fence != NULL) {
+            GLint status = GL_UNSIGNALED;
+            glGetSynciv(r->fence, GL_SYNC_STATUS, 1, NULL, &status);
+            if (status != GL_SIGNALED) {
+                link = &r->next;
+                continue;
+            }
+            glWaitSync(r->fence, 0, GL_TIMEOUT_IGNORED);
+            glDeleteSync(r->fence);
+            *r->destination = r->object;
+        }
+        // Failed uploads leave the destination as it was
+        *link = r->next;
+        free_request(r);
+        published++;
+    }
+
+    pthread_mutex_lock(&q->lock);
+    q->in_flight -= published;
+    pthread_mutex_unlock(&q->lock);
+    q->published += published;
+    double ms = (now_seconds() - start) * 1e3;
+    if (ms > q->longest_publish_ms) {
+        q->longest_publish_ms = ms;
+    }
+    return published;
+}
+
+struct upload_stats upload_queue_report(struct upload_queue* q)
+{
+    pthread_mutex_lock(&q->lock);
+    struct upload_stats s = {
+        .in_flight = q->in_flight,
+        .published = q->published,
+        .longest_publish_ms = q->longest_publish_ms
+    };
+    pthread_mutex_unlock(&q->lock);
+    q->published = 0;
+    q->longest_publish_ms = 0.0;
+    return s;
+}
@@ -0,0 +1,101 @@
+#ifndef UPLOAD_H
+#define UPLOAD_H
+#include <glad/glad.h>
+// Glad needs to be before GLFW
+#include <GLFW/glfw3.h>
+
+#include <pthread.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "gpu_memory.h"
+
+enum upload_kind {
+    UPLOAD_TEXTURE,
+    UPLOAD_BUFFER
+};
+
+struct upload_request {
+    enum upload_kind kind;
+    // Image file of a texture
+    char* path;
+    bool flip;
+    // Contents of a buffer, owned by the request
+    void* data;
+    size_t size;
+    GLenum usage;
+    enum gpu_memory_category category;
+
+    // Where the object goes once the GPU has it, written on the render thread
+    unsigned int* destination;
+    unsigned int object;
+    GLsync fence;
+    struct upload_request* next;
+};
+
+// What happened since the last upload_queue_report
+struct upload_stats {
+    // Requests queued or uploading right now
+    uint32_t in_flight;
+    uint32_t published;
+    // Longest upload_queue_publish call
+    double longest_publish_ms;
+};
+
+/* Uploads on a thread of their own. Its context is a hidden window sharing
+ * objects with the render context, so decoding images, glTexImage2D,
+ * glBufferData and mipmap generation never hold up a frame.
+ *
+ * Every finished object is followed by a fence. The render thread checks the
+ * fences without waiting once a frame and only hands out the objects whose
+ * fence has signaled, after a glWaitSync that orders the upload before its
+ * own use of the object. Until then the destination keeps what it held, like
+ * a fallback texture.
+ */
+struct upload_queue {
+    GLFWwindow* context;
+    pthread_t thread;
+    pthread_mutex_t lock;
+    pthread_cond_t work;
+    bool stopping;
+
+    // Waiting for the upload thread, and uploaded waiting to be published
+    struct upload_request* pending;
+    struct upload_request** pending_tail;
+    struct upload_request* uploaded;
+    struct upload_request** uploaded_tail;
+    // Taken from 'uploaded' by the render thread, fences not signaled yet
+    struct upload_request* fenced;
+
+    uint32_t in_flight;
+    uint32_t published;
+    double longest_publish_ms;
+};
+
+/* Create the upload context sharing with 'window' and start the thread. Call
+ * on the main thread, GLFW creates windows only there. False when no shared
+ * context could be made, uploads then have to happen where they are needed.
+ */
+bool upload_queue_init(struct upload_queue* q, GLFWwindow* window);
+
+/* Stop the thread and delete what was never published. Call on the main
+ * thread with a context current that shares with the upload context.
+ */
+void upload_queue_free(struct upload_queue* q);
+
+// Load the image at 'path' into a mipmapped texture, see texture_load
+void upload_texture(struct upload_queue* q, char const* path, bool flip,
+    unsigned int* destination);
+
+// Copy 'size' bytes of 'data' into a new buffer object
+void upload_buffer(struct upload_queue* q, void const* data, size_t size,
+    GLenum usage, enum gpu_memory_category category, unsigned int* destination);
+
+/* Write the objects whose uploads the GPU has finished to their destinations.
+ * Call once a frame on the render thread. Never waits.
+ */
+uint32_t upload_queue_publish(struct upload_queue* q);
+
+struct upload_stats upload_queue_report(struct upload_queue* q);
+#endif
@@ -0,0 +1,30 @@
+#version 330 core
+// Stretches the scene over the screen with bilinear filtering, then sharpens
+// what the stretching blurred
+in vec2 uv;
+out vec4 frag_color;
+
+uniform sampler2D source;
+uniform float sharpness;
+
+void main()
+{
+    vec2 texel = 1.0 / vec2(textureSize(source, 0));
+    vec3 center = texture(source, uv).rgb;
+    vec3 up = texture(source, uv + vec2(0.0, texel.y)).rgb;
+    vec3 down = texture(source, uv - vec2(0.0, texel.y)).rgb;
+    vec3 left = texture(source, uv - vec2(texel.x, 0.0)).rgb;
+    vec3 right = texture(source, uv + vec2(texel.x, 0.0)).rgb;
+
+    // Sharpen less where the neighbors already differ a lot, so edges that
+    // are sharp do not ring
+    vec3 low = min(center, min(min(up, down), min(left, right)));
+    vec3 high = max(center, max(max(up, down), max(left, right)));
+    vec3 amount = sqrt(clamp(min(low, 1.0 - high) / max(high, 1e-4), 0.0,
+        1.0));
+    vec3 weight = -0.125 * sharpness * amount;
+
+    vec3 color = (center + (up + down + left + right) * weight)
+        / (1.0 + 4.0 * weight);
+    frag_color = vec4(clamp(color, 0.0, 1.0), 1.0);
+}
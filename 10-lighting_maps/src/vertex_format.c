@@ -0,0 +1,249 @@
+#include <glad/glad.h>
+
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "vertex_format.h"
+
+// Half floats step by 1/1024 between 1 and 2, about a texel of a 1K texture
+#define HALF_UV_LIMIT 2.0f
+
+struct vertex_format const vertex_format_float = {
+    .name = "float",
+    .attributes = {
+        { VERTEX_POSITION_LOCATION, VERTEX_ENCODING_FLOAT, 3, GL_FLOAT, false,
+            0 },
+        { VERTEX_NORMAL_LOCATION, VERTEX_ENCODING_FLOAT, 3, GL_FLOAT, false,
+            12 },
+        { VERTEX_UV_LOCATION, VERTEX_ENCODING_FLOAT, 2, GL_FLOAT, false, 24 } },
+    .attribute_count = 3,
+    .stride = 32
+};
+
+struct vertex_format const vertex_format_packed16 = {
+    .name = "packed16",
+    .attributes = {
+        // Two bytes of padding after the position keep the rest 4 byte aligned
+        { VERTEX_POSITION_LOCATION, VERTEX_ENCODING_SNORM16, 3, GL_SHORT, true,
+            0 },
+        { VERTEX_NORMAL_LOCATION, VERTEX_ENCODING_SNORM10, 4,
+            GL_INT_2_10_10_10_REV, true, 8 },
+        { VERTEX_UV_LOCATION, VERTEX_ENCODING_HALF, 2, GL_HALF_FLOAT, false,
+            12 } },
+    .attribute_count = 3,
+    .stride = 16
+};
+
+struct vertex_format const vertex_format_packed12 = {
+    .name = "packed12",
+    .attributes = {
+        { VERTEX_POSITION_LOCATION, VERTEX_ENCODING_SNORM16, 3, GL_SHORT, true,
+            0 },
+        { VERTEX_NORMAL_LOCATION, VERTEX_ENCODING_OCTAHEDRAL8, 2, GL_BYTE, true,
+            6 },
+        { VERTEX_UV_LOCATION, VERTEX_ENCODING_HALF, 2, GL_HALF_FLOAT, false,
+            8 } },
+    .attribute_count = 3,
+    .stride = 12,
+    .octahedral_normals = true
+};
+
+static struct vertex_format const* const formats[] = {
+    &vertex_format_float,
+    &vertex_format_packed16,
+    &vertex_format_packed12
+};
+
+struct vertex_format const* vertex_format_find(char const* name)
+{
+    for (size_t i = 0; i < sizeof(formats) / sizeof(formats[0]); i++) {
+        if (strcmp(formats[i]->name, name) == 0) {
+            return formats[i];
+        }
+    }
+    return NULL;
+}
+
+struct vertex_format const* vertex_format_pick(struct mesh const* m)
+{
+    for (uint32_t i = 0; i < m->vertex_count; i++) {
+        if (fabsf(m->vertices[i].uv[0]) > HALF_UV_LIMIT
+            || fabsf(m->vertices[i].uv[1]) > HALF_UV_LIMIT) {
+            return &vertex_format_float;
+        }
+    }
+    // packed12's 8 bit normals show in sharp highlights, so it has to be
+    // asked for
+    return &vertex_format_packed16;
+}
+
+// Round to nearest even like the GPU does, overflow becomes infinity
+uint16_t float_to_half(float value)
+{
+    uint32_t bits;
+    memcpy(&bits, &value, sizeof(bits));
+    uint32_t sign = (bits >> 16) & 0x8000;
+    uint32_t exponent = (bits >> 23) & 0xff;
+    uint32_t mantissa = bits & 0x7fffff;
+
+    if (exponent == 0xff) {
+        // Infinity stays infinity, NaN stays NaN
+        return sign | 0x7c00 | (mantissa ? 0x200 : 0);
+    }
+    int half_exponent = (int)exponent - 127 + 15;
+    if (half_exponent >= 31) {
+        return sign | 0x7c00;
+    }
+    if (half_exponent <= 0) {
+        // Subnormal half, or zero if it is too small for that
+        if (half_exponent < -10) {
+            return sign;
+        }
+        mantissa |= 0x800000;
+        int shift = 14 - half_exponent;
+        uint32_t half = mantissa >> shift;
+        uint32_t rest = mantissa & ((1u << shift) - 1);
+        uint32_t halfway = 1u << (shift - 1);
+        if (rest > halfway || (rest == halfway && (half & 1))) {
+            half++;
+        }
+        return sign | half;
+    }
+    uint32_t half = (uint32_t)half_exponent << 10 | mantissa >> 13;
+    uint32_t rest = mantissa & 0x1fff;
+    // A carry out of the mantissa correctly bumps the exponent
+    if (rest > 0x1000 || (rest == 0x1000 && (half & 1))) {
+        half++;
+    }
+    return sign | half;
+}
+
+static int32_t to_snorm(float value, int32_t max)
+{
+    return (int32_t)lroundf(glm_clamp(value, -1.0f, 1.0f) * max);
+}
+
+/* Fold the unit sphere onto an octahedron and flatten that onto a square,
+ * the lower half folds out into the corners. Decoded by oct_decode in
+ * shader.vs.
+ */
+static void octahedral_encode(float const normal[3], float out[2])
+{
+    float l1 = fabsf(normal[0]) + fabsf(normal[1]) + fabsf(normal[2]);
+    if (l1 == 0.0f) {
+        out[0] = 0.0f;
+        out[1] = 0.0f;
+        return;
+    }
+    float x = normal[0] / l1;
+    float y = normal[1] / l1;
+    if (normal[2] < 0.0f) {
+        float folded_x = (1.0f - fabsf(y)) * (x >= 0.0f ? 1.0f : -1.0f);
+        float folded_y = (1.0f - fabsf(x)) * (y >= 0.0f ? 1.0f : -1.0f);
+        x = folded_x;
+        y = folded_y;
+    }
+    out[0] = x;
+    out[1] = y;
+}
+
+static void pack_attribute(struct vertex_attribute const* attribute,
+    float const* value, unsigned char* out)
+{
+    switch (attribute->encoding) {
+    case VERTEX_ENCODING_FLOAT:
+        memcpy(out, value, attribute->components * sizeof(float));
+        break;
+    case VERTEX_ENCODING_HALF:
+        for (int i = 0; i < attribute->components; i++) {
+            uint16_t half = float_to_half(value[i]);
+            memcpy(out + i * 2, &half, 2);
+        }
+        break;
+    case VERTEX_ENCODING_SNORM16:
+        for (int i = 0; i < attribute->components; i++) {
+            int16_t snorm = (int16_t)to_snorm(value[i], 32767);
+            memcpy(out + i * 2, &snorm, 2);
+        }
+        break;
+    case VERTEX_ENCODING_SNORM10: {
+        // w is left 0 in the top two bits
+        uint32_t packed = 0;
+        for (int i = 0; i < 3; i++) {
+            packed |= ((uint32_t)to_snorm(value[i], 511) & 0x3ff) << (i * 10);
+        }
+        memcpy(out, &packed, 4);
+        break;
+    }
+    case VERTEX_ENCODING_OCTAHEDRAL8: {
+        float folded[2];
+        octahedral_encode(value, folded);
+        out[0] = (unsigned char)(int8_t)to_snorm(folded[0], 127);
+        out[1] = (unsigned char)(int8_t)to_snorm(folded[1], 127);
+        break;
+    }
+    }
+}
+
+void* vertex_format_pack(struct vertex_format const* format,
+    struct mesh_vertex const* vertices, uint32_t count, vec3 bounds_min,
+    vec3 bounds_max, mat4 dequant)
+{
+    // Quantized positions are -1..1 over the box, flat boxes keep a unit
+    // extent so nothing divides by zero
+    vec3 center;
+    vec3 extent;
+    for (int i = 0; i < 3; i++) {
+        center[i] = (bounds_min[i] + bounds_max[i]) * 0.5f;
+        extent[i] = (bounds_max[i] - bounds_min[i]) * 0.5f;
+        if (extent[i] <= 0.0f) {
+            extent[i] = 1.0f;
+        }
+    }
+    bool quantized = format->attributes[0].encoding == VERTEX_ENCODING_SNORM16;
+    glm_mat4_identity(dequant);
+    if (quantized) {
+        glm_translate(dequant, center);
+        glm_scale(dequant, extent);
+    }
+
+    unsigned char* data = calloc((size_t)count + 1, format->stride);
+    for (uint32_t v = 0; v < count; v++) {
+        unsigned char* out = data + (size_t)v * format->stride;
+        for (uint32_t a = 0; a < format->attribute_count; a++) {
+            struct vertex_attribute const* attribute = &format->attributes[a];
+            float const* value = NULL;
+            vec3 position;
+            switch (attribute->location) {
+            case VERTEX_POSITION_LOCATION:
+                glm_vec3_copy((float*)vertices[v].position, position);
+                if (quantized) {
+                    glm_vec3_sub(position, center, position);
+                    glm_vec3_div(position, extent, position);
+                }
+                value = position;
+                break;
+            case VERTEX_NORMAL_LOCATION:
+                value = vertices[v].normal;
+                break;
+            default:
+                value = vertices[v].uv;
+                break;
+            }
+            pack_attribute(attribute, value, out + attribute->offset);
+        }
+    }
+    return data;
+}
+
+void vertex_format_setup(struct vertex_format const* format)
+{
+    for (uint32_t a = 0; a < format->attribute_count; a++) {
+        struct vertex_attribute const* attribute = &format->attributes[a];
+        glVertexAttribPointer(attribute->location, attribute->components,
+            attribute->type, attribute->normalized, format->stride,
+            (void*)(uintptr_t)attribute->offset);
+        glEnableVertexAttribArray(attribute->location);
+    }
+}
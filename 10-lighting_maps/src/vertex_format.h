@@ -0,0 +1,76 @@
+#ifndef VERTEX_FORMAT_H
+#define VERTEX_FORMAT_H
+#include <cglm/cglm.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "mesh.h"
+
+// Attribute locations of shader.vs
+#define VERTEX_POSITION_LOCATION 0
+#define VERTEX_NORMAL_LOCATION 1
+#define VERTEX_UV_LOCATION 2
+
+// How one attribute is stored, each needs its own conversion when packing
+enum vertex_encoding {
+    VERTEX_ENCODING_FLOAT,
+    VERTEX_ENCODING_HALF,
+    // Signed normalized 16 bit, positions go through the dequant transform
+    VERTEX_ENCODING_SNORM16,
+    // GL_INT_2_10_10_10_REV, x y z in 10 bits each
+    VERTEX_ENCODING_SNORM10,
+    // Unit vector folded onto an octahedron, two signed normalized bytes
+    VERTEX_ENCODING_OCTAHEDRAL8
+};
+
+struct vertex_attribute {
+    unsigned int location;
+    enum vertex_encoding encoding;
+    // What glVertexAttribPointer gets
+    int components;
+    unsigned int type;
+    bool normalized;
+    uint32_t offset;
+};
+
+/* Layout of one interleaved vertex, everything needed to pack vertices into
+ * it and to point the VAO at them
+ */
+struct vertex_format {
+    char const* name;
+    struct vertex_attribute attributes[3];
+    uint32_t attribute_count;
+    uint32_t stride;
+    // shader.vs has to decode the normals, see its 'octahedral_normals'
+    bool octahedral_normals;
+};
+
+// 32 bytes: float position, normal and texture coords like create_shape
+extern struct vertex_format const vertex_format_float;
+// 16 bytes: snorm16 position, 2_10_10_10 normal, half texture coords
+extern struct vertex_format const vertex_format_packed16;
+// 12 bytes: snorm16 position, octahedral normal, half texture coords
+extern struct vertex_format const vertex_format_packed12;
+
+// Format called 'name' ("float", "packed16", "packed12"), NULL if unknown
+struct vertex_format const* vertex_format_find(char const* name);
+
+/* Smallest format that stores the mesh well enough. Texture coords far from
+ * 0 lose too much precision as half floats, those meshes keep floats.
+ */
+struct vertex_format const* vertex_format_pick(struct mesh const* m);
+
+/* Convert 'count' vertices into 'format'. Quantized positions are relative to
+ * the box 'bounds_min'..'bounds_max', 'dequant' gets the matrix that takes
+ * them back to model space. Returns count * format->stride bytes to free.
+ */
+void* vertex_format_pack(struct vertex_format const* format,
+    struct mesh_vertex const* vertices, uint32_t count, vec3 bounds_min,
+    vec3 bounds_max, mat4 dequant);
+
+// glVertexAttribPointer for every attribute, on the bound VAO and VBO
+void vertex_format_setup(struct vertex_format const* format);
+
+uint16_t float_to_half(float value);
+#endif